@@ -0,0 +1,368 @@
+#include <iostream>     // cout, cerr
+#include <fstream>      // ifstream, ofstream
+#include <string>       // string
+#include <vector>       // vector
+#include <cstring>      // memcpy, memcmp, strlen
+#include <cstdlib>      // EXIT_FAILURE
+#include <chrono>       // steady_clock
+#include "AssetPack.h"
+#include "MeshFile.h"
+#include "GpuResources.h"
+#include "stb_image.h"  // Image loading utility functions
+
+using namespace std; // Standard namespace
+
+static_assert(sizeof(UAssetPackHeader) == 48, "UAssetPackHeader layout is part of the file format");
+static_assert(sizeof(UAssetPackEntry) == 40, "UAssetPackEntry layout is part of the file format");
+
+namespace
+{
+    uint64_t UHashName(const char* name, size_t length)
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash ^= (unsigned char)name[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint64_t UAlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool UEndsWith(const string& text, const char* suffix)
+    {
+        size_t n = strlen(suffix);
+        if (text.size() < n)
+            return false;
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (tolower(text[text.size() - n + i]) != suffix[i])
+                return false;
+        }
+        return true;
+    }
+
+    UAssetType UAssetTypeFromName(const string& name)
+    {
+        if (UEndsWith(name, ".jpg") || UEndsWith(name, ".jpeg") || UEndsWith(name, ".png") || UEndsWith(name, ".bmp") || UEndsWith(name, ".tga"))
+            return UASSET_TEXTURE;
+        if (UEndsWith(name, ".umesh"))
+            return UASSET_MESH;
+        if (UEndsWith(name, ".vert") || UEndsWith(name, ".frag") || UEndsWith(name, ".glsl"))
+            return UASSET_SHADER;
+        return UASSET_RAW;
+    }
+
+    bool UReadWholeFile(const string& filename, vector<unsigned char>& bytes)
+    {
+        ifstream in(filename, ios::binary | ios::ate);
+        if (!in)
+            return false;
+        bytes.resize((size_t)in.tellg());
+        in.seekg(0);
+        return bytes.empty() || (bool)in.read((char*)bytes.data(), (streamsize)bytes.size());
+    }
+
+    // Turns a loose file into the bytes stored in the pack
+    bool UBuildEntry(const string& filename, UAssetType type, vector<unsigned char>& payload)
+    {
+        vector<unsigned char> bytes;
+        if (!UReadWholeFile(filename, bytes))
+        {
+            cout << "Failed to read " << filename << endl;
+            return false;
+        }
+
+        if (type == UASSET_TEXTURE)
+        {
+            // Decoded and flipped here once, so runtime loading is a single glTexImage2D
+            int width, height, channels;
+            unsigned char* image = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &channels, 0);
+            if (!image)
+            {
+                cout << "Failed to decode " << filename << endl;
+                return false;
+            }
+            if (channels != 3 && channels != 4)
+            {
+                // Same restriction as UCreateTexture
+                cout << "Not implemented to handle image with " << channels << " channels: " << filename << endl;
+                stbi_image_free(image);
+                return false;
+            }
+
+            UPackedTexture texture = { (uint32_t)width, (uint32_t)height, (uint32_t)channels, 0 };
+            size_t rowBytes = (size_t)width * channels;
+            payload.resize(sizeof(texture) + rowBytes * height);
+            memcpy(payload.data(), &texture, sizeof(texture));
+            for (int row = 0; row < height; ++row)
+                memcpy(&payload[sizeof(texture) + row * rowBytes], image + (size_t)(height - 1 - row) * rowBytes, rowBytes);
+            stbi_image_free(image);
+            return true;
+        }
+
+        payload.swap(bytes);
+        if (type == UASSET_SHADER)
+            payload.push_back('\0');
+        return true;
+    }
+}
+
+bool UOpenAssetPack(const char* filename, UAssetPack& pack)
+{
+    pack.header = nullptr;
+    pack.table = nullptr;
+    pack.names = nullptr;
+
+    if (!UMapFile(filename, pack.file))
+        return false;
+
+    // The mapping is page aligned and the builder keeps the table 8 byte aligned, so the blocks are read in place
+    const UAssetPackHeader* header = (const UAssetPackHeader*)pack.file.data;
+    bool valid = pack.file.size >= sizeof(UAssetPackHeader)
+        && header->magic == UASSET_PACK_MAGIC && header->version == UASSET_PACK_VERSION
+        && header->fileBytes == pack.file.size
+        && header->tableCapacity > 0 && (header->tableCapacity & (header->tableCapacity - 1)) == 0
+        && header->tableOffset % 8 == 0
+        && header->tableOffset + (uint64_t)header->tableCapacity * sizeof(UAssetPackEntry) <= pack.file.size
+        && header->namesOffset + header->namesBytes <= pack.file.size;
+    if (!valid)
+    {
+        cout << filename << " is not a valid version " << UASSET_PACK_VERSION << " asset pack" << endl;
+        UUnmapFile(pack.file);
+        return false;
+    }
+
+    pack.header = header;
+    pack.table = (const UAssetPackEntry*)(pack.file.data + header->tableOffset);
+    pack.names = (const char*)pack.file.data + header->namesOffset;
+    cout << "INFO: Opened asset pack " << filename << " (" << header->nEntries << " assets, " << pack.file.size / 1024 << " KB)" << endl;
+    return true;
+}
+
+void UCloseAssetPack(UAssetPack& pack)
+{
+    if (pack.header)
+        UUnmapFile(pack.file);
+    pack.header = nullptr;
+    pack.table = nullptr;
+    pack.names = nullptr;
+}
+
+bool UIsAssetPackOpen(const UAssetPack& pack)
+{
+    return pack.header != nullptr;
+}
+
+const unsigned char* UFindAsset(const UAssetPack& pack, const char* name, UAssetType type, size_t& size)
+{
+    size = 0;
+    if (!pack.header)
+        return nullptr;
+
+    size_t length = strlen(name);
+    uint64_t hash = UHashName(name, length);
+    uint32_t mask = pack.header->tableCapacity - 1;
+
+    // Linear probing; the table is at most half full so an empty slot ends every search
+    for (uint32_t probe = 0; probe <= mask; ++probe)
+    {
+        const UAssetPackEntry& entry = pack.table[(hash + probe) & mask];
+        if (!entry.used)
+            return nullptr;
+        if (entry.hash != hash || entry.nameLength != length || (uint64_t)entry.nameOffset + length > pack.header->namesBytes
+            || memcmp(pack.names + entry.nameOffset, name, length) != 0)
+            continue;
+
+        if (entry.type != (uint32_t)type || entry.offset + entry.size > pack.file.size)
+        {
+            cout << "Asset " << name << " in the pack has the wrong type or size" << endl;
+            return nullptr;
+        }
+        size = (size_t)entry.size;
+        return pack.file.data + entry.offset;
+    }
+    return nullptr;
+}
+
+bool UCreateTextureFromPack(const UAssetPack& pack, const char* name, GLuint& textureId)
+{
+    size_t size;
+    const unsigned char* data = UFindAsset(pack, name, UASSET_TEXTURE, size);
+    if (!data || size < sizeof(UPackedTexture))
+        return false;
+
+    UPackedTexture texture;
+    memcpy(&texture, data, sizeof(texture));
+    if ((texture.channels != 3 && texture.channels != 4) || sizeof(texture) + (uint64_t)texture.width * texture.height * texture.channels > size)
+        return false;
+
+    textureId = UGenGpuObject(UGPU_TEXTURE, UGPU_MATERIALS, name);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+
+    // set the texture wrapping parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // set texture filtering parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Rows are tightly packed in the pack, RGB widths need not be a multiple of 4
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (texture.channels == 3)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, texture.width, texture.height, 0, GL_RGB, GL_UNSIGNED_BYTE, data + sizeof(texture));
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data + sizeof(texture));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+    USetGpuObjectBytes(UGPU_TEXTURE, textureId, UEstimateTextureBytes(texture.width, texture.height, 1, 4, true));
+    return true;
+}
+
+bool UCreateMeshFromPack(const UAssetPack& pack, const char* name, UGpuMesh& mesh)
+{
+    size_t size;
+    const unsigned char* data = UFindAsset(pack, name, UASSET_MESH, size);
+    return data && ULoadMeshFromMemory(data, size, name, mesh);
+}
+
+const char* UFindShaderInPack(const UAssetPack& pack, const char* name)
+{
+    size_t size;
+    const unsigned char* data = UFindAsset(pack, name, UASSET_SHADER, size);
+    if (!data || size == 0 || data[size - 1] != '\0')
+        return nullptr;
+    return (const char*)data;
+}
+
+int UAssetPackBuilderMain(int argc, char* argv[])
+{
+    const char* output = nullptr;
+    string root = ".";
+    vector<string> names;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--build-pack") == 0)
+            continue;
+        if (strcmp(argv[i], "--root") == 0 && i + 1 < argc)
+            root = argv[++i];
+        else if (!output)
+            output = argv[i];
+        else
+        {
+            // Names always use forward slashes so lookups match on every platform
+            string name = argv[i];
+            for (char& c : name)
+                c = c == '\\' ? '/' : c;
+            names.push_back(name);
+        }
+    }
+
+    if (!output || names.empty())
+    {
+        cout << "Usage: --build-pack <out.upak> [--root dir] <files relative to root>..." << endl;
+        cout << "  .jpg/.png/.bmp/.tga are stored decoded, .umesh as meshes, .vert/.frag/.glsl as shaders" << endl;
+        return EXIT_FAILURE;
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    // Table at most half full
+    uint32_t capacity = 1;
+    while (capacity < names.size() * 2)
+        capacity *= 2;
+
+    UAssetPackHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = UASSET_PACK_MAGIC;
+    header.version = UASSET_PACK_VERSION;
+    header.nEntries = (uint32_t)names.size();
+    header.tableCapacity = capacity;
+    header.tableOffset = sizeof(UAssetPackHeader);
+
+    vector<UAssetPackEntry> table(capacity);
+    memset(table.data(), 0, table.size() * sizeof(UAssetPackEntry));
+
+    string namesBlock;
+    for (const string& name : names)
+    {
+        UAssetPackEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.hash = UHashName(name.c_str(), name.size());
+        entry.nameOffset = (uint32_t)namesBlock.size();
+        entry.nameLength = (uint32_t)name.size();
+        entry.type = UAssetTypeFromName(name);
+        entry.used = 1;
+        namesBlock += name;
+
+        uint32_t slot = (uint32_t)(entry.hash & (capacity - 1));
+        while (table[slot].used)
+        {
+            if (table[slot].hash == entry.hash && table[slot].nameLength == entry.nameLength
+                && namesBlock.compare(table[slot].nameOffset, name.size(), name) == 0)
+            {
+                cout << "Duplicate asset " << name << endl;
+                return EXIT_FAILURE;
+            }
+            slot = (slot + 1) & (capacity - 1);
+        }
+        table[slot] = entry;
+    }
+
+    header.namesOffset = header.tableOffset + capacity * sizeof(UAssetPackEntry);
+    header.namesBytes = namesBlock.size();
+
+    ofstream out(output, ios::binary);
+    if (!out)
+    {
+        cout << "Failed to create " << output << endl;
+        return EXIT_FAILURE;
+    }
+
+    // Payloads are written one at a time so only one asset is in memory; the table is patched at the end
+    uint64_t position = UAlignUp(header.namesOffset + header.namesBytes, UASSET_PACK_ALIGNMENT);
+    out.seekp((streamoff)position);
+    static const char zeros[UASSET_PACK_ALIGNMENT] = {};
+    for (UAssetPackEntry& entry : table)
+    {
+        if (!entry.used)
+            continue;
+
+        string name = namesBlock.substr(entry.nameOffset, entry.nameLength);
+        vector<unsigned char> payload;
+        if (!UBuildEntry(root + "/" + name, (UAssetType)entry.type, payload))
+            return EXIT_FAILURE;
+
+        entry.offset = position;
+        entry.size = payload.size();
+        out.write((const char*)payload.data(), (streamsize)payload.size());
+        position += payload.size();
+
+        uint64_t aligned = UAlignUp(position, UASSET_PACK_ALIGNMENT);
+        out.write(zeros, (streamsize)(aligned - position));
+        position = aligned;
+    }
+
+    header.fileBytes = position;
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)table.data(), (streamsize)(table.size() * sizeof(UAssetPackEntry)));
+    out.write(namesBlock.data(), (streamsize)namesBlock.size());
+    if (!out)
+    {
+        cout << "Failed writing " << output << endl;
+        return EXIT_FAILURE;
+    }
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Packed " << names.size() << " assets into " << output << " (" << position / 1024 << " KB) in " << ms << " ms" << endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>      // uint32_t, uint64_t
+#include <GL/glew.h>    // GLEW library
+
+#include "MappedFile.h"
+#include "VertexFormat.h"
+
+// .upak: every asset in one file so startup opens a single file.
+// Layout (little endian):
+//   UAssetPackHeader
+//   UAssetPackEntry[tableCapacity]   open addressing hash table keyed by FNV-1a of the name
+//   names                            entry names, not terminated
+//   entries                          each aligned to UASSET_PACK_ALIGNMENT
+const uint32_t UASSET_PACK_MAGIC = 0x4B415055;  // "UPAK"
+const uint32_t UASSET_PACK_VERSION = 1;
+const uint32_t UASSET_PACK_ALIGNMENT = 4096;
+
+enum UAssetType
+{
+    UASSET_RAW = 0,
+    UASSET_TEXTURE = 1,     // UPackedTexture followed by pixels, already flipped for GL
+    UASSET_MESH = 2,        // a .umesh file
+    UASSET_SHADER = 3       // GLSL source, NUL terminated
+};
+
+struct UAssetPackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nEntries;
+    uint32_t tableCapacity; // power of two
+    uint64_t tableOffset;
+    uint64_t namesOffset;
+    uint64_t namesBytes;
+    uint64_t fileBytes;
+};
+
+struct UAssetPackEntry
+{
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t nameOffset;    // into the names block
+    uint32_t nameLength;
+    uint32_t type;          // UAssetType
+    uint32_t used;          // 0 for empty table slots
+};
+
+// Decoded texture stored in a pack; glTexImage2D reads the pixels straight from the mapping
+struct UPackedTexture
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;      // 3 or 4
+    uint32_t reserved;
+};
+
+// An open pack; the pointers are into the mapping
+struct UAssetPack
+{
+    UMappedFile file;
+    const UAssetPackHeader* header;
+    const UAssetPackEntry* table;
+    const char* names;
+};
+
+bool UOpenAssetPack(const char* filename, UAssetPack& pack);
+void UCloseAssetPack(UAssetPack& pack);
+bool UIsAssetPackOpen(const UAssetPack& pack);
+
+// Bytes of an asset inside the mapping, nullptr when the pack doesn't have it
+const unsigned char* UFindAsset(const UAssetPack& pack, const char* name, UAssetType type, size_t& size);
+
+bool UCreateTextureFromPack(const UAssetPack& pack, const char* name, GLuint& textureId);
+bool UCreateMeshFromPack(const UAssetPack& pack, const char* name, UGpuMesh& mesh);
+// NUL terminated source inside the mapping, nullptr when missing
+const char* UFindShaderInPack(const UAssetPack& pack, const char* name);
+
+// Offline pack builder, run as "Project1 --build-pack out.upak [--root dir] files..."
+int UAssetPackBuilderMain(int argc, char* argv[]);
@@ -0,0 +1,507 @@
+#include <iostream>     // cout, cerr
+#include <fstream>      // ifstream
+#include <sstream>      // istringstream
+#include <iomanip>      // setprecision
+#include <cstdio>       // snprintf
+#include <cmath>        // cos, sin
+#include <chrono>       // steady_clock
+#include <thread>       // std::thread
+#include <mutex>        // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <atomic>       // std::atomic
+#include <deque>        // std::deque
+#include <utility>      // std::move
+
+// GLM Math Header inclusions
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "BatchRenderer.h"
+#include "PngWriter.h"
+#include "Profiler.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const int READBACK_SLOTS = 3;           // images a render thread may have in flight
+    const size_t QUEUED_IMAGES_PER_ENCODER = 4;
+    const GLuint64 FENCE_WAIT_NS = 1000000000;
+
+    struct UEncodeJob
+    {
+        string filename;
+        vector<unsigned char> pixels;       // RGBA8, bottom row first
+    };
+
+    // Finished readbacks waiting for an encoder. Bounded, so a slow disk holds the render threads
+    // back instead of filling memory with images.
+    struct UEncodeQueue
+    {
+        mutex lock;
+        condition_variable changed;
+        deque<UEncodeJob> jobs;
+        size_t capacity;
+        bool closed;
+    };
+
+    struct UReadback
+    {
+        UGpuBuffer pbo;
+        GLsync fence;
+        size_t pose;
+    };
+
+    // Everything one render thread owns; the objects live in its context
+    struct URenderWorker
+    {
+        GLFWwindow* context;
+        GLuint programId;
+        GLuint lightmapProgramId;
+        vector<UGpuVertexArray> vaos;           // per scene object
+        vector<UGpuVertexArray> lightmapVaos;
+        UGpuFramebuffer fbo;
+        UGpuTexture color;
+        UGpuTexture depth;
+        UReadback readbacks[READBACK_SLOTS];
+        size_t nRendered;
+    };
+
+    struct UBatchJob
+    {
+        const vector<UBatchPose>* poses;
+        const UBatchSettings* settings;
+        vector<UVertexArrayState> states;       // per scene object, read in the main context
+        vector<UVertexArrayState> lightmapStates;
+        vector<char> lightmapped;
+        atomic<size_t> nextPose;
+        atomic<size_t> nFailed;
+        UEncodeQueue queue;
+    };
+
+    void UPushJob(UEncodeQueue& queue, UEncodeJob& job)
+    {
+        unique_lock<mutex> guard(queue.lock);
+        queue.changed.wait(guard, [&queue]() { return queue.jobs.size() < queue.capacity; });
+        queue.jobs.push_back(move(job));
+        queue.changed.notify_all();
+    }
+
+    bool UPopJob(UEncodeQueue& queue, UEncodeJob& job)
+    {
+        unique_lock<mutex> guard(queue.lock);
+        queue.changed.wait(guard, [&queue]() { return !queue.jobs.empty() || queue.closed; });
+        if (queue.jobs.empty())
+            return false;
+        job = move(queue.jobs.front());
+        queue.jobs.pop_front();
+        queue.changed.notify_all();
+        return true;
+    }
+
+    void UCloseQueue(UEncodeQueue& queue)
+    {
+        lock_guard<mutex> guard(queue.lock);
+        queue.closed = true;
+        queue.changed.notify_all();
+    }
+
+    // Same camera model as the interactive one: yaw and pitch around a fixed world up
+    void UGetPoseMatrices(const UBatchPose& pose, float aspect, glm::mat4& view, glm::mat4& projection, float& nearPlane, float& farPlane)
+    {
+        float yaw = glm::radians(pose.yaw), pitch = glm::radians(pose.pitch);
+        glm::vec3 front(cos(yaw) * cos(pitch), sin(pitch), sin(yaw) * cos(pitch));
+        view = glm::lookAt(pose.position, pose.position + glm::normalize(front), glm::vec3(0.0f, 1.0f, 0.0f));
+        if (pose.ortho)
+        {
+            nearPlane = -10.0f;
+            farPlane = 10.0f;
+            projection = glm::ortho(-aspect * pose.size, aspect * pose.size, -pose.size, pose.size, nearPlane, farPlane);
+        }
+        else
+        {
+            nearPlane = 0.1f;
+            farPlane = 100.0f;
+            projection = glm::perspective(glm::radians(pose.size), aspect, nearPlane, farPlane);
+        }
+    }
+
+    // The scene and lightmap passes of URender, through this context's VAOs
+    void URenderPose(const UBatchJob& job, const URenderWorker& worker, const UBatchPose& pose)
+    {
+        const UBatchSettings& settings = *job.settings;
+        const vector<USceneObject>& scene = *settings.scene;
+        glm::mat4 view, projection;
+        float nearPlane, farPlane;
+        UGetPoseMatrices(pose, (float)settings.width / settings.height, view, projection, nearPlane, farPlane);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, worker.fbo);
+        glViewport(0, 0, settings.width, settings.height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        glUseProgram(worker.programId);
+        GLint modelLoc = glGetUniformLocation(worker.programId, "model");
+        GLint normalMatrixLoc = glGetUniformLocation(worker.programId, "normalMatrix");
+        GLint vertexFormatLoc = glGetUniformLocation(worker.programId, "uVertexFormat");
+        GLint uvScaleLoc = glGetUniformLocation(worker.programId, "uvScale");
+        glUniformMatrix4fv(glGetUniformLocation(worker.programId, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(worker.programId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        UBindShadowMap(*settings.shadow, worker.programId, settings.shadowTextureUnit);
+
+        for (size_t i = 0; i < scene.size(); ++i)
+        {
+            if (job.lightmapped[i])
+                continue;
+            const USceneObject& object = scene[i];
+            glm::mat4 model = object.model * object.mesh->dequantize;
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(object.model)));
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+            glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+            glUniform1i(vertexFormatLoc, object.mesh->format);
+            glUniform2fv(uvScaleLoc, 1, glm::value_ptr(object.uvScale));
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, object.texture);
+            UDrawGpuMesh(*object.mesh, 0, worker.vaos[i]);
+        }
+
+        if (settings.lightmap)
+        {
+            glUseProgram(worker.lightmapProgramId);
+            GLint lightmapModelLoc = glGetUniformLocation(worker.lightmapProgramId, "model");
+            glUniformMatrix4fv(glGetUniformLocation(worker.lightmapProgramId, "view"), 1, GL_FALSE, glm::value_ptr(view));
+            glUniformMatrix4fv(glGetUniformLocation(worker.lightmapProgramId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+            glActiveTexture(GL_TEXTURE0 + settings.lightmapTextureUnit);
+            glBindTexture(GL_TEXTURE_2D, settings.lightmap->texture);
+            for (size_t i = 0; i < scene.size(); ++i)
+            {
+                if (!job.lightmapped[i])
+                    continue;
+                const UGpuMesh& mesh = settings.lightmap->meshes[i];
+                glm::mat4 model = scene[i].model * mesh.dequantize;
+                glUniformMatrix4fv(lightmapModelLoc, 1, GL_FALSE, glm::value_ptr(model));
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, scene[i].texture);
+                UDrawGpuMesh(mesh, 0, worker.lightmapVaos[i]);
+            }
+        }
+        glBindVertexArray(0);
+    }
+
+    // Waits for a readback (it was issued READBACK_SLOTS images ago, so normally it is long done)
+    // and queues its pixels for encoding
+    void UFinishReadback(UBatchJob& job, UReadback& readback)
+    {
+        const UBatchSettings& settings = *job.settings;
+        GLenum status = GL_TIMEOUT_EXPIRED;
+        while (status == GL_TIMEOUT_EXPIRED)
+            status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_NS);
+        glDeleteSync(readback.fence);
+        readback.fence = 0;
+
+        size_t bytes = (size_t)settings.width * settings.height * 4;
+        UEncodeJob encode;
+        char filename[512];
+        snprintf(filename, sizeof(filename), "%s/pose_%05u.png", settings.outputDirectory.c_str(), (unsigned)readback.pose);
+        encode.filename = filename;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        const unsigned char* mapped = status == GL_WAIT_FAILED ? nullptr : (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+        if (mapped)
+        {
+            encode.pixels.assign(mapped, mapped + bytes);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        if (encode.pixels.empty())
+        {
+            cerr << "Readback failed for " << encode.filename << endl;
+            ++job.nFailed;
+            return;
+        }
+        UPushJob(job.queue, encode);
+    }
+
+    bool UCreateWorkerObjects(UBatchJob& job, URenderWorker& worker)
+    {
+        const UBatchSettings& settings = *job.settings;
+        worker.programId = worker.lightmapProgramId = 0;
+
+        // Programs are shared between contexts, and so is their uniform state; each thread needs its own
+        if (!UCreateShaderProgram(settings.vertexShaderSource, settings.fragmentShaderSource, worker.programId))
+            return false;
+        glUseProgram(worker.programId);
+        glUniform1i(glGetUniformLocation(worker.programId, "uTexture"), 0);
+        if (settings.lightmap)
+        {
+            if (!UCreateShaderProgram(settings.lightmapVertexShaderSource, settings.lightmapFragmentShaderSource, worker.lightmapProgramId))
+                return false;
+            glUseProgram(worker.lightmapProgramId);
+            glUniform1i(glGetUniformLocation(worker.lightmapProgramId, "uTexture"), 0);
+            glUniform1i(glGetUniformLocation(worker.lightmapProgramId, "uLightmap"), settings.lightmapTextureUnit);
+        }
+
+        worker.vaos.resize(job.states.size());
+        worker.lightmapVaos.resize(job.states.size());
+        for (size_t i = 0; i < job.states.size(); ++i)
+        {
+            if (job.lightmapped[i])
+                UCreateVertexArray(job.lightmapStates[i], UGPU_GEOMETRY, worker.lightmapVaos[i]);
+            else
+                UCreateVertexArray(job.states[i], UGPU_GEOMETRY, worker.vaos[i]);
+        }
+
+        worker.color.Create(UGPU_RENDER_TARGETS, "batch color");
+        glBindTexture(GL_TEXTURE_2D, worker.color);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, settings.width, settings.height);
+        worker.color.SetBytes(UEstimateTextureBytes(settings.width, settings.height, 1, 4, false));
+        worker.depth.Create(UGPU_RENDER_TARGETS, "batch depth");
+        glBindTexture(GL_TEXTURE_2D, worker.depth);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, settings.width, settings.height);
+        worker.depth.SetBytes(UEstimateTextureBytes(settings.width, settings.height, 1, 4, false));
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        worker.fbo.Create(UGPU_RENDER_TARGETS, "batch framebuffer");
+        glBindFramebuffer(GL_FRAMEBUFFER, worker.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, worker.color, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, worker.depth, 0);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        if (!complete)
+        {
+            cerr << "Batch render target incomplete" << endl;
+            return false;
+        }
+
+        GLsizeiptr bytes = (GLsizeiptr)settings.width * settings.height * 4;
+        for (UReadback& readback : worker.readbacks)
+        {
+            readback.pbo.Create(UGPU_STREAMING, "batch readback");
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+            readback.pbo.SetBytes((size_t)bytes);
+            readback.fence = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return true;
+    }
+
+    void UDestroyWorkerObjects(URenderWorker& worker)
+    {
+        for (UReadback& readback : worker.readbacks)
+        {
+            if (readback.fence)
+                glDeleteSync(readback.fence);
+            readback.fence = 0;
+            readback.pbo.Reset();
+        }
+        worker.fbo.Reset();
+        worker.color.Reset();
+        worker.depth.Reset();
+        worker.vaos.clear();
+        worker.lightmapVaos.clear();
+        if (worker.programId)
+            UDestroyShaderProgram(worker.programId);
+        if (worker.lightmapProgramId)
+            UDestroyShaderProgram(worker.lightmapProgramId);
+    }
+
+    void URenderThread(UBatchJob& job, URenderWorker& worker)
+    {
+        UNameProfileThread("Batch render");
+        glfwMakeContextCurrent(worker.context);
+        USetGpuRegistryContext(worker.context);
+        const UBatchSettings& settings = *job.settings;
+
+        if (UCreateWorkerObjects(job, worker))
+        {
+            glEnable(GL_DEPTH_TEST);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+            int slot = 0;
+            for (size_t pose = job.nextPose++; pose < job.poses->size(); pose = job.nextPose++)
+            {
+                UPROFILE_ZONE("Render pose");
+
+                // The slot's previous image has had READBACK_SLOTS - 1 renders to finish its transfer
+                UReadback& readback = worker.readbacks[slot];
+                if (readback.fence)
+                    UFinishReadback(job, readback);
+
+                URenderPose(job, worker, (*job.poses)[pose]);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+                glReadPixels(0, 0, settings.width, settings.height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                readback.pose = pose;
+                glFlush();
+                ++worker.nRendered;
+                slot = (slot + 1) % READBACK_SLOTS;
+            }
+
+            // Oldest first
+            for (int n = 0; n < READBACK_SLOTS; ++n)
+            {
+                UReadback& readback = worker.readbacks[(slot + n) % READBACK_SLOTS];
+                if (readback.fence)
+                    UFinishReadback(job, readback);
+            }
+        }
+        else
+        {
+            // Leave the poses to the other threads; if there are none, nothing gets rendered
+            cerr << "Batch render thread could not set up its context" << endl;
+        }
+
+        UDestroyWorkerObjects(worker);
+        glFinish();
+        glfwMakeContextCurrent(nullptr);
+        USetGpuRegistryContext(nullptr);
+    }
+
+    void UEncodeThread(UBatchJob& job)
+    {
+        UNameProfileThread("Batch encoder");
+        const UBatchSettings& settings = *job.settings;
+        UEncodeJob encode;
+        while (UPopJob(job.queue, encode))
+        {
+            UPROFILE_ZONE_DETAIL("Encode PNG", encode.filename.c_str());
+
+            // Opaque output: alpha carries whatever the textures had
+            size_t nPixels = (size_t)settings.width * settings.height;
+            for (size_t i = 0; i < nPixels; ++i)
+            {
+                encode.pixels[i * 3 + 0] = encode.pixels[i * 4 + 0];
+                encode.pixels[i * 3 + 1] = encode.pixels[i * 4 + 1];
+                encode.pixels[i * 3 + 2] = encode.pixels[i * 4 + 2];
+            }
+            if (!UWritePng(encode.filename.c_str(), encode.pixels.data(), settings.width, settings.height, 3, true))
+                ++job.nFailed;
+        }
+    }
+}
+
+
+bool ULoadBatchPoses(const char* filename, vector<UBatchPose>& poses)
+{
+    ifstream in(filename);
+    if (!in)
+    {
+        cout << "Failed to open " << filename << endl;
+        return false;
+    }
+
+    poses.clear();
+    string line;
+    int lineNumber = 0;
+    while (getline(in, line))
+    {
+        ++lineNumber;
+        size_t comment = line.find('#');
+        if (comment != string::npos)
+            line.resize(comment);
+        istringstream tokens(line);
+        UBatchPose pose;
+        string projection;
+        if (!(tokens >> pose.position.x))
+            continue;   // blank line
+        if (!(tokens >> pose.position.y >> pose.position.z >> pose.yaw >> pose.pitch >> projection >> pose.size)
+            || (projection != "perspective" && projection != "ortho") || pose.size <= 0.0f)
+        {
+            cout << filename << ":" << lineNumber << ": expected x y z yaw pitch perspective|ortho size" << endl;
+            return false;
+        }
+        pose.ortho = projection == "ortho";
+        poses.push_back(pose);
+    }
+    return true;
+}
+
+
+bool UBatchRender(GLFWwindow* sharedWindow, const vector<UBatchPose>& poses, const UBatchSettings& settings)
+{
+    if (poses.empty() || settings.width <= 0 || settings.height <= 0)
+    {
+        cout << "Nothing to render" << endl;
+        return false;
+    }
+    const vector<USceneObject>& scene = *settings.scene;
+    int nRenderThreads = settings.nRenderThreads > 0 ? settings.nRenderThreads : 1;
+    int nEncodeThreads = settings.nEncodeThreads > 0 ? settings.nEncodeThreads : 1;
+
+    UBatchJob job;
+    job.poses = &poses;
+    job.settings = &settings;
+    job.nextPose = 0;
+    job.nFailed = 0;
+    job.queue.capacity = QUEUED_IMAGES_PER_ENCODER * nEncodeThreads;
+    job.queue.closed = false;
+
+    // VAO layouts, read here because only this context can see the originals
+    job.states.resize(scene.size());
+    job.lightmapStates.resize(scene.size());
+    job.lightmapped.assign(scene.size(), 0);
+    for (size_t i = 0; i < scene.size(); ++i)
+    {
+        job.lightmapped[i] = settings.lightmap && i < settings.lightmap->meshes.size() && settings.lightmap->meshes[i].vao;
+        if (job.lightmapped[i])
+            UGetVertexArrayState(settings.lightmap->meshes[i].vao, job.lightmapStates[i]);
+        else
+            UGetVertexArrayState(scene[i].mesh->vao, job.states[i]);
+    }
+    // Everything the other contexts are about to read must be complete first
+    glFinish();
+
+    // Hidden windows only for their contexts; the hints of the main window still apply
+    vector<URenderWorker> workers(nRenderThreads);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    for (URenderWorker& worker : workers)
+    {
+        worker.context = glfwCreateWindow(1, 1, "batch", nullptr, sharedWindow);
+        worker.nRendered = 0;
+        if (!worker.context)
+        {
+            cout << "Failed to create a shared GL context for a batch render thread" << endl;
+            glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+            for (URenderWorker& created : workers)
+            {
+                if (created.context)
+                    glfwDestroyWindow(created.context);
+            }
+            return false;
+        }
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+    cout << "INFO: Rendering " << poses.size() << " poses at " << settings.width << "x" << settings.height << " with "
+        << nRenderThreads << " render and " << nEncodeThreads << " encode threads" << endl;
+    auto start = chrono::steady_clock::now();
+
+    vector<thread> encoders;
+    for (int i = 0; i < nEncodeThreads; ++i)
+        encoders.emplace_back(UEncodeThread, ref(job));
+    vector<thread> renderers;
+    for (URenderWorker& worker : workers)
+        renderers.emplace_back(URenderThread, ref(job), ref(worker));
+    for (thread& renderer : renderers)
+        renderer.join();
+    UCloseQueue(job.queue);
+    for (thread& encoder : encoders)
+        encoder.join();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    size_t nRendered = 0;
+    for (URenderWorker& worker : workers)
+    {
+        nRendered += worker.nRendered;
+        glfwDestroyWindow(worker.context);
+    }
+    glfwMakeContextCurrent(sharedWindow);
+
+    size_t nWritten = nRendered - job.nFailed;
+    cout << "INFO: Wrote " << nWritten << " of " << poses.size() << " images to " << settings.outputDirectory << " in "
+        << fixed << setprecision(2) << seconds << " s, " << (seconds > 0.0 ? nWritten / seconds : 0.0) << " images/s" << endl;
+    return nWritten == poses.size();
+}
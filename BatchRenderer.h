@@ -0,0 +1,54 @@
+#pragma once
+#include <string>       // std::string
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+#include <GLFW/glfw3.h> // GLFW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "ShadowMap.h"
+#include "Lightmap.h"
+
+// One image of a batch: a camera like the interactive one plus its projection
+struct UBatchPose
+{
+    glm::vec3 position;
+    float yaw;              // degrees; -90 looks down -z like the default camera
+    float pitch;
+    bool ortho;             // like the O key
+    float size;             // perspective: vertical field of view in degrees, ortho: half height of the view
+};
+
+// Pose file, one pose per line, '#' starts a comment:
+//   x y z yaw pitch perspective fovDegrees
+//   x y z yaw pitch ortho halfHeight
+bool ULoadBatchPoses(const char* filename, std::vector<UBatchPose>& poses);
+
+struct UBatchSettings
+{
+    int width;
+    int height;
+    int nRenderThreads;     // each with its own GL context sharing the main one's objects
+    int nEncodeThreads;
+    std::string outputDirectory; // must exist
+
+    // What to draw, all created in the main context
+    const std::vector<USceneObject>* scene;
+    const char* vertexShaderSource;
+    const char* fragmentShaderSource;
+    const UShadowMap* shadow;
+    GLuint shadowTextureUnit;
+    const ULightmap* lightmap;  // null without baked lighting
+    const char* lightmapVertexShaderSource;
+    const char* lightmapFragmentShaderSource;
+    GLuint lightmapTextureUnit;
+};
+
+// Renders every pose into outputDirectory/pose_00000.png, pose_00001.png... and reports the images
+// per second. Render threads pull poses from a shared counter, read each image back through a ring
+// of PBOs and hand finished pixels to the encoder threads, so rendering, transfers and PNG encoding
+// overlap. Call on the main thread (GLFW only creates windows there) with the context of
+// sharedWindow current. Returns false when any image failed.
+bool UBatchRender(GLFWwindow* sharedWindow, const std::vector<UBatchPose>& poses, const UBatchSettings& settings);
@@ -0,0 +1,249 @@
+#include <iostream>     // cout
+#include <fstream>      // ofstream
+#include <iomanip>      // setw, setprecision
+#include <cstring>      // strcmp, strstr
+#include <cstdlib>      // atof, EXIT_SUCCESS
+#include <ctime>        // time, strftime
+#include <thread>       // hardware_concurrency
+#include "Benchmark.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>       // clock_gettime
+#endif
+
+using namespace std; // Standard namespace
+
+const void* volatile gBenchmarkSink = nullptr;
+
+namespace
+{
+    const size_t MAX_ITERATIONS = 1000000000;
+
+    struct UBenchmarkResult
+    {
+        string name;
+        UBenchmarkState state;
+    };
+
+    void URunOnce(const UBenchmark& benchmark, int64_t arg, size_t iterations, UBenchmarkState& state)
+    {
+        state = UBenchmarkState();
+        state.arg = arg;
+        state.iterations = iterations;
+        state.remaining = iterations;
+        benchmark.function(state);
+        if (state.timing)
+            UPauseTiming(state);
+    }
+
+    // Same growth rule as Google Benchmark: aim 40% past the minimum, at most 10x per attempt
+    size_t UNextIterations(size_t iterations, double seconds, double minSeconds)
+    {
+        double multiplier = minSeconds * 1.4 / (seconds > 1e-9 ? seconds : 1e-9);
+        if (seconds / minSeconds <= 0.1 || multiplier > 10.0)
+            multiplier = 10.0;
+        double next = iterations * multiplier;
+        size_t result = next > (double)MAX_ITERATIONS ? MAX_ITERATIONS : (size_t)next;
+        return result > iterations ? result : iterations + 1;
+    }
+
+    void UWriteJsonString(ostream& out, const string& text)
+    {
+        out << '"';
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+        out << '"';
+    }
+
+    bool UWriteResults(const char* filename, const char* executable, double minSeconds, const vector<UBenchmarkResult>& results)
+    {
+        ofstream out(filename);
+        if (!out)
+        {
+            cout << "Failed to create " << filename << endl;
+            return false;
+        }
+
+        char date[32] = "";
+        time_t now = time(nullptr);
+        tm local;
+#ifdef _WIN32
+        if (localtime_s(&local, &now) == 0)
+#else
+        if (localtime_r(&now, &local))
+#endif
+            strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &local);
+
+        out << "{\n  \"context\": {\n    \"date\": \"" << date << "\",\n    \"executable\": ";
+        UWriteJsonString(out, executable);
+        out << ",\n    \"num_cpus\": " << thread::hardware_concurrency()
+#ifdef _DEBUG
+            << ",\n    \"library_build_type\": \"debug\""
+#else
+            << ",\n    \"library_build_type\": \"release\""
+#endif
+            << ",\n    \"min_time\": " << minSeconds << "\n  },\n  \"benchmarks\": [";
+
+        out << setprecision(10);
+        bool first = true;
+        for (const UBenchmarkResult& result : results)
+        {
+            const UBenchmarkState& state = result.state;
+            if (state.skipped)
+                continue;
+            out << (first ? "\n" : ",\n") << "    {\n      \"name\": ";
+            UWriteJsonString(out, result.name);
+            out << ",\n      \"run_name\": ";
+            UWriteJsonString(out, result.name);
+            out << ",\n      \"run_type\": \"iteration\",\n      \"repetitions\": 1,\n      \"iterations\": " << state.iterations
+                << ",\n      \"real_time\": " << state.realSeconds * 1e9 / state.iterations
+                << ",\n      \"cpu_time\": " << state.cpuSeconds * 1e9 / state.iterations
+                << ",\n      \"time_unit\": \"ns\"";
+            if (state.itemsPerIteration > 0 && state.realSeconds > 0.0)
+                out << ",\n      \"items_per_second\": " << state.itemsPerIteration * state.iterations / state.realSeconds;
+            if (state.bytesPerIteration > 0 && state.realSeconds > 0.0)
+                out << ",\n      \"bytes_per_second\": " << state.bytesPerIteration * state.iterations / state.realSeconds;
+            if (!state.label.empty())
+            {
+                out << ",\n      \"label\": ";
+                UWriteJsonString(out, state.label);
+            }
+            out << "\n    }";
+            first = false;
+        }
+        out << "\n  ]\n}\n";
+        return (bool)out;
+    }
+
+    // Picks the unit that keeps the number readable
+    void UPrintTime(double ns)
+    {
+        if (ns >= 1e6)
+            cout << setw(12) << ns / 1e6 << " ms";
+        else if (ns >= 1e3)
+            cout << setw(12) << ns / 1e3 << " us";
+        else
+            cout << setw(12) << ns << " ns";
+    }
+}
+
+
+double UThreadCpuSeconds()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0.0;
+    ULARGE_INTEGER kernelTime, userTime;
+    kernelTime.LowPart = kernel.dwLowDateTime;
+    kernelTime.HighPart = kernel.dwHighDateTime;
+    userTime.LowPart = user.dwLowDateTime;
+    userTime.HighPart = user.dwHighDateTime;
+    return (double)(kernelTime.QuadPart + userTime.QuadPart) * 1e-7;   // 100 ns units
+#else
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0)
+        return 0.0;
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+void UPauseTiming(UBenchmarkState& state)
+{
+    if (!state.timing)
+        return;
+    state.realSeconds += chrono::duration<double>(chrono::steady_clock::now() - state.start).count();
+    state.cpuSeconds += UThreadCpuSeconds() - state.startCpu;
+    state.timing = false;
+}
+
+void UResumeTiming(UBenchmarkState& state)
+{
+    if (state.timing)
+        return;
+    state.timing = true;
+    state.startCpu = UThreadCpuSeconds();
+    state.start = chrono::steady_clock::now();
+}
+
+
+int URunBenchmarks(const vector<UBenchmark>& benchmarks, int argc, char* argv[])
+{
+    const char* filter = "";
+    double minSeconds = 0.5;
+    const char* jsonFile = "benchmark_results.json";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            minSeconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonFile = argv[++i];
+    }
+    minSeconds = minSeconds > 0.001 ? minSeconds : 0.001;
+
+#ifdef _DEBUG
+    cout << "***WARNING*** Debug build, timings are not representative" << endl;
+#endif
+    cout << left << setw(40) << "Benchmark" << right << setw(15) << "Time" << setw(15) << "CPU" << setw(12) << "Iterations" << "  Throughput" << endl;
+    cout << string(100, '-') << endl;
+
+    vector<UBenchmarkResult> results;
+    for (const UBenchmark& benchmark : benchmarks)
+    {
+        vector<int64_t> args = benchmark.args;
+        if (args.empty())
+            args.push_back(0);
+        for (int64_t arg : args)
+        {
+            UBenchmarkResult result;
+            result.name = benchmark.name;
+            if (!benchmark.args.empty())
+                result.name += "/" + to_string(arg);
+            if (!strstr(result.name.c_str(), filter))
+                continue;
+
+            // One warm-up iteration, then grow until a run is long enough to trust
+            size_t iterations = 1;
+            URunOnce(benchmark, arg, iterations, result.state);
+            while (!result.state.skipped && result.state.realSeconds < minSeconds && iterations < MAX_ITERATIONS)
+            {
+                iterations = UNextIterations(iterations, result.state.realSeconds, minSeconds);
+                URunOnce(benchmark, arg, iterations, result.state);
+            }
+
+            const UBenchmarkState& state = result.state;
+            cout << left << setw(40) << result.name << right << fixed << setprecision(2);
+            if (state.skipped)
+                cout << "  skipped";
+            else
+            {
+                UPrintTime(state.realSeconds * 1e9 / state.iterations);
+                UPrintTime(state.cpuSeconds * 1e9 / state.iterations);
+                cout << setw(12) << state.iterations;
+                if (state.bytesPerIteration > 0)
+                    cout << "  " << state.bytesPerIteration * state.iterations / state.realSeconds / (1024.0 * 1024.0) << " MiB/s";
+                else if (state.itemsPerIteration > 0)
+                    cout << "  " << state.itemsPerIteration * state.iterations / state.realSeconds / 1e6 << " M items/s";
+            }
+            if (!state.label.empty())
+                cout << "  " << state.label;
+            cout << endl;
+            results.push_back(result);
+        }
+    }
+
+    if (!UWriteResults(jsonFile, argv[0], minSeconds, results))
+        return EXIT_FAILURE;
+    cout << "Results written to " << jsonFile << endl;
+    return EXIT_SUCCESS;
+}
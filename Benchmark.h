@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>      // int64_t
+#include <cstddef>      // size_t
+#include <atomic>       // atomic_signal_fence
+#include <chrono>       // steady_clock
+#include <string>       // std::string
+#include <vector>       // std::vector
+
+/* Minimal microbenchmark harness in the shape of Google Benchmark, so results can go through the
+ * same comparison tools. A benchmark sets up its data, then times its loop:
+ *     while (UKeepRunning(state))
+ *         UDoNotOptimize(UKernel(data));
+ * The harness raises the iteration count until one run takes at least the minimum time and reports
+ * that run. Everything runs on the calling thread without a GL context.
+ */
+
+struct UBenchmarkState
+{
+    int64_t arg;                // size parameter of this run
+    size_t iterations;          // times the timed loop runs
+    size_t itemsPerIteration;   // set by the benchmark for items_per_second, 0 = not reported
+    size_t bytesPerIteration;   // same for bytes_per_second
+    std::string label;          // shown next to the result
+    bool skipped;               // set with a label when the inputs are missing
+
+    // Harness bookkeeping
+    size_t remaining;
+    bool timing;
+    std::chrono::steady_clock::time_point start;
+    double startCpu;
+    double realSeconds;
+    double cpuSeconds;
+};
+
+typedef void (*UBenchmarkFunction)(UBenchmarkState& state);
+
+struct UBenchmark
+{
+    const char* name;
+    UBenchmarkFunction function;
+    std::vector<int64_t> args;  // one run per value, "name/arg"; empty = a single run with arg 0
+};
+
+// CPU time of the calling thread
+double UThreadCpuSeconds();
+
+void UPauseTiming(UBenchmarkState& state);
+void UResumeTiming(UBenchmarkState& state);
+
+// True until the iterations are done; the first call starts the clock and the last stops it
+inline bool UKeepRunning(UBenchmarkState& state)
+{
+    if (state.remaining > 0)
+    {
+        if (!state.timing && state.remaining == state.iterations)
+            UResumeTiming(state);
+        --state.remaining;
+        return true;
+    }
+    if (state.timing)
+        UPauseTiming(state);
+    return false;
+}
+
+// Keeps a result alive so the kernel computing it can't be optimized away, even across translation
+// units with whole program optimization
+extern const void* volatile gBenchmarkSink;
+template <typename T>
+inline void UDoNotOptimize(const T& value)
+{
+    gBenchmarkSink = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+// Runs every benchmark whose name contains the filter, prints a table and writes Google Benchmark
+// style JSON. Options: [--filter TEXT] [--min-time SECONDS] [--json FILE]
+int URunBenchmarks(const std::vector<UBenchmark>& benchmarks, int argc, char* argv[]);
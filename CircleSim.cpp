@@ -0,0 +1,482 @@
+#include <iostream>     // cout
+#include <iomanip>      // setw, setprecision
+#include <chrono>       // timing
+#include <cmath>        // sqrt, fabs
+#include <cstdlib>      // atoi, EXIT_SUCCESS
+#include <cstring>      // strcmp
+#include "CircleSim.h"
+
+// The AVX2 kernels are compiled for every x64 build and only called when the CPU has AVX2, so the
+// executable still runs on older machines. MSVC accepts the intrinsics without /arch:AVX2.
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>  // AVX2
+#define UCIRCLE_AVX2 1
+#ifdef _MSC_VER
+#include <intrin.h>     // __cpuid, _xgetbv
+#define UAVX2_TARGET
+#else
+#define UAVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    double UMillisecondsSince(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    uint32_t UPackColor(const glm::vec4& color)
+    {
+        uint32_t packed = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            float c = color[i] < 0.0f ? 0.0f : (color[i] > 1.0f ? 1.0f : color[i]);
+            packed |= (uint32_t)(c * 255.0f + 0.5f) << (8 * i);
+        }
+        return packed;
+    }
+
+    // Sizes the grid for the largest circle, growing the cells if the grid would dwarf the population
+    void UResizeGrid(UCircleSim& sim)
+    {
+        glm::vec2 extent = sim.boundsMax - sim.boundsMin;
+        float cellSize = sim.maxRadius * 2.0f;
+        size_t maxCells = sim.x.size() + 64;
+        for (;;)
+        {
+            sim.nCellsX = (int)ceil(extent.x / cellSize);
+            sim.nCellsY = (int)ceil(extent.y / cellSize);
+            sim.nCellsX = sim.nCellsX < 1 ? 1 : sim.nCellsX;
+            sim.nCellsY = sim.nCellsY < 1 ? 1 : sim.nCellsY;
+            if ((size_t)sim.nCellsX * sim.nCellsY <= maxCells)
+                break;
+            cellSize *= 1.5f;
+        }
+        sim.cellSize = cellSize;
+        sim.cellStart.assign((size_t)sim.nCellsX * sim.nCellsY + 1, 0);
+    }
+
+    // Position, walls and grid cell for circles [begin, end)
+    void UIntegrateScalar(UCircleSim& sim, float deltaTime, size_t begin, size_t end)
+    {
+        float inverseCell = 1.0f / sim.cellSize;
+        for (size_t i = begin; i < end; ++i)
+        {
+            float r = sim.radius[i];
+            float x = sim.x[i] + sim.vx[i] * deltaTime;
+            float y = sim.y[i] + sim.vy[i] * deltaTime;
+
+            if (x < sim.boundsMin.x + r) { x = sim.boundsMin.x + r; sim.vx[i] = fabs(sim.vx[i]); }
+            if (x > sim.boundsMax.x - r) { x = sim.boundsMax.x - r; sim.vx[i] = -fabs(sim.vx[i]); }
+            if (y < sim.boundsMin.y + r) { y = sim.boundsMin.y + r; sim.vy[i] = fabs(sim.vy[i]); }
+            if (y > sim.boundsMax.y - r) { y = sim.boundsMax.y - r; sim.vy[i] = -fabs(sim.vy[i]); }
+            sim.x[i] = x;
+            sim.y[i] = y;
+
+            int cx = (int)((x - sim.boundsMin.x) * inverseCell);
+            int cy = (int)((y - sim.boundsMin.y) * inverseCell);
+            cx = cx < 0 ? 0 : (cx >= sim.nCellsX ? sim.nCellsX - 1 : cx);
+            cy = cy < 0 ? 0 : (cy >= sim.nCellsY ? sim.nCellsY - 1 : cy);
+            sim.cell[i] = cy * sim.nCellsX + cx;
+        }
+    }
+
+    // Pushes an overlapping pair apart and exchanges the velocity along the contact normal
+    void UResolvePair(UCircleSim& sim, size_t i, size_t j)
+    {
+        float dx = sim.x[j] - sim.x[i];
+        float dy = sim.y[j] - sim.y[i];
+        float distanceSquared = dx * dx + dy * dy;
+        float radii = sim.radius[i] + sim.radius[j];
+        // Checked again: resolving an earlier pair may have separated these
+        if (distanceSquared >= radii * radii)
+            return;
+
+        float distance = sqrt(distanceSquared);
+        float nx = 1.0f, ny = 0.0f;
+        if (distance > 0.0f)
+        {
+            nx = dx / distance;
+            ny = dy / distance;
+        }
+        float push = 0.5f * (radii - distance);
+        sim.x[i] -= nx * push;
+        sim.y[i] -= ny * push;
+        sim.x[j] += nx * push;
+        sim.y[j] += ny * push;
+
+        // Only when approaching; separating pairs keep their velocities
+        float approach = (sim.vx[j] - sim.vx[i]) * nx + (sim.vy[j] - sim.vy[i]) * ny;
+        if (approach < 0.0f)
+        {
+            sim.vx[i] += approach * nx;
+            sim.vy[i] += approach * ny;
+            sim.vx[j] -= approach * nx;
+            sim.vy[j] -= approach * ny;
+        }
+        ++sim.nCollisions;
+    }
+
+    void UCollideScalar(UCircleSim& sim, size_t i, size_t begin, size_t end)
+    {
+        for (size_t j = begin; j < end; ++j)
+        {
+            float dx = sim.x[j] - sim.x[i];
+            float dy = sim.y[j] - sim.y[i];
+            float radii = sim.radius[i] + sim.radius[j];
+            if (dx * dx + dy * dy < radii * radii)
+                UResolvePair(sim, i, j);
+        }
+    }
+
+#ifdef UCIRCLE_AVX2
+    // 8 circles per iteration; returns how many were done, the rest is left for the scalar loop
+    UAVX2_TARGET size_t UIntegrateAvx2(UCircleSim& sim, float deltaTime)
+    {
+        const __m256 dt = _mm256_set1_ps(deltaTime);
+        const __m256 minX = _mm256_set1_ps(sim.boundsMin.x), minY = _mm256_set1_ps(sim.boundsMin.y);
+        const __m256 maxX = _mm256_set1_ps(sim.boundsMax.x), maxY = _mm256_set1_ps(sim.boundsMax.y);
+        const __m256 inverseCell = _mm256_set1_ps(1.0f / sim.cellSize);
+        const __m256 signBit = _mm256_set1_ps(-0.0f);
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i lastX = _mm256_set1_epi32(sim.nCellsX - 1), lastY = _mm256_set1_epi32(sim.nCellsY - 1);
+        const __m256i cellsX = _mm256_set1_epi32(sim.nCellsX);
+
+        size_t n = sim.x.size() / 8 * 8;
+        for (size_t i = 0; i < n; i += 8)
+        {
+            __m256 r = _mm256_loadu_ps(&sim.radius[i]);
+            __m256 vx = _mm256_loadu_ps(&sim.vx[i]);
+            __m256 vy = _mm256_loadu_ps(&sim.vy[i]);
+            __m256 x = _mm256_add_ps(_mm256_loadu_ps(&sim.x[i]), _mm256_mul_ps(vx, dt));
+            __m256 y = _mm256_add_ps(_mm256_loadu_ps(&sim.y[i]), _mm256_mul_ps(vy, dt));
+
+            // Same order as the scalar walls: clamp to the low side, then to the high side
+            __m256 low = _mm256_add_ps(minX, r);
+            __m256 high = _mm256_sub_ps(maxX, r);
+            __m256 absolute = _mm256_andnot_ps(signBit, vx);
+            __m256 hit = _mm256_cmp_ps(x, low, _CMP_LT_OQ);
+            x = _mm256_blendv_ps(x, low, hit);
+            vx = _mm256_blendv_ps(vx, absolute, hit);
+            hit = _mm256_cmp_ps(x, high, _CMP_GT_OQ);
+            x = _mm256_blendv_ps(x, high, hit);
+            vx = _mm256_blendv_ps(vx, _mm256_or_ps(absolute, signBit), hit);
+
+            low = _mm256_add_ps(minY, r);
+            high = _mm256_sub_ps(maxY, r);
+            absolute = _mm256_andnot_ps(signBit, vy);
+            hit = _mm256_cmp_ps(y, low, _CMP_LT_OQ);
+            y = _mm256_blendv_ps(y, low, hit);
+            vy = _mm256_blendv_ps(vy, absolute, hit);
+            hit = _mm256_cmp_ps(y, high, _CMP_GT_OQ);
+            y = _mm256_blendv_ps(y, high, hit);
+            vy = _mm256_blendv_ps(vy, _mm256_or_ps(absolute, signBit), hit);
+
+            _mm256_storeu_ps(&sim.x[i], x);
+            _mm256_storeu_ps(&sim.y[i], y);
+            _mm256_storeu_ps(&sim.vx[i], vx);
+            _mm256_storeu_ps(&sim.vy[i], vy);
+
+            __m256i cx = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(x, minX), inverseCell));
+            __m256i cy = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(y, minY), inverseCell));
+            cx = _mm256_min_epi32(_mm256_max_epi32(cx, zero), lastX);
+            cy = _mm256_min_epi32(_mm256_max_epi32(cy, zero), lastY);
+            __m256i cell = _mm256_add_epi32(_mm256_mullo_epi32(cy, cellsX), cx);
+            _mm256_storeu_si256((__m256i*)&sim.cell[i], cell);
+        }
+        return n;
+    }
+
+    // Tests circle i against 8 candidates at a time; the few hits are resolved one by one
+    UAVX2_TARGET void UCollideAvx2(UCircleSim& sim, size_t i, size_t begin, size_t end)
+    {
+        size_t j = begin;
+        __m256 xi = _mm256_set1_ps(sim.x[i]);
+        __m256 yi = _mm256_set1_ps(sim.y[i]);
+        __m256 ri = _mm256_set1_ps(sim.radius[i]);
+        for (; j + 8 <= end; j += 8)
+        {
+            __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&sim.x[j]), xi);
+            __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&sim.y[j]), yi);
+            __m256 radii = _mm256_add_ps(_mm256_loadu_ps(&sim.radius[j]), ri);
+            __m256 distanceSquared = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+            int mask = _mm256_movemask_ps(_mm256_cmp_ps(distanceSquared, _mm256_mul_ps(radii, radii), _CMP_LT_OQ));
+            if (!mask)
+                continue;
+
+            for (int bit = 0; bit < 8; ++bit)
+                if (mask & (1 << bit))
+                    UResolvePair(sim, i, j + bit);
+            // Circle i moved
+            xi = _mm256_set1_ps(sim.x[i]);
+            yi = _mm256_set1_ps(sim.y[i]);
+        }
+        UCollideScalar(sim, i, j, end);
+    }
+#endif
+
+    // Counting sort by cell, then every array is gathered into cell order
+    void USortByCell(UCircleSim& sim)
+    {
+        size_t n = sim.x.size();
+        size_t nCells = (size_t)sim.nCellsX * sim.nCellsY;
+        sim.cellStart.assign(nCells + 1, 0);
+        for (size_t i = 0; i < n; ++i)
+            ++sim.cellStart[sim.cell[i]];
+
+        // Exclusive prefix sum; the scatter below advances every start to the end of its cell,
+        // which is the start of the next, so shifting by one afterwards restores the starts
+        uint32_t sum = 0;
+        for (size_t c = 0; c < nCells; ++c)
+        {
+            uint32_t count = sim.cellStart[c];
+            sim.cellStart[c] = sum;
+            sum += count;
+        }
+        sim.order.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            sim.order[sim.cellStart[sim.cell[i]]++] = (uint32_t)i;
+        for (size_t c = nCells; c > 0; --c)
+            sim.cellStart[c] = sim.cellStart[c - 1];
+        sim.cellStart[0] = 0;
+
+        vector<float>* fields[] = { &sim.x, &sim.y, &sim.vx, &sim.vy, &sim.radius };
+        sim.scratch.resize(n);
+        for (vector<float>* field : fields)
+        {
+            for (size_t i = 0; i < n; ++i)
+                sim.scratch[i] = (*field)[sim.order[i]];
+            field->swap(sim.scratch);
+        }
+        sim.scratchColor.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            sim.scratchColor[i] = sim.color[sim.order[i]];
+        sim.color.swap(sim.scratchColor);
+    }
+
+    // Every pair once: each circle against the rest of its cell and the cell to the right (one
+    // contiguous range once sorted) and against the three cells of the next row (another one)
+    void UCollideAll(UCircleSim& sim)
+    {
+        const vector<uint32_t>& start = sim.cellStart;
+        for (int cy = 0; cy < sim.nCellsY; ++cy)
+        {
+            for (int cx = 0; cx < sim.nCellsX; ++cx)
+            {
+                size_t c = (size_t)cy * sim.nCellsX + cx;
+                if (start[c] == start[c + 1])
+                    continue;
+
+                size_t sameEnd = cx + 1 < sim.nCellsX ? start[c + 2] : start[c + 1];
+                size_t belowBegin = 0, belowEnd = 0;
+                if (cy + 1 < sim.nCellsY)
+                {
+                    size_t below = c + sim.nCellsX;
+                    belowBegin = start[cx > 0 ? below - 1 : below];
+                    belowEnd = start[cx + 1 < sim.nCellsX ? below + 2 : below + 1];
+                }
+
+                for (size_t i = start[c]; i < start[c + 1]; ++i)
+                {
+#ifdef UCIRCLE_AVX2
+                    // Sparse cells give ranges of a circle or two, not worth a vector
+                    if (sim.useAvx2 && sameEnd - i > 8)
+                        UCollideAvx2(sim, i, i + 1, sameEnd);
+                    else
+                        UCollideScalar(sim, i, i + 1, sameEnd);
+                    if (sim.useAvx2 && belowEnd - belowBegin >= 8)
+                        UCollideAvx2(sim, i, belowBegin, belowEnd);
+                    else
+                        UCollideScalar(sim, i, belowBegin, belowEnd);
+#else
+                    UCollideScalar(sim, i, i + 1, sameEnd);
+                    UCollideScalar(sim, i, belowBegin, belowEnd);
+#endif
+                }
+            }
+        }
+    }
+
+    uint32_t UNextRandom(uint32_t& state)
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+
+    float URandomRange(uint32_t& state, float low, float high)
+    {
+        return low + (high - low) * (UNextRandom(state) / 16777216.0f);
+    }
+
+    // Circles of radius 0.5..1 at the same density for every population, so the collision work per circle is comparable
+    void UCreateBenchmarkSim(UCircleSim& sim, size_t nCircles, bool useAvx2)
+    {
+        float side = 4.0f * sqrt((float)nCircles);
+        UCreateCircleSim(sim, glm::vec2(0.0f), glm::vec2(side));
+        sim.useAvx2 = useAvx2;
+        uint32_t state = 12345;
+        for (size_t i = 0; i < nCircles; ++i)
+        {
+            glm::vec2 position(URandomRange(state, 0.0f, side), URandomRange(state, 0.0f, side));
+            float radius = URandomRange(state, 0.5f, 1.0f);
+            int direction = 1 + (int)(UNextRandom(state) % 8);
+            UAddCircle(sim, position, radius, direction, URandomRange(state, 2.0f, 10.0f), glm::vec4(1.0f));
+        }
+    }
+}
+
+
+bool UCpuHasAvx2()
+{
+#if !defined(UCIRCLE_AVX2)
+    return false;
+#elif defined(_MSC_VER)
+    // AVX2 flag, plus the OS saving the YMM registers on context switches
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+
+void UCreateCircleSim(UCircleSim& sim, const glm::vec2& boundsMin, const glm::vec2& boundsMax)
+{
+    sim = UCircleSim();
+    sim.boundsMin = boundsMin;
+    sim.boundsMax = boundsMax;
+    sim.maxRadius = 0.0f;
+    sim.cellSize = 1.0f;
+    sim.nCellsX = sim.nCellsY = 0;
+    sim.useAvx2 = UCpuHasAvx2();
+    sim.integrateMs = sim.sortMs = sim.collideMs = 0.0;
+    sim.nCollisions = 0;
+}
+
+void USetCircleSimBounds(UCircleSim& sim, const glm::vec2& boundsMin, const glm::vec2& boundsMax)
+{
+    sim.boundsMin = boundsMin;
+    sim.boundsMax = boundsMax;
+    // The grid is rebuilt by the next step
+    sim.nCellsX = 0;
+}
+
+
+glm::vec2 UCircleDirection(int direction)
+{
+    const float diagonal = 0.70710678f;
+    switch (direction)
+    {
+    case 1: return glm::vec2(0.0f, 1.0f);
+    case 2: return glm::vec2(1.0f, 0.0f);
+    case 3: return glm::vec2(0.0f, -1.0f);
+    case 4: return glm::vec2(-1.0f, 0.0f);
+    case 5: return glm::vec2(diagonal, diagonal);
+    case 6: return glm::vec2(-diagonal, diagonal);
+    case 7: return glm::vec2(diagonal, -diagonal);
+    case 8: return glm::vec2(-diagonal, -diagonal);
+    default: return glm::vec2(0.0f);
+    }
+}
+
+
+void UAddCircle(UCircleSim& sim, const glm::vec2& position, float radius, int direction, float speed, const glm::vec4& color)
+{
+    glm::vec2 direction2 = UCircleDirection(direction);
+    sim.x.push_back(position.x);
+    sim.y.push_back(position.y);
+    sim.vx.push_back(direction2.x * speed);
+    sim.vy.push_back(direction2.y * speed);
+    sim.radius.push_back(radius);
+    sim.color.push_back(UPackColor(color));
+    sim.cell.push_back(0);
+    sim.maxRadius = radius > sim.maxRadius ? radius : sim.maxRadius;
+    // The grid is rebuilt by the next step
+    sim.nCellsX = 0;
+}
+
+
+void UStepCircleSim(UCircleSim& sim, float deltaTime)
+{
+    sim.nCollisions = 0;
+    if (sim.x.empty())
+        return;
+    if (sim.nCellsX == 0)
+        UResizeGrid(sim);
+
+    auto start = chrono::steady_clock::now();
+    size_t done = 0;
+#ifdef UCIRCLE_AVX2
+    if (sim.useAvx2)
+        done = UIntegrateAvx2(sim, deltaTime);
+#endif
+    UIntegrateScalar(sim, deltaTime, done, sim.x.size());
+    sim.integrateMs = UMillisecondsSince(start);
+
+    start = chrono::steady_clock::now();
+    USortByCell(sim);
+    sim.sortMs = UMillisecondsSince(start);
+
+    start = chrono::steady_clock::now();
+    UCollideAll(sim);
+    sim.collideMs = UMillisecondsSince(start);
+}
+
+
+int UCircleBenchmarkMain(int argc, char* argv[])
+{
+    int nSteps = 50;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+            nSteps = atoi(argv[++i]);
+    }
+    nSteps = nSteps < 1 ? 1 : nSteps;
+
+    const float DELTA_TIME = 1.0f / 60.0f;
+    const int WARMUP_STEPS = 5;
+    const size_t POPULATIONS[] = { 10000, 100000, 1000000 };
+    bool hasAvx2 = UCpuHasAvx2();
+    if (!hasAvx2)
+        cout << "AVX2 unavailable on this CPU, timing the scalar path only" << endl;
+
+    cout << "Average ms per step over " << nSteps << " steps" << endl;
+    cout << setw(9) << "circles" << setw(8) << "path" << setw(11) << "integrate" << setw(9) << "sort"
+        << setw(10) << "collide" << setw(9) << "total" << setw(15) << "Mcircles/s" << setw(12) << "contacts" << endl;
+    for (size_t nCircles : POPULATIONS)
+    {
+        for (int path = 0; path < (hasAvx2 ? 2 : 1); ++path)
+        {
+            UCircleSim sim;
+            UCreateBenchmarkSim(sim, nCircles, path == 1);
+            for (int step = 0; step < WARMUP_STEPS; ++step)
+                UStepCircleSim(sim, DELTA_TIME);
+
+            double integrateMs = 0.0, sortMs = 0.0, collideMs = 0.0;
+            size_t nCollisions = 0;
+            for (int step = 0; step < nSteps; ++step)
+            {
+                UStepCircleSim(sim, DELTA_TIME);
+                integrateMs += sim.integrateMs;
+                sortMs += sim.sortMs;
+                collideMs += sim.collideMs;
+                nCollisions += sim.nCollisions;
+            }
+            double totalMs = (integrateMs + sortMs + collideMs) / nSteps;
+            cout << fixed << setprecision(3) << setw(9) << nCircles << setw(8) << (path == 1 ? "avx2" : "scalar")
+                << setw(11) << integrateMs / nSteps << setw(9) << sortMs / nSteps << setw(10) << collideMs / nSteps
+                << setw(9) << totalMs << setw(15) << setprecision(1) << nCircles / (totalMs * 1000.0)
+                << setw(12) << nCollisions / nSteps << endl;
+        }
+    }
+    return EXIT_SUCCESS;
+}
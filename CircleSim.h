@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>      // uint32_t
+#include <vector>       // std::vector
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+// Moving circles in structure of arrays layout: every field is its own contiguous array, so the
+// update streams through memory 8 circles per AVX2 instruction. After each step the arrays are
+// reordered by grid cell, which keeps the circles a collision test touches next to each other.
+struct UCircleSim
+{
+    // Per circle
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> vx;      // units per second
+    std::vector<float> vy;
+    std::vector<float> radius;
+    std::vector<uint32_t> color; // RGBA8
+    std::vector<int> cell;      // grid cell of the current position
+
+    // Walls
+    glm::vec2 boundsMin;
+    glm::vec2 boundsMax;
+    float maxRadius;
+
+    // Uniform grid over the bounds, cells at least as big as the largest circle's diameter so
+    // overlapping circles are always in the same or neighbouring cells
+    float cellSize;
+    int nCellsX;
+    int nCellsY;
+    std::vector<uint32_t> cellStart;    // first circle of every cell once sorted, plus the total
+
+    bool useAvx2;               // false forces the scalar path; set when the CPU supports it
+    std::vector<uint32_t> order;        // scratch for the sort
+    std::vector<float> scratch;
+    std::vector<uint32_t> scratchColor;
+
+    // Stats of the last step
+    double integrateMs;
+    double sortMs;
+    double collideMs;
+    size_t nCollisions;
+};
+
+void UCreateCircleSim(UCircleSim& sim, const glm::vec2& boundsMin, const glm::vec2& boundsMax);
+// Moves the walls, e.g. when the window changes shape; circles left outside are pushed back in by the next step
+void USetCircleSimBounds(UCircleSim& sim, const glm::vec2& boundsMin, const glm::vec2& boundsMax);
+// Velocity from the Circle class direction code: 1 up, 2 right, 3 down, 4 left, 5 up right,
+// 6 up left, 7 down right, 8 down left; anything else stands still
+glm::vec2 UCircleDirection(int direction);
+void UAddCircle(UCircleSim& sim, const glm::vec2& position, float radius, int direction, float speed, const glm::vec4& color);
+// Moves every circle, bounces it off the walls and resolves overlapping pairs as equal mass elastic collisions
+void UStepCircleSim(UCircleSim& sim, float deltaTime);
+bool UCpuHasAvx2();
+
+// Update throughput at 10k, 100k and 1M circles, scalar and AVX2, run as "Project1 --circle-bench [--steps N]"
+int UCircleBenchmarkMain(int argc, char* argv[]);
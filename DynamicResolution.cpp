@@ -0,0 +1,289 @@
+#include <iostream>     // cout, cerr
+#include <cmath>        // sqrt, fabs
+#include <algorithm>    // min, max
+#include "DynamicResolution.h"
+#include "Scene.h"
+
+using namespace std; // Standard namespace
+
+/* Fullscreen triangle; texture coordinates run 0..1 over the window */
+const GLchar* upscaleVertexShaderSource = GLSL(440,
+    out vec2 screenCoordinate;
+
+    void main()
+    {
+        vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        screenCoordinate = corner;
+        gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+    }
+);
+
+/* Bilinear stretch plus an unsharp mask over the 4 neighbouring source texels. The result is clamped
+ * to the neighbourhood's range, so edges get crisper without halos. */
+const GLchar* upscaleFragmentShaderSource = GLSL(440,
+    in vec2 screenCoordinate;
+
+    out vec4 fragmentColor;
+
+    uniform sampler2D uScene;
+    uniform vec2 uRenderedSize;     // texture coordinates of the rendered part's far corner
+    uniform vec2 uTexelSize;
+    uniform float uSharpness;
+
+    vec3 Fetch(vec2 uv)
+    {
+        // Never blend in texels outside the rendered part
+        return texture(uScene, clamp(uv, 0.5f * uTexelSize, uRenderedSize - 0.5f * uTexelSize)).rgb;
+    }
+
+    void main()
+    {
+        vec2 uv = screenCoordinate * uRenderedSize;
+        vec3 center = Fetch(uv);
+        vec3 north = Fetch(uv + vec2(0.0f, uTexelSize.y));
+        vec3 south = Fetch(uv - vec2(0.0f, uTexelSize.y));
+        vec3 east = Fetch(uv + vec2(uTexelSize.x, 0.0f));
+        vec3 west = Fetch(uv - vec2(uTexelSize.x, 0.0f));
+
+        vec3 lowest = min(center, min(min(north, south), min(east, west)));
+        vec3 highest = max(center, max(max(north, south), max(east, west)));
+        vec3 sharpened = center + uSharpness * (center - 0.25f * (north + south + east + west));
+        fragmentColor = vec4(clamp(sharpened, lowest, highest), 1.0f);
+    }
+);
+
+namespace
+{
+    const float MEASUREMENT_SMOOTHING = 0.15f;
+    const int SETTLE_FRAMES = 6;        // timings at a new scale before it is judged
+    const float TARGET_LOAD = 0.9f;     // aim a little under the target so noise doesn't push it over
+    const float RAISE_LOAD = 0.8f;      // below this much of the target the scale goes up again
+    const float MAX_RAISE = 0.05f;      // per change; dropping is never limited
+    const float MIN_CHANGE = 0.01f;
+
+    void UDestroyTargets(UDynamicResolution& resolution)
+    {
+        resolution.color.Reset();
+        resolution.depth.Reset();
+        resolution.targetWidth = resolution.targetHeight = 0;
+    }
+
+    bool UCreateTargets(UDynamicResolution& resolution, int windowWidth, int windowHeight)
+    {
+        UDestroyTargets(resolution);
+        int width = (int)ceil(windowWidth * resolution.maxScale);
+        int height = (int)ceil(windowHeight * resolution.maxScale);
+
+        resolution.color.Create(UGPU_RENDER_TARGETS, "scene color");
+        glBindTexture(GL_TEXTURE_2D, resolution.color);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+        resolution.color.SetBytes(UEstimateTextureBytes(width, height, 1, 4, false));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        resolution.depth.Create(UGPU_RENDER_TARGETS, "scene depth");
+        glBindTexture(GL_TEXTURE_2D, resolution.depth);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+        resolution.depth.SetBytes(UEstimateTextureBytes(width, height, 1, 4, false));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, resolution.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolution.color, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, resolution.depth, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            cerr << "Scene render target incomplete: 0x" << hex << status << dec << endl;
+            UDestroyTargets(resolution);
+            return false;
+        }
+
+        resolution.targetWidth = width;
+        resolution.targetHeight = height;
+        return true;
+    }
+
+    void UAddFrameTime(UDynamicResolution& resolution, float ms)
+    {
+        // The first timing at a new scale replaces the old average instead of blending into it
+        if (resolution.framesSinceChange == 0)
+            resolution.frameMs = ms;
+        else
+            resolution.frameMs += (ms - resolution.frameMs) * MEASUREMENT_SMOOTHING;
+        ++resolution.framesSinceChange;
+    }
+
+    // Fill cost goes with the pixel count, the square of the scale, so the scale that would hit the
+    // target is the current one times the square root of the headroom. A dead band between RAISE_LOAD
+    // and 1 keeps it from oscillating around the target.
+    void UUpdateScale(UDynamicResolution& resolution)
+    {
+        if (resolution.framesSinceChange < SETTLE_FRAMES)
+            return;
+        float load = resolution.frameMs / resolution.targetMs;
+        if (load >= RAISE_LOAD && load <= 1.0f)
+            return;
+
+        float scale = resolution.scale * sqrt(TARGET_LOAD / load);
+        scale = min(scale, resolution.scale + MAX_RAISE);
+        scale = max(resolution.minScale, min(resolution.maxScale, scale));
+        if (fabs(scale - resolution.scale) < MIN_CHANGE)
+            return;
+
+        resolution.scale = scale;
+        resolution.framesSinceChange = 0;
+    }
+
+    // Oldest first; stops at the first unfinished one, the ones after it can't be done either
+    void UCollectTimings(UDynamicResolution& resolution)
+    {
+        for (int n = 0; n < UDYNRES_TIMER_QUERIES; ++n)
+        {
+            int i = (resolution.nextQuery + n) % UDYNRES_TIMER_QUERIES;
+            if (!resolution.queryPending[i])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(resolution.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(resolution.queries[i], GL_QUERY_RESULT, &nanoseconds);
+            resolution.queryPending[i] = false;
+            // Frames rendered before the last scale change say nothing about the current one
+            if (resolution.queryScale[i] == resolution.scale)
+                UAddFrameTime(resolution, nanoseconds / 1000000.0f);
+        }
+    }
+}
+
+
+bool UCreateDynamicResolution(UDynamicResolution& resolution)
+{
+    resolution.minScale = max(0.1f, resolution.minScale);
+    resolution.maxScale = max(resolution.minScale, min(2.0f, resolution.maxScale));
+    resolution.targetMs = max(1.0f, resolution.targetMs);
+    resolution.scale = resolution.maxScale;
+    resolution.windowWidth = resolution.windowHeight = 0;
+    resolution.width = resolution.height = 0;
+    resolution.targetWidth = resolution.targetHeight = 0;
+    resolution.nextQuery = 0;
+    resolution.queryActive = false;
+    resolution.frameMs = 0.0f;
+    resolution.framesSinceChange = 0;
+
+    if (!UCreateShaderProgram(upscaleVertexShaderSource, upscaleFragmentShaderSource, resolution.programId))
+        return false;
+    glUseProgram(resolution.programId);
+    glUniform1i(glGetUniformLocation(resolution.programId, "uScene"), 0);
+
+    resolution.fbo.Create(UGPU_RENDER_TARGETS, "scene framebuffer");
+    resolution.emptyVao.Create(UGPU_RENDER_TARGETS, "fullscreen triangle");
+
+    resolution.timerQueries = GLEW_ARB_timer_query != 0;
+    for (int i = 0; i < UDYNRES_TIMER_QUERIES; ++i)
+    {
+        if (resolution.timerQueries)
+            resolution.queries[i].Create(UGPU_RENDER_TARGETS, "frame timer");
+        resolution.queryPending[i] = false;
+        resolution.queryScale[i] = 0.0f;
+    }
+    if (!resolution.timerQueries)
+        cout << "GPU timer queries unavailable, dynamic resolution follows the CPU frame time" << endl;
+    return true;
+}
+
+void UDestroyDynamicResolution(UDynamicResolution& resolution)
+{
+    if (resolution.queryActive)
+        glEndQuery(GL_TIME_ELAPSED);
+    resolution.queryActive = false;
+    for (int i = 0; i < UDYNRES_TIMER_QUERIES; ++i)
+    {
+        resolution.queries[i].Reset();
+        resolution.queryPending[i] = false;
+    }
+    UDestroyTargets(resolution);
+    resolution.emptyVao.Reset();
+    resolution.fbo.Reset();
+    UDestroyShaderProgram(resolution.programId);
+}
+
+bool UBeginDynamicResolutionFrame(UDynamicResolution& resolution, int windowWidth, int windowHeight)
+{
+    if (windowWidth <= 0 || windowHeight <= 0)
+        return false;
+    if (windowWidth != resolution.windowWidth || windowHeight != resolution.windowHeight)
+    {
+        resolution.windowWidth = windowWidth;
+        resolution.windowHeight = windowHeight;
+        UCreateTargets(resolution, windowWidth, windowHeight);
+    }
+    if (!resolution.targetWidth)
+        return false;
+
+    if (resolution.timerQueries)
+        UCollectTimings(resolution);
+    UUpdateScale(resolution);
+
+    // Same scale on both axes keeps the aspect ratio of the window
+    resolution.width = min(resolution.targetWidth, max(1, (int)(windowWidth * resolution.scale + 0.5f)));
+    resolution.height = min(resolution.targetHeight, max(1, (int)(windowHeight * resolution.scale + 0.5f)));
+
+    // A slot still waiting for its result means the GPU is far behind; this frame goes untimed
+    int slot = resolution.nextQuery;
+    if (resolution.timerQueries && !resolution.queryPending[slot])
+    {
+        glBeginQuery(GL_TIME_ELAPSED, resolution.queries[slot]);
+        resolution.queryScale[slot] = resolution.scale;
+        resolution.queryActive = true;
+    }
+    return true;
+}
+
+void UBindSceneTarget(const UDynamicResolution& resolution)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, resolution.fbo);
+    glViewport(0, 0, resolution.width, resolution.height);
+}
+
+void UPresentSceneTarget(const UDynamicResolution& resolution)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, resolution.windowWidth, resolution.windowHeight);
+    glDisable(GL_DEPTH_TEST);
+
+    // Sharpening only makes up for the blur of stretching; at full scale it is a straight copy
+    float stretch = (float)resolution.windowWidth / resolution.width - 1.0f;
+    float sharpness = resolution.sharpness * max(0.0f, min(1.0f, stretch));
+
+    glUseProgram(resolution.programId);
+    glUniform2f(glGetUniformLocation(resolution.programId, "uRenderedSize"),
+        (float)resolution.width / resolution.targetWidth, (float)resolution.height / resolution.targetHeight);
+    glUniform2f(glGetUniformLocation(resolution.programId, "uTexelSize"), 1.0f / resolution.targetWidth, 1.0f / resolution.targetHeight);
+    glUniform1f(glGetUniformLocation(resolution.programId, "uSharpness"), sharpness);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, resolution.color);
+    glBindVertexArray(resolution.emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glEnable(GL_DEPTH_TEST);
+}
+
+void UEndDynamicResolutionFrame(UDynamicResolution& resolution, float cpuFrameMs)
+{
+    if (resolution.queryActive)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        resolution.queryPending[resolution.nextQuery] = true;
+        resolution.nextQuery = (resolution.nextQuery + 1) % UDYNRES_TIMER_QUERIES;
+        resolution.queryActive = false;
+    }
+    else if (!resolution.timerQueries && cpuFrameMs > 0.0f)
+        UAddFrameTime(resolution, cpuFrameMs);
+}
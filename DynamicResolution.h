@@ -0,0 +1,60 @@
+#pragma once
+#include <GL/glew.h>    // GLEW library
+
+#include "GpuResources.h"
+
+const int UDYNRES_TIMER_QUERIES = 4;    // frames the GPU may be behind before one goes untimed
+
+// Dynamic resolution: the scene is drawn into an offscreen target at a fraction of the window size
+// and stretched back up with a light sharpening filter. The fraction follows the measured GPU frame
+// time, so a heavy view costs resolution instead of frame rate.
+// Targets are allocated once at maxScale x window size; a lower scale only renders into the lower
+// left part of them, so changing it costs nothing.
+struct UDynamicResolution
+{
+    // Settings
+    float targetMs;         // GPU time per frame to aim for
+    float minScale;         // per axis, of the window size
+    float maxScale;
+    float sharpness;        // 0 = plain bilinear stretch, 1 = strongest
+
+    // Current state
+    float scale;
+    int windowWidth;
+    int windowHeight;
+    int width;              // rendered part of the targets
+    int height;
+    int targetWidth;        // allocated size
+    int targetHeight;
+
+    UGpuFramebuffer fbo;
+    UGpuTexture color;      // RGBA8, linear filtered for the upscale
+    UGpuTexture depth;      // 24 bit depth + 8 bit stencil, like the window, so Hi-Z can blit it
+    GLuint programId;       // upscale + sharpen
+    UGpuVertexArray emptyVao; // the fullscreen triangle is made from gl_VertexID
+
+    // GPU timing: GL_TIME_ELAPSED around whole frames, collected a few frames later without waiting
+    bool timerQueries;      // false falls back to the CPU frame time
+    UGpuQuery queries[UDYNRES_TIMER_QUERIES];
+    bool queryPending[UDYNRES_TIMER_QUERIES];
+    float queryScale[UDYNRES_TIMER_QUERIES]; // scale the frame was rendered at
+    int nextQuery;
+    bool queryActive;
+    float frameMs;          // smoothed measurement the controller steers with
+    int framesSinceChange;
+};
+
+// Settings must be filled in first
+bool UCreateDynamicResolution(UDynamicResolution& resolution);
+void UDestroyDynamicResolution(UDynamicResolution& resolution);
+
+// Starts a frame for a window of this size: collects finished timings, picks this frame's scale
+// and begins timing it. Returns false when the frame should go straight to the window instead
+// (minimized, or the targets could not be made).
+bool UBeginDynamicResolutionFrame(UDynamicResolution& resolution, int windowWidth, int windowHeight);
+// Binds the offscreen target with a viewport covering the rendered part
+void UBindSceneTarget(const UDynamicResolution& resolution);
+// Stretches the rendered part over the whole window, leaving the window framebuffer bound
+void UPresentSceneTarget(const UDynamicResolution& resolution);
+// Stops timing the frame; cpuFrameMs is only used without timer queries
+void UEndDynamicResolutionFrame(UDynamicResolution& resolution, float cpuFrameMs);
@@ -0,0 +1,262 @@
+#include <atomic>       // std::atomic
+#include <cstdint>      // uintptr_t
+#include <cstdlib>      // malloc, free
+#include <cstring>      // memset
+#include <mutex>        // std::mutex
+#include <vector>       // std::vector
+#include <algorithm>    // find
+#include "FrameArena.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Plain counters, so operator new can use them before and after any constructor has run
+    atomic<unsigned long long> gHeapAllocations(0);
+    thread_local unsigned long long tHeapAllocations = 0;
+
+    void UCountHeapAllocation()
+    {
+        gHeapAllocations.fetch_add(1, memory_order_relaxed);
+        ++tHeapAllocations;
+    }
+
+    // Heap fallback for a frame that outgrew its arena, chained so the reset can free it
+    struct UOverflowBlock
+    {
+        UOverflowBlock* next;
+    };
+
+    struct UArena
+    {
+        unsigned char* memory;
+        size_t used;
+        UOverflowBlock* overflow;
+    };
+
+    struct UThreadArenas;
+
+    atomic<unsigned long long> gFrame(0);
+    atomic<size_t> gArenaSize(UFRAME_ARENA_DEFAULT_SIZE);
+    mutex gRegistryLock;
+    vector<UThreadArenas*> gRegistry;
+
+    void UReleaseArena(UArena& arena)
+    {
+#if UFRAME_ARENA_POISON
+        if (arena.memory)
+            memset(arena.memory, 0xDD, arena.used);
+#endif
+        arena.used = 0;
+        while (arena.overflow)
+        {
+            UOverflowBlock* next = arena.overflow->next;
+            free(arena.overflow);
+            arena.overflow = next;
+        }
+    }
+
+    struct UThreadArenas
+    {
+        UArena arenas[2];
+        int current;
+        unsigned long long frame;
+        size_t capacity;
+
+        // Read by UGetFrameArenaStats from other threads
+        atomic<size_t> bytesUsed;
+        atomic<size_t> peakBytes;
+        atomic<size_t> nOverflows;
+
+        UThreadArenas() : arenas(), current(0), frame(0), capacity(0), bytesUsed(0), peakBytes(0), nOverflows(0) {}
+
+        ~UThreadArenas()
+        {
+            if (!arenas[0].memory)
+                return;
+            {
+                lock_guard<mutex> guard(gRegistryLock);
+                gRegistry.erase(find(gRegistry.begin(), gRegistry.end(), this));
+            }
+            for (UArena& arena : arenas)
+            {
+                UReleaseArena(arena);
+                delete[] arena.memory;
+            }
+        }
+    };
+
+    thread_local UThreadArenas tArenas;
+
+    // First allocation on a thread: its two arenas are the only heap memory it ever takes here
+    void UCreateArenas(UThreadArenas& arenas)
+    {
+        arenas.capacity = gArenaSize.load(memory_order_relaxed);
+        for (UArena& arena : arenas.arenas)
+        {
+            arena.memory = new unsigned char[arenas.capacity];
+            arena.used = 0;
+            arena.overflow = nullptr;
+        }
+        arenas.frame = gFrame.load(memory_order_relaxed);
+        lock_guard<mutex> guard(gRegistryLock);
+        gRegistry.push_back(&arenas);
+    }
+
+    void* UAllocOverflow(UArena& arena, size_t bytes, size_t alignment)
+    {
+        UOverflowBlock* block = (UOverflowBlock*)malloc(sizeof(UOverflowBlock) + bytes + alignment);
+        if (!block)
+            throw bad_alloc();
+        UCountHeapAllocation();
+        block->next = arena.overflow;
+        arena.overflow = block;
+        uintptr_t start = (uintptr_t)(block + 1);
+        return (void*)((start + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+}
+
+
+void USetFrameArenaSize(size_t bytes)
+{
+    gArenaSize = bytes;
+}
+
+void UBeginFrameArenas()
+{
+    gFrame.fetch_add(1, memory_order_relaxed);
+}
+
+void* UFrameAlloc(size_t bytes, size_t alignment)
+{
+    UThreadArenas& arenas = tArenas;
+    if (!arenas.arenas[0].memory)
+        UCreateArenas(arenas);
+
+    // New frame on this thread: the arena two frames back is free again
+    unsigned long long frame = gFrame.load(memory_order_relaxed);
+    if (arenas.frame != frame)
+    {
+        arenas.frame = frame;
+        arenas.current ^= 1;
+        UReleaseArena(arenas.arenas[arenas.current]);
+        arenas.bytesUsed.store(0, memory_order_relaxed);
+    }
+
+    if (alignment == 0)
+        alignment = 1;
+    UArena& arena = arenas.arenas[arenas.current];
+    uintptr_t base = (uintptr_t)arena.memory;
+    uintptr_t start = (base + arena.used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    void* memory;
+    if (start + bytes <= base + arenas.capacity)
+    {
+        arena.used = start + bytes - base;
+        memory = (void*)start;
+    }
+    else
+    {
+        memory = UAllocOverflow(arena, bytes, alignment);
+        arenas.nOverflows.fetch_add(1, memory_order_relaxed);
+    }
+
+    size_t used = arenas.bytesUsed.load(memory_order_relaxed) + bytes;
+    arenas.bytesUsed.store(used, memory_order_relaxed);
+    if (used > arenas.peakBytes.load(memory_order_relaxed))
+        arenas.peakBytes.store(used, memory_order_relaxed);
+    return memory;
+}
+
+void UFrameFree(void* memory, size_t bytes)
+{
+#if UFRAME_ARENA_POISON
+    if (memory)
+        memset(memory, 0xDD, bytes);
+#else
+    (void)memory;
+    (void)bytes;
+#endif
+}
+
+void UGetFrameArenaStats(UFrameArenaStats& stats)
+{
+    stats = UFrameArenaStats();
+    stats.capacity = gArenaSize.load(memory_order_relaxed);
+    lock_guard<mutex> guard(gRegistryLock);
+    stats.nThreads = gRegistry.size();
+    for (const UThreadArenas* arenas : gRegistry)
+    {
+        stats.bytesUsed += arenas->bytesUsed.load(memory_order_relaxed);
+        size_t peak = arenas->peakBytes.load(memory_order_relaxed);
+        stats.peakBytes = peak > stats.peakBytes ? peak : stats.peakBytes;
+        stats.nOverflows += arenas->nOverflows.load(memory_order_relaxed);
+    }
+}
+
+
+unsigned long long UHeapAllocations()
+{
+    return gHeapAllocations.load(memory_order_relaxed);
+}
+
+unsigned long long UThreadHeapAllocations()
+{
+    return tHeapAllocations;
+}
+
+
+// Replacement global allocation functions: the heap as before, but every allocation is counted
+void* operator new(size_t size)
+{
+    UCountHeapAllocation();
+    void* memory = malloc(size ? size : 1);
+    if (!memory)
+        throw bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    UCountHeapAllocation();
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+    return operator new(size, nothrow);
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, const nothrow_t&) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, const nothrow_t&) noexcept
+{
+    free(memory);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>      // size_t
+#include <new>          // bad_alloc
+#include <vector>       // std::vector
+
+/* Per-frame scratch memory. Every thread that allocates gets two bump-pointer arenas of its own and
+ * alternates between them frame by frame, so an allocation stays valid for the frame it was made in
+ * and the one after (long enough to hand a list to next frame's upload), then its memory is reused
+ * without ever going back to the heap. Nothing is freed individually; a frame that needs more than
+ * its arena falls back to the heap and the overflow shows up in the stats.
+ *
+ * With UFRAME_ARENA_POISON (on in debug builds) released and recycled memory is filled with 0xDD, so
+ * anything still pointing into an old frame reads garbage instead of plausible data.
+ */
+#ifndef UFRAME_ARENA_POISON
+#ifdef _DEBUG
+#define UFRAME_ARENA_POISON 1
+#else
+#define UFRAME_ARENA_POISON 0
+#endif
+#endif
+
+const size_t UFRAME_ARENA_DEFAULT_SIZE = 1024 * 1024; // bytes per arena, two per thread
+
+// Size of the arenas threads create from now on
+void USetFrameArenaSize(size_t bytes);
+// Starts a new frame for every thread; call once per frame on the main thread
+void UBeginFrameArenas();
+
+// Scratch memory on the calling thread's arena for this frame
+void* UFrameAlloc(size_t bytes, size_t alignment);
+// Only poisons; the memory comes back when the arena is reused
+void UFrameFree(void* memory, size_t bytes);
+
+struct UFrameArenaStats
+{
+    size_t nThreads;        // threads that have arenas
+    size_t capacity;        // per arena
+    size_t bytesUsed;       // all threads, current frame
+    size_t peakBytes;       // high-water mark of one thread's frame
+    size_t nOverflows;      // allocations that had to go to the heap, ever
+};
+
+void UGetFrameArenaStats(UFrameArenaStats& stats);
+
+// Heap allocations through operator new, counted by the replacement operators in FrameArena.cpp
+unsigned long long UHeapAllocations();          // every thread
+unsigned long long UThreadHeapAllocations();    // the calling thread
+
+// Standard allocator on top of the frame arenas, for containers that live for one frame
+template <typename T>
+struct UFrameAllocator
+{
+    typedef T value_type;
+
+    UFrameAllocator() {}
+    template <typename U>
+    UFrameAllocator(const UFrameAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        if (n > (size_t)-1 / sizeof(T))
+            throw std::bad_alloc();
+        return (T*)UFrameAlloc(n * sizeof(T), alignof(T));
+    }
+    void deallocate(T* memory, size_t n) { UFrameFree(memory, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator==(const UFrameAllocator<T>&, const UFrameAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const UFrameAllocator<T>&, const UFrameAllocator<U>&) { return false; }
+
+template <typename T>
+using UFrameVector = std::vector<T, UFrameAllocator<T>>;
@@ -0,0 +1,343 @@
+#include <iostream>     // cout, cerr
+#include <iomanip>      // setprecision
+#include <chrono>       // steady_clock
+#include <cstring>      // strlen
+#include "FrameCapture.h"
+#include "Profiler.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UCAPTURE_SSE2 1
+#include <emmintrin.h>  // SSE2
+#endif
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // BT.709 limited range in 8.8 fixed point. Every intermediate stays inside 0..65535, so the SSE2
+    // path can use plain wrapping 16 bit arithmetic.
+    const int Y_R = 47, Y_G = 157, Y_B = 16;
+    const int U_R = 26, U_G = 86, U_B = 112;     // U = 128 + (-26 R - 86 G + 112 B) / 256
+    const int V_R = 112, V_G = 102, V_B = 10;    // V = 128 + (112 R - 102 G - 10 B) / 256
+    const int CHROMA_BIAS = 128 * 256 + 128;
+
+    inline uint8_t ULuma(int r, int g, int b)
+    {
+        return (uint8_t)(((Y_R * r + Y_G * g + Y_B * b + 128) >> 8) + 16);
+    }
+
+    // Two source rows into one row of chroma and two rows of luma
+    void UConvertRowPairScalar(const uint8_t* row0, const uint8_t* row1, int x, int width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+    {
+        for (; x < width; x += 2)
+        {
+            const uint8_t* p[4] = { row0 + x * 4, row0 + x * 4 + 4, row1 + x * 4, row1 + x * 4 + 4 };
+            y0[x] = ULuma(p[0][0], p[0][1], p[0][2]);
+            y0[x + 1] = ULuma(p[1][0], p[1][1], p[1][2]);
+            y1[x] = ULuma(p[2][0], p[2][1], p[2][2]);
+            y1[x + 1] = ULuma(p[3][0], p[3][1], p[3][2]);
+            int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+            int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+            int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+            u[x / 2] = (uint8_t)((U_B * b - U_R * r - U_G * g + CHROMA_BIAS) >> 8);
+            v[x / 2] = (uint8_t)((V_R * r - V_G * g - V_B * b + CHROMA_BIAS) >> 8);
+        }
+    }
+
+#ifdef UCAPTURE_SSE2
+    // 8 RGBA pixels as three vectors of 16 bit channels
+    inline void ULoadChannels(const uint8_t* pixels, __m128i& r, __m128i& g, __m128i& b)
+    {
+        const __m128i mask = _mm_set1_epi32(0xFF);
+        __m128i first = _mm_loadu_si128((const __m128i*)pixels);
+        __m128i second = _mm_loadu_si128((const __m128i*)(pixels + 16));
+        r = _mm_packs_epi32(_mm_and_si128(first, mask), _mm_and_si128(second, mask));
+        g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(first, 8), mask), _mm_and_si128(_mm_srli_epi32(second, 8), mask));
+        b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(first, 16), mask), _mm_and_si128(_mm_srli_epi32(second, 16), mask));
+    }
+
+    inline __m128i ULuma8(__m128i r, __m128i g, __m128i b)
+    {
+        __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(Y_R)), _mm_mullo_epi16(g, _mm_set1_epi16(Y_G)));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(Y_B)), _mm_set1_epi16(128)));
+        return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+    }
+
+    // Sum of a 2x2 block per pair of lanes, rounded average in the low 4 lanes
+    inline __m128i UBlockAverage(__m128i top, __m128i bottom)
+    {
+        __m128i pairs = _mm_madd_epi16(_mm_add_epi16(top, bottom), _mm_set1_epi16(1));
+        pairs = _mm_srli_epi32(_mm_add_epi32(pairs, _mm_set1_epi32(2)), 2);
+        return _mm_packs_epi32(pairs, pairs);
+    }
+
+    int UConvertRowPairSse2(const uint8_t* row0, const uint8_t* row1, int width, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i r0, g0, b0, r1, g1, b1;
+            ULoadChannels(row0 + x * 4, r0, g0, b0);
+            ULoadChannels(row1 + x * 4, r1, g1, b1);
+            _mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(ULuma8(r0, g0, b0), zero));
+            _mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(ULuma8(r1, g1, b1), zero));
+
+            __m128i r = UBlockAverage(r0, r1), g = UBlockAverage(g0, g1), b = UBlockAverage(b0, b1);
+            __m128i bias = _mm_set1_epi16((short)CHROMA_BIAS);
+            __m128i cb = _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(U_B)), bias);
+            cb = _mm_sub_epi16(cb, _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(U_R)), _mm_mullo_epi16(g, _mm_set1_epi16(U_G))));
+            __m128i cr = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(V_R)), bias);
+            cr = _mm_sub_epi16(cr, _mm_add_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(V_G)), _mm_mullo_epi16(b, _mm_set1_epi16(V_B))));
+            int packedU = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_srli_epi16(cb, 8), zero));
+            int packedV = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_srli_epi16(cr, 8), zero));
+            memcpy(u + x / 2, &packedU, 4);
+            memcpy(v + x / 2, &packedV, 4);
+        }
+        return x;
+    }
+#endif
+
+    bool UWriteOutput(UFrameCapture& capture, const void* data, size_t size)
+    {
+        if (capture.pipe)
+            return fwrite(data, 1, size, capture.pipe) == size;
+        capture.file.write((const char*)data, (streamsize)size);
+        return (bool)capture.file;
+    }
+
+    void UConverterThread(UFrameCapture& capture)
+    {
+        UNameProfileThread("Capture converter");
+        size_t lumaBytes = (size_t)capture.width * capture.height;
+        size_t chromaBytes = lumaBytes / 4;
+        capture.yuv.resize(lumaBytes + chromaBytes * 2);
+        const char frameHeader[] = "FRAME\n";
+
+        for (;;)
+        {
+            int index;
+            {
+                unique_lock<mutex> guard(capture.lock);
+                capture.changed.wait(guard, [&capture]() { return !capture.ready.empty() || capture.closing; });
+                if (capture.ready.empty())
+                    return;
+                index = capture.ready.front();
+                capture.ready.pop_front();
+            }
+
+            UCaptureSlot& slot = capture.slots[index];
+            if (!capture.failed)
+            {
+                UPROFILE_ZONE("Convert and write frame");
+                auto start = chrono::steady_clock::now();
+                uint8_t* y = capture.yuv.data();
+                URgbaToYuv420(slot.mapped, capture.width, capture.height, true, y, y + lumaBytes, y + lumaBytes + chromaBytes);
+                capture.convertMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+                if (!UWriteOutput(capture, frameHeader, strlen(frameHeader)) || !UWriteOutput(capture, capture.yuv.data(), capture.yuv.size()))
+                {
+                    cerr << "Capture output failed, no further frames are written" << endl;
+                    capture.failed = true;
+                }
+            }
+            slot.state = UCaptureSlot::FREE;
+        }
+    }
+
+    // Oldest first; hands every finished readback to the converter, waiting for them only when asked
+    void UCollectReadbacks(UFrameCapture& capture, bool wait)
+    {
+        for (int n = 0; n < UCAPTURE_SLOTS; ++n)
+        {
+            UCaptureSlot& slot = capture.slots[(capture.next + n) % UCAPTURE_SLOTS];
+            if (slot.state != UCaptureSlot::READING)
+                continue;
+            GLenum status = wait ? glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) : glClientWaitSync(slot.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;  // later frames can't be done either, and frames must stay in order
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+            slot.state = UCaptureSlot::CONVERTING;
+            lock_guard<mutex> guard(capture.lock);
+            capture.ready.push_back((capture.next + n) % UCAPTURE_SLOTS);
+            capture.changed.notify_one();
+        }
+    }
+}
+
+
+void URgbaToYuv420(const uint8_t* rgba, int width, int height, bool bottomUp, uint8_t* y, uint8_t* u, uint8_t* v)
+{
+    size_t stride = (size_t)width * 4;
+    for (int row = 0; row < height; row += 2)
+    {
+        const uint8_t* row0 = rgba + stride * (bottomUp ? height - 1 - row : row);
+        const uint8_t* row1 = rgba + stride * (bottomUp ? height - 2 - row : row + 1);
+        uint8_t* y0 = y + (size_t)width * row;
+        uint8_t* y1 = y0 + width;
+        uint8_t* uRow = u + (size_t)(width / 2) * (row / 2);
+        uint8_t* vRow = v + (size_t)(width / 2) * (row / 2);
+        int x = 0;
+#ifdef UCAPTURE_SSE2
+        x = UConvertRowPairSse2(row0, row1, width, y0, y1, uRow, vRow);
+#endif
+        UConvertRowPairScalar(row0, row1, x, width, y0, y1, uRow, vRow);
+    }
+}
+
+
+bool UStartCapture(UFrameCapture& capture, int windowWidth, int windowHeight, int fps, const char* filename, const char* pipeCommand)
+{
+    // 4:2:0 needs even sizes; an odd last row or column is left out
+    capture.width = windowWidth & ~1;
+    capture.height = windowHeight & ~1;
+    capture.windowWidth = windowWidth;
+    capture.windowHeight = windowHeight;
+    if (capture.width <= 0 || capture.height <= 0)
+        return false;
+
+    capture.pipe = nullptr;
+    if (pipeCommand)
+    {
+#ifdef _WIN32
+        capture.pipe = _popen(pipeCommand, "wb");
+#else
+        capture.pipe = popen(pipeCommand, "w");
+#endif
+        if (!capture.pipe)
+        {
+            cout << "Failed to start " << pipeCommand << endl;
+            return false;
+        }
+    }
+    else
+    {
+        capture.file.open(filename, ios::binary);
+        if (!capture.file)
+        {
+            cout << "Failed to create " << filename << endl;
+            return false;
+        }
+    }
+
+    char header[128];
+    int length = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", capture.width, capture.height, fps > 0 ? fps : 60);
+    capture.failed = !UWriteOutput(capture, header, (size_t)length);
+
+    // Persistent, coherent and in client memory: the converter reads the pixels where the GPU put them
+    GLsizeiptr bytes = (GLsizeiptr)capture.width * capture.height * 4;
+    const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (UCaptureSlot& slot : capture.slots)
+    {
+        slot.pbo.Create(UGPU_STREAMING, "capture readback");
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glBufferStorage(GL_PIXEL_PACK_BUFFER, bytes, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+        slot.pbo.SetBytes((size_t)bytes);
+        slot.mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, flags);
+        slot.fence = 0;
+        slot.state = UCaptureSlot::FREE;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    for (UCaptureSlot& slot : capture.slots)
+    {
+        if (!slot.mapped)
+        {
+            cout << "Capture buffers could not be mapped" << endl;
+            capture.active = true;
+            UStopCapture(capture);
+            return false;
+        }
+    }
+
+    capture.next = 0;
+    capture.closing = false;
+    capture.ready.clear();
+    capture.nFrames = capture.nDropped = capture.nSkipped = 0;
+    capture.captureMs = capture.convertMs = 0.0;
+    capture.thread = thread(UConverterThread, ref(capture));
+    capture.active = true;
+    cout << "INFO: Capturing " << capture.width << "x" << capture.height << " to " << (pipeCommand ? pipeCommand : filename) << endl;
+    return true;
+}
+
+
+void UCaptureFrame(UFrameCapture& capture, int windowWidth, int windowHeight)
+{
+    if (!capture.active)
+        return;
+    auto start = chrono::steady_clock::now();
+
+    UCollectReadbacks(capture, false);
+
+    UCaptureSlot& slot = capture.slots[capture.next];
+    if (windowWidth != capture.windowWidth || windowHeight != capture.windowHeight)
+        ++capture.nSkipped;
+    else if (slot.state != UCaptureSlot::FREE)
+        ++capture.nDropped;     // the GPU or the converter is a whole ring behind; waiting would stall the frame
+    else
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadBuffer(GL_BACK);
+        glReadPixels(0, 0, capture.width, capture.height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.state = UCaptureSlot::READING;
+        capture.next = (capture.next + 1) % UCAPTURE_SLOTS;
+        ++capture.nFrames;
+    }
+
+    capture.captureMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+void UStopCapture(UFrameCapture& capture)
+{
+    if (!capture.active)
+        return;
+    capture.active = false;
+
+    if (capture.thread.joinable())
+    {
+        UCollectReadbacks(capture, true);
+        {
+            lock_guard<mutex> guard(capture.lock);
+            capture.closing = true;
+            capture.changed.notify_one();
+        }
+        capture.thread.join();
+    }
+
+    for (UCaptureSlot& slot : capture.slots)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        slot.fence = 0;
+        if (slot.mapped)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            slot.mapped = nullptr;
+        }
+        slot.pbo.Reset();
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (capture.pipe)
+    {
+#ifdef _WIN32
+        _pclose(capture.pipe);
+#else
+        pclose(capture.pipe);
+#endif
+        capture.pipe = nullptr;
+    }
+    else
+        capture.file.close();
+
+    size_t nWritten = capture.nFrames;
+    cout << "INFO: Captured " << nWritten << " frames, " << capture.nDropped << " dropped, " << capture.nSkipped << " at another size; "
+        << fixed << setprecision(3) << (nWritten ? capture.captureMs / (nWritten + capture.nDropped + capture.nSkipped) : 0.0) << " ms per frame on the render thread, "
+        << (nWritten ? capture.convertMs / nWritten : 0.0) << " ms per frame converting" << endl;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdio>       // FILE
+#include <cstdint>      // uint8_t
+#include <atomic>       // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <deque>        // std::deque
+#include <fstream>      // std::ofstream
+#include <mutex>        // std::mutex
+#include <thread>       // std::thread
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+#include "GpuResources.h"
+
+const int UCAPTURE_SLOTS = 6;   // frames between a readback being issued and the converter being done with it
+
+// One persistently mapped pixel pack buffer. The main thread owns it while it is free or the GPU is
+// writing it; once the fence has signaled the converter thread reads straight from the mapping and
+// hands it back when the frame is written.
+struct UCaptureSlot
+{
+    enum State { FREE, READING, CONVERTING };
+
+    UGpuBuffer pbo;
+    const unsigned char* mapped;
+    GLsync fence;
+    std::atomic<int> state;
+};
+
+// Walkthrough capture to Y4M (YUV 4:2:0, BT.709 limited range), either a file or the stdin of an
+// encoder process such as "ffmpeg -i - walkthrough.mp4". Every rendered frame becomes one video frame;
+// when the GPU or the converter falls UCAPTURE_SLOTS frames behind, frames are dropped rather than
+// stalling the render loop.
+struct UFrameCapture
+{
+    bool active;
+    int width;              // even, fixed for the whole capture
+    int height;
+    int windowWidth;        // framebuffer size it was started with
+    int windowHeight;
+
+    UCaptureSlot slots[UCAPTURE_SLOTS];
+    int next;               // the slot the next frame is read into, also the oldest one in use
+
+    // Converter thread
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<int> ready;  // slots in frame order
+    bool closing;
+    std::vector<uint8_t> yuv;
+
+    // Output: a file, or an encoder process reading Y4M from a pipe
+    std::ofstream file;
+    FILE* pipe;
+    bool failed;
+
+    // Stats
+    size_t nFrames;
+    size_t nDropped;
+    size_t nSkipped;        // frames at another size after a resize
+    double captureMs;       // main thread time spent in UCaptureFrame
+    double convertMs;       // converter thread time spent converting
+};
+
+// Starts capturing a framebuffer of this size; pipeCommand wins over filename when both are set
+bool UStartCapture(UFrameCapture& capture, int windowWidth, int windowHeight, int fps, const char* filename, const char* pipeCommand);
+// Call once the frame is complete in the window's back buffer, before the swap
+void UCaptureFrame(UFrameCapture& capture, int windowWidth, int windowHeight);
+// Writes every frame still in flight, then closes the output
+void UStopCapture(UFrameCapture& capture);
+
+// RGBA8 to planar YUV 4:2:0, chroma averaged over each 2x2 block. Width and height must be even.
+// bottomUp takes rows in GL order. SSE2 when the compiler targets it, scalar otherwise.
+void URgbaToYuv420(const uint8_t* rgba, int width, int height, bool bottomUp, uint8_t* y, uint8_t* u, uint8_t* v);
@@ -0,0 +1,610 @@
+#include <iostream>     // cout, cerr
+#include <cstdlib>      // strtol
+#include <cstring>      // memcpy
+#include "Gltf.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const uint32_t GLB_MAGIC = 0x46546C67;      // "glTF"
+    const uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+    const uint32_t GLB_CHUNK_BIN = 0x004E4942;  // "BIN\0"
+
+    uint32_t UReadU32(const unsigned char* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    int UComponentSize(GLenum componentType)
+    {
+        switch (componentType)
+        {
+        case GL_BYTE: case GL_UNSIGNED_BYTE: return 1;
+        case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT: case GL_FLOAT: return 4;
+        default: return 0;
+        }
+    }
+
+    // Byte counts and offsets: false for negative or fractional values and ones too big to be exact
+    bool USizeOr(const UJsonValue& value, const char* key, size_t fallback, size_t& out)
+    {
+        double number = value.NumberOr(key, (double)fallback);
+        if (!(number >= 0.0 && number <= 9007199254740992.0) || number != (double)(size_t)number)
+            return false;
+        out = (size_t)number;
+        return true;
+    }
+
+    int UComponentCount(const string& type)
+    {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        if (type == "MAT2") return 4;
+        if (type == "MAT3") return 9;
+        if (type == "MAT4") return 16;
+        return 0;
+    }
+
+    glm::mat4 UFromQuaternion(float x, float y, float z, float w)
+    {
+        glm::mat4 m(1.0f);
+        m[0][0] = 1.0f - 2.0f * (y * y + z * z);
+        m[0][1] = 2.0f * (x * y + z * w);
+        m[0][2] = 2.0f * (x * z - y * w);
+        m[1][0] = 2.0f * (x * y - z * w);
+        m[1][1] = 1.0f - 2.0f * (x * x + z * z);
+        m[1][2] = 2.0f * (y * z + x * w);
+        m[2][0] = 2.0f * (x * z + y * w);
+        m[2][1] = 2.0f * (y * z - x * w);
+        m[2][2] = 1.0f - 2.0f * (x * x + y * y);
+        return m;
+    }
+
+    // Reads a JSON number array of the expected size into out
+    bool UReadNumbers(const UJsonValue* value, float* out, size_t count)
+    {
+        if (!value || value->type != UJsonValue::JSON_ARRAY || value->array.size() != count)
+            return false;
+        for (size_t i = 0; i < count; ++i)
+            out[i] = (float)value->array[i].number;
+        return true;
+    }
+
+    void UAppendPrimitive(const UMeshData& primitive, const glm::mat4& world, bool keepNormals, bool keepUvs, bool keepTangents, UMeshData& data)
+    {
+        uint32_t baseVertex = (uint32_t)data.positions.size();
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+        glm::mat3 tangentMatrix(world);
+
+        for (size_t i = 0; i < primitive.positions.size(); ++i)
+        {
+            data.positions.push_back(glm::vec3(world * glm::vec4(primitive.positions[i], 1.0f)));
+            if (keepNormals)
+                data.normals.push_back(glm::normalize(normalMatrix * primitive.normals[i]));
+            if (keepUvs)
+                data.uvs.push_back(primitive.uvs[i]);
+            if (keepTangents)
+                data.tangents.push_back(glm::vec4(glm::normalize(tangentMatrix * glm::vec3(primitive.tangents[i])), primitive.tangents[i].w));
+        }
+        for (uint32_t index : primitive.indices)
+            data.indices.push_back(baseVertex + index);
+    }
+
+    struct UPrimitiveInstance
+    {
+        const UJsonValue* primitive;
+        glm::mat4 world;
+    };
+
+    void UCollectInstances(const UGltfDocument& document, int nodeIndex, const glm::mat4& parent, vector<UPrimitiveInstance>& instances, int depth)
+    {
+        const UJsonValue* nodes = document.json.Find("nodes");
+        if (!nodes || nodeIndex < 0 || nodeIndex >= (int)nodes->array.size() || depth > 64)
+            return;
+
+        const UJsonValue& node = nodes->array[nodeIndex];
+        glm::mat4 world = parent * UGltfNodeMatrix(node);
+
+        const UJsonValue* meshes = document.json.Find("meshes");
+        int meshIndex = node.IntOr("mesh", -1);
+        if (meshes && meshIndex >= 0 && meshIndex < (int)meshes->array.size())
+        {
+            const UJsonValue* primitives = meshes->array[meshIndex].Find("primitives");
+            if (primitives)
+            {
+                for (const UJsonValue& primitive : primitives->array)
+                    instances.push_back({ &primitive, world });
+            }
+        }
+
+        const UJsonValue* children = node.Find("children");
+        if (children)
+        {
+            for (const UJsonValue& child : children->array)
+                UCollectInstances(document, (int)child.number, world, instances, depth + 1);
+        }
+    }
+}
+
+string UGltfResolveUri(const UGltfDocument& document, const string& uri)
+{
+    string decoded;
+    for (size_t i = 0; i < uri.size(); ++i)
+    {
+        if (uri[i] == '%' && i + 2 < uri.size())
+        {
+            decoded += (char)strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        }
+        else
+            decoded += uri[i];
+    }
+    return document.baseDirectory + decoded;
+}
+
+bool UDecodeBase64(const char* text, size_t length, vector<unsigned char>& out)
+{
+    auto decode = [](char c) -> int
+    {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+' || c == '-') return 62;
+        if (c == '/' || c == '_') return 63;
+        return -1;
+    };
+
+    out.clear();
+    out.reserve(length / 4 * 3);
+    uint32_t accumulator = 0;
+    int bits = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (text[i] == '=')
+            break;
+        int value = decode(text[i]);
+        if (value < 0)
+            return false;
+        accumulator = (accumulator << 6) | (uint32_t)value;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out.push_back((unsigned char)((accumulator >> bits) & 0xff));
+        }
+    }
+    return true;
+}
+
+bool ULoadGltfDocument(const char* filename, UGltfDocument& document)
+{
+    document = UGltfDocument();
+
+    string path(filename);
+    size_t slash = path.find_last_of("/\\");
+    document.baseDirectory = slash == string::npos ? string() : path.substr(0, slash + 1);
+
+    UMappedFile file;
+    if (!UMapFile(filename, file))
+    {
+        cout << "Failed to open glTF " << filename << endl;
+        return false;
+    }
+    document.mappedFiles.push_back(file);
+
+    // Binary container: header + JSON chunk + optional BIN chunk
+    const unsigned char* json = file.data;
+    size_t jsonLength = file.size;
+    const unsigned char* binChunk = nullptr;
+    size_t binLength = 0;
+    if (file.size >= 12 && UReadU32(file.data) == GLB_MAGIC)
+    {
+        size_t offset = 12;
+        json = nullptr;
+        while (offset + 8 <= file.size)
+        {
+            uint32_t chunkLength = UReadU32(file.data + offset);
+            uint32_t chunkType = UReadU32(file.data + offset + 4);
+            if (offset + 8 + chunkLength > file.size)
+                break;
+            if (chunkType == GLB_CHUNK_JSON && !json)
+            {
+                json = file.data + offset + 8;
+                jsonLength = chunkLength;
+            }
+            else if (chunkType == GLB_CHUNK_BIN && !binChunk)
+            {
+                binChunk = file.data + offset + 8;
+                binLength = chunkLength;
+            }
+            offset += 8 + ((chunkLength + 3) & ~3u);
+        }
+        if (!json)
+        {
+            cout << "glTF " << filename << " has no JSON chunk" << endl;
+            UFreeGltfDocument(document);
+            return false;
+        }
+    }
+
+    string error;
+    if (!UParseJson((const char*)json, jsonLength, document.json, error))
+    {
+        cout << "Failed to parse glTF " << filename << ": " << error << endl;
+        UFreeGltfDocument(document);
+        return false;
+    }
+
+    // Buffers: the GLB BIN chunk, external files (mapped) or base64 data URIs
+    const UJsonValue* buffers = document.json.Find("buffers");
+    if (buffers)
+    {
+        for (size_t i = 0; i < buffers->array.size(); ++i)
+        {
+            const UJsonValue& buffer = buffers->array[i];
+            string uri = buffer.StringOr("uri", "");
+            UGltfBuffer loaded = { nullptr, 0, vector<unsigned char>() };
+
+            if (uri.empty())
+            {
+                loaded.data = binChunk;
+                loaded.size = binLength;
+            }
+            else if (uri.compare(0, 5, "data:") == 0)
+            {
+                size_t comma = uri.find(',');
+                if (comma == string::npos || !UDecodeBase64(uri.c_str() + comma + 1, uri.size() - comma - 1, loaded.owned))
+                {
+                    cout << "Bad data URI in buffer " << i << endl;
+                    UFreeGltfDocument(document);
+                    return false;
+                }
+                loaded.size = loaded.owned.size();
+            }
+            else
+            {
+                UMappedFile bufferFile;
+                string bufferPath = UGltfResolveUri(document, uri);
+                if (!UMapFile(bufferPath.c_str(), bufferFile))
+                {
+                    cout << "Failed to open glTF buffer " << bufferPath << endl;
+                    UFreeGltfDocument(document);
+                    return false;
+                }
+                document.mappedFiles.push_back(bufferFile);
+                loaded.data = bufferFile.data;
+                loaded.size = bufferFile.size;
+            }
+
+            size_t declared = (size_t)buffer.NumberOr("byteLength", 0.0);
+            if (loaded.size < declared)
+            {
+                cout << "glTF buffer " << i << " is shorter than its byteLength" << endl;
+                UFreeGltfDocument(document);
+                return false;
+            }
+            document.buffers.push_back(loaded);
+        }
+
+        // Owned data only gets its final address once the vector stopped growing
+        for (UGltfBuffer& buffer : document.buffers)
+        {
+            if (!buffer.owned.empty())
+                buffer.data = buffer.owned.data();
+        }
+    }
+
+    return true;
+}
+
+void UFreeGltfDocument(UGltfDocument& document)
+{
+    for (UMappedFile& file : document.mappedFiles)
+        UUnmapFile(file);
+    document.mappedFiles.clear();
+    document.buffers.clear();
+}
+
+bool UGltfGetAccessor(const UGltfDocument& document, int accessorIndex, UGltfAccessor& accessor)
+{
+    const UJsonValue* accessors = document.json.Find("accessors");
+    const UJsonValue* bufferViews = document.json.Find("bufferViews");
+    if (!accessors || accessorIndex < 0 || accessorIndex >= (int)accessors->array.size())
+        return false;
+
+    const UJsonValue& description = accessors->array[accessorIndex];
+    if (description.Find("sparse"))
+    {
+        cout << "Sparse glTF accessors are not supported" << endl;
+        return false;
+    }
+
+    if (!USizeOr(description, "count", 0, accessor.count))
+        return false;
+    accessor.components = UComponentCount(description.StringOr("type", ""));
+    accessor.componentType = (GLenum)description.IntOr("componentType", 0);
+    accessor.normalized = description.BoolOr("normalized", false);
+
+    int componentSize = UComponentSize(accessor.componentType);
+    int viewIndex = description.IntOr("bufferView", -1);
+    if (!bufferViews || componentSize == 0 || accessor.components == 0 || viewIndex < 0 || viewIndex >= (int)bufferViews->array.size())
+        return false;
+
+    const UJsonValue& view = bufferViews->array[viewIndex];
+    int bufferIndex = view.IntOr("buffer", -1);
+    if (bufferIndex < 0 || bufferIndex >= (int)document.buffers.size())
+        return false;
+
+    size_t elementSize = (size_t)componentSize * accessor.components;
+    size_t viewOffset, viewLength, offset;
+    if (!USizeOr(view, "byteStride", 0, accessor.stride) || !USizeOr(view, "byteOffset", 0, viewOffset)
+        || !USizeOr(view, "byteLength", 0, viewLength) || !USizeOr(description, "byteOffset", 0, offset))
+        return false;
+    if (accessor.stride == 0)
+        accessor.stride = elementSize;
+    const UGltfBuffer& buffer = document.buffers[bufferIndex];
+
+    // Bounds check once here so the readers don't have to. Term by term, so hostile counts and
+    // strides can't wrap the sum around
+    bool inside = viewOffset <= buffer.size && viewLength <= buffer.size - viewOffset;
+    if (inside && accessor.count > 0)
+    {
+        inside = offset <= viewLength && elementSize <= viewLength - offset
+            && accessor.count - 1 <= (viewLength - offset - elementSize) / accessor.stride;
+    }
+    if (!inside)
+    {
+        cout << "glTF accessor " << accessorIndex << " runs past its buffer" << endl;
+        return false;
+    }
+
+    accessor.data = buffer.data + viewOffset + offset;
+    return true;
+}
+
+bool UGltfGetAttribute(const UGltfDocument& document, const UJsonValue& attributes, const char* name, int components, size_t count,
+    UGltfAccessor& accessor, bool& present)
+{
+    present = attributes.Find(name) != nullptr;
+    if (!present)
+        return true;
+    if (!UGltfGetAccessor(document, attributes.IntOr(name, -1), accessor) || accessor.components != components || accessor.count != count)
+    {
+        cout << "glTF " << name << " attribute needs " << count << " elements of " << components << " components" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool UGltfDefaultScene(const UGltfDocument& document, const UJsonValue*& scene)
+{
+    scene = nullptr;
+    const UJsonValue* scenes = document.json.Find("scenes");
+    if (!scenes || scenes->array.empty())
+        return true;
+
+    int sceneIndex = document.json.IntOr("scene", 0);
+    if (sceneIndex < 0 || sceneIndex >= (int)scenes->array.size())
+    {
+        cout << "glTF default scene " << sceneIndex << " does not exist" << endl;
+        return false;
+    }
+    scene = &scenes->array[sceneIndex];
+    return true;
+}
+
+float UGltfReadFloat(const UGltfAccessor& accessor, size_t element, int component)
+{
+    const unsigned char* p = accessor.data + element * accessor.stride;
+    switch (accessor.componentType)
+    {
+    case GL_FLOAT:
+    {
+        float value;
+        memcpy(&value, p + component * 4, sizeof(value));
+        return value;
+    }
+    case GL_UNSIGNED_BYTE:
+    {
+        float value = p[component];
+        return accessor.normalized ? value / 255.0f : value;
+    }
+    case GL_BYTE:
+    {
+        float value = (signed char)p[component];
+        return accessor.normalized ? glm::max(value / 127.0f, -1.0f) : value;
+    }
+    case GL_UNSIGNED_SHORT:
+    {
+        uint16_t value;
+        memcpy(&value, p + component * 2, sizeof(value));
+        return accessor.normalized ? value / 65535.0f : (float)value;
+    }
+    case GL_SHORT:
+    {
+        int16_t value;
+        memcpy(&value, p + component * 2, sizeof(value));
+        return accessor.normalized ? glm::max(value / 32767.0f, -1.0f) : (float)value;
+    }
+    case GL_UNSIGNED_INT:
+    {
+        uint32_t value;
+        memcpy(&value, p + component * 4, sizeof(value));
+        return (float)value;
+    }
+    }
+    return 0.0f;
+}
+
+uint32_t UGltfReadIndex(const UGltfAccessor& accessor, size_t element)
+{
+    const unsigned char* p = accessor.data + element * accessor.stride;
+    switch (accessor.componentType)
+    {
+    case GL_UNSIGNED_BYTE:
+        return *p;
+    case GL_UNSIGNED_SHORT:
+    {
+        uint16_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    case GL_UNSIGNED_INT:
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    }
+    return 0;
+}
+
+glm::mat4 UGltfNodeMatrix(const UJsonValue& node)
+{
+    float values[16];
+    if (UReadNumbers(node.Find("matrix"), values, 16))
+    {
+        glm::mat4 m;
+        for (int column = 0; column < 4; ++column)
+            m[column] = glm::vec4(values[column * 4], values[column * 4 + 1], values[column * 4 + 2], values[column * 4 + 3]);
+        return m;
+    }
+
+    glm::mat4 translation(1.0f), rotation(1.0f), scale(1.0f);
+    if (UReadNumbers(node.Find("translation"), values, 3))
+        translation[3] = glm::vec4(values[0], values[1], values[2], 1.0f);
+    if (UReadNumbers(node.Find("rotation"), values, 4))
+        rotation = UFromQuaternion(values[0], values[1], values[2], values[3]);
+    if (UReadNumbers(node.Find("scale"), values, 3))
+    {
+        scale[0][0] = values[0];
+        scale[1][1] = values[1];
+        scale[2][2] = values[2];
+    }
+    return translation * rotation * scale;
+}
+
+bool UGltfPrimitiveToMeshData(const UGltfDocument& document, const UJsonValue& primitive, UMeshData& data)
+{
+    data = UMeshData();
+    if (primitive.IntOr("mode", 4) != 4)
+        return false;
+
+    const UJsonValue* attributes = primitive.Find("attributes");
+    if (!attributes)
+        return false;
+
+    UGltfAccessor positions;
+    if (!UGltfGetAccessor(document, attributes->IntOr("POSITION", -1), positions) || positions.components != 3)
+        return false;
+
+    UGltfAccessor normals, uvs, tangents;
+    bool hasNormals, hasUvs, hasTangents;
+    if (!UGltfGetAttribute(document, *attributes, "NORMAL", 3, positions.count, normals, hasNormals)
+        || !UGltfGetAttribute(document, *attributes, "TEXCOORD_0", 2, positions.count, uvs, hasUvs)
+        || !UGltfGetAttribute(document, *attributes, "TANGENT", 4, positions.count, tangents, hasTangents))
+        return false;
+
+    data.positions.resize(positions.count);
+    for (size_t i = 0; i < positions.count; ++i)
+        data.positions[i] = glm::vec3(UGltfReadFloat(positions, i, 0), UGltfReadFloat(positions, i, 1), UGltfReadFloat(positions, i, 2));
+    if (hasNormals)
+    {
+        data.normals.resize(positions.count);
+        for (size_t i = 0; i < positions.count; ++i)
+            data.normals[i] = glm::vec3(UGltfReadFloat(normals, i, 0), UGltfReadFloat(normals, i, 1), UGltfReadFloat(normals, i, 2));
+    }
+    if (hasUvs)
+    {
+        // glTF puts the UV origin top left, GL bottom left
+        data.uvs.resize(positions.count);
+        for (size_t i = 0; i < positions.count; ++i)
+            data.uvs[i] = glm::vec2(UGltfReadFloat(uvs, i, 0), 1.0f - UGltfReadFloat(uvs, i, 1));
+    }
+    if (hasTangents)
+    {
+        data.tangents.resize(positions.count);
+        for (size_t i = 0; i < positions.count; ++i)
+            data.tangents[i] = glm::vec4(UGltfReadFloat(tangents, i, 0), UGltfReadFloat(tangents, i, 1), UGltfReadFloat(tangents, i, 2), UGltfReadFloat(tangents, i, 3));
+    }
+
+    UGltfAccessor indices;
+    if (UGltfGetAccessor(document, primitive.IntOr("indices", -1), indices))
+    {
+        data.indices.resize(indices.count);
+        for (size_t i = 0; i < indices.count; ++i)
+        {
+            data.indices[i] = UGltfReadIndex(indices, i);
+            if (data.indices[i] >= positions.count)
+                return false;
+        }
+    }
+    else
+    {
+        data.indices.resize(positions.count);
+        for (size_t i = 0; i < positions.count; ++i)
+            data.indices[i] = (uint32_t)i;
+    }
+    return true;
+}
+
+bool UGltfToMeshData(const UGltfDocument& document, UMeshData& data)
+{
+    data = UMeshData();
+
+    // Walk the default scene (or every root if there is none)
+    vector<UPrimitiveInstance> instances;
+    const UJsonValue* scene;
+    if (!UGltfDefaultScene(document, scene))
+        return false;
+    if (scene)
+    {
+        const UJsonValue* roots = scene->Find("nodes");
+        if (roots)
+        {
+            for (const UJsonValue& root : roots->array)
+                UCollectInstances(document, (int)root.number, glm::mat4(1.0f), instances, 0);
+        }
+    }
+    else if (const UJsonValue* meshes = document.json.Find("meshes"))
+    {
+        // No scene graph: take the meshes as they are
+        for (const UJsonValue& mesh : meshes->array)
+        {
+            const UJsonValue* primitives = mesh.Find("primitives");
+            if (primitives)
+            {
+                for (const UJsonValue& primitive : primitives->array)
+                    instances.push_back({ &primitive, glm::mat4(1.0f) });
+            }
+        }
+    }
+
+    vector<UMeshData> primitives;
+    vector<glm::mat4> transforms;
+    bool keepNormals = true, keepUvs = true, keepTangents = true;
+    for (const UPrimitiveInstance& instance : instances)
+    {
+        UMeshData primitive;
+        if (!UGltfPrimitiveToMeshData(document, *instance.primitive, primitive))
+            continue;
+
+        // Only keep streams every primitive has
+        keepNormals = keepNormals && !primitive.normals.empty();
+        keepUvs = keepUvs && !primitive.uvs.empty();
+        keepTangents = keepTangents && !primitive.tangents.empty();
+        primitives.push_back(primitive);
+        transforms.push_back(instance.world);
+    }
+
+    for (size_t i = 0; i < primitives.size(); ++i)
+        UAppendPrimitive(primitives[i], transforms[i], keepNormals, keepUvs, keepTangents, data);
+
+    return !data.positions.empty();
+}
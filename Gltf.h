@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>      // uint32_t
+#include <string>       // std::string
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Json.h"
+#include "MappedFile.h"
+#include "VertexFormat.h"
+
+// One glTF buffer. Points into a memory mapped .glb/.bin, or at owned bytes for data: URIs
+struct UGltfBuffer
+{
+    const unsigned char* data;
+    size_t size;
+    std::vector<unsigned char> owned;
+};
+
+// A parsed .gltf/.glb: the JSON plus every buffer it references (mapped, not copied)
+struct UGltfDocument
+{
+    UJsonValue json;
+    std::string baseDirectory;
+    std::vector<UMappedFile> mappedFiles;
+    std::vector<UGltfBuffer> buffers;
+};
+
+// Typed view of an accessor's elements inside its buffer
+struct UGltfAccessor
+{
+    const unsigned char* data;
+    size_t count;
+    int components;
+    GLenum componentType;
+    bool normalized;
+    size_t stride;
+};
+
+bool ULoadGltfDocument(const char* filename, UGltfDocument& document);
+void UFreeGltfDocument(UGltfDocument& document);
+
+bool UGltfGetAccessor(const UGltfDocument& document, int accessorIndex, UGltfAccessor& accessor);
+// Optional vertex attribute: true with present false when the primitive has none, false when it has
+// one that isn't count elements of components each
+bool UGltfGetAttribute(const UGltfDocument& document, const UJsonValue& attributes, const char* name, int components, size_t count,
+    UGltfAccessor& accessor, bool& present);
+// The "scene" entry, or scene 0; null when the file has no scenes, false when it names one that isn't there
+bool UGltfDefaultScene(const UGltfDocument& document, const UJsonValue*& scene);
+float UGltfReadFloat(const UGltfAccessor& accessor, size_t element, int component);
+uint32_t UGltfReadIndex(const UGltfAccessor& accessor, size_t element);
+
+// Local transform of a node (matrix or TRS)
+glm::mat4 UGltfNodeMatrix(const UJsonValue& node);
+// Mesh data of one primitive in mesh space; false if it isn't an indexed or plain triangle list
+bool UGltfPrimitiveToMeshData(const UGltfDocument& document, const UJsonValue& primitive, UMeshData& data);
+// Every triangle primitive of every mesh instance in the default scene, node transforms baked in
+bool UGltfToMeshData(const UGltfDocument& document, UMeshData& data);
+
+// Joins a URI relative to the document and undoes percent encoding
+std::string UGltfResolveUri(const UGltfDocument& document, const std::string& uri);
+bool UDecodeBase64(const char* text, size_t length, std::vector<unsigned char>& out);
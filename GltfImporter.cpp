@@ -0,0 +1,452 @@
+#include <iostream>     // cout, cerr
+#include <chrono>       // steady_clock
+#include <utility>      // move
+#include "GltfImporter.h"
+#include "Gltf.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Buffer views are streamed in pieces this big so the driver never stages a whole 100+ MB view
+    const size_t UPLOAD_CHUNK_BYTES = 4 * 1024 * 1024;
+
+    size_t UPeakMemoryBytes()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.PeakWorkingSetSize;
+        return 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            return (size_t)usage.ru_maxrss * 1024;
+        return 0;
+#endif
+    }
+
+    double UMillisecondsSince(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // State shared while one file is imported
+    struct UGltfImport
+    {
+        const UGltfDocument& document;
+        UGltfScene& scene;
+        vector<GLuint> viewBuffers;     // GL buffer per buffer view, 0 until first used
+        vector<GLuint> imageTextures;   // texture per image, 0 until first used
+        GLuint defaultTexture;
+        UUploadRing* uploads;           // optional, image files go through it
+    };
+
+    // GL buffer holding a buffer view, streamed from the mapped file on first use
+    GLuint UGetViewBuffer(UGltfImport& import, int viewIndex)
+    {
+        if (viewIndex < 0 || viewIndex >= (int)import.viewBuffers.size())
+            return 0;
+        if (import.viewBuffers[viewIndex])
+            return import.viewBuffers[viewIndex];
+
+        const UJsonValue& view = import.document.json.Find("bufferViews")->array[viewIndex];
+        int bufferIndex = view.IntOr("buffer", -1);
+        size_t offset = (size_t)view.NumberOr("byteOffset", 0.0);
+        size_t length = (size_t)view.NumberOr("byteLength", 0.0);
+        if (bufferIndex < 0 || bufferIndex >= (int)import.document.buffers.size() || length == 0
+            || offset + length > import.document.buffers[bufferIndex].size)
+        {
+            cout << "glTF buffer view " << viewIndex << " is out of range" << endl;
+            return 0;
+        }
+
+        const UGltfBuffer& buffer = import.document.buffers[bufferIndex];
+        const unsigned char* data = buffer.data + offset;
+        bool mapped = buffer.owned.empty();
+
+        // Immutable storage filled chunk by chunk straight from the mapping; consumed pages are
+        // handed back to the OS so resident memory stays around one chunk, not one file
+        UGpuBuffer gpuBuffer;
+        gpuBuffer.Create(UGPU_GEOMETRY, "glTF buffer view");
+        glBindBuffer(GL_COPY_WRITE_BUFFER, gpuBuffer);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)length, nullptr, GL_DYNAMIC_STORAGE_BIT);
+        gpuBuffer.SetBytes(length);
+        for (size_t chunk = 0; chunk < length; chunk += UPLOAD_CHUNK_BYTES)
+        {
+            size_t n = length - chunk < UPLOAD_CHUNK_BYTES ? length - chunk : UPLOAD_CHUNK_BYTES;
+            glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)chunk, (GLsizeiptr)n, data + chunk);
+            if (mapped)
+                UReleaseMappedPages(data + chunk, n);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        GLuint id = gpuBuffer;
+        import.viewBuffers[viewIndex] = id;
+        import.scene.buffers.push_back(std::move(gpuBuffer));
+        import.scene.bytesStreamed += length;
+        return id;
+    }
+
+    GLuint UGetDefaultTexture(UGltfImport& import)
+    {
+        if (!import.defaultTexture && UCreateSolidTexture(glm::vec4(1.0f), import.defaultTexture))
+            import.scene.textures.push_back(import.defaultTexture);
+        return import.defaultTexture;
+    }
+
+    // Texture for an image; glTF UVs start top left, so images are uploaded without the usual flip
+    GLuint UGetImageTexture(UGltfImport& import, int imageIndex)
+    {
+        const UJsonValue* images = import.document.json.Find("images");
+        if (!images || imageIndex < 0 || imageIndex >= (int)images->array.size())
+            return UGetDefaultTexture(import);
+        if (import.imageTextures[imageIndex])
+            return import.imageTextures[imageIndex];
+
+        const UJsonValue& image = images->array[imageIndex];
+        string uri = image.StringOr("uri", "");
+        GLuint id = 0;
+        bool created = false;
+
+        if (uri.compare(0, 5, "data:") == 0)
+        {
+            vector<unsigned char> bytes;
+            size_t comma = uri.find(',');
+            if (comma != string::npos && UDecodeBase64(uri.c_str() + comma + 1, uri.size() - comma - 1, bytes))
+                created = UCreateTextureFromMemory(bytes.data(), bytes.size(), id, false);
+        }
+        else if (!uri.empty() && import.uploads)
+        {
+            id = UQueueTextureFile(*import.uploads, UGltfResolveUri(import.document, uri).c_str(), false);
+            created = true;
+        }
+        else if (!uri.empty())
+            created = UCreateTexture(UGltfResolveUri(import.document, uri).c_str(), id, false);
+        else
+        {
+            // Image stored in a buffer view (usual for .glb); decoded in place from the mapping
+            const UJsonValue* views = import.document.json.Find("bufferViews");
+            int viewIndex = image.IntOr("bufferView", -1);
+            if (views && viewIndex >= 0 && viewIndex < (int)views->array.size())
+            {
+                const UJsonValue& view = views->array[viewIndex];
+                int bufferIndex = view.IntOr("buffer", -1);
+                size_t offset = (size_t)view.NumberOr("byteOffset", 0.0);
+                size_t length = (size_t)view.NumberOr("byteLength", 0.0);
+                if (bufferIndex >= 0 && bufferIndex < (int)import.document.buffers.size() && offset + length <= import.document.buffers[bufferIndex].size)
+                    created = UCreateTextureFromMemory(import.document.buffers[bufferIndex].data + offset, length, id, false);
+            }
+        }
+
+        if (!created)
+        {
+            cout << "Failed to load glTF image " << imageIndex << (uri.empty() || uri.compare(0, 5, "data:") == 0 ? string() : " (" + uri + ")") << endl;
+            return import.imageTextures[imageIndex] = UGetDefaultTexture(import);
+        }
+
+        import.scene.textures.push_back(id);
+        return import.imageTextures[imageIndex] = id;
+    }
+
+    void UImportMaterials(UGltfImport& import)
+    {
+        const UJsonValue* materials = import.document.json.Find("materials");
+        const UJsonValue* textures = import.document.json.Find("textures");
+        if (!materials)
+            return;
+
+        for (size_t i = 0; i < materials->array.size(); ++i)
+        {
+            const UJsonValue& description = materials->array[i];
+            UGltfMaterial material;
+            material.name = description.StringOr("name", "material" + to_string(i));
+            material.baseColorFactor = glm::vec4(1.0f);
+            material.texture = 0;
+
+            const UJsonValue* pbr = description.Find("pbrMetallicRoughness");
+            const UJsonValue* factor = pbr ? pbr->Find("baseColorFactor") : nullptr;
+            if (factor && factor->array.size() == 4)
+                material.baseColorFactor = glm::vec4((float)factor->array[0].number, (float)factor->array[1].number, (float)factor->array[2].number, (float)factor->array[3].number);
+
+            const UJsonValue* baseColor = pbr ? pbr->Find("baseColorTexture") : nullptr;
+            int textureIndex = baseColor ? baseColor->IntOr("index", -1) : -1;
+            if (textures && textureIndex >= 0 && textureIndex < (int)textures->array.size())
+                material.texture = UGetImageTexture(import, textures->array[textureIndex].IntOr("source", -1));
+            else if (UCreateSolidTexture(material.baseColorFactor, material.texture))
+                import.scene.textures.push_back(material.texture);
+
+            import.scene.materials.push_back(material);
+        }
+    }
+
+    // Points one vertex attribute at its buffer view; false when the accessor is unusable
+    bool UBindAttribute(UGltfImport& import, const UJsonValue& attributes, const char* name, GLuint location, UGltfAccessor& accessor)
+    {
+        int accessorIndex = attributes.IntOr(name, -1);
+        if (!UGltfGetAccessor(import.document, accessorIndex, accessor))
+            return false;
+
+        const UJsonValue& description = import.document.json.Find("accessors")->array[accessorIndex];
+        GLuint buffer = UGetViewBuffer(import, description.IntOr("bufferView", -1));
+        if (!buffer)
+            return false;
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribPointer(location, accessor.components, accessor.componentType, accessor.normalized ? GL_TRUE : GL_FALSE,
+            (GLsizei)accessor.stride, (void*)(size_t)description.NumberOr("byteOffset", 0.0));
+        glEnableVertexAttribArray(location);
+        return true;
+    }
+
+    // Builds a VAO over the streamed buffer views; nothing is repacked on the CPU
+    bool UImportPrimitive(UGltfImport& import, const UJsonValue& primitive, UGpuMesh& mesh)
+    {
+        const UJsonValue* attributes = primitive.Find("attributes");
+        if (!attributes || primitive.IntOr("mode", 4) != 4)
+            return false;
+
+        // Every attribute is drawn for positions.count vertices, so all of them must have that many
+        UGltfAccessor positions, normals, uvs, tangents;
+        bool hasNormals, hasUvs, hasTangents;
+        if (!UGltfGetAccessor(import.document, attributes->IntOr("POSITION", -1), positions) || positions.components != 3 || positions.componentType != GL_FLOAT
+            || !UGltfGetAttribute(import.document, *attributes, "NORMAL", 3, positions.count, normals, hasNormals)
+            || !UGltfGetAttribute(import.document, *attributes, "TEXCOORD_0", 2, positions.count, uvs, hasUvs)
+            || !UGltfGetAttribute(import.document, *attributes, "TANGENT", 4, positions.count, tangents, hasTangents))
+            return false;
+
+        mesh = UGpuMesh();
+        mesh.format = UVERTEX_FLOAT;
+        mesh.dequantize = glm::mat4(1.0f);
+        // No vbo/ibo: buffers belong to the scene, views are shared between primitives
+        mesh.vao.Create(UGPU_GEOMETRY, "glTF primitive");
+        glBindVertexArray(mesh.vao);
+
+        if (!UBindAttribute(import, *attributes, "POSITION", UATTRIB_POSITION, positions))
+        {
+            glBindVertexArray(0);
+            mesh.vao.Reset();
+            return false;
+        }
+        hasNormals = hasNormals && UBindAttribute(import, *attributes, "NORMAL", UATTRIB_NORMAL, normals);
+        hasUvs = hasUvs && UBindAttribute(import, *attributes, "TEXCOORD_0", UATTRIB_UV, uvs);
+        hasTangents = hasTangents && UBindAttribute(import, *attributes, "TANGENT", UATTRIB_TANGENT, tangents);
+
+        mesh.nVertices = (GLuint)positions.count;
+        mesh.vertexBytes = (GLsizeiptr)(positions.count * positions.stride
+            + (hasNormals ? normals.count * normals.stride : 0)
+            + (hasUvs ? uvs.count * uvs.stride : 0)
+            + (hasTangents ? tangents.count * tangents.stride : 0));
+
+        // POSITION min/max are required by the spec
+        const UJsonValue& positionAccessor = import.document.json.Find("accessors")->array[attributes->IntOr("POSITION", -1)];
+        const UJsonValue* boundsMin = positionAccessor.Find("min");
+        const UJsonValue* boundsMax = positionAccessor.Find("max");
+        mesh.boundsMin = mesh.boundsMax = glm::vec3(0.0f);
+        if (boundsMin && boundsMax && boundsMin->array.size() == 3 && boundsMax->array.size() == 3)
+        {
+            mesh.boundsMin = glm::vec3((float)boundsMin->array[0].number, (float)boundsMin->array[1].number, (float)boundsMin->array[2].number);
+            mesh.boundsMax = glm::vec3((float)boundsMax->array[0].number, (float)boundsMax->array[1].number, (float)boundsMax->array[2].number);
+        }
+
+        // Indices are drawn straight out of their buffer view
+        mesh.nIndices = 0;
+        mesh.indexBytes = 0;
+        mesh.indexType = GL_UNSIGNED_INT;
+        mesh.nLods = 1;
+        mesh.lods[0].firstIndex = 0;
+        mesh.lods[0].nIndices = 0;
+        mesh.lods[0].error = 0.0f;
+
+        int indexAccessor = primitive.IntOr("indices", -1);
+        UGltfAccessor indices;
+        if (indexAccessor >= 0)
+        {
+            bool valid = UGltfGetAccessor(import.document, indexAccessor, indices);
+            const UJsonValue* description = valid ? &import.document.json.Find("accessors")->array[indexAccessor] : nullptr;
+            GLuint buffer = valid ? UGetViewBuffer(import, description->IntOr("bufferView", -1)) : 0;
+            if (!buffer || indices.components != 1
+                || (indices.componentType != GL_UNSIGNED_BYTE && indices.componentType != GL_UNSIGNED_SHORT && indices.componentType != GL_UNSIGNED_INT))
+            {
+                glBindVertexArray(0);
+                mesh.vao.Reset();
+                return false;
+            }
+
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+            size_t indexSize = indices.componentType == GL_UNSIGNED_BYTE ? 1 : indices.componentType == GL_UNSIGNED_SHORT ? 2 : 4;
+            mesh.indexType = indices.componentType;
+            mesh.nIndices = (GLuint)indices.count;
+            mesh.indexBytes = (GLsizeiptr)(indices.count * indexSize);
+            mesh.lods[0].firstIndex = (uint32_t)((size_t)description->NumberOr("byteOffset", 0.0) / indexSize);
+            mesh.lods[0].nIndices = mesh.nIndices;
+        }
+
+        glBindVertexArray(0);
+        return true;
+    }
+
+    void UImportNode(UGltfImport& import, int nodeIndex, const glm::mat4& parent, const vector<vector<size_t>>& meshPrimitives, int depth)
+    {
+        const UJsonValue* nodes = import.document.json.Find("nodes");
+        if (!nodes || nodeIndex < 0 || nodeIndex >= (int)nodes->array.size() || depth > 64)
+            return;
+
+        const UJsonValue& node = nodes->array[nodeIndex];
+        glm::mat4 world = parent * UGltfNodeMatrix(node);
+        string name = node.StringOr("name", "node" + to_string(nodeIndex));
+
+        int meshIndex = node.IntOr("mesh", -1);
+        if (meshIndex >= 0 && meshIndex < (int)meshPrimitives.size())
+        {
+            const UJsonValue& primitives = *import.document.json.Find("meshes")->array[meshIndex].Find("primitives");
+            for (size_t i = 0; i < meshPrimitives[meshIndex].size(); ++i)
+            {
+                size_t meshSlot = meshPrimitives[meshIndex][i];
+                if (meshSlot == (size_t)-1)
+                    continue;
+
+                int materialIndex = primitives.array[i].IntOr("material", -1);
+                GLuint texture = materialIndex >= 0 && materialIndex < (int)import.scene.materials.size()
+                    ? import.scene.materials[materialIndex].texture : UGetDefaultTexture(import);
+
+                import.scene.objects.push_back({ name, &import.scene.meshes[meshSlot], texture, glm::vec2(1.0f), world, true, true });
+            }
+        }
+
+        const UJsonValue* children = node.Find("children");
+        if (children)
+        {
+            for (const UJsonValue& child : children->array)
+                UImportNode(import, (int)child.number, world, meshPrimitives, depth + 1);
+        }
+    }
+}
+
+bool UImportGltf(const char* filename, const glm::mat4& root, UGltfScene& scene, UUploadRing* uploads)
+{
+    auto start = chrono::steady_clock::now();
+    scene = UGltfScene();
+
+    // Only the JSON is parsed; binary data stays in the mapping until it is streamed to the GPU
+    UGltfDocument document;
+    if (!ULoadGltfDocument(filename, document))
+        return false;
+    scene.parseMs = UMillisecondsSince(start);
+
+    // Before anything is uploaded, so a broken file leaves nothing to clean up
+    const UJsonValue* defaultScene;
+    if (!UGltfDefaultScene(document, defaultScene))
+    {
+        UFreeGltfDocument(document);
+        return false;
+    }
+
+    const UJsonValue* views = document.json.Find("bufferViews");
+    const UJsonValue* images = document.json.Find("images");
+    UGltfImport import = { document, scene, vector<GLuint>(views ? views->array.size() : 0, 0), vector<GLuint>(images ? images->array.size() : 0, 0), 0, uploads };
+
+    auto textureStart = chrono::steady_clock::now();
+    UImportMaterials(import);
+    scene.textureMs = UMillisecondsSince(textureStart);
+
+    // Primitives first so the mesh vector never moves once objects point into it
+    auto uploadStart = chrono::steady_clock::now();
+    const UJsonValue* meshes = document.json.Find("meshes");
+    vector<vector<size_t>> meshPrimitives(meshes ? meshes->array.size() : 0);
+    size_t nPrimitives = 0;
+    for (size_t i = 0; i < meshPrimitives.size(); ++i)
+    {
+        const UJsonValue* primitives = meshes->array[i].Find("primitives");
+        nPrimitives += primitives ? primitives->array.size() : 0;
+    }
+    scene.meshes.reserve(nPrimitives);
+
+    for (size_t i = 0; i < meshPrimitives.size(); ++i)
+    {
+        const UJsonValue* primitives = meshes->array[i].Find("primitives");
+        if (!primitives)
+            continue;
+        for (const UJsonValue& primitive : primitives->array)
+        {
+            UGpuMesh mesh;
+            if (UImportPrimitive(import, primitive, mesh))
+            {
+                meshPrimitives[i].push_back(scene.meshes.size());
+                scene.meshes.push_back(std::move(mesh));
+            }
+            else
+            {
+                cout << "Skipping unsupported primitive in glTF mesh " << i << endl;
+                meshPrimitives[i].push_back((size_t)-1);
+            }
+        }
+    }
+    scene.uploadMs = UMillisecondsSince(uploadStart);
+
+    // Default scene, or every node as a root when the file has no scenes
+    if (defaultScene)
+    {
+        const UJsonValue* roots = defaultScene->Find("nodes");
+        if (roots)
+        {
+            for (const UJsonValue& node : roots->array)
+                UImportNode(import, (int)node.number, root, meshPrimitives, 0);
+        }
+    }
+    else if (const UJsonValue* nodes = document.json.Find("nodes"))
+    {
+        vector<bool> isChild(nodes->array.size(), false);
+        for (const UJsonValue& node : nodes->array)
+        {
+            const UJsonValue* children = node.Find("children");
+            if (!children)
+                continue;
+            for (const UJsonValue& child : children->array)
+            {
+                if (child.number >= 0 && child.number < isChild.size())
+                    isChild[(size_t)child.number] = true;
+            }
+        }
+        for (size_t i = 0; i < nodes->array.size(); ++i)
+        {
+            if (!isChild[i])
+                UImportNode(import, (int)i, root, meshPrimitives, 0);
+        }
+    }
+
+    UFreeGltfDocument(document);
+
+    scene.totalMs = UMillisecondsSince(start);
+    scene.peakMemoryBytes = UPeakMemoryBytes();
+
+    cout << "INFO: Imported " << filename << ": " << scene.objects.size() << " objects, " << scene.meshes.size() << " primitives, "
+         << scene.textures.size() << " textures, " << scene.bytesStreamed / 1024 << " KB streamed" << endl;
+    cout << "INFO: glTF load " << scene.totalMs << " ms (parse " << scene.parseMs << " ms, textures " << scene.textureMs
+         << " ms, buffers " << scene.uploadMs << " ms), peak memory " << scene.peakMemoryBytes / (1024 * 1024) << " MB" << endl;
+
+    return !scene.objects.empty();
+}
+
+void UDestroyGltfScene(UGltfScene& scene)
+{
+    for (UGpuMesh& mesh : scene.meshes)
+        UDestroyGpuMesh(mesh);
+    for (GLuint texture : scene.textures)
+        UDestroyTexture(texture);
+
+    scene.meshes.clear();
+    scene.buffers.clear();
+    scene.textures.clear();
+    scene.materials.clear();
+    scene.objects.clear();
+}
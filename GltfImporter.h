@@ -0,0 +1,41 @@
+#pragma once
+#include <string>       // std::string
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "UploadRing.h"
+
+// Base color of a glTF material; texture is a 1x1 texture of the factor when there is no image
+struct UGltfMaterial
+{
+    std::string name;
+    GLuint texture;
+    glm::vec4 baseColorFactor;
+};
+
+// Everything an imported glTF owns on the GPU plus the objects to add to the scene
+struct UGltfScene
+{
+    std::vector<UGpuBuffer> buffers;        // one per buffer view feeding a mesh, streamed from the mapped file
+    std::vector<GLuint> textures;
+    std::vector<UGltfMaterial> materials;
+    std::vector<UGpuMesh> meshes;           // one per triangle primitive; VAOs point into buffers
+    std::vector<USceneObject> objects;      // one per primitive instance, node transforms applied
+
+    // Load report
+    double parseMs;
+    double uploadMs;
+    double textureMs;
+    double totalMs;
+    size_t bytesStreamed;
+    size_t peakMemoryBytes;
+};
+
+// Imports a .gltf/.glb; root is applied on top of every node transform. With an upload ring,
+// image files are decoded and uploaded in the background and the textures fill in over the next frames.
+bool UImportGltf(const char* filename, const glm::mat4& root, UGltfScene& scene, UUploadRing* uploads = nullptr);
+void UDestroyGltfScene(UGltfScene& scene);
@@ -0,0 +1,219 @@
+#include <iostream>     // cout, cerr
+#include <iomanip>      // setprecision
+#include <cstdint>      // uint64_t
+#include <string>       // std::string
+#include <mutex>        // std::mutex
+#include <functional>   // std::hash
+#include <unordered_map> // std::unordered_map
+#include "GpuResources.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    struct UGpuRecord
+    {
+        UGpuCategory category;
+        size_t bytes;
+        string label;
+    };
+
+    struct UGpuKey
+    {
+        UGpuObjectType type;
+        GLuint id;
+        const void* context;    // null for objects every context shares
+
+        bool operator==(const UGpuKey& other) const { return type == other.type && id == other.id && context == other.context; }
+    };
+
+    struct UGpuKeyHash
+    {
+        size_t operator()(const UGpuKey& key) const
+        {
+            return hash<uint64_t>()((uint64_t)key.type << 32 | key.id) ^ hash<const void*>()(key.context);
+        }
+    };
+
+    struct UGpuRegistry
+    {
+        unordered_map<UGpuKey, UGpuRecord, UGpuKeyHash> objects;
+        UGpuMemoryStats stats;
+        bool closed;            // the context is going away, GL calls are no longer allowed
+        mutex lock;             // batch render workers create objects in their own contexts
+    };
+
+    // Never destroyed: global handles in other files release their objects during static
+    // destruction, in an order relative to this file that C++ leaves unspecified
+    UGpuRegistry& URegistry()
+    {
+        static UGpuRegistry* registry = new UGpuRegistry();
+        return *registry;
+    }
+
+    // Context of the calling thread, for the object types that live in one context only
+    thread_local const void* tContext = nullptr;
+
+    UGpuKey UKey(UGpuObjectType type, GLuint id)
+    {
+        bool perContext = type == UGPU_VERTEX_ARRAY || type == UGPU_FRAMEBUFFER || type == UGPU_QUERY;
+        return { type, id, perContext ? tContext : nullptr };
+    }
+
+    const char* UObjectTypeName(UGpuObjectType type)
+    {
+        const char* names[UGPU_OBJECT_TYPES] = { "buffer", "vertex array", "texture", "program", "framebuffer", "query" };
+        return names[type];
+    }
+
+    double UMegabytes(size_t bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+}
+
+
+GLuint UGenGpuObject(UGpuObjectType type, UGpuCategory category, const char* label)
+{
+    GLuint id = 0;
+    switch (type)
+    {
+    case UGPU_BUFFER: glGenBuffers(1, &id); break;
+    case UGPU_VERTEX_ARRAY: glGenVertexArrays(1, &id); break;
+    case UGPU_TEXTURE: glGenTextures(1, &id); break;
+    case UGPU_PROGRAM: id = glCreateProgram(); break;
+    case UGPU_FRAMEBUFFER: glGenFramebuffers(1, &id); break;
+    case UGPU_QUERY: glGenQueries(1, &id); break;
+    default: break;
+    }
+    if (!id)
+        return 0;
+
+    UGpuRegistry& registry = URegistry();
+    lock_guard<mutex> guard(registry.lock);
+    UGpuRecord record;
+    record.category = category;
+    record.bytes = 0;
+    record.label = label ? label : "";
+    registry.objects[UKey(type, id)] = record;
+    ++registry.stats.categories[category].nObjects;
+    ++registry.stats.nObjects;
+    return id;
+}
+
+
+void UDeleteGpuObject(UGpuObjectType type, GLuint id)
+{
+    if (!id)
+        return;
+
+    UGpuRegistry& registry = URegistry();
+    unique_lock<mutex> guard(registry.lock);
+    auto found = registry.objects.find(UKey(type, id));
+    if (found == registry.objects.end())
+    {
+        // Made without the registry, or deleted twice; either way the books are wrong somewhere
+        cerr << "GPU registry: deleting unknown " << UObjectTypeName(type) << " " << id << endl;
+    }
+    else
+    {
+        UGpuCategoryStats& category = registry.stats.categories[found->second.category];
+        --category.nObjects;
+        category.bytes -= found->second.bytes;
+        --registry.stats.nObjects;
+        registry.stats.bytes -= found->second.bytes;
+        registry.objects.erase(found);
+    }
+
+    if (registry.closed)
+        return;
+    guard.unlock();
+    switch (type)
+    {
+    case UGPU_BUFFER: glDeleteBuffers(1, &id); break;
+    case UGPU_VERTEX_ARRAY: glDeleteVertexArrays(1, &id); break;
+    case UGPU_TEXTURE: glDeleteTextures(1, &id); break;
+    case UGPU_PROGRAM: glDeleteProgram(id); break;
+    case UGPU_FRAMEBUFFER: glDeleteFramebuffers(1, &id); break;
+    case UGPU_QUERY: glDeleteQueries(1, &id); break;
+    default: break;
+    }
+}
+
+
+void USetGpuObjectBytes(UGpuObjectType type, GLuint id, size_t bytes)
+{
+    UGpuRegistry& registry = URegistry();
+    lock_guard<mutex> guard(registry.lock);
+    auto found = registry.objects.find(UKey(type, id));
+    if (found == registry.objects.end())
+        return;
+
+    UGpuCategoryStats& category = registry.stats.categories[found->second.category];
+    category.bytes = category.bytes - found->second.bytes + bytes;
+    registry.stats.bytes = registry.stats.bytes - found->second.bytes + bytes;
+    found->second.bytes = bytes;
+    if (registry.stats.bytes > registry.stats.peakBytes)
+        registry.stats.peakBytes = registry.stats.bytes;
+}
+
+
+void USetGpuRegistryContext(const void* context)
+{
+    tContext = context;
+}
+
+
+size_t UEstimateTextureBytes(int width, int height, int layers, int bytesPerTexel, bool mipmapped)
+{
+    size_t bytes = (size_t)width * height * layers * bytesPerTexel;
+    // A full mip chain adds a third
+    return mipmapped ? bytes + bytes / 3 : bytes;
+}
+
+
+void UGetGpuMemoryStats(UGpuMemoryStats& stats)
+{
+    UGpuRegistry& registry = URegistry();
+    lock_guard<mutex> guard(registry.lock);
+    stats = registry.stats;
+}
+
+
+const char* UGpuCategoryName(UGpuCategory category)
+{
+    const char* names[UGPU_CATEGORIES] = { "geometry", "materials", "shadows", "lightmap", "culling", "picking", "overlay", "streaming", "shaders", "render targets" };
+    return names[category];
+}
+
+
+size_t UReportGpuLeaks()
+{
+    UGpuRegistry& registry = URegistry();
+    lock_guard<mutex> guard(registry.lock);
+    registry.closed = true;
+
+    cout << "INFO: GPU memory peaked at " << fixed << setprecision(1) << UMegabytes(registry.stats.peakBytes) << " MB" << endl;
+    if (registry.objects.empty())
+    {
+        cout << "INFO: Every GPU object was released" << endl;
+        return 0;
+    }
+
+    cout << "GPU objects still alive at shutdown: " << registry.objects.size() << ", " << UMegabytes(registry.stats.bytes) << " MB" << endl;
+    for (int category = 0; category < UGPU_CATEGORIES; ++category)
+    {
+        const UGpuCategoryStats& stats = registry.stats.categories[category];
+        if (!stats.nObjects)
+            continue;
+        cout << "  " << UGpuCategoryName((UGpuCategory)category) << ": " << stats.nObjects << " objects, " << UMegabytes(stats.bytes) << " MB" << endl;
+        for (const auto& object : registry.objects)
+        {
+            if (object.second.category != category)
+                continue;
+            cout << "    " << UObjectTypeName(object.first.type) << " " << object.first.id
+                << " " << object.second.label << " (" << object.second.bytes << " bytes)" << endl;
+        }
+    }
+    return registry.objects.size();
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstddef>      // size_t
+#include <GL/glew.h>    // GLEW library
+
+// Every GL object the program creates goes through this registry, which knows what is alive,
+// who made it and roughly how much video memory it holds. The numbers are estimates from the
+// sizes we asked for; drivers pad and compress, but growth between two scene loads is real.
+enum UGpuObjectType
+{
+    UGPU_BUFFER,
+    UGPU_VERTEX_ARRAY,
+    UGPU_TEXTURE,
+    UGPU_PROGRAM,
+    UGPU_FRAMEBUFFER,
+    UGPU_QUERY,
+    UGPU_OBJECT_TYPES
+};
+
+enum UGpuCategory
+{
+    UGPU_GEOMETRY,      // meshes
+    UGPU_MATERIALS,     // textures the scene samples
+    UGPU_SHADOWS,
+    UGPU_LIGHTMAP,
+    UGPU_CULLING,
+    UGPU_PICKING,
+    UGPU_OVERLAY,
+    UGPU_STREAMING,     // upload and readback staging
+    UGPU_SHADERS,
+    UGPU_RENDER_TARGETS, // offscreen scene rendering
+    UGPU_CATEGORIES
+};
+
+struct UGpuCategoryStats
+{
+    size_t nObjects;
+    size_t bytes;
+};
+
+struct UGpuMemoryStats
+{
+    UGpuCategoryStats categories[UGPU_CATEGORIES];
+    size_t nObjects;
+    size_t bytes;
+    size_t peakBytes;
+};
+
+// Creates and registers one object; label says what it is in the leak report
+GLuint UGenGpuObject(UGpuObjectType type, UGpuCategory category, const char* label);
+// Deletes and unregisters; 0 is ignored
+void UDeleteGpuObject(UGpuObjectType type, GLuint id);
+// Records the storage an object got, replacing the previous estimate
+void USetGpuObjectBytes(UGpuObjectType type, GLuint id, size_t bytes);
+
+// Vertex arrays, framebuffers and queries aren't shared between contexts, so another context
+// reuses their names. A thread rendering in a context of its own names it here before creating
+// any objects; the main context is null.
+void USetGpuRegistryContext(const void* context);
+
+size_t UEstimateTextureBytes(int width, int height, int layers, int bytesPerTexel, bool mipmapped);
+void UGetGpuMemoryStats(UGpuMemoryStats& stats);
+const char* UGpuCategoryName(UGpuCategory category);
+
+// Lists every object still alive, by category. Call once, right before the context is destroyed:
+// objects released after it (global handles running their destructors at exit) are only
+// unregistered, without GL calls. Returns the number of leaked objects.
+size_t UReportGpuLeaks();
+
+// Move-only owner of one registered object, deleted when the handle goes away or is reset.
+// Converts to GLuint, so it can be bound and passed to GL like the plain name.
+template <UGpuObjectType Type>
+class UGpuHandle
+{
+public:
+    UGpuHandle() : id(0) {}
+    ~UGpuHandle() { Reset(); }
+
+    UGpuHandle(UGpuHandle&& other) noexcept : id(other.id) { other.id = 0; }
+    UGpuHandle& operator=(UGpuHandle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            id = other.id;
+            other.id = 0;
+        }
+        return *this;
+    }
+    UGpuHandle(const UGpuHandle&) = delete;
+    UGpuHandle& operator=(const UGpuHandle&) = delete;
+
+    // Replaces whatever the handle owned with a new object
+    void Create(UGpuCategory category, const char* label)
+    {
+        Reset();
+        id = UGenGpuObject(Type, category, label);
+    }
+
+    void Reset()
+    {
+        UDeleteGpuObject(Type, id);
+        id = 0;
+    }
+
+    void SetBytes(size_t bytes) const { USetGpuObjectBytes(Type, id, bytes); }
+    operator GLuint() const { return id; }
+
+private:
+    GLuint id;
+};
+
+typedef UGpuHandle<UGPU_BUFFER> UGpuBuffer;
+typedef UGpuHandle<UGPU_VERTEX_ARRAY> UGpuVertexArray;
+typedef UGpuHandle<UGPU_TEXTURE> UGpuTexture;
+typedef UGpuHandle<UGPU_PROGRAM> UGpuProgram;
+typedef UGpuHandle<UGPU_FRAMEBUFFER> UGpuFramebuffer;
+typedef UGpuHandle<UGPU_QUERY> UGpuQuery;
@@ -0,0 +1,283 @@
+#include <iostream>     // cout
+#include <iomanip>      // setprecision
+#include <cstring>      // memcpy
+#include <algorithm>    // sort
+#include "InputJournal.h"
+#include "MappedFile.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    template <typename T>
+    void UAppend(vector<unsigned char>& bytes, T value)
+    {
+        const unsigned char* first = (const unsigned char*)&value;
+        bytes.insert(bytes.end(), first, first + sizeof(T));
+    }
+
+    template <typename T>
+    bool URead(const unsigned char*& cursor, const unsigned char* end, T& value)
+    {
+        if ((size_t)(end - cursor) < sizeof(T))
+            return false;
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    // One frame record; false when the file ends inside it
+    bool UReadFrame(const unsigned char*& cursor, const unsigned char* end, UInputFrame& frame, float& cursorX, float& cursorY)
+    {
+        uint16_t nEvents = 0;
+        if (!URead(cursor, end, frame.deltaTime) || !URead(cursor, end, frame.keys) || !URead(cursor, end, nEvents))
+            return false;
+
+        frame.events.resize(nEvents);
+        for (UInputEvent& event : frame.events)
+        {
+            uint8_t type = 0;
+            if (!URead(cursor, end, type))
+                return false;
+            event.type = (UInputEventType)type;
+            event.x = event.y = 0.0;
+            event.button = event.action = 0;
+            if (type == UINPUT_BUTTON)
+            {
+                uint8_t button = 0, action = 0;
+                if (!URead(cursor, end, button) || !URead(cursor, end, action))
+                    return false;
+                event.button = button;
+                event.action = action;
+                continue;
+            }
+
+            float x = 0.0f, y = 0.0f;
+            if ((type != UINPUT_CURSOR && type != UINPUT_SCROLL) || !URead(cursor, end, x) || !URead(cursor, end, y))
+                return false;
+            if (type == UINPUT_CURSOR)
+            {
+                // Summed in float exactly like the recording did, so positions come back bit for bit
+                cursorX += x;
+                cursorY += y;
+                event.x = cursorX;
+                event.y = cursorY;
+            }
+            else
+            {
+                event.x = x;
+                event.y = y;
+            }
+        }
+        return true;
+    }
+
+    void UPrintReplayStats(const UInputJournal& journal)
+    {
+        // The first frame includes whatever happened before the loop started
+        if (journal.frameMs.size() < 2)
+            return;
+        vector<float> sorted(journal.frameMs.begin() + 1, journal.frameMs.end());
+        sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (float ms : sorted)
+            total += ms;
+        size_t n = sorted.size();
+        cout << "INFO: Replayed " << journal.frameMs.size() << " frames of " << journal.filename << fixed << setprecision(2)
+            << ": avg " << total / n << " ms, p50 " << sorted[n / 2] << " ms, p95 " << sorted[n * 95 / 100]
+            << " ms, p99 " << sorted[n * 99 / 100] << " ms, worst " << sorted[n - 1] << " ms" << endl;
+    }
+}
+
+
+bool UStartRecording(UInputJournal& journal, const char* filename, uint32_t nKeys)
+{
+    journal.out.open(filename, ios::binary);
+    if (!journal.out)
+    {
+        cout << "Failed to create " << filename << endl;
+        return false;
+    }
+
+    UInputJournalHeader header;
+    header.magic = UINPUT_JOURNAL_MAGIC;
+    header.version = UINPUT_JOURNAL_VERSION;
+    header.headerBytes = sizeof(UInputJournalHeader);
+    header.nKeys = nKeys;
+    journal.out.write((const char*)&header, sizeof(header));
+
+    journal.mode = UJOURNAL_RECORD;
+    journal.filename = filename;
+    journal.frame.events.clear();
+    journal.cursorX = journal.cursorY = 0.0f;
+    journal.nRecorded = 0;
+    journal.dispatching = false;
+    cout << "INFO: Recording input to " << filename << endl;
+    return true;
+}
+
+bool UStartReplay(UInputJournal& journal, const char* filename, uint32_t nKeys, float fixedDeltaTime)
+{
+    UMappedFile file;
+    if (!UMapFile(filename, file))
+    {
+        cout << "Failed to open " << filename << endl;
+        return false;
+    }
+
+    UInputJournalHeader header;
+    bool valid = file.size >= sizeof(UInputJournalHeader);
+    if (valid)
+    {
+        memcpy(&header, file.data, sizeof(header));
+        valid = header.magic == UINPUT_JOURNAL_MAGIC && header.version == UINPUT_JOURNAL_VERSION
+            && header.headerBytes >= sizeof(UInputJournalHeader) && header.headerBytes <= file.size;
+    }
+    if (!valid || header.nKeys != nKeys)
+    {
+        cout << filename << " is not a version " << UINPUT_JOURNAL_VERSION << " input journal of this program" << endl;
+        UUnmapFile(file);
+        return false;
+    }
+
+    journal.frames.clear();
+    journal.cursorX = journal.cursorY = 0.0f;
+    const unsigned char* cursor = file.data + header.headerBytes;
+    const unsigned char* end = file.data + file.size;
+    UInputFrame frame;
+    while (cursor < end && UReadFrame(cursor, end, frame, journal.cursorX, journal.cursorY))
+        journal.frames.push_back(frame);
+    UUnmapFile(file);
+
+    journal.mode = UJOURNAL_REPLAY;
+    journal.filename = filename;
+    journal.nextFrame = 0;
+    journal.fixedDeltaTime = fixedDeltaTime;
+    journal.dispatching = false;
+    journal.frameMs.clear();
+    journal.frameMs.reserve(journal.frames.size());
+    cout << "INFO: Replaying " << journal.frames.size() << " frames from " << filename
+        << (fixedDeltaTime > 0.0f ? " with a fixed timestep" : " with the recorded timesteps") << endl;
+    return true;
+}
+
+void UStopJournal(UInputJournal& journal)
+{
+    if (journal.mode == UJOURNAL_RECORD)
+    {
+        journal.out.close();
+        cout << "INFO: Recorded " << journal.nRecorded << " frames to " << journal.filename << endl;
+    }
+    else if (journal.mode == UJOURNAL_REPLAY)
+        UPrintReplayStats(journal);
+    journal.mode = UJOURNAL_OFF;
+}
+
+bool UBeginJournalFrame(UInputJournal& journal, float& deltaTime)
+{
+    if (journal.mode == UJOURNAL_RECORD)
+    {
+        journal.frame.deltaTime = deltaTime;
+        journal.frame.keys = 0;
+        journal.frame.events.clear();
+    }
+    else if (journal.mode == UJOURNAL_REPLAY)
+    {
+        if (journal.nextFrame >= journal.frames.size())
+            return false;
+        journal.frameMs.push_back(deltaTime * 1000.0f);
+        journal.frame = journal.frames[journal.nextFrame++];
+        deltaTime = journal.fixedDeltaTime > 0.0f ? journal.fixedDeltaTime : journal.frame.deltaTime;
+    }
+    return true;
+}
+
+uint32_t UJournalKeys(UInputJournal& journal, uint32_t keys)
+{
+    if (journal.mode == UJOURNAL_REPLAY)
+        return journal.frame.keys;
+    if (journal.mode == UJOURNAL_RECORD)
+        journal.frame.keys = keys;
+    return keys;
+}
+
+bool UJournalCursor(UInputJournal& journal, double x, double y)
+{
+    if (journal.mode == UJOURNAL_REPLAY)
+        return journal.dispatching;
+    if (journal.mode == UJOURNAL_RECORD)
+    {
+        UInputEvent event;
+        event.type = UINPUT_CURSOR;
+        // Deltas of the float positions, so the sum on replay lands on the same floats
+        event.x = (float)((float)x - journal.cursorX);
+        event.y = (float)((float)y - journal.cursorY);
+        event.button = event.action = 0;
+        journal.cursorX += (float)event.x;
+        journal.cursorY += (float)event.y;
+        journal.frame.events.push_back(event);
+    }
+    return true;
+}
+
+bool UJournalScroll(UInputJournal& journal, double x, double y)
+{
+    if (journal.mode == UJOURNAL_REPLAY)
+        return journal.dispatching;
+    if (journal.mode == UJOURNAL_RECORD)
+    {
+        UInputEvent event;
+        event.type = UINPUT_SCROLL;
+        event.x = (float)x;
+        event.y = (float)y;
+        event.button = event.action = 0;
+        journal.frame.events.push_back(event);
+    }
+    return true;
+}
+
+bool UJournalButton(UInputJournal& journal, int button, int action)
+{
+    if (journal.mode == UJOURNAL_REPLAY)
+        return journal.dispatching;
+    if (journal.mode == UJOURNAL_RECORD)
+    {
+        UInputEvent event;
+        event.type = UINPUT_BUTTON;
+        event.x = event.y = 0.0;
+        event.button = button;
+        event.action = action;
+        journal.frame.events.push_back(event);
+    }
+    return true;
+}
+
+void UEndJournalFrame(UInputJournal& journal)
+{
+    if (journal.mode != UJOURNAL_RECORD)
+        return;
+
+    // A frame with more events than the count can hold keeps the first ones
+    size_t nEvents = journal.frame.events.size() < 0xFFFF ? journal.frame.events.size() : 0xFFFF;
+    journal.bytes.clear();
+    UAppend(journal.bytes, journal.frame.deltaTime);
+    UAppend(journal.bytes, journal.frame.keys);
+    UAppend(journal.bytes, (uint16_t)nEvents);
+    for (size_t i = 0; i < nEvents; ++i)
+    {
+        const UInputEvent& event = journal.frame.events[i];
+        UAppend(journal.bytes, (uint8_t)event.type);
+        if (event.type == UINPUT_BUTTON)
+        {
+            UAppend(journal.bytes, (uint8_t)event.button);
+            UAppend(journal.bytes, (uint8_t)event.action);
+        }
+        else
+        {
+            UAppend(journal.bytes, (float)event.x);
+            UAppend(journal.bytes, (float)event.y);
+        }
+    }
+    journal.out.write((const char*)journal.bytes.data(), (streamsize)journal.bytes.size());
+    ++journal.nRecorded;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>      // uint32_t
+#include <fstream>      // std::ofstream
+#include <string>       // std::string
+#include <vector>       // std::vector
+
+// .uij: everything the camera reacts to, frame by frame, so a session can be played back exactly.
+// Layout (little endian): UInputJournalHeader, then one record per frame:
+//   float deltaTime, uint32_t keys, uint16_t nEvents, then nEvents times
+//   uint8_t type + float dx, dy (cursor, relative to the previous cursor event)
+//               | float x, y (scroll)
+//               | uint8_t button, action (mouse button)
+// Frames are appended as they end, so a recording cut short is still readable up to its last frame.
+const uint32_t UINPUT_JOURNAL_MAGIC = 0x524A4955;  // "UIJR"
+const uint32_t UINPUT_JOURNAL_VERSION = 1;
+
+struct UInputJournalHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerBytes;   // sizeof(UInputJournalHeader) when written
+    uint32_t nKeys;         // keys in the bit mask, in the order the program tracks them
+};
+
+enum UInputEventType
+{
+    UINPUT_CURSOR = 1,
+    UINPUT_SCROLL = 2,
+    UINPUT_BUTTON = 3
+};
+
+struct UInputEvent
+{
+    UInputEventType type;
+    double x, y;            // cursor position (absolute once read back) or scroll offsets
+    int button;
+    int action;
+};
+
+struct UInputFrame
+{
+    float deltaTime;        // as measured while recording
+    uint32_t keys;          // bit i = tracked key i held
+    std::vector<UInputEvent> events;    // in the order they arrived during the frame
+};
+
+enum UJournalMode
+{
+    UJOURNAL_OFF,
+    UJOURNAL_RECORD,
+    UJOURNAL_REPLAY
+};
+
+struct UInputJournal
+{
+    UJournalMode mode;
+    std::string filename;
+    UInputFrame frame;      // recording: the one being filled, replay: the one being played
+    float cursorX;          // last cursor position, rebuilt from the deltas exactly as the replay will
+    float cursorY;
+
+    // Recording
+    std::ofstream out;
+    std::vector<unsigned char> bytes;
+    size_t nRecorded;
+
+    // Replay
+    std::vector<UInputFrame> frames;
+    size_t nextFrame;
+    float fixedDeltaTime;   // > 0 replaces the recorded timesteps
+    bool dispatching;       // the journal is feeding events, live ones are dropped meanwhile
+    std::vector<float> frameMs; // real time each replayed frame took
+};
+
+bool UStartRecording(UInputJournal& journal, const char* filename, uint32_t nKeys);
+// fixedDeltaTime 0 replays the recorded timesteps
+bool UStartReplay(UInputJournal& journal, const char* filename, uint32_t nKeys, float fixedDeltaTime);
+// Closes a recording; after a replay prints the frame time statistics
+void UStopJournal(UInputJournal& journal);
+
+// Frame start. Recording keeps deltaTime; a replay stores it as the real frame time and swaps in
+// the recorded or fixed timestep. Returns false once a replay has no frames left.
+bool UBeginJournalFrame(UInputJournal& journal, float& deltaTime);
+// The frame's key snapshot: recorded as is, or replaced by the replayed one
+uint32_t UJournalKeys(UInputJournal& journal, uint32_t keys);
+
+// Input handlers call these first; false means the event is live input during a replay and must be dropped
+bool UJournalCursor(UInputJournal& journal, double x, double y);
+bool UJournalScroll(UInputJournal& journal, double x, double y);
+bool UJournalButton(UInputJournal& journal, int button, int action);
+
+// Frame end, after the window events were polled: a recording writes the frame out
+void UEndJournalFrame(UInputJournal& journal);
@@ -0,0 +1,923 @@
+#include <cstdint>      // uint8_t, int16_t
+#include <cstring>      // memset
+#include <cmath>        // cos, sqrt
+#include "JpegDecoder.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UJPEG_SSE2 1
+#include <emmintrin.h>  // SSE2
+#endif
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Zigzag position to natural (row major) position; the extra entries absorb corrupt run lengths
+    const int ZIGZAG[64 + 16] = {
+        0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+        12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+        63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63,
+    };
+
+    const int FAST_BITS = 9;
+    const int MAX_DIMENSION = 32768;
+
+    struct UHuffmanTable
+    {
+        uint16_t fast[1 << FAST_BITS];  // (length << 8) | symbol for codes up to FAST_BITS long, 0 = longer
+        int32_t fastAc[1 << FAST_BITS]; // AC code and magnitude bits both within FAST_BITS: (value << 8) | (run << 4) | total length
+        int32_t maxCode[18];            // largest code of each length, -1 = none of that length
+        int32_t valueOffset[17];        // index of a length's first symbol minus its first code
+        uint8_t symbols[256];
+        bool defined;
+    };
+
+    struct UJpegComponent
+    {
+        int id;
+        int h, v;                       // sampling factors
+        int quantTable;
+        int dcTable, acTable;           // of the current scan
+        int blocksPerLine;              // padded to whole MCUs
+        int blocksPerColumn;
+        int dcPredictor;
+        vector<int16_t> coefficients;   // progressive only: 64 per block, natural order
+        vector<uint8_t> plane;          // samples after the scaled inverse DCT
+        int planeStride;
+    };
+
+    // Entropy coded data; bits are kept MSB first, and zeros are fed in once a marker is reached
+    struct UBitReader
+    {
+        const uint8_t* data;
+        size_t pos;
+        size_t end;
+        uint64_t buffer;
+        int nBits;
+        bool atMarker;
+    };
+
+    struct UJpegDecoder
+    {
+        const uint8_t* data;
+        size_t size;
+        size_t pos;
+
+        uint16_t quant[4][64];          // natural order
+        UHuffmanTable dc[4];
+        UHuffmanTable ac[4];
+        UJpegComponent components[3];
+        int nComponents;
+        int width, height;
+        int hMax, vMax;
+        int mcusX, mcusY;
+        bool frame;
+        bool progressive;
+        int restartInterval;
+        bool rgb;                       // Adobe transform 0 or R, G, B component ids: no color conversion
+
+        int blockSize;                  // 8 / scale
+        float idct[8 * 8];              // [u * 8 + m]: basis u at output sample m of a blockSize point IDCT
+
+        UBitReader bits;
+        int eobRun;
+        bool corrupt;
+    };
+
+
+    // Tops the buffer up to at least 57 bits; callers only come here when they could run short
+    void UFillBits(UBitReader& reader)
+    {
+        while (reader.nBits <= 56)
+        {
+            uint64_t byte = 0;
+            if (!reader.atMarker && reader.pos < reader.end)
+            {
+                byte = reader.data[reader.pos];
+                if (byte == 0xFF)
+                {
+                    // FF 00 is a stuffed FF byte, anything else ends the segment
+                    if (reader.pos + 1 < reader.end && reader.data[reader.pos + 1] == 0x00)
+                        reader.pos += 2;
+                    else
+                    {
+                        reader.atMarker = true;
+                        byte = 0;
+                    }
+                }
+                else
+                    ++reader.pos;
+            }
+            reader.buffer |= byte << (56 - reader.nBits);
+            reader.nBits += 8;
+        }
+    }
+
+    inline void UConsumeBits(UBitReader& reader, int n)
+    {
+        reader.buffer <<= n;
+        reader.nBits -= n;
+    }
+
+    int UGetBits(UBitReader& reader, int n)
+    {
+        if (n == 0)
+            return 0;
+        if (reader.nBits < n)
+            UFillBits(reader);
+        int value = (int)(reader.buffer >> (64 - n));
+        UConsumeBits(reader, n);
+        return value;
+    }
+
+    // n bit magnitude category value to its signed value
+    int UReceiveExtend(UBitReader& reader, int n)
+    {
+        if (n == 0)
+            return 0;
+        int value = UGetBits(reader, n);
+        return value < (1 << (n - 1)) ? value - (1 << n) + 1 : value;
+    }
+
+    int UDecodeHuffman(UJpegDecoder& decoder, const UHuffmanTable& table)
+    {
+        UBitReader& reader = decoder.bits;
+        if (reader.nBits < 16)
+            UFillBits(reader);
+        int entry = table.fast[reader.buffer >> (64 - FAST_BITS)];
+        if (entry)
+        {
+            UConsumeBits(reader, entry >> 8);
+            return entry & 0xFF;
+        }
+        for (int length = FAST_BITS + 1; length <= 16; ++length)
+        {
+            int32_t code = (int32_t)(reader.buffer >> (64 - length));
+            if (code <= table.maxCode[length])
+            {
+                UConsumeBits(reader, length);
+                int index = table.valueOffset[length] + code;
+                return index >= 0 && index < 256 ? table.symbols[index] : 0;
+            }
+        }
+        decoder.corrupt = true;
+        UConsumeBits(reader, 16);
+        return 0;
+    }
+
+    bool UBuildHuffmanTable(const uint8_t counts[16], const uint8_t* symbols, int nSymbols, UHuffmanTable& table)
+    {
+        memset(table.fast, 0, sizeof(table.fast));
+        memcpy(table.symbols, symbols, nSymbols);
+        int32_t code = 0;
+        int k = 0;
+        for (int length = 1; length <= 16; ++length)
+        {
+            table.valueOffset[length] = k - code;
+            for (int i = 0; i < counts[length - 1]; ++i, ++code, ++k)
+            {
+                if (length <= FAST_BITS)
+                {
+                    int first = code << (FAST_BITS - length);
+                    for (int fill = 0; fill < 1 << (FAST_BITS - length); ++fill)
+                        table.fast[first + fill] = (uint16_t)(length << 8 | symbols[k]);
+                }
+            }
+            if (code > 1 << length)
+                return false;   // more codes than this length can hold
+            table.maxCode[length] = counts[length - 1] ? code - 1 : -1;
+            code <<= 1;
+        }
+        table.maxCode[0] = table.maxCode[17] = -1;
+
+        // Most AC coefficients are a short code plus a few magnitude bits, decoded with one lookup
+        for (int i = 0; i < 1 << FAST_BITS; ++i)
+        {
+            table.fastAc[i] = 0;
+            int entry = table.fast[i];
+            int length = entry >> 8, run = (entry >> 4) & 15, size = entry & 15;
+            if (!entry || size == 0 || length + size > FAST_BITS)
+                continue;
+            int value = (i >> (FAST_BITS - length - size)) & ((1 << size) - 1);
+            if (value < 1 << (size - 1))
+                value += 1 - (1 << size);
+            table.fastAc[i] = value * 256 + run * 16 + length + size;
+        }
+        table.defined = true;
+        return true;
+    }
+
+
+    // Basis functions of the reduced transform. A blockSize point IDCT of the lowest coefficients is
+    // the full 8 point IDCT sampled at the centres of each group of 8 / blockSize pixels, so the
+    // scaling matches: a DC only block comes out as its mean whatever the size.
+    void UCreateIdctTable(UJpegDecoder& decoder)
+    {
+        const double PI = 3.14159265358979323846;
+        int k = decoder.blockSize;
+        for (int u = 0; u < 8; ++u)
+        {
+            for (int m = 0; m < 8; ++m)
+            {
+                double c = u == 0 ? 1.0 / sqrt(2.0) : 1.0;
+                decoder.idct[u * 8 + m] = u < k && m < k ? (float)(0.5 * c * cos((2 * m + 1) * u * PI / (2 * k))) : 0.0f;
+            }
+        }
+    }
+
+    // Dequantizes the lowest blockSize x blockSize coefficients and writes blockSize x blockSize samples
+    void UScaledIdct(const UJpegDecoder& decoder, const int16_t* coefficients, const uint16_t* quant, uint8_t* out, int stride)
+    {
+        const int k = decoder.blockSize;
+        const float* table = decoder.idct;
+        float in[8 * 8];
+        float rows[8 * 8];
+        for (int v = 0; v < k; ++v)
+        {
+            for (int u = 0; u < k; ++u)
+                in[v * 8 + u] = (float)(coefficients[v * 8 + u] * quant[v * 8 + u]);
+        }
+
+#ifdef UJPEG_SSE2
+        if (k % 4 == 0)
+        {
+            // Four output samples per instruction, rows then columns
+            for (int v = 0; v < k; ++v)
+            {
+                for (int m = 0; m < k; m += 4)
+                {
+                    __m128 sum = _mm_setzero_ps();
+                    for (int u = 0; u < k; ++u)
+                        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(in[v * 8 + u]), _mm_loadu_ps(table + u * 8 + m)));
+                    _mm_storeu_ps(rows + v * 8 + m, sum);
+                }
+            }
+            const __m128 offset = _mm_set1_ps(128.0f);
+            for (int n = 0; n < k; ++n)
+            {
+                for (int m = 0; m < k; m += 4)
+                {
+                    __m128 sum = offset;
+                    for (int v = 0; v < k; ++v)
+                        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(table[v * 8 + n]), _mm_loadu_ps(rows + v * 8 + m)));
+                    __m128i samples = _mm_cvtps_epi32(sum);
+                    samples = _mm_packs_epi32(samples, samples);
+                    samples = _mm_packus_epi16(samples, samples);
+                    int packed = _mm_cvtsi128_si32(samples);
+                    memcpy(out + n * stride + m, &packed, 4);
+                }
+            }
+            return;
+        }
+#endif
+
+        for (int v = 0; v < k; ++v)
+        {
+            for (int m = 0; m < k; ++m)
+            {
+                float sum = 0.0f;
+                for (int u = 0; u < k; ++u)
+                    sum += in[v * 8 + u] * table[u * 8 + m];
+                rows[v * 8 + m] = sum;
+            }
+        }
+        for (int n = 0; n < k; ++n)
+        {
+            for (int m = 0; m < k; ++m)
+            {
+                float sum = 128.5f;
+                for (int v = 0; v < k; ++v)
+                    sum += table[v * 8 + n] * rows[v * 8 + m];
+                out[n * stride + m] = (uint8_t)(sum <= 0.0f ? 0 : (sum >= 255.0f ? 255 : (int)sum));
+            }
+        }
+    }
+
+    void UIdctBlock(UJpegDecoder& decoder, UJpegComponent& component, const int16_t* coefficients, int blockX, int blockY)
+    {
+        int k = decoder.blockSize;
+        uint8_t* out = component.plane.data() + (size_t)blockY * k * component.planeStride + (size_t)blockX * k;
+        UScaledIdct(decoder, coefficients, decoder.quant[component.quantTable], out, component.planeStride);
+    }
+
+
+    // One block of a baseline scan, all 64 coefficients at once
+    void UDecodeBaselineBlock(UJpegDecoder& decoder, UJpegComponent& component, int16_t block[64])
+    {
+        memset(block, 0, 64 * sizeof(int16_t));
+        int category = UDecodeHuffman(decoder, decoder.dc[component.dcTable]);
+        component.dcPredictor += UReceiveExtend(decoder.bits, category);
+        block[0] = (int16_t)component.dcPredictor;
+
+        const UHuffmanTable& table = decoder.ac[component.acTable];
+        UBitReader& reader = decoder.bits;
+        for (int k = 1; k < 64;)
+        {
+            if (reader.nBits < 16)
+                UFillBits(reader);
+            int fast = table.fastAc[reader.buffer >> (64 - FAST_BITS)];
+            if (fast)
+            {
+                UConsumeBits(reader, fast & 15);
+                k += (fast >> 4) & 15;
+                block[ZIGZAG[k++]] = (int16_t)(fast >> 8);
+                continue;
+            }
+
+            int rs = UDecodeHuffman(decoder, table);
+            int run = rs >> 4, size = rs & 15;
+            if (size == 0)
+            {
+                if (run != 15)
+                    break;      // end of block
+                k += 16;
+                continue;
+            }
+            k += run;
+            if (k > 63)
+            {
+                decoder.corrupt = true;
+                break;
+            }
+            block[ZIGZAG[k++]] = (int16_t)UReceiveExtend(decoder.bits, size);
+        }
+    }
+
+    void UDecodeDcFirst(UJpegDecoder& decoder, UJpegComponent& component, int16_t* block, int al)
+    {
+        int category = UDecodeHuffman(decoder, decoder.dc[component.dcTable]);
+        component.dcPredictor += UReceiveExtend(decoder.bits, category);
+        block[0] = (int16_t)(component.dcPredictor * (1 << al));
+    }
+
+    void UDecodeDcRefine(UJpegDecoder& decoder, int16_t* block, int al)
+    {
+        if (UGetBits(decoder.bits, 1))
+            block[0] |= (int16_t)(1 << al);
+    }
+
+    void UDecodeAcFirst(UJpegDecoder& decoder, const UJpegComponent& component, int16_t* block, int ss, int se, int al)
+    {
+        if (decoder.eobRun > 0)
+        {
+            --decoder.eobRun;
+            return;
+        }
+        const UHuffmanTable& table = decoder.ac[component.acTable];
+        UBitReader& reader = decoder.bits;
+        for (int k = ss; k <= se;)
+        {
+            if (reader.nBits < 16)
+                UFillBits(reader);
+            int fast = table.fastAc[reader.buffer >> (64 - FAST_BITS)];
+            if (fast)
+            {
+                UConsumeBits(reader, fast & 15);
+                k += (fast >> 4) & 15;
+                block[ZIGZAG[k++]] = (int16_t)((fast >> 8) * (1 << al));
+                continue;
+            }
+
+            int rs = UDecodeHuffman(decoder, table);
+            int run = rs >> 4, size = rs & 15;
+            if (size == 0)
+            {
+                if (run < 15)
+                {
+                    // End of band run, this block included
+                    decoder.eobRun = (1 << run) - 1 + UGetBits(decoder.bits, run);
+                    break;
+                }
+                k += 16;
+                continue;
+            }
+            k += run;
+            if (k > 63)
+            {
+                decoder.corrupt = true;
+                break;
+            }
+            block[ZIGZAG[k++]] = (int16_t)(UReceiveExtend(decoder.bits, size) * (1 << al));
+        }
+    }
+
+    // Successive approximation: one more bit for every coefficient already nonzero, new ones of +-1
+    void UDecodeAcRefine(UJpegDecoder& decoder, const UJpegComponent& component, int16_t* block, int ss, int se, int al)
+    {
+        const int16_t plus = (int16_t)(1 << al);
+        const int16_t minus = (int16_t)(-1 * (1 << al));
+        int k = ss;
+        if (decoder.eobRun == 0)
+        {
+            const UHuffmanTable& table = decoder.ac[component.acTable];
+            for (; k <= se; ++k)
+            {
+                int rs = UDecodeHuffman(decoder, table);
+                int run = rs >> 4, size = rs & 15;
+                int16_t value = 0;
+                if (size == 0)
+                {
+                    if (run < 15)
+                    {
+                        decoder.eobRun = (1 << run) + UGetBits(decoder.bits, run);
+                        break;
+                    }
+                }
+                else
+                    value = UGetBits(decoder.bits, 1) ? plus : minus;
+
+                // Skip run zero coefficients, refining the nonzero ones passed on the way
+                for (; k <= se; ++k)
+                {
+                    int16_t& coefficient = block[ZIGZAG[k]];
+                    if (coefficient != 0)
+                    {
+                        if (UGetBits(decoder.bits, 1) && (coefficient & plus) == 0)
+                            coefficient += coefficient >= 0 ? plus : minus;
+                    }
+                    else if (--run < 0)
+                        break;
+                }
+                if (value && k <= se)
+                    block[ZIGZAG[k]] = value;
+            }
+        }
+
+        if (decoder.eobRun > 0)
+        {
+            // Inside an end of band run only the existing coefficients get their bit
+            for (; k <= se; ++k)
+            {
+                int16_t& coefficient = block[ZIGZAG[k]];
+                if (coefficient != 0 && UGetBits(decoder.bits, 1) && (coefficient & plus) == 0)
+                    coefficient += coefficient >= 0 ? plus : minus;
+            }
+            --decoder.eobRun;
+        }
+    }
+
+
+    // Byte aligns, steps over the RSTn marker and starts the next interval from scratch
+    void URestart(UJpegDecoder& decoder)
+    {
+        UBitReader& reader = decoder.bits;
+        reader.buffer = 0;
+        reader.nBits = 0;
+        reader.atMarker = false;
+        while (reader.pos + 1 < reader.end && !(reader.data[reader.pos] == 0xFF && reader.data[reader.pos + 1] >= 0xD0 && reader.data[reader.pos + 1] <= 0xD7))
+            ++reader.pos;
+        if (reader.pos + 1 < reader.end)
+            reader.pos += 2;
+        for (int i = 0; i < decoder.nComponents; ++i)
+            decoder.components[i].dcPredictor = 0;
+        decoder.eobRun = 0;
+    }
+
+    // One scan: interleaved scans go MCU by MCU, single component scans block by block
+    bool UDecodeScan(UJpegDecoder& decoder, const int* scanComponents, int nScanComponents, int ss, int se, int ah, int al)
+    {
+        decoder.bits.data = decoder.data;
+        decoder.bits.pos = decoder.pos;
+        decoder.bits.end = decoder.size;
+        decoder.bits.buffer = 0;
+        decoder.bits.nBits = 0;
+        decoder.bits.atMarker = false;
+        decoder.eobRun = 0;
+        for (int i = 0; i < decoder.nComponents; ++i)
+            decoder.components[i].dcPredictor = 0;
+
+        int mcusX = decoder.mcusX, mcusY = decoder.mcusY;
+        if (nScanComponents == 1)
+        {
+            // Only the blocks that cover the image, not the MCU padding
+            const UJpegComponent& component = decoder.components[scanComponents[0]];
+            int samplesX = (decoder.width * component.h + decoder.hMax - 1) / decoder.hMax;
+            int samplesY = (decoder.height * component.v + decoder.vMax - 1) / decoder.vMax;
+            mcusX = (samplesX + 7) / 8;
+            mcusY = (samplesY + 7) / 8;
+        }
+
+        int16_t baselineBlock[64];
+        size_t nMcus = (size_t)mcusX * mcusY;
+        for (size_t mcu = 0; mcu < nMcus; ++mcu)
+        {
+            if (decoder.restartInterval && mcu > 0 && mcu % decoder.restartInterval == 0)
+                URestart(decoder);
+
+            int mcuX = (int)(mcu % mcusX), mcuY = (int)(mcu / mcusX);
+            for (int c = 0; c < nScanComponents; ++c)
+            {
+                UJpegComponent& component = decoder.components[scanComponents[c]];
+                int blocksX = nScanComponents == 1 ? 1 : component.h;
+                int blocksY = nScanComponents == 1 ? 1 : component.v;
+                for (int y = 0; y < blocksY; ++y)
+                {
+                    for (int x = 0; x < blocksX; ++x)
+                    {
+                        int blockX = mcuX * blocksX + x, blockY = mcuY * blocksY + y;
+                        if (!decoder.progressive)
+                        {
+                            UDecodeBaselineBlock(decoder, component, baselineBlock);
+                            UIdctBlock(decoder, component, baselineBlock, blockX, blockY);
+                            continue;
+                        }
+
+                        int16_t* block = component.coefficients.data() + ((size_t)blockY * component.blocksPerLine + blockX) * 64;
+                        if (ss == 0)
+                        {
+                            if (ah == 0)
+                                UDecodeDcFirst(decoder, component, block, al);
+                            else
+                                UDecodeDcRefine(decoder, block, al);
+                        }
+                        else if (ah == 0)
+                            UDecodeAcFirst(decoder, component, block, ss, se, al);
+                        else
+                            UDecodeAcRefine(decoder, component, block, ss, se, al);
+                    }
+                }
+            }
+            if (decoder.corrupt)
+                return false;
+        }
+
+        // Markers are read from where the entropy coded data stopped
+        decoder.pos = decoder.bits.pos;
+        return true;
+    }
+
+
+    int UReadU16(const uint8_t* p)
+    {
+        return p[0] << 8 | p[1];
+    }
+
+    bool UReadQuantTables(UJpegDecoder& decoder, const uint8_t* p, const uint8_t* end)
+    {
+        while (p < end)
+        {
+            int precision = *p >> 4, index = *p & 15;
+            ++p;
+            if (index > 3 || p + (precision ? 128 : 64) > end)
+                return false;
+            for (int i = 0; i < 64; ++i)
+            {
+                decoder.quant[index][ZIGZAG[i]] = (uint16_t)(precision ? UReadU16(p) : *p);
+                p += precision ? 2 : 1;
+            }
+        }
+        return true;
+    }
+
+    bool UReadHuffmanTables(UJpegDecoder& decoder, const uint8_t* p, const uint8_t* end)
+    {
+        while (p < end)
+        {
+            int tableClass = *p >> 4, index = *p & 15;
+            ++p;
+            if (tableClass > 1 || index > 3 || p + 16 > end)
+                return false;
+            const uint8_t* counts = p;
+            int nSymbols = 0;
+            for (int i = 0; i < 16; ++i)
+                nSymbols += counts[i];
+            p += 16;
+            if (nSymbols > 256 || p + nSymbols > end)
+                return false;
+            // Every symbol ends up as a bit count: DC categories go up to 11, AC sizes up to 10
+            for (int i = 0; i < nSymbols; ++i)
+            {
+                if (tableClass == 0 ? p[i] > 11 : (p[i] & 15) > 10)
+                    return false;
+            }
+            if (!UBuildHuffmanTable(counts, p, nSymbols, tableClass == 0 ? decoder.dc[index] : decoder.ac[index]))
+                return false;
+            p += nSymbols;
+        }
+        return true;
+    }
+
+    bool UReadFrame(UJpegDecoder& decoder, const uint8_t* p, const uint8_t* end)
+    {
+        if (decoder.frame || end - p < 6 || p[0] != 8)
+            return false;   // a second frame, or 12 bit samples
+        decoder.height = UReadU16(p + 1);
+        decoder.width = UReadU16(p + 3);
+        decoder.nComponents = p[5];
+        p += 6;
+        if (decoder.width <= 0 || decoder.height <= 0 || decoder.width > MAX_DIMENSION || decoder.height > MAX_DIMENSION)
+            return false;   // 0 height means a DNL marker, which nobody writes
+        if ((decoder.nComponents != 1 && decoder.nComponents != 3) || end - p < decoder.nComponents * 3)
+            return false;
+
+        decoder.hMax = decoder.vMax = 1;
+        for (int i = 0; i < decoder.nComponents; ++i, p += 3)
+        {
+            UJpegComponent& component = decoder.components[i];
+            component.id = p[0];
+            component.h = p[1] >> 4;
+            component.v = p[1] & 15;
+            component.quantTable = p[2];
+            if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quantTable > 3)
+                return false;
+            decoder.hMax = component.h > decoder.hMax ? component.h : decoder.hMax;
+            decoder.vMax = component.v > decoder.vMax ? component.v : decoder.vMax;
+        }
+        if (decoder.nComponents == 3 && decoder.components[0].id == 'R' && decoder.components[1].id == 'G' && decoder.components[2].id == 'B')
+            decoder.rgb = true;
+
+        decoder.mcusX = (decoder.width + 8 * decoder.hMax - 1) / (8 * decoder.hMax);
+        decoder.mcusY = (decoder.height + 8 * decoder.vMax - 1) / (8 * decoder.vMax);
+        int k = decoder.blockSize;
+        for (int i = 0; i < decoder.nComponents; ++i)
+        {
+            UJpegComponent& component = decoder.components[i];
+            component.blocksPerLine = decoder.mcusX * component.h;
+            component.blocksPerColumn = decoder.mcusY * component.v;
+            component.planeStride = component.blocksPerLine * k;
+            component.plane.assign((size_t)component.planeStride * component.blocksPerColumn * k, 0);
+            if (decoder.progressive)
+                component.coefficients.assign((size_t)component.blocksPerLine * component.blocksPerColumn * 64, 0);
+        }
+        decoder.frame = true;
+        return true;
+    }
+
+    bool UReadScan(UJpegDecoder& decoder, const uint8_t* p, const uint8_t* end)
+    {
+        if (!decoder.frame || end - p < 1)
+            return false;
+        int nScanComponents = p[0];
+        ++p;
+        if (nScanComponents < 1 || nScanComponents > decoder.nComponents || end - p < nScanComponents * 2 + 3)
+            return false;
+
+        int scanComponents[3];
+        for (int i = 0; i < nScanComponents; ++i, p += 2)
+        {
+            int found = -1;
+            for (int c = 0; c < decoder.nComponents; ++c)
+            {
+                if (decoder.components[c].id == p[0])
+                    found = c;
+            }
+            if (found < 0)
+                return false;
+            UJpegComponent& component = decoder.components[found];
+            component.dcTable = p[1] >> 4;
+            component.acTable = p[1] & 15;
+            if (component.dcTable > 3 || component.acTable > 3)
+                return false;
+            scanComponents[i] = found;
+        }
+        int ss = p[0], se = p[1], ah = p[2] >> 4, al = p[2] & 15;
+
+        // Only the tables this scan actually reads have to exist
+        for (int i = 0; i < nScanComponents; ++i)
+        {
+            const UJpegComponent& component = decoder.components[scanComponents[i]];
+            if ((ss == 0 && ah == 0 && !decoder.dc[component.dcTable].defined) || (se > 0 && !decoder.ac[component.acTable].defined))
+                return false;
+        }
+
+        if (decoder.progressive)
+        {
+            if (ss > se || se > 63 || al > 13 || (ss == 0 && se != 0) || (ss > 0 && nScanComponents != 1))
+                return false;
+        }
+        else if (ss != 0 || se != 63 || ah != 0 || al != 0)
+            return false;
+
+        return UDecodeScan(decoder, scanComponents, nScanComponents, ss, se, ah, al);
+    }
+
+    // Next marker code at or after pos, skipping anything that isn't one; -1 at the end of the data
+    int UNextMarker(UJpegDecoder& decoder)
+    {
+        while (decoder.pos + 1 < decoder.size)
+        {
+            if (decoder.data[decoder.pos] == 0xFF && decoder.data[decoder.pos + 1] != 0xFF && decoder.data[decoder.pos + 1] != 0x00)
+            {
+                int marker = decoder.data[decoder.pos + 1];
+                decoder.pos += 2;
+                return marker;
+            }
+            ++decoder.pos;
+        }
+        return -1;
+    }
+
+    bool UReadMarkers(UJpegDecoder& decoder)
+    {
+        for (;;)
+        {
+            int marker = UNextMarker(decoder);
+            if (marker < 0 || marker == 0xD9)
+                return decoder.frame;   // a truncated file still shows what arrived
+            if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0x01)
+                continue;               // no length field
+
+            if (decoder.pos + 2 > decoder.size)
+                return false;
+            size_t length = (size_t)UReadU16(decoder.data + decoder.pos);
+            if (length < 2 || decoder.pos + length > decoder.size)
+                return false;
+            const uint8_t* p = decoder.data + decoder.pos + 2;
+            const uint8_t* end = decoder.data + decoder.pos + length;
+            decoder.pos += length;
+
+            bool valid = true;
+            switch (marker)
+            {
+            case 0xC0:  // baseline
+            case 0xC1:  // extended sequential, Huffman
+                valid = UReadFrame(decoder, p, end);
+                break;
+            case 0xC2:  // progressive, Huffman
+                decoder.progressive = true;
+                valid = UReadFrame(decoder, p, end);
+                break;
+            case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+            case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+                return false;           // lossless, hierarchical or arithmetic coded
+            case 0xC4:
+                valid = UReadHuffmanTables(decoder, p, end);
+                break;
+            case 0xDB:
+                valid = UReadQuantTables(decoder, p, end);
+                break;
+            case 0xDD:
+                valid = end - p >= 2;
+                if (valid)
+                    decoder.restartInterval = UReadU16(p);
+                break;
+            case 0xDA:
+                valid = UReadScan(decoder, p, end);
+                break;
+            case 0xEE:
+                // Adobe: transform 0 means the three components are plain RGB
+                if (end - p >= 12 && memcmp(p, "Adobe", 5) == 0 && p[11] == 0)
+                    decoder.rgb = true;
+                break;
+            default:
+                break;                  // APPn, comments
+            }
+            if (!valid)
+                return false;
+        }
+    }
+
+    // Chroma is taken from the nearest sample of its (equally scaled) plane
+    void UConvertToRgb(const UJpegDecoder& decoder, int scale, bool flipVertically, UJpegImage& image)
+    {
+        image.width = (decoder.width + scale - 1) / scale;
+        image.height = (decoder.height + scale - 1) / scale;
+        image.channels = 3;
+        image.scale = scale;
+        image.pixels.resize((size_t)image.width * image.height * 3);
+
+        const UJpegComponent* components = decoder.components;
+        vector<int> columns[3];
+        for (int c = 0; c < decoder.nComponents; ++c)
+        {
+            columns[c].resize(image.width);
+            for (int x = 0; x < image.width; ++x)
+                columns[c][x] = x * components[c].h / decoder.hMax;
+        }
+
+        for (int y = 0; y < image.height; ++y)
+        {
+            unsigned char* out = image.pixels.data() + (size_t)(flipVertically ? image.height - 1 - y : y) * image.width * 3;
+            const uint8_t* rows[3];
+            for (int c = 0; c < decoder.nComponents; ++c)
+                rows[c] = components[c].plane.data() + (size_t)(y * components[c].v / decoder.vMax) * components[c].planeStride;
+
+            if (decoder.nComponents == 1)
+            {
+                for (int x = 0; x < image.width; ++x, out += 3)
+                    out[0] = out[1] = out[2] = rows[0][columns[0][x]];
+            }
+            else if (decoder.rgb)
+            {
+                for (int x = 0; x < image.width; ++x, out += 3)
+                {
+                    out[0] = rows[0][columns[0][x]];
+                    out[1] = rows[1][columns[1][x]];
+                    out[2] = rows[2][columns[2][x]];
+                }
+            }
+            else
+            {
+                // JFIF YCbCr in 16.16 fixed point
+                for (int x = 0; x < image.width; ++x, out += 3)
+                {
+                    int luma = rows[0][columns[0][x]];
+                    int cb = rows[1][columns[1][x]] - 128;
+                    int cr = rows[2][columns[2][x]] - 128;
+                    int r = luma + ((91881 * cr + 32768) >> 16);
+                    int g = luma + ((-22554 * cb - 46802 * cr + 32768) >> 16);
+                    int b = luma + ((116130 * cb + 32768) >> 16);
+                    out[0] = (unsigned char)(r < 0 ? 0 : (r > 255 ? 255 : r));
+                    out[1] = (unsigned char)(g < 0 ? 0 : (g > 255 ? 255 : g));
+                    out[2] = (unsigned char)(b < 0 ? 0 : (b > 255 ? 255 : b));
+                }
+            }
+        }
+    }
+}
+
+
+bool UReadJpegSize(const unsigned char* data, size_t size, int& width, int& height)
+{
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return false;
+    size_t pos = 2;
+    while (pos + 4 <= size)
+    {
+        if (data[pos] != 0xFF)
+        {
+            ++pos;
+            continue;
+        }
+        int marker = data[pos + 1];
+        if (marker == 0xFF || (marker >= 0xD0 && marker <= 0xD8) || marker == 0x01)
+        {
+            pos += marker == 0xFF ? 1 : 2;
+            continue;
+        }
+        size_t length = (size_t)UReadU16(data + pos + 2);
+        bool startOfFrame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (startOfFrame && length >= 7 && pos + 2 + length <= size)
+        {
+            height = UReadU16(data + pos + 5);
+            width = UReadU16(data + pos + 7);
+            return width > 0 && height > 0;
+        }
+        if (marker == 0xDA || marker == 0xD9)
+            return false;
+        pos += 2 + length;
+    }
+    return false;
+}
+
+int UChooseJpegScale(int width, int height, int maxSize)
+{
+    if (maxSize <= 0)
+        return 1;
+    int side = width > height ? width : height;
+    for (int scale = 1; scale < 8; scale *= 2)
+    {
+        if ((side + scale - 1) / scale <= maxSize)
+            return scale;
+    }
+    return 8;
+}
+
+bool UDecodeJpeg(const unsigned char* data, size_t size, int scale, bool flipVertically, UJpegImage& image)
+{
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8 || (scale != 1 && scale != 2 && scale != 4 && scale != 8))
+        return false;
+
+    // Huffman tables are large; keep them off the stack
+    vector<UJpegDecoder> storage(1);
+    UJpegDecoder& decoder = storage[0];
+    memset(decoder.quant, 0, sizeof(decoder.quant));
+    for (int i = 0; i < 4; ++i)
+        decoder.dc[i].defined = decoder.ac[i].defined = false;
+    decoder.data = data;
+    decoder.size = size;
+    decoder.pos = 2;
+    decoder.nComponents = 0;
+    decoder.width = decoder.height = 0;
+    decoder.frame = false;
+    decoder.progressive = false;
+    decoder.restartInterval = 0;
+    decoder.rgb = false;
+    decoder.blockSize = 8 / scale;
+    decoder.eobRun = 0;
+    decoder.corrupt = false;
+    UCreateIdctTable(decoder);
+
+    if (!UReadMarkers(decoder))
+        return false;
+
+    // Progressive files only have their final coefficients once every scan is in
+    if (decoder.progressive)
+    {
+        for (int c = 0; c < decoder.nComponents; ++c)
+        {
+            UJpegComponent& component = decoder.components[c];
+            for (int blockY = 0; blockY < component.blocksPerColumn; ++blockY)
+            {
+                for (int blockX = 0; blockX < component.blocksPerLine; ++blockX)
+                    UIdctBlock(decoder, component, component.coefficients.data() + ((size_t)blockY * component.blocksPerLine + blockX) * 64, blockX, blockY);
+            }
+            vector<int16_t>().swap(component.coefficients);
+        }
+    }
+
+    UConvertToRgb(decoder, scale, flipVertically, image);
+    return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>      // size_t
+#include <vector>       // std::vector
+
+/* JPEG decoder that can produce the image at 1/2, 1/4 or 1/8 size straight from the DCT
+ * coefficients: each 8x8 block goes through a 4x4, 2x2 or 1x1 inverse DCT of its lowest
+ * frequencies, so a reduced decode does a fraction of the transform work and never holds the full
+ * size image. Handles baseline and progressive Huffman coded files with 8 bit samples, which covers
+ * what cameras and image editors write; anything else (arithmetic coding, 12 bit, lossless, CMYK)
+ * is refused so the caller can fall back to stb_image.
+ */
+
+struct UJpegImage
+{
+    int width;              // after scaling
+    int height;
+    int channels;           // always 3, grayscale is expanded
+    int scale;              // 1, 2, 4 or 8
+    std::vector<unsigned char> pixels;
+};
+
+// Size from the frame header, without decoding anything
+bool UReadJpegSize(const unsigned char* data, size_t size, int& width, int& height);
+// Smallest of 1, 2, 4 and 8 that brings the larger side down to maxSize, or 8 if none does
+int UChooseJpegScale(int width, int height, int maxSize);
+// RGB pixels at 1/scale of the full size (rounded up), rows bottom up when flipVertically is set
+bool UDecodeJpeg(const unsigned char* data, size_t size, int scale, bool flipVertically, UJpegImage& image);
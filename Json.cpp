@@ -0,0 +1,386 @@
+#include <cstdlib>      // strtod
+#include <cstring>      // strcmp
+#include <sstream>      // ostringstream
+#include "Json.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    struct UJsonParser
+    {
+        const char* text;
+        size_t length;
+        size_t pos;
+        string error;
+
+        bool Fail(const char* message)
+        {
+            if (error.empty())
+                error = string(message) + " at byte " + to_string(pos);
+            return false;
+        }
+
+        void SkipWhitespace()
+        {
+            while (pos < length && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'))
+                ++pos;
+        }
+
+        bool Match(const char* literal)
+        {
+            size_t n = strlen(literal);
+            if (pos + n > length || strncmp(text + pos, literal, n) != 0)
+                return false;
+            pos += n;
+            return true;
+        }
+
+        static void AppendUtf8(string& out, unsigned codepoint)
+        {
+            if (codepoint < 0x80)
+                out += (char)codepoint;
+            else if (codepoint < 0x800)
+            {
+                out += (char)(0xc0 | (codepoint >> 6));
+                out += (char)(0x80 | (codepoint & 0x3f));
+            }
+            else if (codepoint < 0x10000)
+            {
+                out += (char)(0xe0 | (codepoint >> 12));
+                out += (char)(0x80 | ((codepoint >> 6) & 0x3f));
+                out += (char)(0x80 | (codepoint & 0x3f));
+            }
+            else
+            {
+                out += (char)(0xf0 | (codepoint >> 18));
+                out += (char)(0x80 | ((codepoint >> 12) & 0x3f));
+                out += (char)(0x80 | ((codepoint >> 6) & 0x3f));
+                out += (char)(0x80 | (codepoint & 0x3f));
+            }
+        }
+
+        bool ParseHex4(unsigned& value)
+        {
+            if (pos + 4 > length)
+                return Fail("Truncated \\u escape");
+            value = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                char c = text[pos++];
+                value <<= 4;
+                if (c >= '0' && c <= '9') value |= (unsigned)(c - '0');
+                else if (c >= 'a' && c <= 'f') value |= (unsigned)(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F') value |= (unsigned)(c - 'A' + 10);
+                else return Fail("Bad \\u escape");
+            }
+            return true;
+        }
+
+        bool ParseString(string& out)
+        {
+            // Caller checked the opening quote
+            ++pos;
+            out.clear();
+            while (pos < length)
+            {
+                char c = text[pos++];
+                if (c == '"')
+                    return true;
+                if (c != '\\')
+                {
+                    out += c;
+                    continue;
+                }
+                if (pos >= length)
+                    break;
+                char escape = text[pos++];
+                switch (escape)
+                {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u':
+                {
+                    unsigned codepoint = 0;
+                    if (!ParseHex4(codepoint))
+                        return false;
+                    // Surrogate pair: a high half must be followed by a low one, and a low one never stands alone
+                    if (codepoint >= 0xdc00 && codepoint < 0xe000)
+                        return Fail("Unpaired surrogate");
+                    if (codepoint >= 0xd800 && codepoint < 0xdc00)
+                    {
+                        unsigned low = 0;
+                        if (!Match("\\u"))
+                            return Fail("Unpaired surrogate");
+                        if (!ParseHex4(low))
+                            return false;
+                        if (low < 0xdc00 || low >= 0xe000)
+                            return Fail("Unpaired surrogate");
+                        codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    AppendUtf8(out, codepoint);
+                }
+                break;
+                default:
+                    return Fail("Bad escape");
+                }
+            }
+            return Fail("Unterminated string");
+        }
+
+        bool ParseValue(UJsonValue& value, int depth)
+        {
+            if (depth > 256)
+                return Fail("Nesting too deep");
+
+            SkipWhitespace();
+            if (pos >= length)
+                return Fail("Unexpected end");
+
+            char c = text[pos];
+            if (c == '{')
+            {
+                value.type = UJsonValue::JSON_OBJECT;
+                ++pos;
+                SkipWhitespace();
+                if (pos < length && text[pos] == '}')
+                {
+                    ++pos;
+                    return true;
+                }
+                while (true)
+                {
+                    SkipWhitespace();
+                    if (pos >= length || text[pos] != '"')
+                        return Fail("Expected key");
+                    value.object.push_back(make_pair(string(), UJsonValue()));
+                    if (!ParseString(value.object.back().first))
+                        return false;
+                    SkipWhitespace();
+                    if (pos >= length || text[pos] != ':')
+                        return Fail("Expected ':'");
+                    ++pos;
+                    if (!ParseValue(value.object.back().second, depth + 1))
+                        return false;
+                    SkipWhitespace();
+                    if (pos < length && text[pos] == ',')
+                    {
+                        ++pos;
+                        continue;
+                    }
+                    if (pos < length && text[pos] == '}')
+                    {
+                        ++pos;
+                        return true;
+                    }
+                    return Fail("Expected ',' or '}'");
+                }
+            }
+            if (c == '[')
+            {
+                value.type = UJsonValue::JSON_ARRAY;
+                ++pos;
+                SkipWhitespace();
+                if (pos < length && text[pos] == ']')
+                {
+                    ++pos;
+                    return true;
+                }
+                while (true)
+                {
+                    value.array.push_back(UJsonValue());
+                    if (!ParseValue(value.array.back(), depth + 1))
+                        return false;
+                    SkipWhitespace();
+                    if (pos < length && text[pos] == ',')
+                    {
+                        ++pos;
+                        continue;
+                    }
+                    if (pos < length && text[pos] == ']')
+                    {
+                        ++pos;
+                        return true;
+                    }
+                    return Fail("Expected ',' or ']'");
+                }
+            }
+            if (c == '"')
+            {
+                value.type = UJsonValue::JSON_STRING;
+                return ParseString(value.string);
+            }
+            if (Match("true"))
+            {
+                value.type = UJsonValue::JSON_BOOL;
+                value.boolean = true;
+                return true;
+            }
+            if (Match("false"))
+            {
+                value.type = UJsonValue::JSON_BOOL;
+                value.boolean = false;
+                return true;
+            }
+            if (Match("null"))
+            {
+                value.type = UJsonValue::JSON_NULL;
+                return true;
+            }
+            if (c == '-' || (c >= '0' && c <= '9'))
+            {
+                // strtod needs a terminated buffer; numbers are short so copy them out
+                size_t start = pos;
+                while (pos < length && strchr("+-0123456789.eE", text[pos]))
+                    ++pos;
+                string number(text + start, pos - start);
+                char* end = nullptr;
+                value.type = UJsonValue::JSON_NUMBER;
+                value.number = strtod(number.c_str(), &end);
+                if (end != number.c_str() + number.size())
+                    return Fail("Bad number");
+                return true;
+            }
+            return Fail("Unexpected character");
+        }
+    };
+
+    void UWriteString(ostringstream& out, const string& text)
+    {
+        out << '"';
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20)
+                {
+                    const char* hex = "0123456789abcdef";
+                    out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+                }
+                else
+                    out << c;
+            }
+        }
+        out << '"';
+    }
+
+    void UWriteValue(ostringstream& out, const UJsonValue& value, int indent, int depth)
+    {
+        string newline = indent >= 0 ? "\n" : "";
+        string pad = indent >= 0 ? string((depth + 1) * indent, ' ') : "";
+        string closePad = indent >= 0 ? string(depth * indent, ' ') : "";
+
+        switch (value.type)
+        {
+        case UJsonValue::JSON_NULL: out << "null"; break;
+        case UJsonValue::JSON_BOOL: out << (value.boolean ? "true" : "false"); break;
+        case UJsonValue::JSON_NUMBER:
+        {
+            ostringstream number;
+            number.precision(9);
+            number << value.number;
+            out << number.str();
+        }
+        break;
+        case UJsonValue::JSON_STRING: UWriteString(out, value.string); break;
+        case UJsonValue::JSON_ARRAY:
+            out << '[';
+            for (size_t i = 0; i < value.array.size(); ++i)
+            {
+                out << (i ? "," : "") << newline << pad;
+                UWriteValue(out, value.array[i], indent, depth + 1);
+            }
+            if (!value.array.empty())
+                out << newline << closePad;
+            out << ']';
+            break;
+        case UJsonValue::JSON_OBJECT:
+            out << '{';
+            for (size_t i = 0; i < value.object.size(); ++i)
+            {
+                out << (i ? "," : "") << newline << pad;
+                UWriteString(out, value.object[i].first);
+                out << (indent >= 0 ? ": " : ":");
+                UWriteValue(out, value.object[i].second, indent, depth + 1);
+            }
+            if (!value.object.empty())
+                out << newline << closePad;
+            out << '}';
+            break;
+        }
+    }
+}
+
+const UJsonValue* UJsonValue::Find(const char* key) const
+{
+    if (type != JSON_OBJECT)
+        return nullptr;
+    for (const auto& member : object)
+    {
+        if (member.first == key)
+            return &member.second;
+    }
+    return nullptr;
+}
+
+double UJsonValue::NumberOr(const char* key, double fallback) const
+{
+    const UJsonValue* member = Find(key);
+    return member && member->type == JSON_NUMBER ? member->number : fallback;
+}
+
+int UJsonValue::IntOr(const char* key, int fallback) const
+{
+    const UJsonValue* member = Find(key);
+    return member && member->type == JSON_NUMBER ? (int)member->number : fallback;
+}
+
+string UJsonValue::StringOr(const char* key, const std::string& fallback) const
+{
+    const UJsonValue* member = Find(key);
+    return member && member->type == JSON_STRING ? member->string : fallback;
+}
+
+bool UJsonValue::BoolOr(const char* key, bool fallback) const
+{
+    const UJsonValue* member = Find(key);
+    return member && member->type == JSON_BOOL ? member->boolean : fallback;
+}
+
+bool UParseJson(const char* text, size_t length, UJsonValue& value, string& error)
+{
+    UJsonParser parser = { text, length, 0, string() };
+    value = UJsonValue();
+    if (!parser.ParseValue(value, 0))
+    {
+        error = parser.error;
+        return false;
+    }
+    parser.SkipWhitespace();
+    if (parser.pos != length && text[parser.pos] != '\0')
+    {
+        parser.Fail("Trailing characters");
+        error = parser.error;
+        return false;
+    }
+    return true;
+}
+
+string UWriteJson(const UJsonValue& value, int indent)
+{
+    ostringstream out;
+    UWriteValue(out, value, indent, 0);
+    return out.str();
+}
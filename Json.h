@@ -0,0 +1,31 @@
+#pragma once
+#include <string>       // std::string
+#include <utility>      // std::pair
+#include <vector>       // std::vector
+
+// Minimal JSON document, enough for glTF and the scene files
+struct UJsonValue
+{
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+    Type type = JSON_NULL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<UJsonValue> array;
+    std::vector<std::pair<std::string, UJsonValue>> object;
+
+    // Object member lookup, nullptr when missing or not an object
+    const UJsonValue* Find(const char* key) const;
+
+    // Convenience accessors with defaults
+    double NumberOr(const char* key, double fallback) const;
+    int IntOr(const char* key, int fallback) const;
+    std::string StringOr(const char* key, const std::string& fallback) const;
+    bool BoolOr(const char* key, bool fallback) const;
+};
+
+// Parses text into value; on failure error holds a message with the byte offset
+bool UParseJson(const char* text, size_t length, UJsonValue& value, std::string& error);
+// Serializes value (compact when indent < 0)
+std::string UWriteJson(const UJsonValue& value, int indent = 2);
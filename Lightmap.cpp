@@ -0,0 +1,643 @@
+#include <iostream>     // cout, cerr
+#include <fstream>      // ofstream
+#include <algorithm>    // sort
+#include <atomic>       // std::atomic
+#include <chrono>       // timing
+#include <cmath>        // ceil, exp
+#include <cstring>      // memcpy, memset
+#include <string>       // std::string
+#include <thread>       // std::thread
+#include <unordered_map>
+#include "Lightmap.h"
+#include "MappedFile.h"
+
+using namespace std; // Standard namespace
+
+static_assert(sizeof(ULightmapFileHeader) == 40, "ULightmapFileHeader layout is part of the file format");
+
+namespace
+{
+    const int CHART_BORDER = 2;         // texels around every chart, filled by dilation so bilinear taps stay on the chart
+    const float RAY_OFFSET = 1e-3f;     // world units off the surface for rays leaving a texel
+    const int FILTER_RADIUS = 3;        // texels, denoiser footprint is (2r + 1)^2
+
+    double UMillisecondsSince(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // One flat group of connected triangles of one input
+    struct UChart
+    {
+        size_t input;
+        int axis;                   // dropped by the projection
+        vector<uint32_t> triangles;
+        glm::vec2 min;              // projected world units
+        glm::vec2 max;
+        int width, height;          // texels, border included
+        int x, y;                   // placement in the atlas
+    };
+
+    int UFind(vector<uint32_t>& parents, uint32_t i)
+    {
+        while (parents[i] != i)
+        {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return (int)i;
+    }
+
+    glm::vec2 UProject(const glm::vec3& p, int axis)
+    {
+        return glm::vec2(p[(axis + 1) % 3], p[(axis + 2) % 3]);
+    }
+
+    uint32_t UCorner(const UMeshData& mesh, size_t triangle, int corner)
+    {
+        return mesh.indices.empty() ? (uint32_t)(triangle * 3 + corner) : mesh.indices[triangle * 3 + corner];
+    }
+
+    size_t UTriangleCount(const UMeshData& mesh)
+    {
+        return (mesh.indices.empty() ? mesh.positions.size() : mesh.indices.size()) / 3;
+    }
+
+    // Charts of one input: union of triangles sharing an edge and facing the same major axis
+    void USegmentCharts(const ULightmapInput& input, size_t inputIndex, vector<UChart>& charts)
+    {
+        const UMeshData& mesh = *input.mesh;
+        size_t nTriangles = UTriangleCount(mesh);
+
+        // UV seams split vertices, so edges are matched on positions
+        unordered_map<string, uint32_t> positionIds;
+        vector<uint32_t> cornerIds(nTriangles * 3);
+        vector<int> buckets(nTriangles);
+        for (size_t t = 0; t < nTriangles; ++t)
+        {
+            glm::vec3 p[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                uint32_t vertex = UCorner(mesh, t, c);
+                p[c] = glm::vec3(input.model * glm::vec4(mesh.positions[vertex], 1.0f));
+                string key((const char*)&mesh.positions[vertex], sizeof(glm::vec3));
+                cornerIds[t * 3 + c] = positionIds.insert(make_pair(key, (uint32_t)positionIds.size())).first->second;
+            }
+            glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 a(fabs(n.x), fabs(n.y), fabs(n.z));
+            int axis = a.x >= a.y && a.x >= a.z ? 0 : (a.y >= a.z ? 1 : 2);
+            buckets[t] = axis * 2 + (n[axis] < 0.0f ? 1 : 0);
+        }
+
+        vector<uint32_t> parents(nTriangles);
+        for (size_t t = 0; t < nTriangles; ++t)
+            parents[t] = (uint32_t)t;
+        unordered_map<uint64_t, uint32_t> edges;
+        for (size_t t = 0; t < nTriangles; ++t)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                uint32_t a = cornerIds[t * 3 + c], b = cornerIds[t * 3 + (c + 1) % 3];
+                uint64_t key = a < b ? ((uint64_t)a << 32 | b) : ((uint64_t)b << 32 | a);
+                auto inserted = edges.insert(make_pair(key, (uint32_t)t));
+                uint32_t other = inserted.first->second;
+                if (!inserted.second && buckets[other] == buckets[t])
+                    parents[UFind(parents, (uint32_t)t)] = (uint32_t)UFind(parents, other);
+            }
+        }
+
+        unordered_map<int, size_t> chartOfRoot;
+        for (size_t t = 0; t < nTriangles; ++t)
+        {
+            int root = UFind(parents, (uint32_t)t);
+            auto inserted = chartOfRoot.insert(make_pair(root, charts.size()));
+            if (inserted.second)
+            {
+                UChart chart;
+                chart.input = inputIndex;
+                chart.axis = buckets[t] / 2;
+                chart.min = glm::vec2(1e30f);
+                chart.max = glm::vec2(-1e30f);
+                charts.push_back(chart);
+            }
+            UChart& chart = charts[inserted.first->second];
+            chart.triangles.push_back((uint32_t)t);
+            for (int c = 0; c < 3; ++c)
+            {
+                glm::vec2 q = UProject(glm::vec3(input.model * glm::vec4(mesh.positions[UCorner(mesh, t, c)], 1.0f)), chart.axis);
+                chart.min = glm::min(chart.min, q);
+                chart.max = glm::max(chart.max, q);
+            }
+        }
+    }
+
+    // Skyline packing, tallest first: each chart goes where it ends up lowest; false when the charts
+    // do not fit at this density
+    bool UPackCharts(vector<UChart>& charts, int size, float texelsPerUnit)
+    {
+        for (UChart& chart : charts)
+        {
+            glm::vec2 extent = (chart.max - chart.min) * texelsPerUnit;
+            chart.width = (int)ceil(extent.x) + 1 + 2 * CHART_BORDER;
+            chart.height = (int)ceil(extent.y) + 1 + 2 * CHART_BORDER;
+        }
+        vector<UChart*> order;
+        for (UChart& chart : charts)
+            order.push_back(&chart);
+        stable_sort(order.begin(), order.end(), [](const UChart* a, const UChart* b) { return a->height > b->height; });
+
+        struct USegment { int x, y, width; };
+        vector<USegment> skyline(1, USegment{ 0, 0, size });
+        for (UChart* chart : order)
+        {
+            int bestX = -1, bestY = size;
+            for (size_t i = 0; i < skyline.size(); ++i)
+            {
+                int x = skyline[i].x;
+                if (x + chart->width > size)
+                    break;
+                int y = 0;
+                for (size_t j = i; j < skyline.size() && skyline[j].x < x + chart->width; ++j)
+                    y = skyline[j].y > y ? skyline[j].y : y;
+                if (y < bestY)
+                {
+                    bestX = x;
+                    bestY = y;
+                }
+            }
+            if (bestX < 0 || bestY + chart->height > size)
+                return false;
+            chart->x = bestX;
+            chart->y = bestY;
+
+            // Raise the skyline under the chart
+            vector<USegment> next;
+            int right = bestX + chart->width;
+            for (const USegment& segment : skyline)
+            {
+                int end = segment.x + segment.width;
+                if (end <= bestX || segment.x >= right)
+                    next.push_back(segment);
+                else
+                {
+                    if (segment.x < bestX)
+                        next.push_back(USegment{ segment.x, segment.y, bestX - segment.x });
+                    if (segment.x <= bestX)
+                        next.push_back(USegment{ bestX, bestY + chart->height, chart->width });
+                    if (end > right)
+                        next.push_back(USegment{ right, segment.y, end - right });
+                }
+            }
+            skyline.swap(next);
+        }
+        return true;
+    }
+
+    uint64_t UFnv1a(const void* data, size_t size, uint64_t hash)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // What the bake needs to know about one covered texel
+    struct UTexel
+    {
+        glm::vec3 position;     // world space
+        glm::vec3 normal;       // shading normal
+        glm::vec3 faceNormal;   // rays leave along this one
+        int object;             // -1 = not covered
+    };
+
+    // Unattenuated point lights, like lightFragmentShaderSource
+    glm::vec3 UDirectLight(const UBvh& bvh, const vector<ULightmapLight>& lights, const glm::vec3& position, const glm::vec3& normal, const glm::vec3& offsetNormal)
+    {
+        glm::vec3 light(0.0f);
+        for (const ULightmapLight& source : lights)
+        {
+            glm::vec3 toLight = source.position - position;
+            float distance = glm::length(toLight);
+            glm::vec3 direction = toLight / distance;
+            float impact = glm::dot(normal, direction);
+            if (impact <= 0.0f)
+                continue;
+            UTraceHit hit;
+            if (!UIntersectBvh(bvh, position + offsetNormal * RAY_OFFSET, direction, distance, true, hit))
+                light += impact * source.color;
+        }
+        return light;
+    }
+
+    // Light arriving along one ray: direct light of every diffuse surface the path meets
+    glm::vec3 UGatherPath(const UBvh& bvh, const vector<ULightmapLight>& lights, glm::vec3 origin, glm::vec3 direction, int maxBounces, UTraceRandom& random)
+    {
+        glm::vec3 radiance(0.0f), throughput(1.0f);
+        for (int bounce = 1; bounce <= maxBounces; ++bounce)
+        {
+            UTraceHit hit;
+            if (!UIntersectBvh(bvh, origin, direction, 1e30f, false, hit))
+                break;
+            UTraceSurface surface;
+            UGetTraceSurface(bvh, hit, origin, direction, surface);
+            throughput *= surface.albedo;
+            radiance += throughput * UDirectLight(bvh, lights, surface.position, surface.normal, surface.geometricNormal);
+
+            if (bounce >= 2)
+            {
+                float survive = glm::max(throughput.x, glm::max(throughput.y, throughput.z));
+                survive = survive < 0.05f ? 0.05f : (survive > 0.95f ? 0.95f : survive);
+                if (random.Next() > survive)
+                    break;
+                throughput /= survive;
+            }
+            origin = surface.position + surface.geometricNormal * RAY_OFFSET;
+            direction = USampleCosineHemisphere(surface.normal, random);
+        }
+        return radiance;
+    }
+
+    // Runs rows [0, nRows) on every thread
+    template <typename Row>
+    void UParallelRows(int nRows, unsigned nThreads, Row row)
+    {
+        atomic<int> next(0);
+        auto worker = [&]()
+        {
+            for (int y = next.fetch_add(1); y < nRows; y = next.fetch_add(1))
+                row(y);
+        };
+        vector<thread> threads;
+        for (unsigned i = 1; i < nThreads; ++i)
+            threads.push_back(thread(worker));
+        worker();
+        for (thread& t : threads)
+            t.join();
+    }
+}
+
+void UBuildLightmapAtlas(const vector<ULightmapInput>& inputs, const ULightmapLight& sceneLight, int size, ULightmapAtlas& atlas)
+{
+    vector<UChart> charts;
+    for (size_t i = 0; i < inputs.size(); ++i)
+        USegmentCharts(inputs[i], i, charts);
+
+    // One density for the whole scene: the highest that still fits
+    float area = 0.0f;
+    for (const UChart& chart : charts)
+        area += (chart.max.x - chart.min.x) * (chart.max.y - chart.min.y);
+    float low = 0.0f, high = area > 0.0f ? sqrt((float)size * size / area) : 1.0f;
+    for (int step = 0; step < 20; ++step)
+    {
+        float middle = (low + high) * 0.5f;
+        if (UPackCharts(charts, size, middle))
+            low = middle;
+        else
+            high = middle;
+    }
+    float texelsPerUnit = low;
+    if (!UPackCharts(charts, size, texelsPerUnit))
+        cout << "Lightmap atlas of " << size << " texels is too small for " << charts.size() << " charts" << endl;
+
+    atlas.size = size;
+    atlas.texelsPerUnit = texelsPerUnit;
+    atlas.nCharts = charts.size();
+    atlas.sceneIndices.clear();
+    atlas.meshes.assign(inputs.size(), UMeshData());
+    atlas.models.clear();
+    for (const ULightmapInput& input : inputs)
+    {
+        atlas.sceneIndices.push_back(input.sceneIndex);
+        atlas.models.push_back(input.model);
+    }
+
+    // Every chart triangle gets its own corners, welded again afterwards
+    for (const UChart& chart : charts)
+    {
+        const UMeshData& source = *inputs[chart.input].mesh;
+        UMeshData& mesh = atlas.meshes[chart.input];
+        glm::vec2 origin(chart.x + CHART_BORDER + 0.5f, chart.y + CHART_BORDER + 0.5f);
+        for (uint32_t triangle : chart.triangles)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                uint32_t vertex = UCorner(source, triangle, c);
+                mesh.positions.push_back(source.positions[vertex]);
+                if (!source.normals.empty())
+                    mesh.normals.push_back(source.normals[vertex]);
+                if (!source.uvs.empty())
+                    mesh.uvs.push_back(source.uvs[vertex]);
+                if (!source.tangents.empty())
+                    mesh.tangents.push_back(source.tangents[vertex]);
+                glm::vec2 q = UProject(glm::vec3(inputs[chart.input].model * glm::vec4(source.positions[vertex], 1.0f)), chart.axis);
+                mesh.lightmapUvs.push_back((origin + (q - chart.min) * texelsPerUnit) / (float)size);
+            }
+        }
+    }
+
+    // The charts only see shapes; where the objects sit and what lights them changes the texels too
+    uint64_t signature = UFnv1a(&size, sizeof(size), 14695981039346656037ull);
+    signature = UFnv1a(&sceneLight.position, sizeof(glm::vec3), signature);
+    signature = UFnv1a(&sceneLight.color, sizeof(glm::vec3), signature);
+    signature = UFnv1a(atlas.models.data(), atlas.models.size() * sizeof(glm::mat4), signature);
+    for (UMeshData& mesh : atlas.meshes)
+    {
+        UWeldVertices(mesh);
+        signature = UFnv1a(mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3), signature);
+        signature = UFnv1a(mesh.lightmapUvs.data(), mesh.lightmapUvs.size() * sizeof(glm::vec2), signature);
+        signature = UFnv1a(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t), signature);
+    }
+    atlas.signature = signature;
+}
+
+void UBakeLightmap(const ULightmapAtlas& atlas, const UBvh& bvh, const ULightmapBakeSettings& settings, ULightmapBake& bake)
+{
+    const int size = atlas.size;
+    unsigned nThreads = settings.nThreads ? settings.nThreads : thread::hardware_concurrency();
+    nThreads = nThreads ? nThreads : 1;
+    bake.size = size;
+    bake.texels.assign((size_t)size * size, glm::vec3(0.0f));
+
+    // Surface point behind every texel center
+    auto start = chrono::steady_clock::now();
+    vector<UTexel> texels((size_t)size * size);
+    for (UTexel& texel : texels)
+        texel.object = -1;
+    for (size_t object = 0; object < atlas.meshes.size(); ++object)
+    {
+        const UMeshData& mesh = atlas.meshes[object];
+        const glm::mat4& model = atlas.models[object];
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+
+        // The built in meshes have no normals and mixed winding: face normals point away from the
+        // object's center, or toward the first light on flat objects that pass through it
+        glm::vec3 center(0.0f);
+        for (const glm::vec3& p : mesh.positions)
+            center += p;
+        center = glm::vec3(model * glm::vec4(center / (float)(mesh.positions.empty() ? 1 : mesh.positions.size()), 1.0f));
+
+        for (size_t triangle = 0; triangle < UTriangleCount(mesh); ++triangle)
+        {
+            uint32_t corner[3];
+            glm::vec3 world[3];
+            glm::vec2 texel[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                corner[c] = UCorner(mesh, triangle, c);
+                world[c] = glm::vec3(model * glm::vec4(mesh.positions[corner[c]], 1.0f));
+                texel[c] = mesh.lightmapUvs[corner[c]] * (float)size;
+            }
+            glm::vec3 faceNormal = glm::cross(world[1] - world[0], world[2] - world[0]);
+            if (glm::length(faceNormal) == 0.0f)
+                continue;
+            faceNormal = glm::normalize(faceNormal);
+            float away = glm::dot(faceNormal, (world[0] + world[1] + world[2]) / 3.0f - center);
+            if (fabs(away) < 1e-4f && !settings.lights.empty())
+                away = glm::dot(faceNormal, settings.lights[0].position - world[0]);
+            if (away < 0.0f)
+                faceNormal = -faceNormal;
+
+            float area = (texel[1].x - texel[0].x) * (texel[2].y - texel[0].y) - (texel[2].x - texel[0].x) * (texel[1].y - texel[0].y);
+            if (area == 0.0f)
+                continue;
+            int minX = (int)glm::max(floor(glm::min(texel[0].x, glm::min(texel[1].x, texel[2].x))), 0.0f);
+            int minY = (int)glm::max(floor(glm::min(texel[0].y, glm::min(texel[1].y, texel[2].y))), 0.0f);
+            int maxX = (int)glm::min(ceil(glm::max(texel[0].x, glm::max(texel[1].x, texel[2].x))), (float)size - 1.0f);
+            int maxY = (int)glm::min(ceil(glm::max(texel[0].y, glm::max(texel[1].y, texel[2].y))), (float)size - 1.0f);
+            for (int y = minY; y <= maxY; ++y)
+            {
+                for (int x = minX; x <= maxX; ++x)
+                {
+                    // Barycentrics of the texel center
+                    glm::vec2 p(x + 0.5f, y + 0.5f);
+                    float w1 = ((p.x - texel[0].x) * (texel[2].y - texel[0].y) - (texel[2].x - texel[0].x) * (p.y - texel[0].y)) / area;
+                    float w2 = ((texel[1].x - texel[0].x) * (p.y - texel[0].y) - (p.x - texel[0].x) * (texel[1].y - texel[0].y)) / area;
+                    float w0 = 1.0f - w1 - w2;
+                    if (w0 < -1e-4f || w1 < -1e-4f || w2 < -1e-4f)
+                        continue;
+                    UTexel& target = texels[(size_t)y * size + x];
+                    if (target.object >= 0)
+                        continue;
+                    target.object = (int)object;
+                    target.position = world[0] * w0 + world[1] * w1 + world[2] * w2;
+                    target.faceNormal = faceNormal;
+                    target.normal = faceNormal;
+                    if (!mesh.normals.empty())
+                    {
+                        glm::vec3 n = normalMatrix * (mesh.normals[corner[0]] * w0 + mesh.normals[corner[1]] * w1 + mesh.normals[corner[2]] * w2);
+                        if (glm::length(n) > 0.0f)
+                            target.normal = glm::normalize(glm::dot(n, faceNormal) < 0.0f ? -n : n);
+                    }
+                }
+            }
+        }
+    }
+    bake.nCoveredTexels = 0;
+    for (const UTexel& texel : texels)
+        bake.nCoveredTexels += texel.object >= 0 ? 1 : 0;
+    bake.rasterizeMs = UMillisecondsSince(start);
+
+    // Direct light is exact; the indirect estimate is kept apart for the denoiser
+    start = chrono::steady_clock::now();
+    vector<glm::vec3> indirect((size_t)size * size, glm::vec3(0.0f));
+    UParallelRows(size, nThreads, [&](int y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                size_t index = (size_t)y * size + x;
+                const UTexel& texel = texels[index];
+                if (texel.object < 0)
+                    continue;
+                bake.texels[index] = UDirectLight(bvh, settings.lights, texel.position, texel.normal, texel.faceNormal);
+
+                UTraceRandom random = { UTraceHash((uint32_t)index * 9781u + 1u) };
+                glm::vec3 origin = texel.position + texel.faceNormal * RAY_OFFSET;
+                glm::vec3 sum(0.0f);
+                for (int sample = 0; sample < settings.nSamples; ++sample)
+                    sum += UGatherPath(bvh, settings.lights, origin, USampleCosineHemisphere(texel.normal, random), settings.maxBounces, random);
+                indirect[index] = settings.nSamples > 0 ? sum / (float)settings.nSamples : glm::vec3(0.0f);
+            }
+        });
+    bake.lightingMs = UMillisecondsSince(start);
+
+    // Denoise: cross bilateral filter guided by position and normal, so it never blurs across
+    // objects, creases or depth steps
+    start = chrono::steady_clock::now();
+    UParallelRows(size, nThreads, [&](int y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                size_t index = (size_t)y * size + x;
+                const UTexel& center = texels[index];
+                if (center.object < 0)
+                    continue;
+                glm::vec3 sum(0.0f);
+                float weightSum = 0.0f;
+                for (int dy = -FILTER_RADIUS; dy <= FILTER_RADIUS; ++dy)
+                {
+                    for (int dx = -FILTER_RADIUS; dx <= FILTER_RADIUS; ++dx)
+                    {
+                        int sx = x + dx, sy = y + dy;
+                        if (sx < 0 || sy < 0 || sx >= size || sy >= size)
+                            continue;
+                        const UTexel& tap = texels[(size_t)sy * size + sx];
+                        if (tap.object != center.object)
+                            continue;
+                        float normalWeight = glm::dot(center.normal, tap.normal);
+                        if (normalWeight <= 0.0f)
+                            continue;
+                        normalWeight *= normalWeight;   // ^8
+                        normalWeight *= normalWeight;
+                        normalWeight *= normalWeight;
+                        float planeDistance = glm::dot(center.faceNormal, tap.position - center.position) * atlas.texelsPerUnit;
+                        float weight = exp(-(dx * dx + dy * dy) / 8.0f - planeDistance * planeDistance) * normalWeight;
+                        sum += indirect[(size_t)sy * size + sx] * weight;
+                        weightSum += weight;
+                    }
+                }
+                bake.texels[index] += weightSum > 0.0f ? sum / weightSum : indirect[index];
+            }
+        });
+
+    // Dilate into the chart borders (and texels no triangle covered the center of)
+    vector<char> covered((size_t)size * size);
+    for (size_t i = 0; i < texels.size(); ++i)
+        covered[i] = texels[i].object >= 0;
+    for (int pass = 0; pass < CHART_BORDER; ++pass)
+    {
+        vector<char> next = covered;
+        for (int y = 0; y < size; ++y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                size_t index = (size_t)y * size + x;
+                if (covered[index])
+                    continue;
+                glm::vec3 sum(0.0f);
+                int count = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        int sx = x + dx, sy = y + dy;
+                        if (sx >= 0 && sy >= 0 && sx < size && sy < size && covered[(size_t)sy * size + sx])
+                        {
+                            sum += bake.texels[(size_t)sy * size + sx];
+                            ++count;
+                        }
+                    }
+                }
+                if (count)
+                {
+                    bake.texels[index] = sum / (float)count;
+                    next[index] = 1;
+                }
+            }
+        }
+        covered.swap(next);
+    }
+    bake.filterMs = UMillisecondsSince(start);
+}
+
+bool UWriteLightmapFile(const char* filename, const ULightmapAtlas& atlas, const ULightmapBake& bake)
+{
+    ULightmapFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ULIGHTMAP_MAGIC;
+    header.version = ULIGHTMAP_VERSION;
+    header.headerBytes = sizeof(ULightmapFileHeader);
+    header.size = (uint32_t)bake.size;
+    header.signature = atlas.signature;
+    header.texelOffset = sizeof(ULightmapFileHeader);
+    header.texelBytes = (uint64_t)bake.size * bake.size * 3 * sizeof(uint16_t);
+
+    vector<uint16_t> halves;
+    halves.reserve(bake.texels.size() * 3);
+    for (const glm::vec3& texel : bake.texels)
+    {
+        halves.push_back(UFloatToHalf(texel.x));
+        halves.push_back(UFloatToHalf(texel.y));
+        halves.push_back(UFloatToHalf(texel.z));
+    }
+
+    ofstream out(filename, ios::binary);
+    if (!out)
+    {
+        cout << "Failed to create " << filename << endl;
+        return false;
+    }
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)halves.data(), (streamsize)header.texelBytes);
+    if (!out)
+    {
+        cout << "Failed writing " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+bool ULoadLightmap(const char* filename, const ULightmapAtlas& atlas, size_t nSceneObjects, UVertexFormat format, ULightmap& lightmap)
+{
+    UMappedFile file;
+    if (!UMapFile(filename, file))
+        return false;
+
+    ULightmapFileHeader header;
+    bool valid = file.size >= sizeof(ULightmapFileHeader);
+    if (valid)
+    {
+        memcpy(&header, file.data, sizeof(header));
+        valid = header.magic == ULIGHTMAP_MAGIC && header.version == ULIGHTMAP_VERSION && header.headerBytes >= sizeof(ULightmapFileHeader)
+            && header.size > 0 && header.texelBytes == (uint64_t)header.size * header.size * 3 * sizeof(uint16_t)
+            && header.texelOffset + header.texelBytes <= file.size;
+    }
+    if (!valid)
+    {
+        cout << filename << " is not a valid version " << ULIGHTMAP_VERSION << " lightmap" << endl;
+        UUnmapFile(file);
+        return false;
+    }
+    if (header.size != (uint32_t)atlas.size || header.signature != atlas.signature)
+    {
+        cout << filename << " was baked for a different scene, rebake it with --bake-lightmap" << endl;
+        UUnmapFile(file);
+        return false;
+    }
+
+    // No mipmaps: they would average neighboring charts together
+    lightmap.texture.Create(UGPU_LIGHTMAP, filename);
+    glBindTexture(GL_TEXTURE_2D, lightmap.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, header.size, header.size, 0, GL_RGB, GL_HALF_FLOAT, file.data + header.texelOffset);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    lightmap.texture.SetBytes(UEstimateTextureBytes(header.size, header.size, 1, 6, false));
+    UUnmapFile(file);
+
+    lightmap.meshes.clear();
+    lightmap.meshes.resize(nSceneObjects);
+    for (size_t i = 0; i < atlas.meshes.size(); ++i)
+    {
+        if (atlas.sceneIndices[i] < nSceneObjects)
+            UCreateGpuMesh(atlas.meshes[i], format, lightmap.meshes[atlas.sceneIndices[i]]);
+    }
+    return true;
+}
+
+void UDestroyLightmap(ULightmap& lightmap)
+{
+    for (UGpuMesh& mesh : lightmap.meshes)
+    {
+        if (mesh.vao)
+            UDestroyGpuMesh(mesh);
+    }
+    lightmap.meshes.clear();
+    lightmap.texture.Reset();
+}
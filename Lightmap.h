@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>      // uint32_t, uint64_t
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "VertexFormat.h"
+#include "GpuResources.h"
+#include "PathTracer.h"
+
+// .ulm: baked lighting for one atlas layout.
+// Layout (little endian): ULightmapFileHeader, then size * size RGB half floats, first row at v = 0.
+const uint32_t ULIGHTMAP_MAGIC = 0x504D4C55;    // "ULMP"
+const uint32_t ULIGHTMAP_VERSION = 1;
+
+struct ULightmapFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerBytes;   // sizeof(ULightmapFileHeader) when written
+    uint32_t size;          // texels per side
+    uint64_t signature;     // layout and lighting the texels belong to, see ULightmapAtlas
+    uint64_t texelOffset;
+    uint64_t texelBytes;
+};
+
+// A static object that gets its own region of the lightmap
+struct ULightmapInput
+{
+    size_t sceneIndex;      // into the caller's object list
+    const UMeshData* mesh;
+    glm::mat4 model;
+};
+
+// Second UV channel of every input, packed into one square atlas
+struct ULightmapAtlas
+{
+    int size;
+    float texelsPerUnit;            // world space density, the same on every object
+    std::vector<size_t> sceneIndices;
+    std::vector<glm::mat4> models;
+    std::vector<UMeshData> meshes;  // per input: the mesh split along chart seams, with lightmapUvs
+    size_t nCharts;
+    uint64_t signature;             // hash of the layout, the transforms and the scene light; a bake only fits an atlas with the same one
+};
+
+struct ULightmapLight
+{
+    glm::vec3 position;
+    glm::vec3 color;
+};
+
+struct ULightmapBakeSettings
+{
+    std::vector<ULightmapLight> lights;
+    int nSamples;           // indirect rays per texel
+    int maxBounces;
+    unsigned nThreads;      // 0 = every core
+};
+
+// Baked texels plus what the bake cost
+struct ULightmapBake
+{
+    int size;
+    std::vector<glm::vec3> texels;  // linear, multiplies the albedo
+    size_t nCoveredTexels;
+    double rasterizeMs;
+    double lightingMs;
+    double filterMs;
+};
+
+// Baked lighting on the GPU: per scene object, the mesh that carries the lightmap UVs
+struct ULightmap
+{
+    UGpuTexture texture;
+    std::vector<UGpuMesh> meshes;   // vao 0 for objects outside the atlas
+};
+
+// Charts are flat groups of connected triangles facing the same axis, projected at one density and
+// shelf packed with a border for bilinear filtering. sceneLight is the light the window renders with,
+// so a bake under another light doesn't match
+void UBuildLightmapAtlas(const std::vector<ULightmapInput>& inputs, const ULightmapLight& sceneLight, int size, ULightmapAtlas& atlas);
+
+// Direct light with shadow rays plus diffuse bounces, traced against the bvh of the whole scene;
+// the noisy indirect part is denoised with a normal aware filter, then charts are dilated into their border
+void UBakeLightmap(const ULightmapAtlas& atlas, const UBvh& bvh, const ULightmapBakeSettings& settings, ULightmapBake& bake);
+
+bool UWriteLightmapFile(const char* filename, const ULightmapAtlas& atlas, const ULightmapBake& bake);
+// Uploads the texels and a lightmapped mesh per atlas object; fails when the file was baked for another layout
+bool ULoadLightmap(const char* filename, const ULightmapAtlas& atlas, size_t nSceneObjects, UVertexFormat format, ULightmap& lightmap);
+void UDestroyLightmap(ULightmap& lightmap);
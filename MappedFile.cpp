@@ -0,0 +1,141 @@
+#include <iostream>     // cout, cerr
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std; // Standard namespace
+
+bool UMapFile(const char* filename, UMappedFile& file)
+{
+    file.data = nullptr;
+    file.size = 0;
+
+#ifdef _WIN32
+    file.mappingHandle = nullptr;
+    file.fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file.fileHandle == INVALID_HANDLE_VALUE)
+    {
+        file.fileHandle = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file.fileHandle, &size))
+    {
+        UUnmapFile(file);
+        return false;
+    }
+    file.size = (size_t)size.QuadPart;
+
+    // Empty files can't be mapped, but they are still valid files
+    if (file.size == 0)
+        return true;
+
+    file.mappingHandle = CreateFileMappingA(file.fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (file.mappingHandle)
+        file.data = (const unsigned char*)MapViewOfFile(file.mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+    file.fd = open(filename, O_RDONLY);
+    if (file.fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(file.fd, &info) != 0)
+    {
+        UUnmapFile(file);
+        return false;
+    }
+    file.size = (size_t)info.st_size;
+
+    // Empty files can't be mapped, but they are still valid files
+    if (file.size == 0)
+        return true;
+
+    void* mapping = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+    if (mapping != MAP_FAILED)
+        file.data = (const unsigned char*)mapping;
+#endif
+
+    if (!file.data)
+    {
+        cout << "Failed to map " << filename << endl;
+        UUnmapFile(file);
+        return false;
+    }
+    return true;
+}
+
+void UUnmapFile(UMappedFile& file)
+{
+#ifdef _WIN32
+    if (file.data)
+        UnmapViewOfFile(file.data);
+    if (file.mappingHandle)
+        CloseHandle(file.mappingHandle);
+    if (file.fileHandle)
+        CloseHandle(file.fileHandle);
+    file.fileHandle = file.mappingHandle = nullptr;
+#else
+    if (file.data)
+        munmap((void*)file.data, file.size);
+    if (file.fd >= 0)
+        close(file.fd);
+    file.fd = -1;
+#endif
+
+    file.data = nullptr;
+    file.size = 0;
+}
+
+void UReleaseMappedPages(const void* data, size_t size)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    size_t pageSize = info.dwPageSize;
+#else
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+
+    // Only pages that lie completely inside the range; neighbours may still be in use
+    size_t start = ((size_t)data + pageSize - 1) / pageSize * pageSize;
+    size_t end = ((size_t)data + size) / pageSize * pageSize;
+    if (end <= start)
+        return;
+
+#ifdef _WIN32
+    // Unlocking pages that were never locked trims them from the working set
+    VirtualUnlock((void*)start, end - start);
+#else
+    madvise((void*)start, end - start, MADV_DONTNEED);
+#endif
+}
+
+bool UGetFileWriteTime(const char* filename, unsigned long long& writeTime)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &info))
+        return false;
+    writeTime = ((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat info;
+    if (stat(filename, &info) != 0)
+        return false;
+#ifdef __APPLE__
+    writeTime = (unsigned long long)info.st_mtimespec.tv_sec * 1000000000ull + info.st_mtimespec.tv_nsec;
+#else
+    writeTime = (unsigned long long)info.st_mtim.tv_sec * 1000000000ull + info.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>      // size_t
+
+// Read only memory mapping of a whole file
+struct UMappedFile
+{
+    const unsigned char* data;
+    size_t size;
+
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fd;
+#endif
+};
+
+bool UMapFile(const char* filename, UMappedFile& file);
+void UUnmapFile(UMappedFile& file);
+// Drops the whole pages of a mapped range from the working set once they have been consumed;
+// touching them again just reads them back from disk
+void UReleaseMappedPages(const void* data, size_t size);
+// Last modification time in file system ticks, only good for comparing against an earlier call
+bool UGetFileWriteTime(const char* filename, unsigned long long& writeTime);
@@ -0,0 +1,275 @@
+#include <iostream>     // cout, cerr
+#include <fstream>      // ifstream
+#include <sstream>      // istringstream
+#include <string>       // string
+#include <cstring>      // strcmp
+#include <cstdlib>      // atoi
+#include <chrono>       // steady_clock
+#include <map>          // map
+#include <unordered_map> // unordered_map
+#include "MeshConverter.h"
+#include "MeshFile.h"
+#include "Gltf.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    bool UEndsWith(const string& text, const char* suffix)
+    {
+        size_t n = strlen(suffix);
+        if (text.size() < n)
+            return false;
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (tolower(text[text.size() - n + i]) != suffix[i])
+                return false;
+        }
+        return true;
+    }
+
+    // OBJ index (1 based, negative = relative to the end) to a 0 based index, -1 when absent/invalid
+    int UObjIndex(const string& token, size_t count)
+    {
+        if (token.empty())
+            return -1;
+        int index = atoi(token.c_str());
+        if (index < 0)
+            index += (int)count;
+        else
+            index -= 1;
+        return index >= 0 && index < (int)count ? index : -1;
+    }
+
+    // Wavefront OBJ: v/vt/vn/f, polygons are fan triangulated, everything goes into one mesh
+    bool ULoadObj(const char* filename, UMeshData& data)
+    {
+        ifstream in(filename);
+        if (!in)
+        {
+            cout << "Failed to open " << filename << endl;
+            return false;
+        }
+
+        vector<glm::vec3> positions, normals;
+        vector<glm::vec2> uvs;
+        map<string, uint32_t> corners; // "v/vt/vn" -> output vertex
+        bool anyNormals = false, anyUvs = false;
+        vector<glm::ivec3> triangleCorners; // v/vt/vn per output vertex, resolved once the whole file is read
+
+        string line;
+        while (getline(in, line))
+        {
+            istringstream tokens(line);
+            string keyword;
+            tokens >> keyword;
+
+            if (keyword == "v")
+            {
+                glm::vec3 p(0.0f);
+                tokens >> p.x >> p.y >> p.z;
+                positions.push_back(p);
+            }
+            else if (keyword == "vt")
+            {
+                glm::vec2 uv(0.0f);
+                tokens >> uv.x >> uv.y;
+                uvs.push_back(uv);
+            }
+            else if (keyword == "vn")
+            {
+                glm::vec3 n(0.0f);
+                tokens >> n.x >> n.y >> n.z;
+                normals.push_back(n);
+            }
+            else if (keyword == "f")
+            {
+                vector<uint32_t> polygon;
+                string corner;
+                while (tokens >> corner)
+                {
+                    auto found = corners.find(corner);
+                    if (found != corners.end())
+                    {
+                        polygon.push_back(found->second);
+                        continue;
+                    }
+
+                    // v, v/vt, v//vn or v/vt/vn
+                    string parts[3];
+                    size_t part = 0;
+                    for (char c : corner)
+                    {
+                        if (c == '/')
+                            part = part < 2 ? part + 1 : part;
+                        else
+                            parts[part] += c;
+                    }
+                    glm::ivec3 resolved(UObjIndex(parts[0], positions.size()), UObjIndex(parts[1], uvs.size()), UObjIndex(parts[2], normals.size()));
+                    if (resolved.x < 0)
+                    {
+                        cout << "Bad face corner '" << corner << "' in " << filename << endl;
+                        return false;
+                    }
+                    anyUvs = anyUvs || resolved.y >= 0;
+                    anyNormals = anyNormals || resolved.z >= 0;
+
+                    uint32_t vertex = (uint32_t)triangleCorners.size();
+                    triangleCorners.push_back(resolved);
+                    corners[corner] = vertex;
+                    polygon.push_back(vertex);
+                }
+                for (size_t i = 2; i < polygon.size(); ++i)
+                {
+                    data.indices.push_back(polygon[0]);
+                    data.indices.push_back(polygon[i - 1]);
+                    data.indices.push_back(polygon[i]);
+                }
+            }
+        }
+
+        for (const glm::ivec3& corner : triangleCorners)
+        {
+            data.positions.push_back(positions[corner.x]);
+            if (anyUvs)
+                data.uvs.push_back(corner.y >= 0 ? uvs[corner.y] : glm::vec2(0.0f));
+            if (anyNormals)
+                data.normals.push_back(corner.z >= 0 ? glm::normalize(normals[corner.z]) : glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+        return !data.indices.empty();
+    }
+
+    bool ULoadGltfMesh(const char* filename, UMeshData& data)
+    {
+        UGltfDocument document;
+        if (!ULoadGltfDocument(filename, document))
+            return false;
+        bool loaded = UGltfToMeshData(document, data);
+        UFreeGltfDocument(document);
+        if (!loaded)
+            cout << filename << " has no triangle meshes" << endl;
+        return loaded;
+    }
+
+    // Vertex clustering: snaps every vertex to a grid cell, collapses each cell onto one of
+    // its existing vertices and drops triangles that became degenerate. Reusing vertices
+    // means every level shares the vertex buffer and only adds indices.
+    vector<uint32_t> USimplify(const UMeshData& data, const vector<uint32_t>& indices, float cellSize)
+    {
+        glm::vec3 boundsMin = data.positions[0];
+        for (const glm::vec3& p : data.positions)
+            boundsMin = glm::min(boundsMin, p);
+
+        unordered_map<uint64_t, uint32_t> cells;
+        vector<uint32_t> remap(data.positions.size());
+        for (size_t i = 0; i < data.positions.size(); ++i)
+        {
+            glm::vec3 cell = glm::floor((data.positions[i] - boundsMin) / cellSize);
+            uint64_t key = ((uint64_t)cell.x & 0x1fffff) | (((uint64_t)cell.y & 0x1fffff) << 21) | (((uint64_t)cell.z & 0x1fffff) << 42);
+            auto inserted = cells.insert(make_pair(key, (uint32_t)i));
+            remap[i] = inserted.first->second;
+        }
+
+        vector<uint32_t> simplified;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (a != b && b != c && a != c)
+            {
+                simplified.push_back(a);
+                simplified.push_back(b);
+                simplified.push_back(c);
+            }
+        }
+        return simplified;
+    }
+
+    // Appends nLods - 1 coarser levels; each roughly halves the triangle count of the previous one
+    void UBuildLods(UMeshData& data, int nLods)
+    {
+        data.lods.clear();
+        data.lods.push_back({ 0, (uint32_t)data.indices.size(), 0.0f });
+        if (data.indices.empty())
+            return;
+
+        glm::vec3 boundsMin = data.positions[0], boundsMax = data.positions[0];
+        for (const glm::vec3& p : data.positions)
+        {
+            boundsMin = glm::min(boundsMin, p);
+            boundsMax = glm::max(boundsMax, p);
+        }
+        float diagonal = glm::length(boundsMax - boundsMin);
+
+        vector<uint32_t> previous = data.indices;
+        float cellSize = diagonal / 256.0f;
+        while ((int)data.lods.size() < nLods && cellSize < diagonal)
+        {
+            vector<uint32_t> level = USimplify(data, data.indices, cellSize);
+            cellSize *= 2.0f;
+
+            // Not coarse enough yet to be worth a level
+            if (level.size() * 3 > previous.size() * 2)
+                continue;
+            if (level.empty())
+                break;
+
+            ULodRange range = { (uint32_t)data.indices.size(), (uint32_t)level.size(), cellSize * 0.5f * 1.7320508f };
+            data.indices.insert(data.indices.end(), level.begin(), level.end());
+            data.lods.push_back(range);
+            previous = level;
+        }
+    }
+}
+
+int UMeshConverterMain(int argc, char* argv[])
+{
+    const char* input = nullptr;
+    const char* output = nullptr;
+    UVertexFormat format = UVERTEX_COMPRESSED;
+    int nLods = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--convert-mesh") == 0)
+            continue;
+        if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc)
+            format = strcmp(argv[++i], "float") == 0 ? UVERTEX_FLOAT : UVERTEX_COMPRESSED;
+        else if (strcmp(argv[i], "--lods") == 0 && i + 1 < argc)
+            nLods = glm::clamp(atoi(argv[++i]), 1, UMAX_LODS);
+        else if (!input)
+            input = argv[i];
+        else if (!output)
+            output = argv[i];
+    }
+
+    if (!input || !output)
+    {
+        cout << "Usage: --convert-mesh <input.obj|.gltf|.glb> <output.umesh> [--vertex-format float|compressed] [--lods N]" << endl;
+        return EXIT_FAILURE;
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    UMeshData data;
+    string inputName(input);
+    bool loaded = UEndsWith(inputName, ".obj") ? ULoadObj(input, data) : ULoadGltfMesh(input, data);
+    if (!loaded)
+        return EXIT_FAILURE;
+
+    UWeldVertices(data);
+    if (!data.normals.empty() && !data.uvs.empty() && data.tangents.empty())
+        UComputeTangents(data);
+    UBuildLods(data, nLods);
+
+    UPackedMesh packed;
+    UPackMesh(data, format, packed);
+    if (!UWriteMeshFile(output, packed))
+        return EXIT_FAILURE;
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Converted " << input << " -> " << output << ": " << packed.nVertices << " vertices, " << packed.lods.size() << " LODs";
+    for (const ULodRange& lod : packed.lods)
+        cout << " [" << lod.nIndices / 3 << " tris]";
+    cout << ", " << (packed.vertices.size() + packed.indices.size()) / 1024 << " KB in " << ms << " ms" << endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// Offline OBJ/glTF -> .umesh converter, run as "Project1 --convert-mesh in out [options]"
+int UMeshConverterMain(int argc, char* argv[]);
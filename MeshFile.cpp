@@ -0,0 +1,159 @@
+#include <iostream>     // cout, cerr
+#include <fstream>      // ofstream
+#include <chrono>       // steady_clock
+#include <cstring>      // memcpy, memset
+#include "MeshFile.h"
+#include "MappedFile.h"
+
+using namespace std; // Standard namespace
+
+static_assert(sizeof(UMeshFileHeader) == 176, "UMeshFileHeader layout is part of the file format");
+static_assert(sizeof(ULodRange) == 12, "ULodRange layout is part of the file format");
+
+namespace
+{
+    uint64_t UAlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    void UWritePadding(ofstream& out, uint64_t from, uint64_t to)
+    {
+        static const char zeros[UMESH_ALIGNMENT] = {};
+        if (to > from)
+            out.write(zeros, (streamsize)(to - from));
+    }
+}
+
+bool UWriteMeshFile(const char* filename, const UPackedMesh& packed)
+{
+    // Lightmap UVs depend on where an object sits in the atlas, so they are generated at load time instead
+    if (packed.layout.lightmapUvOffset >= 0)
+    {
+        cout << "Mesh files cannot store lightmap UVs: " << filename << endl;
+        return false;
+    }
+
+    UMeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = UMESH_MAGIC;
+    header.version = UMESH_VERSION;
+    header.headerBytes = sizeof(UMeshFileHeader);
+    header.format = (uint32_t)packed.format;
+    header.stride = packed.layout.stride;
+    header.normalOffset = packed.layout.normalOffset;
+    header.uvOffset = packed.layout.uvOffset;
+    header.tangentOffset = packed.layout.tangentOffset;
+    header.nVertices = packed.nVertices;
+    header.nIndices = packed.nIndices;
+    header.indexType = packed.indexType;
+    header.nLods = (uint32_t)packed.lods.size();
+    memcpy(header.boundsMin, &packed.boundsMin[0], sizeof(header.boundsMin));
+    memcpy(header.boundsMax, &packed.boundsMax[0], sizeof(header.boundsMax));
+    memcpy(header.dequantize, &packed.dequantize[0][0], sizeof(header.dequantize));
+
+    header.lodOffset = sizeof(UMeshFileHeader);
+    header.vertexOffset = UAlignUp(header.lodOffset + header.nLods * sizeof(ULodRange), UMESH_ALIGNMENT);
+    header.vertexBytes = packed.vertices.size();
+    header.indexOffset = UAlignUp(header.vertexOffset + header.vertexBytes, UMESH_ALIGNMENT);
+    header.indexBytes = packed.indices.size();
+
+    ofstream out(filename, ios::binary);
+    if (!out)
+    {
+        cout << "Failed to create " << filename << endl;
+        return false;
+    }
+
+    out.write((const char*)&header, sizeof(header));
+    if (header.nLods)
+        out.write((const char*)packed.lods.data(), header.nLods * sizeof(ULodRange));
+    UWritePadding(out, header.lodOffset + header.nLods * sizeof(ULodRange), header.vertexOffset);
+    out.write((const char*)packed.vertices.data(), (streamsize)header.vertexBytes);
+    UWritePadding(out, header.vertexOffset + header.vertexBytes, header.indexOffset);
+    if (header.indexBytes)
+        out.write((const char*)packed.indices.data(), (streamsize)header.indexBytes);
+
+    if (!out)
+    {
+        cout << "Failed writing " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+bool ULoadMeshFromMemory(const unsigned char* data, size_t size, const char* name, UGpuMesh& mesh)
+{
+    // Validate everything before handing pointers to GL
+    UMeshFileHeader header;
+    bool valid = size >= sizeof(UMeshFileHeader);
+    if (valid)
+    {
+        memcpy(&header, data, sizeof(header));
+        valid = header.magic == UMESH_MAGIC && header.version == UMESH_VERSION && header.headerBytes >= sizeof(UMeshFileHeader)
+            && (header.format == UVERTEX_FLOAT || header.format == UVERTEX_COMPRESSED)
+            && (header.indexType == GL_UNSIGNED_SHORT || header.indexType == GL_UNSIGNED_INT)
+            && header.stride > 0 && header.nLods <= (uint32_t)UMAX_LODS
+            && header.lodOffset + header.nLods * sizeof(ULodRange) <= size
+            && header.vertexOffset + header.vertexBytes <= size
+            && header.indexOffset + header.indexBytes <= size
+            && header.vertexBytes == (uint64_t)header.nVertices * header.stride
+            && header.indexBytes == (uint64_t)header.nIndices * (header.indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+    }
+    if (!valid)
+    {
+        cout << name << " is not a valid version " << UMESH_VERSION << " mesh file" << endl;
+        return false;
+    }
+
+    ULodRange lods[UMAX_LODS];
+    if (header.nLods)
+        memcpy(lods, data + header.lodOffset, header.nLods * sizeof(ULodRange));
+    for (uint32_t lod = 0; lod < header.nLods; ++lod)
+    {
+        if ((uint64_t)lods[lod].firstIndex + lods[lod].nIndices > header.nIndices)
+        {
+            cout << name << " has a level of detail outside its index buffer" << endl;
+            return false;
+        }
+    }
+
+    UMeshView view;
+    view.format = (UVertexFormat)header.format;
+    view.layout.stride = header.stride;
+    view.layout.normalOffset = header.normalOffset;
+    view.layout.uvOffset = header.uvOffset;
+    view.layout.tangentOffset = header.tangentOffset;
+    view.layout.lightmapUvOffset = -1;
+    view.vertices = data + header.vertexOffset;
+    view.vertexBytes = (GLsizeiptr)header.vertexBytes;
+    view.nVertices = header.nVertices;
+    view.indices = header.indexBytes ? data + header.indexOffset : nullptr;
+    view.indexBytes = (GLsizeiptr)header.indexBytes;
+    view.indexType = header.indexType;
+    view.nIndices = header.nIndices;
+    memcpy(&view.boundsMin[0], header.boundsMin, sizeof(header.boundsMin));
+    memcpy(&view.boundsMax[0], header.boundsMax, sizeof(header.boundsMax));
+    memcpy(&view.dequantize[0][0], header.dequantize, sizeof(header.dequantize));
+    view.lods = lods;
+    view.nLods = header.nLods;
+
+    return UCreateGpuMesh(view, mesh);
+}
+
+bool ULoadMeshFile(const char* filename, UGpuMesh& mesh)
+{
+    auto start = chrono::steady_clock::now();
+
+    UMappedFile file;
+    if (!UMapFile(filename, file))
+        return false;
+
+    bool created = ULoadMeshFromMemory(file.data, file.size, filename, mesh);
+    UUnmapFile(file);
+
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    if (created)
+        cout << "INFO: Loaded " << filename << " (" << mesh.nVertices << " vertices, " << mesh.nIndices / 3 << " triangles) in " << ms << " ms" << endl;
+    return created;
+}
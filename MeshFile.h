@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>      // uint32_t
+#include "VertexFormat.h"
+
+// .umesh: versioned binary container holding packed GPU-ready vertex/index bytes.
+// Layout (little endian):
+//   UMeshFileHeader
+//   ULodRange[nLods]
+//   padding to UMESH_ALIGNMENT, vertex bytes
+//   padding to UMESH_ALIGNMENT, index bytes
+// The blocks are page aligned so a mapped file is passed to glBufferStorage as is.
+const uint32_t UMESH_MAGIC = 0x48534D55;    // "UMSH"
+const uint32_t UMESH_VERSION = 1;
+const uint32_t UMESH_ALIGNMENT = 4096;
+
+struct UMeshFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerBytes;   // sizeof(UMeshFileHeader) when written, lets newer readers skip fields
+    uint32_t format;        // UVertexFormat
+
+    int32_t stride;
+    int32_t normalOffset;   // -1 when the stream is not stored
+    int32_t uvOffset;
+    int32_t tangentOffset;
+
+    uint32_t nVertices;
+    uint32_t nIndices;
+    uint32_t indexType;     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    uint32_t nLods;
+
+    float boundsMin[3];
+    float boundsMax[3];
+    float dequantize[16];   // column major
+
+    uint64_t lodOffset;
+    uint64_t vertexOffset;
+    uint64_t vertexBytes;
+    uint64_t indexOffset;
+    uint64_t indexBytes;
+};
+
+bool UWriteMeshFile(const char* filename, const UPackedMesh& packed);
+// Maps the file and uploads the vertex/index blocks straight from the mapping
+bool ULoadMeshFile(const char* filename, UGpuMesh& mesh);
+// Same for .umesh bytes that are already in memory (e.g. inside a mapped asset pack); name is for messages
+bool ULoadMeshFromMemory(const unsigned char* data, size_t size, const char* name, UGpuMesh& mesh);
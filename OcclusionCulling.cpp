@@ -0,0 +1,405 @@
+#include <iostream>     // cout, cerr
+#include <cmath>        // floor, ceil, log2
+#include <cstring>      // memcpy
+#include "OcclusionCulling.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>  // SSE
+#define UHIZ_SSE 1
+#endif
+
+using namespace std; // Standard namespace
+
+/* Max reduction of one pyramid level; level 0 reads the depth copy, the rest the level above */
+const GLchar* hizComputeShaderSource = GLSL(440,
+    layout(local_size_x = 8, local_size_y = 8) in;
+
+    layout(binding = 0, r32f) uniform writeonly image2D uDestination;
+    layout(binding = 1, r32f) uniform readonly image2D uSource;
+    uniform sampler2D uDepth;
+    uniform bool uFromDepth;
+    uniform ivec2 uSourceSize;
+
+    float Fetch(ivec2 p)
+    {
+        p = min(p, uSourceSize - 1);
+        return uFromDepth ? texelFetch(uDepth, p, 0).r : imageLoad(uSource, p).r;
+    }
+
+    void main()
+    {
+        ivec2 destination = ivec2(gl_GlobalInvocationID.xy);
+        if (any(greaterThanEqual(destination, imageSize(uDestination))))
+            return;
+
+        ivec2 source = destination * 2;
+        float depth = max(max(Fetch(source), Fetch(source + ivec2(1, 0))), max(Fetch(source + ivec2(0, 1)), Fetch(source + ivec2(1, 1))));
+
+        // Odd source sizes: the last texel also covers the extra row/column
+        bool extraX = (uSourceSize.x & 1) == 1 && destination.x == imageSize(uDestination).x - 1;
+        bool extraY = (uSourceSize.y & 1) == 1 && destination.y == imageSize(uDestination).y - 1;
+        if (extraX)
+            depth = max(depth, max(Fetch(source + ivec2(2, 0)), Fetch(source + ivec2(2, 1))));
+        if (extraY)
+            depth = max(depth, max(Fetch(source + ivec2(0, 2)), Fetch(source + ivec2(1, 2))));
+        if (extraX && extraY)
+            depth = max(depth, Fetch(source + ivec2(2, 2)));
+
+        imageStore(uDestination, destination, vec4(depth));
+    }
+);
+
+namespace
+{
+    // Levels coarser than this many texels wide are what the CPU tests against
+    const GLsizei READBACK_MAX_WIDTH = 160;
+
+    // GL halves mip sizes rounding down; the shader folds the odd row/column into the last texel
+    GLsizei ULevelSize(GLsizei baseSize, GLint level)
+    {
+        GLsizei size = baseSize >> level;
+        return size > 1 ? size : 1;
+    }
+
+    void UDestroyTargets(UHiZ& hiz)
+    {
+        hiz.depthCopy.Reset();
+        hiz.pyramid.Reset();
+        hiz.width = hiz.height = 0;
+    }
+
+    void UCreateTargets(UHiZ& hiz, GLsizei width, GLsizei height)
+    {
+        UDestroyTargets(hiz);
+        hiz.width = width;
+        hiz.height = height;
+
+        hiz.depthCopy.Create(UGPU_CULLING, "Hi-Z depth copy");
+        glBindTexture(GL_TEXTURE_2D, hiz.depthCopy);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+        hiz.depthCopy.SetBytes(UEstimateTextureBytes(width, height, 1, 4, false));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // floor(log2(max side)) + 1 levels, the most glTexStorage2D accepts
+        GLsizei levelWidth = (width + 1) / 2, levelHeight = (height + 1) / 2;
+        hiz.nLevels = 1;
+        hiz.readbackLevel = 0;
+        for (GLsizei size = levelWidth > levelHeight ? levelWidth : levelHeight; size > 1; size >>= 1)
+        {
+            if (ULevelSize(levelWidth, hiz.nLevels) > READBACK_MAX_WIDTH)
+                hiz.readbackLevel = hiz.nLevels;
+            ++hiz.nLevels;
+        }
+
+        hiz.pyramid.Create(UGPU_CULLING, "Hi-Z pyramid");
+        glBindTexture(GL_TEXTURE_2D, hiz.pyramid);
+        glTexStorage2D(GL_TEXTURE_2D, hiz.nLevels, GL_R32F, levelWidth, levelHeight);
+        hiz.pyramid.SetBytes(UEstimateTextureBytes(levelWidth, levelHeight, 1, 4, true));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, hiz.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, hiz.depthCopy, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // Readbacks of the old size are useless now
+        hiz.valid = false;
+    }
+
+    // Copies the newest finished readback into the CPU pyramid
+    void UPollReadbacks(UHiZ& hiz)
+    {
+        for (int n = 0; n < UHIZ_READBACK_BUFFERS; ++n)
+        {
+            // Oldest first, so the newest finished one wins
+            int i = (hiz.nextPbo + n) % UHIZ_READBACK_BUFFERS;
+            if (!hiz.fences[i])
+                continue;
+            GLenum status = glClientWaitSync(hiz.fences[i], 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+            glDeleteSync(hiz.fences[i]);
+            hiz.fences[i] = 0;
+
+            // The pyramid keeps its storage from readback to readback, so this runs without touching the heap
+            GLsizei width = hiz.pboWidth[i], height = hiz.pboHeight[i];
+            size_t nLevels = 1;
+            if (hiz.levels.empty())
+                hiz.levels.resize(1);
+            hiz.levels[0].resize((size_t)width * height);
+            hiz.levelSizes.assign(1, glm::ivec2(width, height));
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, hiz.pbos[i]);
+            glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)(hiz.levels[0].size() * sizeof(float)), hiz.levels[0].data());
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+            // Remaining levels on the CPU, same reduction as the shader
+            while (width > 1 || height > 1)
+            {
+                GLsizei nextWidth = ULevelSize(width, 1), nextHeight = ULevelSize(height, 1);
+                if (hiz.levels.size() <= nLevels)
+                    hiz.levels.resize(nLevels + 1);
+                const vector<float>& source = hiz.levels[nLevels - 1];
+                vector<float>& level = hiz.levels[nLevels];
+                level.assign((size_t)nextWidth * nextHeight, 0.0f);
+                for (GLsizei y = 0; y < height; ++y)
+                {
+                    GLsizei destinationY = y / 2 < nextHeight ? y / 2 : nextHeight - 1;
+                    for (GLsizei x = 0; x < width; ++x)
+                    {
+                        GLsizei destinationX = x / 2 < nextWidth ? x / 2 : nextWidth - 1;
+                        float& destination = level[(size_t)destinationY * nextWidth + destinationX];
+                        float depth = source[(size_t)y * width + x];
+                        destination = depth > destination ? depth : destination;
+                    }
+                }
+                hiz.levelSizes.push_back(glm::ivec2(nextWidth, nextHeight));
+                ++nLevels;
+                width = nextWidth;
+                height = nextHeight;
+            }
+
+            hiz.viewProjection = hiz.pboViewProjection[i];
+            hiz.valid = true;
+        }
+    }
+
+    // Window space rectangle (in [0,1]) and nearest depth of an AABB; false if it crosses the near plane
+    bool UProjectBounds(const glm::mat4& m, const glm::vec3& boundsMin, const glm::vec3& boundsMax, glm::vec2& rectMin, glm::vec2& rectMax, float& nearestDepth)
+    {
+#ifdef UHIZ_SSE
+        // Four corners per pass: x/y/z/w of four clip positions at once
+        const __m128 xs = _mm_setr_ps(boundsMin.x, boundsMax.x, boundsMin.x, boundsMax.x);
+        const __m128 ys = _mm_setr_ps(boundsMin.y, boundsMin.y, boundsMax.y, boundsMax.y);
+        __m128 minX = _mm_set1_ps(1e30f), minY = minX, minZ = minX;
+        __m128 maxX = _mm_set1_ps(-1e30f), maxY = maxX;
+        __m128 minW = _mm_set1_ps(1e30f);
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            const __m128 zs = _mm_set1_ps(pass ? boundsMax.z : boundsMin.z);
+            __m128 clip[4];
+            for (int row = 0; row < 4; ++row)
+            {
+                clip[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][row]), xs), _mm_mul_ps(_mm_set1_ps(m[1][row]), ys)),
+                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][row]), zs), _mm_set1_ps(m[3][row])));
+            }
+            minW = _mm_min_ps(minW, clip[3]);
+            __m128 inverseW = _mm_div_ps(_mm_set1_ps(1.0f), clip[3]);
+            __m128 x = _mm_mul_ps(clip[0], inverseW), y = _mm_mul_ps(clip[1], inverseW), z = _mm_mul_ps(clip[2], inverseW);
+            minX = _mm_min_ps(minX, x);
+            maxX = _mm_max_ps(maxX, x);
+            minY = _mm_min_ps(minY, y);
+            maxY = _mm_max_ps(maxY, y);
+            minZ = _mm_min_ps(minZ, z);
+        }
+
+        float lanes[6][4];
+        _mm_storeu_ps(lanes[0], minX);
+        _mm_storeu_ps(lanes[1], maxX);
+        _mm_storeu_ps(lanes[2], minY);
+        _mm_storeu_ps(lanes[3], maxY);
+        _mm_storeu_ps(lanes[4], minZ);
+        _mm_storeu_ps(lanes[5], minW);
+        glm::vec3 ndcMin(1e30f), ndcMax(-1e30f);
+        float wMin = 1e30f;
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            ndcMin.x = lanes[0][lane] < ndcMin.x ? lanes[0][lane] : ndcMin.x;
+            ndcMax.x = lanes[1][lane] > ndcMax.x ? lanes[1][lane] : ndcMax.x;
+            ndcMin.y = lanes[2][lane] < ndcMin.y ? lanes[2][lane] : ndcMin.y;
+            ndcMax.y = lanes[3][lane] > ndcMax.y ? lanes[3][lane] : ndcMax.y;
+            ndcMin.z = lanes[4][lane] < ndcMin.z ? lanes[4][lane] : ndcMin.z;
+            wMin = lanes[5][lane] < wMin ? lanes[5][lane] : wMin;
+        }
+#else
+        glm::vec3 ndcMin(1e30f), ndcMax(-1e30f);
+        float wMin = 1e30f;
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec4 p((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z, 1.0f);
+            glm::vec4 clip = m * p;
+            wMin = clip.w < wMin ? clip.w : wMin;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            ndcMin = glm::min(ndcMin, ndc);
+            ndcMax = glm::max(ndcMax, ndc);
+        }
+#endif
+        if (wMin <= 1e-5f)
+            return false;
+
+        rectMin = glm::vec2(ndcMin.x * 0.5f + 0.5f, ndcMin.y * 0.5f + 0.5f);
+        rectMax = glm::vec2(ndcMax.x * 0.5f + 0.5f, ndcMax.y * 0.5f + 0.5f);
+        nearestDepth = ndcMin.z * 0.5f + 0.5f;
+        return true;
+    }
+
+    bool UIsOccluded(const UHiZ& hiz, const glm::mat4& worldToClip, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec2 rectMin, rectMax;
+        float nearestDepth;
+        if (!UProjectBounds(worldToClip, boundsMin, boundsMax, rectMin, rectMax, nearestDepth))
+            return false;
+
+        // Off screen objects are left to frustum culling
+        if (rectMax.x < 0.0f || rectMax.y < 0.0f || rectMin.x > 1.0f || rectMin.y > 1.0f || nearestDepth > 1.0f)
+            return false;
+        rectMin = glm::vec2(glm::clamp(rectMin.x, 0.0f, 1.0f), glm::clamp(rectMin.y, 0.0f, 1.0f));
+        rectMax = glm::vec2(glm::clamp(rectMax.x, 0.0f, 1.0f), glm::clamp(rectMax.y, 0.0f, 1.0f));
+
+        // Level where the rectangle covers at most 2x2 texels
+        const glm::ivec2& baseSize = hiz.levelSizes[0];
+        float extent = (rectMax.x - rectMin.x) * baseSize.x > (rectMax.y - rectMin.y) * baseSize.y
+            ? (rectMax.x - rectMin.x) * baseSize.x : (rectMax.y - rectMin.y) * baseSize.y;
+        int level = extent > 1.0f ? (int)ceil(log2(extent)) : 0;
+        level = level < (int)hiz.levelSizes.size() - 1 ? level : (int)hiz.levelSizes.size() - 1;
+
+        const glm::ivec2& size = hiz.levelSizes[level];
+        int x0 = (int)floor(rectMin.x * size.x), x1 = (int)floor(rectMax.x * size.x);
+        int y0 = (int)floor(rectMin.y * size.y), y1 = (int)floor(rectMax.y * size.y);
+        x1 = x1 < size.x - 1 ? x1 : size.x - 1;
+        y1 = y1 < size.y - 1 ? y1 : size.y - 1;
+
+        float farthest = 0.0f;
+        for (int y = y0; y <= y1; ++y)
+        {
+            for (int x = x0; x <= x1; ++x)
+            {
+                float depth = hiz.levels[level][(size_t)y * size.x + x];
+                farthest = depth > farthest ? depth : farthest;
+            }
+        }
+        return nearestDepth > farthest;
+    }
+}
+
+bool UCreateHiZ(UHiZ& hiz)
+{
+    hiz.width = hiz.height = 0;
+    hiz.nextPbo = 0;
+    hiz.valid = false;
+    hiz.nTested = hiz.nCulled = 0;
+
+    if (!UCreateComputeProgram(hizComputeShaderSource, hiz.programId))
+        return false;
+
+    hiz.fbo.Create(UGPU_CULLING, "Hi-Z framebuffer");
+    for (int i = 0; i < UHIZ_READBACK_BUFFERS; ++i)
+    {
+        hiz.pbos[i].Create(UGPU_STREAMING, "Hi-Z readback");
+        hiz.fences[i] = 0;
+        hiz.pboWidth[i] = hiz.pboHeight[i] = 0;
+    }
+    return true;
+}
+
+void UDestroyHiZ(UHiZ& hiz)
+{
+    for (int i = 0; i < UHIZ_READBACK_BUFFERS; ++i)
+    {
+        if (hiz.fences[i])
+            glDeleteSync(hiz.fences[i]);
+        hiz.fences[i] = 0;
+        hiz.pbos[i].Reset();
+    }
+    hiz.fbo.Reset();
+    UDestroyTargets(hiz);
+    UDestroyShaderProgram(hiz.programId);
+    hiz.levels.clear();
+    hiz.levelSizes.clear();
+    hiz.valid = false;
+}
+
+void UCaptureHiZ(UHiZ& hiz, const glm::mat4& viewProjection, GLsizei width, GLsizei height,
+    GLuint readFramebuffer, GLsizei readWidth, GLsizei readHeight)
+{
+    if (width <= 0 || height <= 0)
+        return;
+    if (width != hiz.width || height != hiz.height)
+        UCreateTargets(hiz, width, height);
+
+    // A readback still in flight in this slot means the GPU is far behind; skip rather than wait
+    int slot = hiz.nextPbo;
+    if (hiz.fences[slot])
+        return;
+
+    // Scene depth -> depth copy (formats match: the window and the offscreen targets are 24 bit
+    // depth + 8 bit stencil). A smaller source is stretched, so the pyramid keeps its size when
+    // the render resolution changes.
+    if (readWidth <= 0 || readHeight <= 0)
+    {
+        readWidth = width;
+        readHeight = height;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, hiz.fbo);
+    glBlitFramebuffer(0, 0, readWidth, readHeight, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Max pyramid down to the readback level; the CPU builds the rest
+    glUseProgram(hiz.programId);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, hiz.depthCopy);
+    glUniform1i(glGetUniformLocation(hiz.programId, "uDepth"), 0);
+    GLint fromDepthLoc = glGetUniformLocation(hiz.programId, "uFromDepth");
+    GLint sourceSizeLoc = glGetUniformLocation(hiz.programId, "uSourceSize");
+
+    // Level 0 is half the depth copy rounded up, after that the sizes GL gave the mips
+    GLsizei sourceWidth = width, sourceHeight = height;
+    for (GLint level = 0; level <= hiz.readbackLevel; ++level)
+    {
+        GLsizei levelWidth = ULevelSize((width + 1) / 2, level), levelHeight = ULevelSize((height + 1) / 2, level);
+        glUniform1i(fromDepthLoc, level == 0);
+        glUniform2i(sourceSizeLoc, sourceWidth, sourceHeight);
+        glBindImageTexture(0, hiz.pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glBindImageTexture(1, hiz.pyramid, level > 0 ? level - 1 : 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        sourceWidth = levelWidth;
+        sourceHeight = levelHeight;
+    }
+    glMemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    // Async readback of the coarse level
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, hiz.pbos[slot]);
+    GLsizeiptr bytes = (GLsizeiptr)sourceWidth * sourceHeight * sizeof(float);
+    if (hiz.pboWidth[slot] * hiz.pboHeight[slot] != sourceWidth * sourceHeight)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        hiz.pbos[slot].SetBytes((size_t)bytes);
+    }
+    glBindTexture(GL_TEXTURE_2D, hiz.pyramid);
+    glGetTexImage(GL_TEXTURE_2D, hiz.readbackLevel, GL_RED, GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    hiz.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    hiz.pboViewProjection[slot] = viewProjection;
+    hiz.pboWidth[slot] = sourceWidth;
+    hiz.pboHeight[slot] = sourceHeight;
+    hiz.nextPbo = (slot + 1) % UHIZ_READBACK_BUFFERS;
+}
+
+void UCullScene(UHiZ& hiz, const vector<USceneObject>& scene, vector<char>& visible)
+{
+    UPollReadbacks(hiz);
+
+    visible.assign(scene.size(), 1);
+    hiz.nTested = hiz.nCulled = 0;
+    if (!hiz.valid)
+        return;
+
+    // Bounds are tested where the objects were when the depth was rendered; the one frame of
+    // latency is the usual Hi-Z trade-off (a newly revealed object can appear one frame late)
+    for (size_t i = 0; i < scene.size(); ++i)
+    {
+        const USceneObject& object = scene[i];
+        glm::mat4 worldToClip = hiz.viewProjection * object.model;
+        ++hiz.nTested;
+        if (UIsOccluded(hiz, worldToClip, object.mesh->boundsMin, object.mesh->boundsMax))
+        {
+            visible[i] = 0;
+            ++hiz.nCulled;
+        }
+    }
+}
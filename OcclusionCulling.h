@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "GpuResources.h"
+
+const int UHIZ_READBACK_BUFFERS = 3;
+
+// Hierarchical Z occlusion culling against the previous frame's depth.
+// After a frame is drawn its depth buffer is copied and reduced (max) into a mip pyramid by a
+// compute shader; a coarse level is read back asynchronously through PBOs. The next frames test
+// object bounds against that pyramid on the CPU, so nothing ever waits on the GPU.
+struct UHiZ
+{
+    GLuint programId;
+    UGpuFramebuffer fbo;
+    UGpuTexture depthCopy;  // GL_DEPTH24_STENCIL8 copy of the window depth
+    UGpuTexture pyramid;    // GL_R32F, level 0 is half the window size
+    GLsizei width;          // window size the textures were made for
+    GLsizei height;
+    GLint nLevels;
+    GLint readbackLevel;    // coarsest level that is still detailed enough for the CPU
+
+    // Async readback ring
+    UGpuBuffer pbos[UHIZ_READBACK_BUFFERS];
+    GLsync fences[UHIZ_READBACK_BUFFERS];
+    glm::mat4 pboViewProjection[UHIZ_READBACK_BUFFERS];
+    GLsizei pboWidth[UHIZ_READBACK_BUFFERS];
+    GLsizei pboHeight[UHIZ_READBACK_BUFFERS];
+    int nextPbo;
+
+    // CPU pyramid built from the newest completed readback; levels[0] is readbackLevel. levelSizes
+    // holds the current level count, levels may keep spare storage from a larger readback.
+    std::vector<std::vector<float>> levels;
+    std::vector<glm::ivec2> levelSizes;
+    glm::mat4 viewProjection;   // matrix the depth was rendered with
+    bool valid;
+
+    // Stats of the last UCullScene
+    int nTested;
+    int nCulled;
+};
+
+bool UCreateHiZ(UHiZ& hiz);
+void UDestroyHiZ(UHiZ& hiz);
+
+// Call after the scene is drawn: copies depth, builds the pyramid, starts a readback. The pyramid is
+// width x height; depth comes from the lower left readWidth x readHeight of readFramebuffer
+// (0 = the window, 0 sizes = the same size).
+void UCaptureHiZ(UHiZ& hiz, const glm::mat4& viewProjection, GLsizei width, GLsizei height,
+    GLuint readFramebuffer = 0, GLsizei readWidth = 0, GLsizei readHeight = 0);
+
+// Fills visible (one entry per object); everything is visible until a readback has completed
+void UCullScene(UHiZ& hiz, const std::vector<USceneObject>& scene, std::vector<char>& visible);
@@ -0,0 +1,416 @@
+#include <iostream>     // cout, cerr
+#include <cmath>        // cos, sin, sqrt
+#include <cstddef>      // offsetof
+#include <cstring>      // memcpy
+#include "Overlay.h"
+#include "Scene.h"
+
+using namespace std; // Standard namespace
+
+/* Pixel coordinates to clip space; coverage comes from the font texture (1 for shapes) */
+const GLchar* overlayVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec2 position; // pixels, origin at the top left
+    layout(location = 1) in vec2 textureCoordinate;
+    layout(location = 2) in vec4 color;
+
+    out vec2 vertexTextureCoordinate;
+    out vec4 vertexColor;
+
+    uniform vec2 uViewportSize;
+
+    void main()
+    {
+        vec2 ndc = position / uViewportSize * 2.0f - 1.0f;
+        gl_Position = vec4(ndc.x, -ndc.y, 0.0f, 1.0f);
+        vertexTextureCoordinate = textureCoordinate;
+        vertexColor = color;
+    }
+);
+
+const GLchar* overlayFragmentShaderSource = GLSL(440,
+    in vec2 vertexTextureCoordinate;
+    in vec4 vertexColor;
+
+    out vec4 fragmentColor;
+
+    uniform sampler2D uFont;
+
+    void main()
+    {
+        fragmentColor = vec4(vertexColor.rgb, vertexColor.a * texture(uFont, vertexTextureCoordinate).r);
+    }
+);
+
+namespace
+{
+    // 5x7 glyphs for ASCII 32..95, one byte per row from the top, bit 4 is the leftmost column
+    const int FONT_FIRST_CHAR = 32;
+    const int FONT_CHARS = 64;
+    const int GLYPH_WIDTH = 5;
+    const int GLYPH_HEIGHT = 7;
+    const unsigned char FONT_GLYPHS[FONT_CHARS][GLYPH_HEIGHT] =
+    {
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+        { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+        { 0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00 }, // "
+        { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A }, // #
+        { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 }, // $
+        { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+        { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D }, // &
+        { 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 }, // '
+        { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+        { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+        { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 }, // *
+        { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // +
+        { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ,
+        { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // -
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+        { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+        { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+        { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+        { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+        { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+        { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+        { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+        { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+        { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+        { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+        { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+        { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+        { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 }, // ;
+        { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+        { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // =
+        { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+        { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+        { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E }, // @
+        { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // A
+        { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+        { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+        { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+        { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+        { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+        { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+        { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+        { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+        { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+        { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+        { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+        { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+        { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+        { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+        { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+        { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+        { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+        { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+        { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+        { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+        { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+        { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+        { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+        { 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 }, // Y
+        { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+        { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E }, // [
+        { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // backslash
+        { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E }, // ]
+        { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 }, // ^
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }, // _
+    };
+
+    // Atlas of 16x4 cells of 6x8 texels; the last column and row of a cell are spacing
+    const int CELL_WIDTH = GLYPH_WIDTH + 1;
+    const int CELL_HEIGHT = GLYPH_HEIGHT + 1;
+    const int ATLAS_COLUMNS = 16;
+    const int ATLAS_WIDTH = ATLAS_COLUMNS * CELL_WIDTH;
+    const int ATLAS_HEIGHT = FONT_CHARS / ATLAS_COLUMNS * CELL_HEIGHT;
+
+    // Shapes sample the spacing corner of the space cell, which is set to 1
+    const glm::vec2 WHITE_UV((CELL_WIDTH - 0.5f) / ATLAS_WIDTH, (CELL_HEIGHT - 0.5f) / ATLAS_HEIGHT);
+
+    uint32_t UPackColor(const glm::vec4& color)
+    {
+        uint32_t packed = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            float c = color[i] < 0.0f ? 0.0f : (color[i] > 1.0f ? 1.0f : color[i]);
+            packed |= (uint32_t)(c * 255.0f + 0.5f) << (8 * i);
+        }
+        return packed;
+    }
+
+    void UPushVertex(UOverlay& overlay, const glm::vec2& position, const glm::vec2& uv, uint32_t color)
+    {
+        UOverlayVertex vertex;
+        vertex.position = position;
+        vertex.uv = uv;
+        vertex.color = color;
+        overlay.vertices.push_back(vertex);
+    }
+
+    // Two triangles; corners in order around the quad
+    void UPushQuad(UOverlay& overlay, const glm::vec2 corners[4], const glm::vec2 uvs[4], uint32_t color)
+    {
+        const int order[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int i : order)
+            UPushVertex(overlay, corners[i], uvs[i], color);
+    }
+
+    void UCreateFontTexture(UGpuTexture& texture)
+    {
+        vector<unsigned char> texels(ATLAS_WIDTH * ATLAS_HEIGHT, 0);
+        for (int c = 0; c < FONT_CHARS; ++c)
+        {
+            int cellX = c % ATLAS_COLUMNS * CELL_WIDTH;
+            int cellY = c / ATLAS_COLUMNS * CELL_HEIGHT;
+            for (int y = 0; y < GLYPH_HEIGHT; ++y)
+                for (int x = 0; x < GLYPH_WIDTH; ++x)
+                    if (FONT_GLYPHS[c][y] & (0x10 >> x))
+                        texels[(cellY + y) * ATLAS_WIDTH + cellX + x] = 255;
+        }
+        texels[(CELL_HEIGHT - 1) * ATLAS_WIDTH + CELL_WIDTH - 1] = 255;
+
+        // Row 0 is the top of the atlas; uvs are computed the same way, so nothing is flipped
+        texture.Create(UGPU_OVERLAY, "overlay font");
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, ATLAS_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, texels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        // Nearest keeps the pixel font sharp at integer scales
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        texture.SetBytes(UEstimateTextureBytes(ATLAS_WIDTH, ATLAS_HEIGHT, 1, 1, false));
+    }
+
+    // Waits until the GPU is done with the region, so it can be written again
+    void UWaitRegion(UOverlay& overlay, int region)
+    {
+        if (!overlay.fences[region])
+            return;
+        glClientWaitSync(overlay.fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(overlay.fences[region]);
+        overlay.fences[region] = 0;
+    }
+}
+
+
+bool UCreateOverlay(UOverlay& overlay, size_t regionVertices)
+{
+    overlay.mapped = nullptr;
+    overlay.regionVertices = regionVertices;
+    overlay.region = 0;
+    for (int i = 0; i < UOVERLAY_FRAMES; ++i)
+        overlay.fences[i] = 0;
+    overlay.width = overlay.height = 0;
+    overlay.nVertices = 0;
+    overlay.nDrawCalls = 0;
+
+    UCreateOverlayTables(overlay);
+
+    if (!UCreateShaderProgram(overlayVertexShaderSource, overlayFragmentShaderSource, overlay.programId))
+        return false;
+
+    // Persistent + coherent: a flush is one memcpy into the current region, no map/unmap per frame
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr bytes = (GLsizeiptr)(regionVertices * UOVERLAY_FRAMES * sizeof(UOverlayVertex));
+    overlay.vao.Create(UGPU_OVERLAY, "overlay");
+    glBindVertexArray(overlay.vao);
+    overlay.vbo.Create(UGPU_OVERLAY, "overlay vertices");
+    glBindBuffer(GL_ARRAY_BUFFER, overlay.vbo);
+    glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+    overlay.vbo.SetBytes((size_t)bytes);
+    overlay.mapped = (UOverlayVertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+
+    const GLsizei stride = sizeof(UOverlayVertex);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(UOverlayVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(UOverlayVertex, uv));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(UOverlayVertex, color));
+    glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (!overlay.mapped)
+    {
+        cerr << "Failed to map the overlay vertex buffer" << endl;
+        UDestroyOverlay(overlay);
+        return false;
+    }
+
+    UCreateFontTexture(overlay.fontTexture);
+
+    glUseProgram(overlay.programId);
+    glUniform1i(glGetUniformLocation(overlay.programId, "uFont"), 0);
+    glUseProgram(0);
+    return true;
+}
+
+
+void UCreateOverlayTables(UOverlay& overlay)
+{
+    // Computed once; every circle reuses it instead of calling cos/sin per vertex
+    for (int i = 0; i < UOVERLAY_CIRCLE_POINTS; ++i)
+    {
+        float angle = 6.28318530718f * i / UOVERLAY_CIRCLE_POINTS;
+        overlay.unitCircle[i] = glm::vec2(cos(angle), sin(angle));
+    }
+}
+
+
+void UDestroyOverlay(UOverlay& overlay)
+{
+    for (int i = 0; i < UOVERLAY_FRAMES; ++i)
+        UWaitRegion(overlay, i);
+    if (overlay.mapped)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, overlay.vbo);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        overlay.mapped = nullptr;
+    }
+    overlay.vbo.Reset();
+    overlay.vao.Reset();
+    overlay.fontTexture.Reset();
+    UDestroyShaderProgram(overlay.programId);
+    overlay.vertices.clear();
+}
+
+
+void UBeginOverlay(UOverlay& overlay, int width, int height)
+{
+    overlay.width = width;
+    overlay.height = height;
+    overlay.vertices.clear();
+}
+
+
+void UOverlayQuad(UOverlay& overlay, const glm::vec2& min, const glm::vec2& max, const glm::vec4& color)
+{
+    const glm::vec2 corners[4] = { min, glm::vec2(max.x, min.y), max, glm::vec2(min.x, max.y) };
+    const glm::vec2 uvs[4] = { WHITE_UV, WHITE_UV, WHITE_UV, WHITE_UV };
+    UPushQuad(overlay, corners, uvs, UPackColor(color));
+}
+
+
+void UOverlayLine(UOverlay& overlay, const glm::vec2& from, const glm::vec2& to, float width, const glm::vec4& color)
+{
+    glm::vec2 direction(to.x - from.x, to.y - from.y);
+    float length = sqrt(direction.x * direction.x + direction.y * direction.y);
+    if (length <= 0.0f)
+        return;
+
+    // Offset both ends sideways by half the width
+    float scale = 0.5f * width / length;
+    glm::vec2 side(-direction.y * scale, direction.x * scale);
+    const glm::vec2 corners[4] =
+    {
+        glm::vec2(from.x + side.x, from.y + side.y), glm::vec2(to.x + side.x, to.y + side.y),
+        glm::vec2(to.x - side.x, to.y - side.y), glm::vec2(from.x - side.x, from.y - side.y)
+    };
+    const glm::vec2 uvs[4] = { WHITE_UV, WHITE_UV, WHITE_UV, WHITE_UV };
+    UPushQuad(overlay, corners, uvs, UPackColor(color));
+}
+
+
+void UOverlayCircle(UOverlay& overlay, const glm::vec2& center, float radius, const glm::vec4& color)
+{
+    if (radius <= 0.0f)
+        return;
+
+    // Fewer segments for small circles: every step-th table point, from 16 up to the whole table
+    int nSegments = 16;
+    while (nSegments < UOVERLAY_CIRCLE_POINTS && nSegments < radius * 2.0f)
+        nSegments *= 2;
+    int step = UOVERLAY_CIRCLE_POINTS / nSegments;
+
+    uint32_t packed = UPackColor(color);
+    glm::vec2 previous(center.x + radius * overlay.unitCircle[0].x, center.y + radius * overlay.unitCircle[0].y);
+    for (int i = 1; i <= nSegments; ++i)
+    {
+        const glm::vec2& unit = overlay.unitCircle[i * step % UOVERLAY_CIRCLE_POINTS];
+        glm::vec2 point(center.x + radius * unit.x, center.y + radius * unit.y);
+        UPushVertex(overlay, center, WHITE_UV, packed);
+        UPushVertex(overlay, previous, WHITE_UV, packed);
+        UPushVertex(overlay, point, WHITE_UV, packed);
+        previous = point;
+    }
+}
+
+
+void UOverlayText(UOverlay& overlay, const glm::vec2& topLeft, float pixelSize, const char* text, const glm::vec4& color)
+{
+    uint32_t packed = UPackColor(color);
+    glm::vec2 pen = topLeft;
+    for (const char* c = text; *c; ++c)
+    {
+        if (*c == '\n')
+        {
+            pen = glm::vec2(topLeft.x, pen.y + CELL_HEIGHT * pixelSize);
+            continue;
+        }
+
+        int ch = *c;
+        if (ch >= 'a' && ch <= 'z')
+            ch += 'A' - 'a';
+        if (ch < FONT_FIRST_CHAR || ch >= FONT_FIRST_CHAR + FONT_CHARS)
+            ch = '?';
+        int glyph = ch - FONT_FIRST_CHAR;
+
+        // Spaces only advance
+        if (glyph != 0)
+        {
+            float u0 = (float)(glyph % ATLAS_COLUMNS * CELL_WIDTH) / ATLAS_WIDTH;
+            float v0 = (float)(glyph / ATLAS_COLUMNS * CELL_HEIGHT) / ATLAS_HEIGHT;
+            float u1 = u0 + (float)GLYPH_WIDTH / ATLAS_WIDTH;
+            float v1 = v0 + (float)GLYPH_HEIGHT / ATLAS_HEIGHT;
+            glm::vec2 max(pen.x + GLYPH_WIDTH * pixelSize, pen.y + GLYPH_HEIGHT * pixelSize);
+            const glm::vec2 corners[4] = { pen, glm::vec2(max.x, pen.y), max, glm::vec2(pen.x, max.y) };
+            const glm::vec2 uvs[4] = { glm::vec2(u0, v0), glm::vec2(u1, v0), glm::vec2(u1, v1), glm::vec2(u0, v1) };
+            UPushQuad(overlay, corners, uvs, packed);
+        }
+        pen.x += CELL_WIDTH * pixelSize;
+    }
+}
+
+
+void UFlushOverlay(UOverlay& overlay)
+{
+    overlay.nVertices = overlay.vertices.size();
+    overlay.nDrawCalls = 0;
+    if (overlay.vertices.empty())
+        return;
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glUseProgram(overlay.programId);
+    glUniform2f(glGetUniformLocation(overlay.programId, "uViewportSize"), (float)overlay.width, (float)overlay.height);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, overlay.fontTexture);
+    glBindVertexArray(overlay.vao);
+
+    // Normally the whole frame fits its region and this is one draw. A bigger batch is drawn in
+    // region sized pieces, each waiting for the GPU to finish with the region before overwriting it.
+    size_t perDraw = overlay.regionVertices / 3 * 3;
+    for (size_t first = 0; first < overlay.vertices.size(); first += perDraw)
+    {
+        size_t count = overlay.vertices.size() - first < perDraw ? overlay.vertices.size() - first : perDraw;
+        UWaitRegion(overlay, overlay.region);
+
+        size_t base = (size_t)overlay.region * overlay.regionVertices;
+        memcpy(overlay.mapped + base, overlay.vertices.data() + first, count * sizeof(UOverlayVertex));
+        glDrawArrays(GL_TRIANGLES, (GLint)base, (GLsizei)count);
+        overlay.fences[overlay.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        overlay.region = (overlay.region + 1) % UOVERLAY_FRAMES;
+        ++overlay.nDrawCalls;
+    }
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
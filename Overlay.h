@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>      // uint32_t
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "GpuResources.h"
+
+const int UOVERLAY_FRAMES = 3;          // regions of the streaming buffer the GPU may still be reading
+const int UOVERLAY_CIRCLE_POINTS = 256; // unit circle table; small circles use every 2nd, 4th... point
+
+struct UOverlayVertex
+{
+    glm::vec2 position;     // pixels, origin at the top left
+    glm::vec2 uv;           // into the font texture; shapes use its white texel
+    uint32_t color;         // RGBA8
+};
+
+// Batched 2D overlay for the core profile. Circles, quads, lines and text are accumulated as
+// triangles during the frame and streamed into one region of a persistently mapped vertex
+// buffer; UFlushOverlay draws all of them with one call.
+struct UOverlay
+{
+    GLuint programId;
+    UGpuVertexArray vao;
+    UGpuBuffer vbo;
+    UGpuTexture fontTexture; // R8 glyph atlas
+    UOverlayVertex* mapped;
+    size_t regionVertices;  // capacity of one region
+    int region;             // the one the next flush writes
+    GLsync fences[UOVERLAY_FRAMES];
+    glm::vec2 unitCircle[UOVERLAY_CIRCLE_POINTS];
+
+    // This frame
+    int width;
+    int height;
+    std::vector<UOverlayVertex> vertices;
+
+    // Stats of the last flush
+    size_t nVertices;
+    unsigned nDrawCalls;
+};
+
+bool UCreateOverlay(UOverlay& overlay, size_t regionVertices);
+// The CPU side alone: enough to queue shapes without a GL context
+void UCreateOverlayTables(UOverlay& overlay);
+void UDestroyOverlay(UOverlay& overlay);
+
+// Starts a frame drawn over a framebuffer of this size
+void UBeginOverlay(UOverlay& overlay, int width, int height);
+void UOverlayQuad(UOverlay& overlay, const glm::vec2& min, const glm::vec2& max, const glm::vec4& color);
+void UOverlayLine(UOverlay& overlay, const glm::vec2& from, const glm::vec2& to, float width, const glm::vec4& color);
+void UOverlayCircle(UOverlay& overlay, const glm::vec2& center, float radius, const glm::vec4& color);
+// 5x7 pixel font scaled by pixelSize; lower case is drawn as upper case, '\n' starts a new line
+void UOverlayText(UOverlay& overlay, const glm::vec2& topLeft, float pixelSize, const char* text, const glm::vec4& color);
+// Draws everything queued since UBeginOverlay
+void UFlushOverlay(UOverlay& overlay);
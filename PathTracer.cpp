@@ -0,0 +1,607 @@
+#include <algorithm>    // partition, sort
+#include <atomic>       // std::atomic
+#include <chrono>       // timing
+#include <cmath>        // sqrt, cos, sin
+#include <thread>       // std::thread
+#include "PathTracer.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>  // SSE2
+#define UTRACE_SSE 1
+#endif
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const int LEAF_SIZE = 4;            // leaves are made once a node has this many triangles or fewer
+    const int SAH_BINS = 16;
+    const float TRAVERSAL_COST = 1.0f;  // relative to one triangle test
+    const int TILE_SIZE = 16;           // pixels per side of one unit of tracing work
+    const float RAY_EPSILON = 1e-4f;
+    const float PI = 3.14159265358979f;
+
+    // Same constants as lightFragmentShaderSource
+    const float SPECULAR_INTENSITY = 0.8f;
+
+    double UMillisecondsSince(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    struct UBounds
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+
+        UBounds() : min(1e30f), max(-1e30f) {}
+        void Grow(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+        void Grow(const UBounds& b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+        float Area() const
+        {
+            glm::vec3 e = max - min;
+            return e.x < 0.0f ? 0.0f : 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+    };
+
+    // Binary node used while building
+    struct UBuildNode
+    {
+        UBounds bounds;
+        int left, right;        // children, -1 for leaves
+        int first, count;       // triangle range of a leaf
+    };
+
+    struct UBuilder
+    {
+        vector<UBounds> triangleBounds;
+        vector<glm::vec3> centroids;
+        vector<int> order;
+        vector<UBuildNode> nodes;
+    };
+
+    int UBuildBinary(UBuilder& builder, int begin, int end)
+    {
+        UBuildNode node;
+        node.left = node.right = -1;
+        node.first = begin;
+        node.count = end - begin;
+        UBounds centroidBounds;
+        for (int i = begin; i < end; ++i)
+        {
+            node.bounds.Grow(builder.triangleBounds[builder.order[i]]);
+            centroidBounds.Grow(builder.centroids[builder.order[i]]);
+        }
+        int index = (int)builder.nodes.size();
+        builder.nodes.push_back(node);
+        if (node.count <= LEAF_SIZE)
+            return index;
+
+        // Binned SAH over all three axes
+        float bestCost = 1e30f;
+        int bestAxis = -1, bestSplit = 0;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float axisMin = centroidBounds.min[axis], axisMax = centroidBounds.max[axis];
+            if (axisMax <= axisMin)
+                continue;
+            UBounds binBounds[SAH_BINS];
+            int binCounts[SAH_BINS] = {};
+            float scale = SAH_BINS / (axisMax - axisMin);
+            for (int i = begin; i < end; ++i)
+            {
+                int bin = (int)((builder.centroids[builder.order[i]][axis] - axisMin) * scale);
+                bin = bin < SAH_BINS - 1 ? bin : SAH_BINS - 1;
+                binBounds[bin].Grow(builder.triangleBounds[builder.order[i]]);
+                ++binCounts[bin];
+            }
+
+            // Sweep from the right, then evaluate each split from the left
+            float rightArea[SAH_BINS];
+            int rightCount[SAH_BINS];
+            UBounds right;
+            int count = 0;
+            for (int bin = SAH_BINS - 1; bin > 0; --bin)
+            {
+                right.Grow(binBounds[bin]);
+                count += binCounts[bin];
+                rightArea[bin] = right.Area();
+                rightCount[bin] = count;
+            }
+            UBounds left;
+            count = 0;
+            for (int split = 1; split < SAH_BINS; ++split)
+            {
+                left.Grow(binBounds[split - 1]);
+                count += binCounts[split - 1];
+                if (count == 0 || rightCount[split] == 0)
+                    continue;
+                float cost = left.Area() * count + rightArea[split] * rightCount[split];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        int middle;
+        if (bestAxis < 0)
+        {
+            // Every centroid in one spot: halve the range
+            middle = (begin + end) / 2;
+        }
+        else
+        {
+            // Leaf if splitting costs more than testing everything
+            float leafCost = (float)node.count;
+            bestCost = TRAVERSAL_COST + bestCost / node.bounds.Area();
+            if (bestCost >= leafCost && node.count <= 2 * LEAF_SIZE)
+                return index;
+
+            float axisMin = centroidBounds.min[bestAxis];
+            float scale = SAH_BINS / (centroidBounds.max[bestAxis] - axisMin);
+            middle = (int)(partition(builder.order.begin() + begin, builder.order.begin() + end, [&](int triangle)
+                {
+                    int bin = (int)((builder.centroids[triangle][bestAxis] - axisMin) * scale);
+                    return (bin < SAH_BINS - 1 ? bin : SAH_BINS - 1) < bestSplit;
+                }) - builder.order.begin());
+        }
+
+        int left = UBuildBinary(builder, begin, middle);
+        int right = UBuildBinary(builder, middle, end);
+        builder.nodes[index].left = left;
+        builder.nodes[index].right = right;
+        return index;
+    }
+
+    // Pulls grandchildren up until a node has 4 children (largest inner child first)
+    int UCollapse(const UBuilder& builder, UBvh& bvh, int binaryIndex, int depth)
+    {
+        bvh.depth = depth > bvh.depth ? depth : bvh.depth;
+        vector<int> children;
+        const UBuildNode& binary = builder.nodes[binaryIndex];
+        if (binary.left < 0)
+            children.push_back(binaryIndex);
+        else
+        {
+            children.push_back(binary.left);
+            children.push_back(binary.right);
+        }
+        while (children.size() < 4)
+        {
+            int best = -1;
+            float bestArea = -1.0f;
+            for (size_t i = 0; i < children.size(); ++i)
+            {
+                const UBuildNode& child = builder.nodes[children[i]];
+                if (child.left >= 0 && child.bounds.Area() > bestArea)
+                {
+                    best = (int)i;
+                    bestArea = child.bounds.Area();
+                }
+            }
+            if (best < 0)
+                break;
+            int expanded = children[best];
+            children[best] = builder.nodes[expanded].left;
+            children.push_back(builder.nodes[expanded].right);
+        }
+
+        int index = (int)bvh.nodes.size();
+        bvh.nodes.push_back(UBvh4Node());
+        for (int slot = 0; slot < 4; ++slot)
+        {
+            UBounds bounds;
+            int32_t child = -1, count = 0;
+            if (slot < (int)children.size())
+            {
+                const UBuildNode& node = builder.nodes[children[slot]];
+                bounds = node.bounds;
+                if (node.left < 0)
+                {
+                    child = node.first;
+                    count = node.count;
+                }
+                else
+                    child = UCollapse(builder, bvh, children[slot], depth + 1);
+            }
+
+            // Empty slots keep inverted bounds, so the slab test never hits them
+            UBvh4Node& node4 = bvh.nodes[index];
+            node4.minX[slot] = bounds.min.x;
+            node4.minY[slot] = bounds.min.y;
+            node4.minZ[slot] = bounds.min.z;
+            node4.maxX[slot] = bounds.max.x;
+            node4.maxY[slot] = bounds.max.y;
+            node4.maxZ[slot] = bounds.max.z;
+            node4.child[slot] = child;
+            node4.count[slot] = count;
+        }
+        return index;
+    }
+
+    // Moller-Trumbore
+    bool UIntersectTriangle(const UTraceTriangle& triangle, const glm::vec3& origin, const glm::vec3& direction, float tMax, float& t, float& u, float& v)
+    {
+        glm::vec3 p = glm::cross(direction, triangle.edge2);
+        float determinant = glm::dot(triangle.edge1, p);
+        if (determinant > -1e-12f && determinant < 1e-12f)
+            return false;
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - triangle.v0;
+        u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, triangle.edge1);
+        v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        t = glm::dot(triangle.edge2, q) * inverse;
+        return t > RAY_EPSILON && t < tMax;
+    }
+}
+
+bool UIntersectBvh(const UBvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float tMax, bool shadowRay, UTraceHit& hit)
+{
+    if (bvh.nodes.empty())
+        return false;
+
+    glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    hit.t = tMax;
+    hit.triangle = -1;
+
+    // A level leaves at most 3 siblings waiting, so 3 per level covers any tree; only unusually
+    // unbalanced ones need more than the local array
+    const int FIXED_STACK = 64;
+    int fixedStack[FIXED_STACK];
+    vector<int> deepStack;
+    int* stack = fixedStack;
+    if (3 * bvh.depth + 1 > FIXED_STACK)
+    {
+        deepStack.resize((size_t)3 * bvh.depth + 1);
+        stack = deepStack.data();
+    }
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+#ifdef UTRACE_SSE
+    const __m128 originX = _mm_set1_ps(origin.x), originY = _mm_set1_ps(origin.y), originZ = _mm_set1_ps(origin.z);
+    const __m128 inverseX = _mm_set1_ps(inverseDirection.x), inverseY = _mm_set1_ps(inverseDirection.y), inverseZ = _mm_set1_ps(inverseDirection.z);
+#endif
+    while (stackSize > 0)
+    {
+        const UBvh4Node& node = bvh.nodes[stack[--stackSize]];
+
+        // Slab test of all four children at once
+        float tNear[4];
+        int mask = 0;
+#ifdef UTRACE_SSE
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), originX), inverseX);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), originX), inverseX);
+        __m128 enter = _mm_min_ps(t0, t1), exit = _mm_max_ps(t0, t1);
+        t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), originY), inverseY);
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), originY), inverseY);
+        enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+        exit = _mm_min_ps(exit, _mm_max_ps(t0, t1));
+        t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), originZ), inverseZ);
+        t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), originZ), inverseZ);
+        enter = _mm_max_ps(_mm_max_ps(enter, _mm_min_ps(t0, t1)), _mm_setzero_ps());
+        exit = _mm_min_ps(_mm_min_ps(exit, _mm_max_ps(t0, t1)), _mm_set1_ps(hit.t));
+        mask = _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+        _mm_storeu_ps(tNear, enter);
+#else
+        for (int slot = 0; slot < 4; ++slot)
+        {
+            float tx0 = (node.minX[slot] - origin.x) * inverseDirection.x, tx1 = (node.maxX[slot] - origin.x) * inverseDirection.x;
+            float ty0 = (node.minY[slot] - origin.y) * inverseDirection.y, ty1 = (node.maxY[slot] - origin.y) * inverseDirection.y;
+            float tz0 = (node.minZ[slot] - origin.z) * inverseDirection.z, tz1 = (node.maxZ[slot] - origin.z) * inverseDirection.z;
+            float enter = glm::max(glm::max(glm::min(tx0, tx1), glm::min(ty0, ty1)), glm::max(glm::min(tz0, tz1), 0.0f));
+            float exit = glm::min(glm::min(glm::max(tx0, tx1), glm::max(ty0, ty1)), glm::min(glm::max(tz0, tz1), hit.t));
+            tNear[slot] = enter;
+            mask |= enter <= exit ? 1 << slot : 0;
+        }
+#endif
+        if (!mask)
+            continue;
+
+        // Nearest child first
+        int slots[4], nSlots = 0;
+        for (int slot = 0; slot < 4; ++slot)
+        {
+            if ((mask & (1 << slot)) && node.child[slot] >= 0)
+                slots[nSlots++] = slot;
+        }
+        sort(slots, slots + nSlots, [&](int a, int b) { return tNear[a] < tNear[b]; });
+
+        for (int i = nSlots - 1; i >= 0; --i)
+        {
+            int slot = slots[i];
+            if (node.count[slot] == 0)
+            {
+                stack[stackSize++] = node.child[slot];
+                continue;
+            }
+            for (int triangle = node.child[slot]; triangle < node.child[slot] + node.count[slot]; ++triangle)
+            {
+                if (shadowRay && !bvh.shading[triangle].castsShadow)
+                    continue;
+                float t, u, v;
+                if (UIntersectTriangle(bvh.triangles[triangle], origin, direction, hit.t, t, u, v))
+                {
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.triangle = triangle;
+                    if (shadowRay)
+                        return true;
+                }
+            }
+        }
+    }
+    return hit.triangle >= 0;
+}
+
+void UGetTraceSurface(const UBvh& bvh, const UTraceHit& hit, const glm::vec3& origin, const glm::vec3& direction, UTraceSurface& surface)
+{
+    const UTraceTriangle& triangle = bvh.triangles[hit.triangle];
+    const UTraceShading& shading = bvh.shading[hit.triangle];
+    float w = 1.0f - hit.u - hit.v;
+    surface.position = origin + direction * hit.t;
+
+    // Two sided
+    surface.geometricNormal = glm::normalize(glm::cross(triangle.edge1, triangle.edge2));
+    if (glm::dot(surface.geometricNormal, direction) > 0.0f)
+        surface.geometricNormal = -surface.geometricNormal;
+    surface.normal = glm::normalize(shading.normal[0] * w + shading.normal[1] * hit.u + shading.normal[2] * hit.v);
+    if (glm::dot(surface.normal, surface.geometricNormal) < 0.0f)
+        surface.normal = -surface.normal;
+
+    glm::vec2 uv = shading.uv[0] * w + shading.uv[1] * hit.u + shading.uv[2] * hit.v;
+    surface.albedo = shading.texture ? glm::vec3(USampleSoftTexture(*shading.texture, uv)) : glm::vec3(1.0f);
+}
+
+uint32_t UTraceHash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+glm::vec3 USampleCosineHemisphere(const glm::vec3& n, UTraceRandom& random)
+{
+    float r1 = random.Next(), r2 = random.Next();
+    float phi = 2.0f * PI * r1;
+    float radius = sqrt(r2);
+    float x = radius * cos(phi), y = radius * sin(phi), z = sqrt(1.0f - r2);
+
+    // Branchless orthonormal basis (Duff et al.)
+    float sign = n.z >= 0.0f ? 1.0f : -1.0f;
+    float a = -1.0f / (sign + n.z);
+    float b = n.x * n.y * a;
+    glm::vec3 tangent(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+    glm::vec3 bitangent(b, sign + n.y * n.y * a, -n.y);
+    return tangent * x + bitangent * y + n * z;
+}
+
+namespace
+{
+    // One path. Direct light uses the unattenuated point light and Phong terms of
+    // lightFragmentShaderSource plus a shadow ray; indirect bounces replace its constant ambient.
+    glm::vec3 UTracePath(const UBvh& bvh, const USoftScene& scene, glm::vec3 origin, glm::vec3 direction, int maxBounces, UTraceRandom& random, uint64_t& nRays)
+    {
+        glm::vec3 radiance(0.0f), throughput(1.0f);
+        for (int bounce = 0; ; ++bounce)
+        {
+            UTraceHit hit;
+            ++nRays;
+            if (!UIntersectBvh(bvh, origin, direction, 1e30f, false, hit))
+                break; // black background, like the GL clear color
+
+            UTraceSurface surface;
+            UGetTraceSurface(bvh, hit, origin, direction, surface);
+            glm::vec3 offsetOrigin = surface.position + surface.geometricNormal * RAY_EPSILON * 10.0f;
+
+            glm::vec3 toLight = scene.lightPosition - surface.position;
+            float lightDistance = glm::length(toLight);
+            glm::vec3 lightDirection = toLight / lightDistance;
+            float impact = glm::dot(surface.normal, lightDirection);
+            if (impact > 0.0f)
+            {
+                UTraceHit shadowHit;
+                ++nRays;
+                if (!UIntersectBvh(bvh, offsetOrigin, lightDirection, lightDistance, true, shadowHit))
+                {
+                    glm::vec3 reflectDir = glm::reflect(-lightDirection, surface.normal);
+                    float specularDot = glm::dot(-direction, reflectDir);
+                    specularDot = specularDot > 0.0f ? specularDot : 0.0f;
+                    float specularComponent = specularDot * specularDot;    // pow(x, 16)
+                    specularComponent *= specularComponent;
+                    specularComponent *= specularComponent;
+                    specularComponent *= specularComponent;
+                    glm::vec3 direct = (impact + SPECULAR_INTENSITY * specularComponent) * scene.lightColor;
+                    radiance += throughput * direct * surface.albedo;
+                }
+            }
+
+            if (bounce >= maxBounces)
+                break;
+
+            // Lambertian bounce: cosine sampling cancels everything but the albedo
+            throughput *= surface.albedo;
+            if (bounce >= 2)
+            {
+                float survive = glm::max(throughput.x, glm::max(throughput.y, throughput.z));
+                survive = survive < 0.05f ? 0.05f : (survive > 0.95f ? 0.95f : survive);
+                if (random.Next() > survive)
+                    break;
+                throughput /= survive;
+            }
+            origin = offsetOrigin;
+            direction = USampleCosineHemisphere(surface.normal, random);
+        }
+        return radiance;
+    }
+}
+
+void UBuildBvh(const USoftScene& scene, UBvh& bvh)
+{
+    auto start = chrono::steady_clock::now();
+
+    // Flatten every object into world space
+    vector<UTraceTriangle> triangles;
+    vector<UTraceShading> shading;
+    for (const USoftObject& object : scene.objects)
+    {
+        const UMeshData& mesh = *object.mesh;
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(object.model)));
+        size_t nTriangles = (mesh.indices.empty() ? mesh.positions.size() : mesh.indices.size()) / 3;
+        for (size_t i = 0; i < nTriangles; ++i)
+        {
+            uint32_t corner[3];
+            for (int c = 0; c < 3; ++c)
+                corner[c] = mesh.indices.empty() ? (uint32_t)(i * 3 + c) : mesh.indices[i * 3 + c];
+
+            glm::vec3 p[3];
+            for (int c = 0; c < 3; ++c)
+                p[c] = glm::vec3(object.model * glm::vec4(mesh.positions[corner[c]], 1.0f));
+            UTraceTriangle triangle = { p[0], p[1] - p[0], p[2] - p[0] };
+            glm::vec3 faceNormal = glm::cross(triangle.edge1, triangle.edge2);
+            if (glm::length(faceNormal) == 0.0f)
+                continue;
+
+            UTraceShading triangleShading;
+            for (int c = 0; c < 3; ++c)
+            {
+                triangleShading.normal[c] = mesh.normals.empty() ? glm::normalize(faceNormal) : glm::normalize(normalMatrix * mesh.normals[corner[c]]);
+                triangleShading.uv[c] = mesh.uvs.empty() ? glm::vec2(0.0f) : mesh.uvs[corner[c]] * object.uvScale;
+            }
+            triangleShading.texture = object.texture;
+            triangleShading.castsShadow = object.castsShadow;
+            triangles.push_back(triangle);
+            shading.push_back(triangleShading);
+        }
+    }
+
+    UBuilder builder;
+    builder.triangleBounds.resize(triangles.size());
+    builder.centroids.resize(triangles.size());
+    builder.order.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i)
+    {
+        UBounds bounds;
+        bounds.Grow(triangles[i].v0);
+        bounds.Grow(triangles[i].v0 + triangles[i].edge1);
+        bounds.Grow(triangles[i].v0 + triangles[i].edge2);
+        builder.triangleBounds[i] = bounds;
+        builder.centroids[i] = (bounds.min + bounds.max) * 0.5f;
+        builder.order[i] = (int)i;
+    }
+
+    bvh.nodes.clear();
+    bvh.triangles.clear();
+    bvh.shading.clear();
+    bvh.depth = 0;
+    if (!triangles.empty())
+    {
+        builder.nodes.reserve(triangles.size() * 2 / LEAF_SIZE + 1);
+        UBuildBinary(builder, 0, (int)triangles.size());
+        UCollapse(builder, bvh, 0, 1);
+
+        // Leaves index straight into the reordered triangles
+        bvh.triangles.reserve(triangles.size());
+        bvh.shading.reserve(triangles.size());
+        for (int index : builder.order)
+        {
+            bvh.triangles.push_back(triangles[index]);
+            bvh.shading.push_back(shading[index]);
+        }
+    }
+    bvh.nBinaryNodes = builder.nodes.size();
+    bvh.buildMs = UMillisecondsSince(start);
+}
+
+void UCreatePathTracer(UPathTracer& tracer, int width, int height, int maxBounces, unsigned nThreads)
+{
+    if (nThreads == 0)
+        nThreads = thread::hardware_concurrency();
+    tracer.width = width;
+    tracer.height = height;
+    tracer.maxBounces = maxBounces;
+    tracer.nThreads = nThreads > 0 ? nThreads : 1;
+    tracer.accumulated.assign((size_t)width * height, glm::vec3(0.0f));
+    tracer.nSamples = 0;
+    tracer.passMs = 0.0;
+    tracer.passRays = 0;
+}
+
+void UTracePass(UPathTracer& tracer, const UBvh& bvh, const USoftScene& scene)
+{
+    auto start = chrono::steady_clock::now();
+    glm::mat4 inverseViewProjection = glm::inverse(scene.projection * scene.view);
+    int nTilesX = (tracer.width + TILE_SIZE - 1) / TILE_SIZE;
+    int nTilesY = (tracer.height + TILE_SIZE - 1) / TILE_SIZE;
+    int nTiles = nTilesX * nTilesY;
+    atomic<int> nextTile(0);
+    atomic<uint64_t> nRays(0);
+    uint32_t sample = tracer.nSamples;
+
+    auto worker = [&]()
+    {
+        uint64_t workerRays = 0;
+        for (int tile = nextTile.fetch_add(1); tile < nTiles; tile = nextTile.fetch_add(1))
+        {
+            int x0 = (tile % nTilesX) * TILE_SIZE, y0 = (tile / nTilesX) * TILE_SIZE;
+            int x1 = x0 + TILE_SIZE < tracer.width ? x0 + TILE_SIZE : tracer.width;
+            int y1 = y0 + TILE_SIZE < tracer.height ? y0 + TILE_SIZE : tracer.height;
+            for (int y = y0; y < y1; ++y)
+            {
+                for (int x = x0; x < x1; ++x)
+                {
+                    size_t pixel = (size_t)y * tracer.width + x;
+                    UTraceRandom random = { UTraceHash((uint32_t)pixel * 9781u + UTraceHash(sample + 1)) };
+
+                    // Jittered camera ray through the pixel; rows are bottom up like the GL frame
+                    glm::vec2 ndc(((x + random.Next()) / tracer.width) * 2.0f - 1.0f, ((y + random.Next()) / tracer.height) * 2.0f - 1.0f);
+                    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+                    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+                    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+                    glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+                    tracer.accumulated[pixel] += UTracePath(bvh, scene, origin, direction, tracer.maxBounces, random, workerRays);
+                }
+            }
+        }
+        nRays += workerRays;
+    };
+
+    vector<thread> threads;
+    for (unsigned i = 1; i < tracer.nThreads; ++i)
+        threads.push_back(thread(worker));
+    worker();
+    for (thread& t : threads)
+        t.join();
+
+    ++tracer.nSamples;
+    tracer.passRays = nRays;
+    tracer.passMs = UMillisecondsSince(start);
+}
+
+void UResolvePathTracer(const UPathTracer& tracer, USoftFrame& frame)
+{
+    if (frame.width != tracer.width || frame.height != tracer.height)
+        UResizeSoftFrame(frame, tracer.width, tracer.height);
+    float scale = tracer.nSamples > 0 ? 1.0f / tracer.nSamples : 0.0f;
+    for (size_t i = 0; i < tracer.accumulated.size(); ++i)
+    {
+        glm::vec3 color = glm::clamp(tracer.accumulated[i] * scale, 0.0f, 1.0f);
+        frame.color[i * 4 + 0] = (unsigned char)(color.x * 255.0f + 0.5f);
+        frame.color[i * 4 + 1] = (unsigned char)(color.y * 255.0f + 0.5f);
+        frame.color[i * 4 + 2] = (unsigned char)(color.z * 255.0f + 0.5f);
+        frame.color[i * 4 + 3] = 255;
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>      // int32_t, uint32_t
+#include <vector>       // std::vector
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "SoftwareRasterizer.h"
+
+// World space triangle in the form the intersection test wants (Moller-Trumbore)
+struct UTraceTriangle
+{
+    glm::vec3 v0;
+    glm::vec3 edge1;
+    glm::vec3 edge2;
+};
+
+// What shading needs once a triangle was hit
+struct UTraceShading
+{
+    glm::vec3 normal[3];        // world space, all equal to the face normal when the mesh has none
+    glm::vec2 uv[3];            // already multiplied by the object's uvScale
+    const USoftTexture* texture;
+    bool castsShadow;
+};
+
+// 4 wide BVH node: the bounds of all children sit side by side so one SSE slab test covers them
+struct UBvh4Node
+{
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    int32_t child[4];           // inner node index, or first triangle when count > 0, -1 = empty slot
+    int32_t count[4];           // triangles in a leaf child, 0 for inner nodes
+};
+
+struct UBvh
+{
+    std::vector<UTraceTriangle> triangles;  // in leaf order
+    std::vector<UTraceShading> shading;     // same order
+    std::vector<UBvh4Node> nodes;           // nodes[0] is the root
+    int depth;                              // levels of 4 wide nodes, sizes the traversal stack
+    double buildMs;
+    size_t nBinaryNodes;                    // before collapsing to 4 wide nodes
+};
+
+struct UTraceHit
+{
+    float t;
+    float u, v;             // barycentrics of vertices 1 and 2
+    int triangle;
+};
+
+// What a hit looks like to shading: both normals face the incoming ray
+struct UTraceSurface
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 geometricNormal;
+    glm::vec3 albedo;
+};
+
+// PCG; seed it per pixel/texel and sample so results do not depend on the thread count
+struct UTraceRandom
+{
+    uint32_t state;
+
+    float Next()
+    {
+        state = state * 747796405u + 2891336453u;
+        uint32_t word = ((state >> ((state >> 28) + 4)) ^ state) * 277803737u;
+        word = (word >> 22) ^ word;
+        return (word >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+// Progressive accumulation: every UTracePass adds one sample per pixel
+struct UPathTracer
+{
+    int width;
+    int height;
+    int maxBounces;
+    unsigned nThreads;
+    std::vector<glm::vec3> accumulated;
+    uint32_t nSamples;          // per pixel so far
+
+    // Stats of the last pass
+    double passMs;
+    uint64_t passRays;          // camera, bounce and shadow rays
+};
+
+// SAH build (binned) over every triangle of the scene, then collapsed to 4 wide nodes
+void UBuildBvh(const USoftScene& scene, UBvh& bvh);
+
+// Closest hit, or any shadow casting hit before tMax when shadowRay is set
+bool UIntersectBvh(const UBvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float tMax, bool shadowRay, UTraceHit& hit);
+void UGetTraceSurface(const UBvh& bvh, const UTraceHit& hit, const glm::vec3& origin, const glm::vec3& direction, UTraceSurface& surface);
+uint32_t UTraceHash(uint32_t x);
+// Cosine weighted direction around n
+glm::vec3 USampleCosineHemisphere(const glm::vec3& n, UTraceRandom& random);
+
+void UCreatePathTracer(UPathTracer& tracer, int width, int height, int maxBounces, unsigned nThreads = 0); // 0 = every core
+void UTracePass(UPathTracer& tracer, const UBvh& bvh, const USoftScene& scene);
+// Average so far into frame.color (clamped, no gamma, like the GL framebuffer)
+void UResolvePathTracer(const UPathTracer& tracer, USoftFrame& frame);
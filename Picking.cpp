@@ -0,0 +1,278 @@
+#include <iostream>     // cout, cerr
+#include "Picking.h"
+
+// GLM Math Header inclusions
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace std; // Standard namespace
+
+/* Writes the object ID of every covered pixel */
+const GLchar* pickVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+
+    uniform mat4 model;
+    uniform mat4 viewProjection;
+
+    void main()
+    {
+        gl_Position = viewProjection * model * vec4(position, 1.0f);
+    }
+);
+
+const GLchar* pickFragmentShaderSource = GLSL(440,
+    uniform uint uObjectId;
+
+    out uint objectId;
+
+    void main()
+    {
+        objectId = uObjectId;
+    }
+);
+
+namespace
+{
+    void UDestroyTargets(UPicker& picker)
+    {
+        picker.idTexture.Reset();
+        picker.depthTexture.Reset();
+        picker.width = picker.height = 0;
+    }
+
+    bool UCreateTargets(UPicker& picker, GLsizei width, GLsizei height)
+    {
+        UDestroyTargets(picker);
+        picker.width = width;
+        picker.height = height;
+
+        picker.idTexture.Create(UGPU_PICKING, "pick ids");
+        glBindTexture(GL_TEXTURE_2D, picker.idTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, width, height);
+        picker.idTexture.SetBytes(UEstimateTextureBytes(width, height, 1, 4, false));
+
+        picker.depthTexture.Create(UGPU_PICKING, "pick depth");
+        glBindTexture(GL_TEXTURE_2D, picker.depthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, width, height);
+        picker.depthTexture.SetBytes(UEstimateTextureBytes(width, height, 1, 4, false));
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, picker.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, picker.idTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, picker.depthTexture, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            cout << "Picking framebuffer is incomplete: 0x" << hex << status << dec << endl;
+            UDestroyTargets(picker);
+            return false;
+        }
+        return true;
+    }
+
+    // Renders the IDs around the queued pick pixel and starts the readback into a free PBO
+    void URenderPick(UPicker& picker, const vector<USceneObject>& scene, const vector<char>* visible, const glm::mat4& viewProjection)
+    {
+        int slot = picker.nextRequest;
+        UPickRequest& request = picker.requests[slot];
+        // Every readback still in flight: keep the click for a later frame
+        if (request.fence)
+            return;
+        picker.pending = false;
+
+        request.x = picker.pendingX < picker.width - 1 ? picker.pendingX : picker.width - 1;
+        request.y = picker.pendingY < picker.height - 1 ? picker.pendingY : picker.height - 1;
+        request.x = request.x > 0 ? request.x : 0;
+        request.y = request.y > 0 ? request.y : 0;
+        if (picker.regionRadius < 0)
+        {
+            request.regionX = request.regionY = 0;
+            request.regionWidth = picker.width;
+            request.regionHeight = picker.height;
+        }
+        else
+        {
+            request.regionX = request.x - picker.regionRadius > 0 ? request.x - picker.regionRadius : 0;
+            request.regionY = request.y - picker.regionRadius > 0 ? request.y - picker.regionRadius : 0;
+            int right = request.x + picker.regionRadius < picker.width - 1 ? request.x + picker.regionRadius : picker.width - 1;
+            int top = request.y + picker.regionRadius < picker.height - 1 ? request.y + picker.regionRadius : picker.height - 1;
+            request.regionWidth = right - request.regionX + 1;
+            request.regionHeight = top - request.regionY + 1;
+        }
+        request.width = picker.width;
+        request.height = picker.height;
+        request.viewProjection = viewProjection;
+        request.nObjects = scene.size();
+
+        // IDs only inside the region
+        glBindFramebuffer(GL_FRAMEBUFFER, picker.fbo);
+        glViewport(0, 0, picker.width, picker.height);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(request.regionX, request.regionY, request.regionWidth, request.regionHeight);
+        const GLuint background[4] = { 0, 0, 0, 0 };
+        const GLfloat farDepth = 1.0f;
+        glClearBufferuiv(GL_COLOR, 0, background);
+        glClearBufferfv(GL_DEPTH, 0, &farDepth);
+
+        glEnable(GL_DEPTH_TEST);
+        glUseProgram(picker.programId);
+        GLint modelLoc = glGetUniformLocation(picker.programId, "model");
+        GLint objectIdLoc = glGetUniformLocation(picker.programId, "uObjectId");
+        glUniformMatrix4fv(glGetUniformLocation(picker.programId, "viewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+        for (size_t i = 0; i < scene.size(); ++i)
+        {
+            if (visible && i < visible->size() && !(*visible)[i])
+                continue;
+            const USceneObject& object = scene[i];
+            glm::mat4 model = object.model * object.mesh->dequantize;
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+            glUniform1ui(objectIdLoc, (GLuint)i + 1);
+            UDrawGpuMesh(*object.mesh);
+        }
+        glBindVertexArray(0);
+        glDisable(GL_SCISSOR_TEST);
+
+        // IDs then depth, both into the slot's PBO
+        GLsizeiptr planeBytes = (GLsizeiptr)request.regionWidth * request.regionHeight * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, picker.pbos[slot]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, planeBytes * 2, nullptr, GL_STREAM_READ);
+        picker.pbos[slot].SetBytes((size_t)planeBytes * 2);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(request.regionX, request.regionY, request.regionWidth, request.regionHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, (void*)0);
+        glReadPixels(request.regionX, request.regionY, request.regionWidth, request.regionHeight, GL_DEPTH_COMPONENT, GL_FLOAT, (void*)planeBytes);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, picker.width, picker.height);
+
+        request.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        picker.nextRequest = (slot + 1) % UPICK_READBACK_BUFFERS;
+    }
+
+    // Turns a finished readback into a result; the nearest hit in the region counts, so clicks
+    // just beside thin objects still select them
+    void UResolvePick(const UPicker& picker, int slot, const vector<USceneObject>& scene, UPickResult& result)
+    {
+        const UPickRequest& request = picker.requests[slot];
+        GLsizeiptr planeBytes = (GLsizeiptr)request.regionWidth * request.regionHeight * 4;
+
+        result.hit = false;
+        result.objectIndex = -1;
+        result.name.clear();
+        result.worldPosition = glm::vec3(0.0f);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, picker.pbos[slot]);
+        const unsigned char* mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, planeBytes * 2, GL_MAP_READ_BIT);
+        if (mapped)
+        {
+            const GLuint* ids = (const GLuint*)mapped;
+            const GLfloat* depths = (const GLfloat*)(mapped + planeBytes);
+
+            int best = -1;
+            int bestDistance = 0;
+            for (int y = 0; y < request.regionHeight; ++y)
+            {
+                for (int x = 0; x < request.regionWidth; ++x)
+                {
+                    int i = y * request.regionWidth + x;
+                    if (ids[i] == 0 || ids[i] > request.nObjects)
+                        continue;
+                    int dx = request.regionX + x - request.x, dy = request.regionY + y - request.y;
+                    int distance = dx * dx + dy * dy;
+                    if (best < 0 || distance < bestDistance)
+                    {
+                        best = i;
+                        bestDistance = distance;
+                    }
+                }
+            }
+
+            // Scene may have been rebuilt since the click; indices past its end are stale
+            if (best >= 0 && ids[best] - 1 < scene.size())
+            {
+                result.hit = true;
+                result.objectIndex = (int)ids[best] - 1;
+                result.name = scene[result.objectIndex].name;
+
+                // Pixel center and depth back to world space with the matrix it was rendered with
+                int pixelX = request.regionX + best % request.regionWidth;
+                int pixelY = request.regionY + best / request.regionWidth;
+                glm::vec4 ndc((pixelX + 0.5f) / request.width * 2.0f - 1.0f, (pixelY + 0.5f) / request.height * 2.0f - 1.0f, depths[best] * 2.0f - 1.0f, 1.0f);
+                glm::vec4 world = glm::inverse(request.viewProjection) * ndc;
+                result.worldPosition = glm::vec3(world) / world.w;
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
+
+bool UCreatePicker(UPicker& picker, int regionRadius)
+{
+    picker.width = picker.height = 0;
+    picker.regionRadius = regionRadius;
+    picker.nextRequest = 0;
+    picker.pending = false;
+
+    if (!UCreateShaderProgram(pickVertexShaderSource, pickFragmentShaderSource, picker.programId))
+        return false;
+
+    picker.fbo.Create(UGPU_PICKING, "pick framebuffer");
+    for (int i = 0; i < UPICK_READBACK_BUFFERS; ++i)
+    {
+        picker.pbos[i].Create(UGPU_STREAMING, "pick readback");
+        picker.requests[i].fence = 0;
+    }
+    return true;
+}
+
+void UDestroyPicker(UPicker& picker)
+{
+    for (int i = 0; i < UPICK_READBACK_BUFFERS; ++i)
+    {
+        if (picker.requests[i].fence)
+            glDeleteSync(picker.requests[i].fence);
+        picker.requests[i].fence = 0;
+        picker.pbos[i].Reset();
+    }
+    picker.fbo.Reset();
+    UDestroyTargets(picker);
+    UDestroyShaderProgram(picker.programId);
+}
+
+void URequestPick(UPicker& picker, int x, int y)
+{
+    picker.pending = true;
+    picker.pendingX = x;
+    picker.pendingY = y;
+}
+
+bool UUpdatePicker(UPicker& picker, const vector<USceneObject>& scene, const vector<char>* visible,
+    const glm::mat4& viewProjection, GLsizei width, GLsizei height, UPickResult& result)
+{
+    if (picker.pending && width > 0 && height > 0)
+    {
+        if ((width == picker.width && height == picker.height) || UCreateTargets(picker, width, height))
+            URenderPick(picker, scene, visible, viewProjection);
+        else
+            picker.pending = false;
+    }
+
+    // Oldest request first; never wait on a fence
+    bool resolved = false;
+    for (int n = 0; n < UPICK_READBACK_BUFFERS; ++n)
+    {
+        int slot = (picker.nextRequest + n) % UPICK_READBACK_BUFFERS;
+        UPickRequest& request = picker.requests[slot];
+        if (!request.fence)
+            continue;
+        GLenum status = glClientWaitSync(request.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            continue;
+        glDeleteSync(request.fence);
+        request.fence = 0;
+        UResolvePick(picker, slot, scene, result);
+        resolved = true;
+    }
+    return resolved;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <string>       // std::string
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "GpuResources.h"
+
+const int UPICK_READBACK_BUFFERS = 3;
+
+// What a click landed on
+struct UPickResult
+{
+    bool hit;
+    int objectIndex;            // index into the scene list, -1 on a miss
+    std::string name;
+    glm::vec3 worldPosition;    // point on the surface under the pick pixel
+};
+
+// A pick waiting for its readback
+struct UPickRequest
+{
+    GLsync fence;
+    int x, y;                   // pick pixel, framebuffer coordinates with y up
+    int regionX, regionY;       // lower left corner and size of the rendered region
+    GLsizei regionWidth;
+    GLsizei regionHeight;
+    GLsizei width;              // framebuffer size it was rendered at
+    GLsizei height;
+    glm::mat4 viewProjection;
+    size_t nObjects;            // scene size when it was rendered
+};
+
+// Click picking through an object ID buffer.
+// Object index + 1 is rendered into an R32UI attachment, scissored to a small square around the
+// pick pixel; IDs and depth are copied into a PBO and only read once its fence has signaled, so a
+// pick never stalls the pipeline and the answer arrives a frame or two after the click.
+struct UPicker
+{
+    GLuint programId;
+    UGpuFramebuffer fbo;
+    UGpuTexture idTexture;      // GL_R32UI, 0 = background
+    UGpuTexture depthTexture;
+    GLsizei width;
+    GLsizei height;
+    int regionRadius;           // pixels around the pick pixel to render, < 0 renders the whole frame
+
+    UGpuBuffer pbos[UPICK_READBACK_BUFFERS];
+    UPickRequest requests[UPICK_READBACK_BUFFERS];
+    int nextRequest;
+
+    bool pending;               // a click not rendered yet
+    int pendingX, pendingY;
+};
+
+bool UCreatePicker(UPicker& picker, int regionRadius);
+void UDestroyPicker(UPicker& picker);
+
+// Queues a pick at framebuffer pixel (x, y), y measured from the bottom; a newer click replaces an unrendered one
+void URequestPick(UPicker& picker, int x, int y);
+
+// Once per frame after the scene is drawn: renders a queued pick and collects finished ones.
+// Returns true when result holds a new answer. visible may be null to consider every object.
+bool UUpdatePicker(UPicker& picker, const std::vector<USceneObject>& scene, const std::vector<char>* visible,
+    const glm::mat4& viewProjection, GLsizei width, GLsizei height, UPickResult& result);
@@ -0,0 +1,125 @@
+#include <fstream>      // ofstream
+#include <iostream>     // cout, cerr
+#include "PngWriter.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    void UPutBigEndian(vector<unsigned char>& out, uint32_t value)
+    {
+        out.push_back((unsigned char)(value >> 24));
+        out.push_back((unsigned char)(value >> 16));
+        out.push_back((unsigned char)(value >> 8));
+        out.push_back((unsigned char)value);
+    }
+
+    void UPutChunk(vector<unsigned char>& png, const char* type, const unsigned char* data, size_t size)
+    {
+        UPutBigEndian(png, (uint32_t)size);
+        size_t typeStart = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data, data + size);
+        UPutBigEndian(png, UCrc32(&png[typeStart], size + 4));
+    }
+}
+
+uint32_t UCrc32(const unsigned char* data, size_t size, uint32_t crc)
+{
+    // Built once, thread safe as a function local static
+    static const struct UCrcTable
+    {
+        uint32_t entries[256];
+        UCrcTable()
+        {
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+        }
+    } table;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void UEncodePng(const unsigned char* pixels, int width, int height, int channels, bool bottomUp, vector<unsigned char>& png)
+{
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    static const unsigned char colorTypes[5] = { 0, 0, 4, 2, 6 };
+    png.assign(signature, signature + 8);
+
+    vector<unsigned char> header;
+    UPutBigEndian(header, (uint32_t)width);
+    UPutBigEndian(header, (uint32_t)height);
+    header.push_back(8);                // bits per channel
+    header.push_back(colorTypes[channels]);
+    header.push_back(0);                // deflate
+    header.push_back(0);                // adaptive filtering
+    header.push_back(0);                // not interlaced
+    UPutChunk(png, "IHDR", header.data(), header.size());
+
+    // Every row gets filter type 0; the zlib stream is made of stored blocks of at most 65535 bytes
+    size_t rowBytes = (size_t)width * channels;
+    size_t rawBytes = (rowBytes + 1) * height;
+    vector<unsigned char> zlib;
+    zlib.reserve(rawBytes + rawBytes / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+
+    uint32_t adlerA = 1, adlerB = 0;
+    size_t blockLeft = 0;
+    size_t remaining = rawBytes;
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char* row = pixels + (size_t)(bottomUp ? height - 1 - y : y) * rowBytes;
+        for (size_t i = 0; i <= rowBytes; ++i)
+        {
+            if (blockLeft == 0)
+            {
+                blockLeft = remaining < 65535 ? remaining : 65535;
+                zlib.push_back(remaining == blockLeft ? 1 : 0);
+                zlib.push_back((unsigned char)blockLeft);
+                zlib.push_back((unsigned char)(blockLeft >> 8));
+                zlib.push_back((unsigned char)~blockLeft);
+                zlib.push_back((unsigned char)(~blockLeft >> 8));
+            }
+            unsigned char value = i == 0 ? 0 : row[i - 1];
+            zlib.push_back(value);
+            adlerA = (adlerA + value) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+            --blockLeft;
+            --remaining;
+        }
+    }
+    UPutBigEndian(zlib, (adlerB << 16) | adlerA);
+
+    UPutChunk(png, "IDAT", zlib.data(), zlib.size());
+    UPutChunk(png, "IEND", nullptr, 0);
+}
+
+bool UWritePng(const char* filename, const unsigned char* pixels, int width, int height, int channels, bool bottomUp)
+{
+    if (channels < 1 || channels > 4 || width <= 0 || height <= 0)
+        return false;
+
+    vector<unsigned char> png;
+    UEncodePng(pixels, width, height, channels, bottomUp, png);
+
+    ofstream out(filename, ios::binary);
+    if (!out)
+    {
+        cout << "Failed to open " << filename << " for writing" << endl;
+        return false;
+    }
+    out.write((const char*)png.data(), png.size());
+    bool written = (bool)out;
+    if (!written)
+        cout << "Failed to write " << filename << endl;
+    return written;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>      // size_t
+#include <cstdint>      // uint32_t
+#include <vector>       // std::vector
+
+// Encodes 8 bit gray/RGB/RGBA pixels as a PNG (zlib stored blocks, no compression library needed).
+// bottomUp takes rows in GL order, first row at the bottom of the image.
+void UEncodePng(const unsigned char* pixels, int width, int height, int channels, bool bottomUp, std::vector<unsigned char>& png);
+bool UWritePng(const char* filename, const unsigned char* pixels, int width, int height, int channels, bool bottomUp);
+
+uint32_t UCrc32(const unsigned char* data, size_t size, uint32_t crc = 0);
@@ -0,0 +1,226 @@
+#pragma once
+#include <cstddef>      // size_t
+#include <cstdint>      // uint16_t
+
+#include "VertexFormat.h"
+
+/* Indexed primitive meshes generated at compile time. Every builder is constexpr and its vertex and
+ * index counts follow from the template arguments, so
+ *     static constexpr auto CUBE = UMakeBox(1.0f, 1.0f, 1.0f, UUV_UNIT);
+ * lands in read only data with nothing left to compute when the program runs. Faces wind counter
+ * clockwise seen from outside and every vertex has a normal, UV and tangent.
+ */
+
+// How UVs are laid out over a primitive
+enum UUvLayout
+{
+    UUV_UNIT,   // every face (the cylinder side: once around) spans 0..1
+    UUV_WORLD   // one UV unit per world unit, so a tiled texture keeps its size on any extent
+};
+
+struct UStaticVertex
+{
+    float position[3];
+    float normal[3];
+    float uv[2];
+    float tangent[4];   // w = handedness, like UComputeTangents
+
+    constexpr UStaticVertex() : position{}, normal{}, uv{}, tangent{} {}
+};
+
+template <size_t NVertices, size_t NIndices>
+struct UStaticMesh
+{
+    UStaticVertex vertices[NVertices];
+    uint16_t indices[NIndices];
+
+    constexpr UStaticMesh() : vertices{}, indices{} {}
+};
+
+namespace UPrimitiveDetail
+{
+    constexpr double PI = 3.14159265358979323846;
+
+    struct UVec3
+    {
+        float x, y, z;
+    };
+
+    constexpr UVec3 operator+(UVec3 a, UVec3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    constexpr UVec3 operator*(UVec3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+    constexpr float ULength(UVec3 a)
+    {
+        // Only ever called on axis aligned edges
+        return a.x != 0.0f ? (a.x < 0.0f ? -a.x : a.x) : a.y != 0.0f ? (a.y < 0.0f ? -a.y : a.y) : (a.z < 0.0f ? -a.z : a.z);
+    }
+
+    // <cmath> isn't constexpr; the Taylor series is exact to float precision over [-pi, pi]
+    constexpr double USin(double x)
+    {
+        while (x > PI)
+            x -= 2.0 * PI;
+        while (x < -PI)
+            x += 2.0 * PI;
+        double term = x;
+        double sum = x;
+        for (int n = 1; n < 12; ++n)
+        {
+            term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double UCos(double x) { return USin(x + PI / 2.0); }
+
+    constexpr void USet(float* out, UVec3 v) { out[0] = v.x; out[1] = v.y; out[2] = v.z; }
+
+    constexpr UStaticVertex UVertex(UVec3 position, UVec3 normal, float u, float v, UVec3 tangent, float handedness)
+    {
+        UStaticVertex vertex;
+        USet(vertex.position, position);
+        USet(vertex.normal, normal);
+        vertex.uv[0] = u;
+        vertex.uv[1] = v;
+        USet(vertex.tangent, tangent);
+        vertex.tangent[3] = handedness;
+        return vertex;
+    }
+
+    // Quad from corner along edges u and v, facing u x v
+    template <size_t NVertices, size_t NIndices>
+    constexpr void UAddQuad(UStaticMesh<NVertices, NIndices>& mesh, size_t& nVertices, size_t& nIndices,
+        UVec3 corner, UVec3 u, UVec3 v, UVec3 normal, UUvLayout layout)
+    {
+        float uLength = ULength(u);
+        float vLength = ULength(v);
+        float uMax = layout == UUV_WORLD ? uLength : 1.0f;
+        float vMax = layout == UUV_WORLD ? vLength : 1.0f;
+        UVec3 tangent = u * (1.0f / uLength);
+
+        uint16_t first = (uint16_t)nVertices;
+        mesh.vertices[nVertices++] = UVertex(corner, normal, 0.0f, 0.0f, tangent, 1.0f);
+        mesh.vertices[nVertices++] = UVertex(corner + u, normal, uMax, 0.0f, tangent, 1.0f);
+        mesh.vertices[nVertices++] = UVertex(corner + u + v, normal, uMax, vMax, tangent, 1.0f);
+        mesh.vertices[nVertices++] = UVertex(corner + v, normal, 0.0f, vMax, tangent, 1.0f);
+
+        const uint16_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+        for (uint16_t index : quad)
+            mesh.indices[nIndices++] = (uint16_t)(first + index);
+    }
+}
+
+constexpr size_t UCylinderVertexCount(size_t segments, bool caps) { return (segments + 1) * 2 + (caps ? (segments + 1) * 2 : 0); }
+constexpr size_t UCylinderIndexCount(size_t segments, bool caps) { return segments * 6 + (caps ? segments * 6 : 0); }
+
+
+// Horizontal quad centered on the y axis at height y, facing up
+constexpr UStaticMesh<4, 6> UMakePlane(float sizeX, float sizeZ, float y, UUvLayout layout)
+{
+    using namespace UPrimitiveDetail;
+    UStaticMesh<4, 6> mesh;
+    size_t nVertices = 0, nIndices = 0;
+    UAddQuad(mesh, nVertices, nIndices, { -sizeX / 2.0f, y, sizeZ / 2.0f }, { sizeX, 0.0f, 0.0f }, { 0.0f, 0.0f, -sizeZ }, { 0.0f, 1.0f, 0.0f }, layout);
+    return mesh;
+}
+
+// Box centered on the origin; each face has its own four vertices so normals and UVs stay sharp
+constexpr UStaticMesh<24, 36> UMakeBox(float sizeX, float sizeY, float sizeZ, UUvLayout layout)
+{
+    using namespace UPrimitiveDetail;
+    UStaticMesh<24, 36> mesh;
+    size_t nVertices = 0, nIndices = 0;
+    float x = sizeX / 2.0f, y = sizeY / 2.0f, z = sizeZ / 2.0f;
+    UAddQuad(mesh, nVertices, nIndices, { x, -y, z }, { 0.0f, 0.0f, -sizeZ }, { 0.0f, sizeY, 0.0f }, { 1.0f, 0.0f, 0.0f }, layout);
+    UAddQuad(mesh, nVertices, nIndices, { -x, -y, -z }, { 0.0f, 0.0f, sizeZ }, { 0.0f, sizeY, 0.0f }, { -1.0f, 0.0f, 0.0f }, layout);
+    UAddQuad(mesh, nVertices, nIndices, { -x, y, z }, { sizeX, 0.0f, 0.0f }, { 0.0f, 0.0f, -sizeZ }, { 0.0f, 1.0f, 0.0f }, layout);
+    UAddQuad(mesh, nVertices, nIndices, { -x, -y, -z }, { sizeX, 0.0f, 0.0f }, { 0.0f, 0.0f, sizeZ }, { 0.0f, -1.0f, 0.0f }, layout);
+    UAddQuad(mesh, nVertices, nIndices, { -x, -y, z }, { sizeX, 0.0f, 0.0f }, { 0.0f, sizeY, 0.0f }, { 0.0f, 0.0f, 1.0f }, layout);
+    UAddQuad(mesh, nVertices, nIndices, { x, -y, -z }, { -sizeX, 0.0f, 0.0f }, { 0.0f, sizeY, 0.0f }, { 0.0f, 0.0f, -1.0f }, layout);
+    return mesh;
+}
+
+// Cylinder around the y axis from 0 to height. The side has a seam column so its UVs wrap cleanly;
+// caps are planar mapped from above.
+template <size_t Segments, bool Caps>
+constexpr UStaticMesh<UCylinderVertexCount(Segments, Caps), UCylinderIndexCount(Segments, Caps)> UMakeCylinder(float radius, float height, UUvLayout layout)
+{
+    static_assert(Segments >= 3, "a cylinder needs at least 3 segments");
+    static_assert(UCylinderVertexCount(Segments, Caps) <= 65536, "indices are 16 bit");
+    using namespace UPrimitiveDetail;
+    UStaticMesh<UCylinderVertexCount(Segments, Caps), UCylinderIndexCount(Segments, Caps)> mesh;
+    size_t nVertices = 0, nIndices = 0;
+
+    float uMax = layout == UUV_WORLD ? (float)(2.0 * PI * radius) : 1.0f;
+    float vMax = layout == UUV_WORLD ? height : 1.0f;
+    for (size_t i = 0; i <= Segments; ++i)
+    {
+        double angle = 2.0 * PI * i / Segments;
+        float s = (float)USin(angle), c = (float)UCos(angle);
+        UVec3 normal = { s, 0.0f, c };
+        UVec3 tangent = { c, 0.0f, -s };
+        float u = uMax * i / Segments;
+        mesh.vertices[nVertices++] = UVertex(normal * radius, normal, u, 0.0f, tangent, 1.0f);
+        mesh.vertices[nVertices++] = UVertex(normal * radius + UVec3{ 0.0f, height, 0.0f }, normal, u, vMax, tangent, 1.0f);
+    }
+    for (size_t i = 0; i < Segments; ++i)
+    {
+        uint16_t bottom = (uint16_t)(i * 2), top = (uint16_t)(i * 2 + 1);
+        const uint16_t quad[6] = { bottom, (uint16_t)(bottom + 2), (uint16_t)(top + 2), bottom, (uint16_t)(top + 2), top };
+        for (uint16_t index : quad)
+            mesh.indices[nIndices++] = index;
+    }
+
+    if (Caps)
+    {
+        // Center then ring for each cap; the top's v runs toward -z so neither cap is mirrored
+        float uvScale = layout == UUV_WORLD ? radius : 0.5f;
+        float uvCenter = layout == UUV_WORLD ? 0.0f : 0.5f;
+        for (int cap = 0; cap < 2; ++cap)
+        {
+            float y = cap == 0 ? 0.0f : height;
+            float facing = cap == 0 ? -1.0f : 1.0f;
+            UVec3 normal = { 0.0f, facing, 0.0f };
+            UVec3 tangent = { 1.0f, 0.0f, 0.0f };
+            uint16_t center = (uint16_t)nVertices;
+            mesh.vertices[nVertices++] = UVertex({ 0.0f, y, 0.0f }, normal, uvCenter, uvCenter, tangent, 1.0f);
+            for (size_t i = 0; i < Segments; ++i)
+            {
+                double angle = 2.0 * PI * i / Segments;
+                float s = (float)USin(angle), c = (float)UCos(angle);
+                mesh.vertices[nVertices++] = UVertex({ s * radius, y, c * radius }, normal, uvCenter + uvScale * s, uvCenter - facing * uvScale * c, tangent, 1.0f);
+            }
+            for (size_t i = 0; i < Segments; ++i)
+            {
+                uint16_t current = (uint16_t)(center + 1 + i);
+                uint16_t next = (uint16_t)(center + 1 + (i + 1) % Segments);
+                mesh.indices[nIndices++] = center;
+                mesh.indices[nIndices++] = cap == 0 ? next : current;
+                mesh.indices[nIndices++] = cap == 0 ? current : next;
+            }
+        }
+    }
+    return mesh;
+}
+
+
+// Copies a generated mesh into the runtime representation; normals and tangents only when asked for
+template <size_t NVertices, size_t NIndices>
+UMeshData UMeshDataFromStatic(const UStaticMesh<NVertices, NIndices>& mesh, bool withNormals)
+{
+    UMeshData data;
+    data.positions.reserve(NVertices);
+    data.uvs.reserve(NVertices);
+    for (const UStaticVertex& vertex : mesh.vertices)
+    {
+        data.positions.push_back(glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]));
+        data.uvs.push_back(glm::vec2(vertex.uv[0], vertex.uv[1]));
+        if (withNormals)
+        {
+            data.normals.push_back(glm::vec3(vertex.normal[0], vertex.normal[1], vertex.normal[2]));
+            data.tangents.push_back(glm::vec4(vertex.tangent[0], vertex.tangent[1], vertex.tangent[2], vertex.tangent[3]));
+        }
+    }
+    data.indices.assign(mesh.indices, mesh.indices + NIndices);
+    return data;
+}
@@ -0,0 +1,206 @@
+#include <iostream>     // cout
+#include <fstream>      // ofstream
+#include <mutex>        // std::mutex
+#include <vector>       // std::vector
+#include "Profiler.h"
+
+using namespace std; // Standard namespace
+
+atomic<bool> gProfilerEnabled(false);
+
+namespace
+{
+    struct UProfileEvent
+    {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+        char detail[UPROFILE_DETAIL_LENGTH + 1];
+    };
+
+    const size_t EVENTS_PER_CHUNK = 16384;
+    const size_t MAX_CHUNKS = 1024;    // ~16M events per thread before new ones are dropped
+
+    // One recording thread. Only that thread writes; a chunk is published before the count that
+    // covers it, so the writer of the trace never sees a half written event.
+    struct UProfileThread
+    {
+        int id;
+        char name[32];
+        atomic<UProfileEvent*> chunks[MAX_CHUNKS];
+        atomic<size_t> nEvents;
+        size_t nDropped;
+    };
+
+    // Buffers outlive their threads, so workers that finished early are still in the trace
+    struct UProfileRegistry
+    {
+        mutex lock;
+        vector<UProfileThread*> threads;
+
+        ~UProfileRegistry()
+        {
+            for (UProfileThread* thread : threads)
+            {
+                for (atomic<UProfileEvent*>& chunk : thread->chunks)
+                    delete[] chunk.load();
+                delete thread;
+            }
+        }
+    };
+
+    UProfileRegistry gRegistry;
+    thread_local UProfileThread* tThread = nullptr;
+
+    // Tick to time calibration, taken when recording starts
+    uint64_t gStartTicks = 0;
+    chrono::steady_clock::time_point gStartTime;
+
+    UProfileThread& UCurrentThread()
+    {
+        if (!tThread)
+        {
+            UProfileThread* thread = new UProfileThread();
+            for (atomic<UProfileEvent*>& chunk : thread->chunks)
+                chunk.store(nullptr, memory_order_relaxed);
+            thread->nEvents.store(0, memory_order_relaxed);
+            thread->nDropped = 0;
+            thread->name[0] = '\0';
+            lock_guard<mutex> guard(gRegistry.lock);
+            thread->id = (int)gRegistry.threads.size() + 1;
+            gRegistry.threads.push_back(thread);
+            tThread = thread;
+        }
+        return *tThread;
+    }
+
+    void UWriteJsonString(ostream& out, const char* text)
+    {
+        out << '"';
+        for (const char* c = text; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+                out << '\\' << *c;
+            else if ((unsigned char)*c < 0x20)
+                out << ' ';
+            else
+                out << *c;
+        }
+        out << '"';
+    }
+}
+
+
+void URecordProfileZone(const char* name, const char* detail, uint64_t start, uint64_t end)
+{
+    UProfileThread& thread = UCurrentThread();
+    size_t index = thread.nEvents.load(memory_order_relaxed);
+    size_t chunkIndex = index / EVENTS_PER_CHUNK;
+    if (chunkIndex >= MAX_CHUNKS)
+    {
+        ++thread.nDropped;
+        return;
+    }
+    UProfileEvent* chunk = thread.chunks[chunkIndex].load(memory_order_relaxed);
+    if (!chunk)
+    {
+        chunk = new UProfileEvent[EVENTS_PER_CHUNK];
+        thread.chunks[chunkIndex].store(chunk, memory_order_release);
+    }
+
+    UProfileEvent& event = chunk[index % EVENTS_PER_CHUNK];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    event.detail[0] = '\0';
+    if (detail)
+    {
+        size_t i = 0;
+        for (; i < (size_t)UPROFILE_DETAIL_LENGTH && detail[i]; ++i)
+            event.detail[i] = detail[i];
+        event.detail[i] = '\0';
+    }
+    thread.nEvents.store(index + 1, memory_order_release);
+}
+
+void UStartProfiler()
+{
+    gStartTime = chrono::steady_clock::now();
+    gStartTicks = UProfileTicks();
+    gProfilerEnabled = true;
+}
+
+void UStopProfiler()
+{
+    gProfilerEnabled = false;
+}
+
+void UNameProfileThread(const char* name)
+{
+    // Threads only get a buffer when there is something to record
+    if (!gProfilerEnabled)
+        return;
+    UProfileThread& thread = UCurrentThread();
+    size_t i = 0;
+    for (; i + 1 < sizeof(thread.name) && name[i]; ++i)
+        thread.name[i] = name[i];
+    thread.name[i] = '\0';
+}
+
+bool UWriteProfile(const char* filename)
+{
+    // Ticks per microsecond over the whole recording; the time stamp counter runs at a fixed rate
+    uint64_t endTicks = UProfileTicks();
+    double elapsedUs = chrono::duration<double, micro>(chrono::steady_clock::now() - gStartTime).count();
+    double ticksPerUs = elapsedUs > 0.0 ? (double)(endTicks - gStartTicks) / elapsedUs : 1.0;
+
+    ofstream out(filename);
+    if (!out)
+    {
+        cout << "Failed to create " << filename << endl;
+        return false;
+    }
+
+    lock_guard<mutex> guard(gRegistry.lock);
+    size_t nEvents = 0, nDropped = 0;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Project1\"}}";
+    out.setf(ios::fixed);
+    out.precision(3);
+    for (const UProfileThread* thread : gRegistry.threads)
+    {
+        if (thread->name[0])
+        {
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id << ",\"args\":{\"name\":";
+            UWriteJsonString(out, thread->name);
+            out << "}}";
+        }
+
+        size_t count = thread->nEvents.load(memory_order_acquire);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const UProfileEvent& event = thread->chunks[i / EVENTS_PER_CHUNK].load(memory_order_acquire)[i % EVENTS_PER_CHUNK];
+            out << ",\n{\"name\":";
+            UWriteJsonString(out, event.name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->id
+                << ",\"ts\":" << (double)(int64_t)(event.start - gStartTicks) / ticksPerUs
+                << ",\"dur\":" << (double)(event.end - event.start) / ticksPerUs;
+            if (event.detail[0])
+            {
+                out << ",\"args\":{\"detail\":";
+                UWriteJsonString(out, event.detail);
+                out << "}";
+            }
+            out << "}";
+        }
+        nEvents += count;
+        nDropped += thread->nDropped;
+    }
+    out << "\n]}\n";
+
+    cout << "INFO: Wrote " << nEvents << " profile zones from " << gRegistry.threads.size() << " threads to " << filename;
+    if (nDropped > 0)
+        cout << " (" << nDropped << " dropped, buffers full)";
+    cout << endl;
+    return (bool)out;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>       // std::atomic
+#include <cstdint>      // uint64_t
+#include <chrono>       // steady_clock
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>     // __rdtsc
+#define UPROFILE_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>  // __rdtsc
+#define UPROFILE_RDTSC 1
+#endif
+
+/* CPU timeline profiler. A zone is a scope:
+ *     UPROFILE_ZONE("Shadow update");
+ *     UPROFILE_ZONE_DETAIL("Decode image", filename);
+ * While the profiler is off a zone costs one relaxed load and a branch. While it is on, entering and
+ * leaving read the time stamp counter and the exit appends one event to a buffer only the zone's
+ * thread writes to, so threads never contend. UWriteProfile turns everything recorded into Chrome
+ * trace_event JSON (chrome://tracing, Perfetto, Speedscope...).
+ */
+
+extern std::atomic<bool> gProfilerEnabled;
+
+inline uint64_t UProfileTicks()
+{
+#ifdef UPROFILE_RDTSC
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Zone names must outlive the profile (string literals); details are copied, up to this many chars
+const int UPROFILE_DETAIL_LENGTH = 39;
+
+void URecordProfileZone(const char* name, const char* detail, uint64_t start, uint64_t end);
+
+class UProfileZone
+{
+public:
+    explicit UProfileZone(const char* name, const char* detail = nullptr)
+        : name(gProfilerEnabled.load(std::memory_order_relaxed) ? name : nullptr), detail(detail), start(0)
+    {
+        if (this->name)
+            start = UProfileTicks();
+    }
+
+    ~UProfileZone()
+    {
+        if (name)
+            URecordProfileZone(name, detail, start, UProfileTicks());
+    }
+
+    UProfileZone(const UProfileZone&) = delete;
+    UProfileZone& operator=(const UProfileZone&) = delete;
+
+private:
+    const char* name;
+    const char* detail;
+    uint64_t start;
+};
+
+#define UPROFILE_CONCAT_INNER(a, b) a##b
+#define UPROFILE_CONCAT(a, b) UPROFILE_CONCAT_INNER(a, b)
+#define UPROFILE_ZONE(name) UProfileZone UPROFILE_CONCAT(profileZone, __LINE__)(name)
+#define UPROFILE_ZONE_DETAIL(name, detail) UProfileZone UPROFILE_CONCAT(profileZone, __LINE__)(name, detail)
+
+// Starts recording; zones already open stay unrecorded
+void UStartProfiler();
+void UStopProfiler();
+// Shows up as the track name in the trace; call on the thread itself, once recording has started
+void UNameProfileThread(const char* name);
+// Everything recorded so far as Chrome trace JSON; call once the other threads are done recording
+bool UWriteProfile(const char* filename);
@@ -0,0 +1,174 @@
+#include <iostream>     // cout
+#include <fstream>      // ifstream, ofstream
+#include <sstream>      // istringstream
+#include <algorithm>    // stable_sort
+#include "ProgressiveLoader.h"
+#include "Scene.h"
+#include "GpuResources.h"
+#include "Profiler.h"
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // Placeholder for an image the last run never loaded
+    const glm::vec4 DEFAULT_PLACEHOLDER(0.5f, 0.5f, 0.5f, 1.0f);
+
+    glm::vec4 UAverageColor(const UProgressiveTexture& texture)
+    {
+        uint64_t sums[4] = { 0, 0, 0, 0 };
+        size_t nPixels = (size_t)texture.width * texture.height;
+        const unsigned char* pixel = texture.pixels.data();
+        for (size_t i = 0; i < nPixels; ++i, pixel += texture.channels)
+        {
+            for (int c = 0; c < texture.channels; ++c)
+                sums[c] += pixel[c];
+        }
+
+        glm::vec4 color(1.0f);
+        for (int c = 0; c < texture.channels; ++c)
+            color[c] = nPixels > 0 ? (float)((double)sums[c] / nPixels / 255.0) : 0.5f;
+        return color;
+    }
+
+    void UProgressiveWorker(UProgressiveLoader* loader)
+    {
+        UNameProfileThread("Texture loader");
+        while (!loader->quit)
+        {
+            size_t index;
+            {
+                lock_guard<mutex> lock(loader->mutex);
+                if (loader->nextTexture >= loader->textures.size())
+                    return;
+                index = loader->nextTexture++;
+            }
+
+            // Nobody else touches this entry until it is on the finished list
+            UProgressiveTexture& texture = loader->textures[index];
+            {
+                UPROFILE_ZONE_DETAIL("Progressive texture", texture.filename.c_str());
+                texture.failed = !UDecodeTexturePixels(texture.filename.c_str(), texture.maxSize, true, texture.pixels, texture.width, texture.height, texture.channels, texture.scale)
+                    || (texture.channels != 3 && texture.channels != 4);
+            }
+            glm::vec4 color = texture.failed ? DEFAULT_PLACEHOLDER : UAverageColor(texture);
+
+            lock_guard<mutex> lock(loader->mutex);
+            if (!texture.failed)
+                loader->colors[texture.filename] = color;
+            loader->finished.push_back(index);
+        }
+    }
+}
+
+
+void ULoadPlaceholderColors(const char* filename, UProgressiveLoader& loader)
+{
+    // One "r g b a filename" line per image
+    ifstream in(filename);
+    string line;
+    while (getline(in, line))
+    {
+        istringstream fields(line);
+        glm::vec4 color;
+        string name;
+        if (!(fields >> color.x >> color.y >> color.z >> color.w))
+            continue;
+        getline(fields >> ws, name);
+        if (!name.empty())
+            loader.colors[name] = color;
+    }
+}
+
+bool UAddProgressiveTexture(UProgressiveLoader& loader, const char* filename, int maxSize, GLuint& textureId)
+{
+    auto known = loader.colors.find(filename);
+    if (!UCreateSolidTexture(known != loader.colors.end() ? known->second : DEFAULT_PLACEHOLDER, textureId))
+        return false;
+
+    UProgressiveTexture texture = UProgressiveTexture();
+    texture.textureId = textureId;
+    texture.filename = filename;
+    texture.maxSize = maxSize;
+    loader.textures.push_back(texture);
+    return true;
+}
+
+void UStartProgressiveLoader(UProgressiveLoader& loader, int nThreads)
+{
+    // Ties keep the order they were added in
+    stable_sort(loader.textures.begin(), loader.textures.end(),
+        [](const UProgressiveTexture& a, const UProgressiveTexture& b) { return a.priority > b.priority; });
+
+    loader.nextTexture = 0;
+    loader.nSwapped = 0;
+    loader.quit = false;
+    nThreads = nThreads < (int)loader.textures.size() ? nThreads : (int)loader.textures.size();
+    for (int i = 0; i < nThreads; ++i)
+        loader.workers.push_back(thread(UProgressiveWorker, &loader));
+}
+
+int UPumpProgressiveLoader(UProgressiveLoader& loader)
+{
+    size_t index;
+    {
+        lock_guard<mutex> lock(loader.mutex);
+        if (loader.finished.empty())
+            return 0;
+        index = loader.finished.front();
+        loader.finished.pop_front();
+    }
+
+    UProgressiveTexture& texture = loader.textures[index];
+    if (texture.failed)
+        cout << "Failed to load texture " << texture.filename << ", keeping its placeholder" << endl;
+    else
+    {
+        // Workers don't print, so their messages don't interleave with the render thread's
+        if (texture.scale > 1)
+            cout << "INFO: Decoded " << texture.filename << " at 1/" << texture.scale << " (" << texture.width << "x" << texture.height << ")" << endl;
+
+        // Same texture object with new storage; its wrap and filter settings carry over
+        UPROFILE_ZONE_DETAIL("Swap in texture", texture.filename.c_str());
+        glBindTexture(GL_TEXTURE_2D, texture.textureId);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (texture.channels == 3)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, texture.width, texture.height, 0, GL_RGB, GL_UNSIGNED_BYTE, texture.pixels.data());
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texture.width, texture.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture.pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        // RGB8 is stored as 4 bytes a texel by most drivers
+        USetGpuObjectBytes(UGPU_TEXTURE, texture.textureId, UEstimateTextureBytes(texture.width, texture.height, 1, 4, true));
+    }
+    vector<unsigned char>().swap(texture.pixels);
+    ++loader.nSwapped;
+    return 1;
+}
+
+bool UProgressiveLoaderDone(const UProgressiveLoader& loader)
+{
+    return loader.nSwapped >= loader.textures.size();
+}
+
+void UStopProgressiveLoader(UProgressiveLoader& loader, const char* colorsFile)
+{
+    loader.quit = true;
+    for (thread& worker : loader.workers)
+        worker.join();
+    loader.workers.clear();
+    if (loader.textures.empty() || !colorsFile)
+        return;
+
+    ofstream out(colorsFile);
+    if (!out)
+    {
+        cout << "Failed to create " << colorsFile << endl;
+        return;
+    }
+    out.setf(ios::fixed);
+    out.precision(4);
+    for (const auto& entry : loader.colors)
+        out << entry.second.x << ' ' << entry.second.y << ' ' << entry.second.z << ' ' << entry.second.w << ' ' << entry.first << '\n';
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>       // std::atomic
+#include <deque>        // std::deque
+#include <map>          // std::map
+#include <mutex>        // std::mutex
+#include <string>       // std::string
+#include <thread>       // std::thread
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+/* Progressive startup: every texture starts out as a 1x1 placeholder of its average color, remembered
+ * from the last run, so the first frame waits for no decode. Worker threads decode the real images in
+ * priority order and the render thread swaps each one into its placeholder's texture object as it
+ * arrives, so the scene, the scene file cache and anything else holding the id never changes.
+ */
+
+struct UProgressiveTexture
+{
+    GLuint textureId;                   // placeholder until swapped
+    std::string filename;
+    int maxSize;                        // as for UCreateTexture, 0 = full size
+    float priority;                     // higher loads first, set before UStartProgressiveLoader
+
+    // Written by the worker that decoded it, read by the render thread once it is finished
+    std::vector<unsigned char> pixels;  // GL row order
+    int width;
+    int height;
+    int channels;
+    int scale;                          // 1, or the reduction a large JPEG was decoded at
+    bool failed;
+};
+
+struct UProgressiveLoader
+{
+    std::vector<UProgressiveTexture> textures;  // load order once started
+    std::map<std::string, glm::vec4> colors;    // average color by filename, for the next run's placeholders
+
+    // Shared with the workers
+    std::mutex mutex;
+    size_t nextTexture;                 // next one a worker picks up
+    std::deque<size_t> finished;        // decoded (or failed), waiting to be swapped in
+    std::atomic<bool> quit;
+    std::vector<std::thread> workers;
+
+    // Render thread only
+    size_t nSwapped;
+};
+
+// Average colors saved by the last run; a missing file just means grey placeholders
+void ULoadPlaceholderColors(const char* filename, UProgressiveLoader& loader);
+
+// Creates the placeholder texture right away and queues the real image
+bool UAddProgressiveTexture(UProgressiveLoader& loader, const char* filename, int maxSize, GLuint& textureId);
+// Sorts by priority and starts decoding; nothing is swapped in before this
+void UStartProgressiveLoader(UProgressiveLoader& loader, int nThreads);
+
+// Once per frame on the render thread: finishes at most one texture, swapping in its image (a failed
+// one keeps its placeholder); returns how many it finished
+int UPumpProgressiveLoader(UProgressiveLoader& loader);
+bool UProgressiveLoaderDone(const UProgressiveLoader& loader);
+
+// Stops the workers (textures not swapped in yet keep their placeholder) and saves the average colors
+void UStopProgressiveLoader(UProgressiveLoader& loader, const char* colorsFile);
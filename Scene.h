@@ -0,0 +1,46 @@
+#pragma once
+#include <string>       // std::string
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "VertexFormat.h"
+
+/*Shader program Macro*/
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+// One drawable object in the scene: which mesh it uses, how it is textured and where it sits
+struct USceneObject
+{
+    std::string name;
+    const UGpuMesh* mesh;
+    GLuint texture;
+    glm::vec2 uvScale;  // the built in props tile their textures, imported assets use their UVs as is
+    glm::mat4 model;
+
+    bool isStatic;      // static objects never move, so anything derived from them can be cached
+    bool castsShadow;   // false for the countertop (nothing below it) and the lamp (it is the light)
+};
+
+// Helpers implemented in Source.cpp that the other modules share
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+bool UCreateComputeProgram(const char* computeShaderSource, GLuint& programId);
+void UDestroyShaderProgram(GLuint programId);
+// maxSize > 0 decodes larger JPEGs straight at 1/2, 1/4 or 1/8 size until both sides fit
+bool UCreateTexture(const char* filename, GLuint& textureId, bool flipVertically = true, int maxSize = 0);
+bool UCreateTextureFromMemory(const unsigned char* data, size_t size, GLuint& textureId, bool flipVertically = true, int maxSize = 0);
+bool UCreateSolidTexture(const glm::vec4& color, GLuint& textureId);
+// Decodes to pixels in GL row order without touching GL or printing, so any thread can call it;
+// maxSize as above, scale is the reduction it was decoded at (1 = full size)
+bool UDecodeTexturePixels(const char* filename, int maxSize, bool flipVertically, std::vector<unsigned char>& pixels, int& width, int& height, int& channels, int& scale);
+// Same for an image already in memory; label names it in the profile
+bool UDecodeTexturePixelsFromMemory(const unsigned char* data, size_t size, const char* label, int maxSize, bool flipVertically,
+    std::vector<unsigned char>& pixels, int& width, int& height, int& channels, int& scale);
+void UDestroyTexture(GLuint textureId);
+// Asset pack first, then the loose file
+bool ULoadTexture(const char* filename, GLuint& textureId, int maxSize = 0);
+bool ULoadMesh(const char* filename, UGpuMesh& mesh);
@@ -0,0 +1,391 @@
+#include <iostream>     // cout, cerr
+#include <utility>      // move
+#include "SceneFile.h"
+#include "Json.h"
+#include "MappedFile.h"
+
+// GLM Math Header inclusions
+#include <glm/gtx/transform.hpp>
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    const double POLL_INTERVAL = 0.25; // seconds between time stamp checks
+
+    // Fills as many components as the array has; anything else leaves the default
+    void UReadFloats(const UJsonValue* value, float* out, int n)
+    {
+        if (!value)
+            return;
+        if (value->type == UJsonValue::JSON_NUMBER)
+        {
+            for (int i = 0; i < n; ++i)
+                out[i] = (float)value->number;
+            return;
+        }
+        for (int i = 0; i < n && i < (int)value->array.size(); ++i)
+            if (value->array[i].type == UJsonValue::JSON_NUMBER)
+                out[i] = (float)value->array[i].number;
+    }
+
+    glm::vec3 UVec3Or(const UJsonValue& object, const char* key, const glm::vec3& fallback)
+    {
+        glm::vec3 result = fallback;
+        UReadFloats(object.Find(key), &result.x, 3);
+        return result;
+    }
+
+    glm::mat4 UReadModel(const UJsonValue& object)
+    {
+        glm::mat4 model = glm::translate(UVec3Or(object, "translate", glm::vec3(0.0f)));
+        const UJsonValue* rotations = object.Find("rotate");
+        if (rotations && rotations->type == UJsonValue::JSON_ARRAY)
+        {
+            for (const UJsonValue& rotation : rotations->array)
+            {
+                float angle = rotation.Find("radians") ? (float)rotation.NumberOr("radians", 0.0) : glm::radians((float)rotation.NumberOr("degrees", 0.0));
+                model = model * glm::rotate(angle, UVec3Or(rotation, "axis", glm::vec3(0.0f, 1.0f, 0.0f)));
+            }
+        }
+        return model * glm::scale(UVec3Or(object, "scale", glm::vec3(1.0f)));
+    }
+
+    bool USameObject(const USceneObject& a, const USceneObject& b)
+    {
+        return a.mesh == b.mesh && a.texture == b.texture && a.uvScale == b.uvScale && a.model == b.model
+            && a.isStatic == b.isStatic && a.castsShadow == b.castsShadow;
+    }
+
+    bool USameCameras(const vector<USceneCamera>& a, const vector<USceneCamera>& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (a[i].name != b[i].name || a[i].position != b[i].position || a[i].yaw != b[i].yaw || a[i].pitch != b[i].pitch
+                || a[i].zoom != b[i].zoom || a[i].ortho != b[i].ortho)
+                return false;
+        }
+        return true;
+    }
+
+    // Cached texture for path, loading it the first time; 0 when it can't be loaded
+    GLuint UUseTexture(USceneFile& file, const string& path, USceneChanges& changes)
+    {
+        if (path.empty())
+            return 0;
+        auto found = file.textures.find(path);
+        if (found != file.textures.end())
+        {
+            found->second.used = true;
+            return found->second.id;
+        }
+
+        // Failures aren't cached, so the next reload tries again
+        GLuint id;
+        if (!ULoadTexture(path.c_str(), id))
+        {
+            cout << "Failed to load texture " << path << endl;
+            return 0;
+        }
+        file.textures[path] = { id, true, true };
+        ++changes.nTexturesLoaded;
+        return id;
+    }
+
+    const UGpuMesh* UUseMesh(USceneFile& file, const string& name, USceneChanges& changes)
+    {
+        auto builtin = file.builtinMeshes.find(name);
+        if (builtin != file.builtinMeshes.end())
+            return builtin->second;
+        auto path = file.desc.meshFiles.find(name);
+        if (path == file.desc.meshFiles.end())
+        {
+            cout << "Unknown mesh " << name << endl;
+            return nullptr;
+        }
+
+        auto found = file.meshes.find(path->second);
+        if (found != file.meshes.end())
+        {
+            found->second.used = true;
+            return &found->second.mesh;
+        }
+        USceneMesh& loaded = file.meshes[path->second];
+        if (!ULoadMesh(path->second.c_str(), loaded.mesh))
+        {
+            cout << "Failed to load mesh " << path->second << endl;
+            file.meshes.erase(path->second);
+            return nullptr;
+        }
+        loaded.used = true;
+        ++changes.nMeshesLoaded;
+        return &loaded.mesh;
+    }
+}
+
+
+bool UParseSceneFile(const char* filename, USceneDescription& desc, string& error)
+{
+    UMappedFile mapped;
+    if (!UMapFile(filename, mapped))
+    {
+        error = "can't open the file";
+        return false;
+    }
+    UJsonValue document;
+    bool parsed = UParseJson((const char*)mapped.data, mapped.size, document, error);
+    UUnmapFile(mapped);
+    if (!parsed)
+        return false;
+    if (document.type != UJsonValue::JSON_OBJECT)
+    {
+        error = "the document is not an object";
+        return false;
+    }
+
+    USceneDescription result;
+    if (const UJsonValue* materials = document.Find("materials"))
+    {
+        for (const auto& member : materials->object)
+        {
+            USceneMaterial& material = result.materials[member.first];
+            material.texture = member.second.StringOr("texture", "");
+            material.uvScale = glm::vec2(1.0f);
+            UReadFloats(member.second.Find("uvScale"), &material.uvScale.x, 2);
+        }
+    }
+    if (const UJsonValue* meshes = document.Find("meshes"))
+    {
+        for (const auto& member : meshes->object)
+            result.meshFiles[member.first] = member.second.string;
+    }
+
+    const UJsonValue* objects = document.Find("objects");
+    if (objects && objects->type == UJsonValue::JSON_ARRAY)
+    {
+        for (const UJsonValue& object : objects->array)
+        {
+            USceneObjectDesc desc;
+            desc.name = object.StringOr("name", "");
+            desc.mesh = object.StringOr("mesh", "");
+            desc.material = object.StringOr("material", "");
+            desc.model = UReadModel(object);
+            desc.isStatic = object.BoolOr("static", true);
+            desc.castsShadow = object.BoolOr("castsShadow", true);
+            if (desc.name.empty() || desc.mesh.empty())
+            {
+                error = "every object needs a name and a mesh";
+                return false;
+            }
+            for (const USceneObjectDesc& other : result.objects)
+            {
+                if (other.name == desc.name)
+                {
+                    error = "two objects are called " + desc.name;
+                    return false;
+                }
+            }
+            result.objects.push_back(desc);
+        }
+    }
+
+    // The defaults are the built in light
+    const UJsonValue empty;
+    const UJsonValue* light = document.Find("light");
+    if (!light)
+        light = &empty;
+    result.light.position = UVec3Or(*light, "position", glm::vec3(2.0f, 2.0f, -5.0f));
+    result.light.color = UVec3Or(*light, "color", glm::vec3(1.0f));
+    result.light.scale = UVec3Or(*light, "scale", glm::vec3(0.3f));
+    result.light.material = light->StringOr("material", "");
+
+    const UJsonValue* cameras = document.Find("cameras");
+    if (cameras && cameras->type == UJsonValue::JSON_ARRAY)
+    {
+        for (const UJsonValue& camera : cameras->array)
+        {
+            USceneCamera preset;
+            preset.name = camera.StringOr("name", "");
+            preset.position = UVec3Or(camera, "position", glm::vec3(0.0f, 0.0f, 3.0f));
+            preset.yaw = (float)camera.NumberOr("yaw", -90.0);
+            preset.pitch = (float)camera.NumberOr("pitch", 0.0);
+            preset.zoom = (float)camera.NumberOr("zoom", 45.0);
+            preset.ortho = camera.BoolOr("ortho", false);
+            result.cameras.push_back(preset);
+        }
+    }
+
+    desc = move(result);
+    return true;
+}
+
+
+void UAddSceneTexture(USceneFile& file, const string& path, GLuint textureId)
+{
+    file.textures[path] = { textureId, false, false };
+}
+
+void UAddSceneMesh(USceneFile& file, const string& name, const UGpuMesh* mesh)
+{
+    file.builtinMeshes[name] = mesh;
+}
+
+
+bool UOpenSceneFile(USceneFile& file, const char* filename)
+{
+    string error;
+    file.filename = filename;
+    file.writeTime = 0;
+    file.nextPoll = 0.0;
+    file.hasApplied = false;
+    UGetFileWriteTime(filename, file.writeTime);
+    if (!UParseSceneFile(filename, file.desc, error))
+    {
+        cout << "Failed to load scene " << filename << ": " << error << endl;
+        return false;
+    }
+    cout << "INFO: Scene " << filename << " with " << file.desc.objects.size() << " objects, watching it for changes" << endl;
+    return true;
+}
+
+bool UPollSceneFile(USceneFile& file, double now)
+{
+    if (file.filename.empty() || now < file.nextPoll)
+        return false;
+    file.nextPoll = now + POLL_INTERVAL;
+
+    unsigned long long writeTime;
+    if (!UGetFileWriteTime(file.filename.c_str(), writeTime) || writeTime == file.writeTime)
+        return false;
+
+    // An editor may still be writing; a file that can't be opened yet is tried again next poll
+    string error;
+    USceneDescription desc;
+    if (!UParseSceneFile(file.filename.c_str(), desc, error))
+    {
+        if (error != "can't open the file")
+        {
+            cout << "Scene " << file.filename << " not reloaded: " << error << endl;
+            file.writeTime = writeTime;
+        }
+        return false;
+    }
+    file.writeTime = writeTime;
+    file.desc = move(desc);
+    return true;
+}
+
+void UApplySceneFile(USceneFile& file, vector<USceneObject>& scene, USceneChanges& changes)
+{
+    changes = USceneChanges();
+    for (auto& texture : file.textures)
+        texture.second.used = false;
+    for (auto& mesh : file.meshes)
+        mesh.second.used = false;
+
+    // The lamp is where the light is and uses the light's material
+    const USceneDescription& desc = file.desc;
+    vector<USceneObjectDesc> objects = desc.objects;
+    objects.push_back({ "lamp", "lamp", desc.light.material, glm::translate(desc.light.position) * glm::scale(desc.light.scale), true, false });
+
+    vector<USceneObject> built;
+    built.reserve(objects.size());
+    for (const USceneObjectDesc& object : objects)
+    {
+        const UGpuMesh* mesh = UUseMesh(file, object.mesh, changes);
+        if (!mesh)
+            continue;
+        auto material = desc.materials.find(object.material);
+        GLuint texture = 0;
+        glm::vec2 uvScale(1.0f);
+        if (material != desc.materials.end())
+        {
+            texture = UUseTexture(file, material->second.texture, changes);
+            uvScale = material->second.uvScale;
+        }
+        else if (!object.material.empty())
+            cout << "Unknown material " << object.material << " on " << object.name << endl;
+        built.push_back({ object.name, mesh, texture, uvScale, object.model, object.isStatic, object.castsShadow });
+    }
+
+    // Diff by name against the last apply
+    vector<const USceneObject*> staticBefore, staticAfter;
+    for (const USceneObject& object : file.applied)
+    {
+        if (object.isStatic)
+            staticBefore.push_back(&object);
+    }
+    for (const USceneObject& object : built)
+    {
+        const USceneObject* previous = nullptr;
+        for (const USceneObject& other : file.applied)
+        {
+            if (other.name == object.name)
+                previous = &other;
+        }
+        if (!previous)
+            ++changes.nAdded;
+        else if (!USameObject(*previous, object))
+            ++changes.nMoved;
+        if (object.isStatic)
+            staticAfter.push_back(&object);
+    }
+    changes.nRemoved = file.applied.size() + changes.nAdded - built.size();
+    changes.orderChanged = file.applied.size() != built.size();
+    for (size_t i = 0; !changes.orderChanged && i < built.size(); ++i)
+        changes.orderChanged = file.applied[i].name != built[i].name;
+
+    // Baked data follows the static objects in order, so any difference among them makes it stale
+    changes.staticLayoutChanged = staticBefore.size() != staticAfter.size();
+    for (size_t i = 0; !changes.staticLayoutChanged && i < staticAfter.size(); ++i)
+    {
+        changes.staticLayoutChanged = staticBefore[i]->name != staticAfter[i]->name || !USameObject(*staticBefore[i], *staticAfter[i]);
+    }
+    changes.lightChanged = !file.hasApplied || desc.light.position != file.appliedLight.position || desc.light.color != file.appliedLight.color;
+    changes.camerasChanged = !file.hasApplied || !USameCameras(desc.cameras, file.appliedCameras);
+
+    file.applied = built;
+    file.appliedLight = desc.light;
+    file.appliedCameras = desc.cameras;
+    file.hasApplied = true;
+    scene = move(built);
+
+    // Assets only the previous version used
+    for (auto texture = file.textures.begin(); texture != file.textures.end();)
+    {
+        if (texture->second.owned && !texture->second.used)
+        {
+            UDestroyTexture(texture->second.id);
+            texture = file.textures.erase(texture);
+        }
+        else
+            ++texture;
+    }
+    for (auto mesh = file.meshes.begin(); mesh != file.meshes.end();)
+    {
+        if (!mesh->second.used)
+        {
+            UDestroyGpuMesh(mesh->second.mesh);
+            mesh = file.meshes.erase(mesh);
+        }
+        else
+            ++mesh;
+    }
+}
+
+void UCloseSceneFile(USceneFile& file)
+{
+    for (auto& texture : file.textures)
+    {
+        if (texture.second.owned)
+            UDestroyTexture(texture.second.id);
+    }
+    for (auto& mesh : file.meshes)
+        UDestroyGpuMesh(mesh.second.mesh);
+    file.textures.clear();
+    file.meshes.clear();
+    file.applied.clear();
+    file.filename.clear();
+}
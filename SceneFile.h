@@ -0,0 +1,130 @@
+#pragma once
+#include <map>          // std::map
+#include <string>       // std::string
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+
+/* Scene description (JSON), everything but the arrays optional:
+ *   {
+ *     "materials": { "bottle": { "texture": "../images/bottle.jpg", "uvScale": [5, 5] } },
+ *     "meshes": { "teapot": "../meshes/teapot.umesh" },   // plane, cube, cylinder and lamp are built in
+ *     "objects": [ { "name": "bottle", "mesh": "cube", "material": "bottle",
+ *                    "translate": [-2, 0, -1.5], "rotate": [ { "radians": -25, "axis": [0, 1, 0] } ],
+ *                    "scale": [1, 2, 1], "castsShadow": true, "static": true } ],
+ *     "light": { "position": [2, 2, -5], "color": [1, 1, 1], "scale": 0.3, "material": "saltShaker" },
+ *     "cameras": [ { "name": "overview", "position": [0, 0, 3], "yaw": -90, "pitch": 0, "zoom": 45, "ortho": false } ]
+ *   }
+ * Model matrices are translate * rotate[0] * rotate[1] ... * scale; a rotation takes "degrees" or "radians".
+ * The light is drawn as the lamp, which is added to the objects automatically.
+ */
+struct USceneMaterial
+{
+    std::string texture;
+    glm::vec2 uvScale;
+};
+
+struct USceneObjectDesc
+{
+    std::string name;
+    std::string mesh;
+    std::string material;
+    glm::mat4 model;
+    bool isStatic;
+    bool castsShadow;
+};
+
+struct USceneLight
+{
+    glm::vec3 position;
+    glm::vec3 color;
+    glm::vec3 scale;
+    std::string material;
+};
+
+struct USceneCamera
+{
+    std::string name;
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    float zoom;
+    bool ortho;
+};
+
+struct USceneDescription
+{
+    std::map<std::string, USceneMaterial> materials;
+    std::map<std::string, std::string> meshFiles;
+    std::vector<USceneObjectDesc> objects;
+    USceneLight light;
+    std::vector<USceneCamera> cameras;
+};
+
+// Parses a scene file; on failure error says what is wrong and desc is untouched
+bool UParseSceneFile(const char* filename, USceneDescription& desc, std::string& error);
+
+// What the last apply changed, so the caller only invalidates what depends on it
+struct USceneChanges
+{
+    size_t nMoved;          // same object, other transform, mesh or material
+    size_t nAdded;
+    size_t nRemoved;
+    size_t nTexturesLoaded;
+    size_t nMeshesLoaded;
+    bool staticLayoutChanged; // anything baked for the static objects is stale
+    bool orderChanged;      // objects added, removed or reordered, so anything kept per scene index is stale
+    bool lightChanged;
+    bool camerasChanged;
+};
+
+struct USceneTexture
+{
+    GLuint id;
+    bool owned;             // loaded for the scene file, as opposed to registered by the caller
+    bool used;
+};
+
+struct USceneMesh
+{
+    UGpuMesh mesh;
+    bool used;
+};
+
+// A scene file that is watched for changes. Textures and meshes are cached by path, so a reload only
+// loads the assets that are new to it and frees the ones nothing refers to anymore; everything else on
+// the GPU stays as it is.
+struct USceneFile
+{
+    std::string filename;
+    unsigned long long writeTime;
+    double nextPoll;
+    USceneDescription desc;             // the latest contents that parsed
+
+    // What the last apply built, to diff the next one against
+    bool hasApplied;
+    std::vector<USceneObject> applied;
+    USceneLight appliedLight;
+    std::vector<USceneCamera> appliedCameras;
+
+    std::map<std::string, USceneTexture> textures;  // by path
+    std::map<std::string, USceneMesh> meshes;       // by path; std::map keeps the addresses stable
+    std::map<std::string, const UGpuMesh*> builtinMeshes;
+};
+
+// Makes a texture the caller already loaded available under its path; it is never freed here
+void UAddSceneTexture(USceneFile& file, const std::string& path, GLuint textureId);
+void UAddSceneMesh(USceneFile& file, const std::string& name, const UGpuMesh* mesh);
+
+// Reads the file for the first time
+bool UOpenSceneFile(USceneFile& file, const char* filename);
+// True when the file was written since the last read and its new contents parsed. Checks the time
+// stamp at most every few hundred ms; a file that fails to parse keeps the previous scene.
+bool UPollSceneFile(USceneFile& file, double now);
+// Rebuilds scene from the description, loading only the textures and meshes it doesn't have yet
+void UApplySceneFile(USceneFile& file, std::vector<USceneObject>& scene, USceneChanges& changes);
+void UCloseSceneFile(USceneFile& file);
@@ -0,0 +1,367 @@
+#include <iostream>     // cout, cerr
+#include <cmath>        // asin, pow, ceil, floor
+#include "ShadowMap.h"
+
+// GLM Math Header inclusions
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace std; // Standard namespace
+
+/* Depth only shader used to render the casters from the light */
+const GLchar* shadowVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+
+    uniform mat4 model;
+    uniform mat4 lightSpace; // light view * light projection for the layer being rendered
+
+    void main()
+    {
+        gl_Position = lightSpace * model * vec4(position, 1.0f);
+    }
+);
+
+const GLchar* shadowFragmentShaderSource = GLSL(440,
+    void main()
+    {
+        // Only depth is written
+    }
+);
+
+namespace
+{
+    // Picks an up vector that is not parallel to the light direction
+    glm::vec3 ULightUp(const glm::vec3& direction)
+    {
+        return fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    // Perspective map from the light position covering the whole shadow area
+    glm::mat4 USpotLightSpace(const UShadowMap& shadow, const glm::vec3& lightPosition)
+    {
+        glm::vec3 center = (shadow.boundsMin + shadow.boundsMax) * 0.5f;
+        float radius = glm::length(shadow.boundsMax - shadow.boundsMin) * 0.5f;
+        float distance = glm::length(center - lightPosition);
+
+        float fov = glm::radians(120.0f);
+        float nearPlane = 0.05f;
+        if (distance > radius)
+        {
+            fov = 2.0f * asin(radius / distance);
+            nearPlane = glm::max(distance - radius, 0.05f);
+        }
+        float farPlane = distance + radius;
+
+        glm::vec3 direction = glm::normalize(center - lightPosition);
+        return glm::perspective(fov, 1.0f, nearPlane, farPlane) * glm::lookAt(lightPosition, center, ULightUp(direction));
+    }
+
+    // View space depth -> NDC depth for the camera projection (works for perspective and ortho)
+    float UNdcDepth(const glm::mat4& projection, float distance)
+    {
+        float z = -distance;
+        float clipZ = projection[2][2] * z + projection[3][2];
+        float clipW = projection[2][3] * z + projection[3][3];
+        return clipZ / clipW;
+    }
+
+    // Directional light cascades fitted to slices of the camera frustum.
+    // Each cascade is a bounding sphere snapped to the shadow texel grid, so the matrix only
+    // changes when the camera moved by more than a texel and the static layer stays cached.
+    void UCascadeLightSpaces(UShadowMap& shadow, const glm::vec3& lightPosition,
+        const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+    {
+        glm::vec3 center = (shadow.boundsMin + shadow.boundsMax) * 0.5f;
+        float boundsDiameter = glm::length(shadow.boundsMax - shadow.boundsMin);
+        glm::vec3 direction = glm::normalize(center - lightPosition);
+        glm::vec3 up = ULightUp(direction);
+
+        // Don't spend cascades past the far edge of the countertop
+        float maxDistance = 0.0f;
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec3 p((corner & 1) ? shadow.boundsMax.x : shadow.boundsMin.x,
+                        (corner & 2) ? shadow.boundsMax.y : shadow.boundsMin.y,
+                        (corner & 4) ? shadow.boundsMax.z : shadow.boundsMin.z);
+            maxDistance = glm::max(maxDistance, -(view * glm::vec4(p, 1.0f)).z);
+        }
+        nearPlane = glm::max(nearPlane, 0.1f);
+        farPlane = glm::min(farPlane, maxDistance);
+        if (farPlane <= nearPlane)
+            farPlane = nearPlane + 1.0f;
+
+        glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+        glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+        glm::mat4 inverseLightRotation = glm::inverse(lightRotation);
+
+        float sliceNear = nearPlane;
+        for (int i = 0; i < shadow.nCascades; ++i)
+        {
+            // Practical split scheme: blend of uniform and logarithmic splits
+            float t = float(i + 1) / shadow.nCascades;
+            float uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+            float logSplit = nearPlane * pow(farPlane / nearPlane, t);
+            float sliceFar = glm::mix(uniformSplit, logSplit, 0.75f);
+            shadow.cascadeSplits[i] = sliceFar;
+
+            // Bounding sphere of the frustum slice
+            glm::vec3 corners[8];
+            glm::vec3 sliceCenter(0.0f);
+            float ndcNear = UNdcDepth(projection, sliceNear);
+            float ndcFar = UNdcDepth(projection, sliceFar);
+            for (int corner = 0; corner < 8; ++corner)
+            {
+                glm::vec4 p = inverseViewProjection * glm::vec4((corner & 1) ? 1.0f : -1.0f,
+                                                                (corner & 2) ? 1.0f : -1.0f,
+                                                                (corner & 4) ? ndcFar : ndcNear, 1.0f);
+                corners[corner] = glm::vec3(p) / p.w;
+                sliceCenter += corners[corner] / 8.0f;
+            }
+            float radius = 0.0f;
+            for (int corner = 0; corner < 8; ++corner)
+                radius = glm::max(radius, glm::length(corners[corner] - sliceCenter));
+            radius = ceil(radius * 16.0f) / 16.0f;
+
+            // Snap the center to whole texels in light space
+            float texelSize = 2.0f * radius / shadow.size;
+            glm::vec4 lightCenter = lightRotation * glm::vec4(sliceCenter, 1.0f);
+            lightCenter.x = floor(lightCenter.x / texelSize) * texelSize;
+            lightCenter.y = floor(lightCenter.y / texelSize) * texelSize;
+            lightCenter.z = floor(lightCenter.z / texelSize) * texelSize;
+            sliceCenter = glm::vec3(inverseLightRotation * lightCenter);
+
+            // Pull the eye back far enough to catch every caster over the countertop
+            float pullBack = boundsDiameter + radius;
+            glm::vec3 eye = sliceCenter - direction * pullBack;
+            shadow.lightSpace[i] = glm::ortho(-radius, radius, -radius, radius, 0.0f, pullBack + radius) * glm::lookAt(eye, sliceCenter, up);
+
+            sliceNear = sliceFar;
+        }
+    }
+
+    // Draws either the static or the dynamic casters with the depth shader
+    void URenderCasters(const UShadowMap& shadow, const vector<USceneObject>& scene, const glm::mat4& lightSpace, bool staticCasters)
+    {
+        glUniformMatrix4fv(glGetUniformLocation(shadow.programId, "lightSpace"), 1, GL_FALSE, glm::value_ptr(lightSpace));
+        GLint modelLoc = glGetUniformLocation(shadow.programId, "model");
+
+        for (const USceneObject& object : scene)
+        {
+            if (!object.castsShadow || object.isStatic != staticCasters)
+                continue;
+
+            glm::mat4 model = object.model * object.mesh->dequantize;
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+            UDrawGpuMesh(*object.mesh);
+        }
+    }
+
+    void UCreateDepthArray(GLsizei size, int layers, bool comparison, UGpuTexture& texture)
+    {
+        texture.Create(UGPU_SHADOWS, comparison ? "shadow depth" : "static shadow depth");
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, size, size, layers);
+        texture.SetBytes(UEstimateTextureBytes(size, size, layers, 4, false));
+
+        // Outside the map counts as lit
+        const GLfloat border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+
+        if (comparison)
+        {
+            // Hardware PCF
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        else
+        {
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+}
+
+bool UCreateShadowMap(UShadowMap& shadow, GLsizei size, int nCascades, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    shadow.size = size;
+    shadow.nCascades = glm::clamp(nCascades, 1, MAX_SHADOW_CASCADES);
+    shadow.boundsMin = boundsMin;
+    shadow.boundsMax = boundsMax;
+    shadow.hadDynamicCasters = false;
+    shadow.nStaticLayersRendered = 0;
+    shadow.nDynamicLayersRendered = 0;
+    shadow.cachedStaticModels.clear();
+    for (int i = 0; i < MAX_SHADOW_CASCADES; ++i)
+    {
+        shadow.staticValid[i] = false;
+        shadow.lightSpace[i] = glm::mat4(1.0f);
+        shadow.cachedLightSpace[i] = glm::mat4(1.0f);
+        shadow.cascadeSplits[i] = 0.0f;
+    }
+
+    if (!UCreateShaderProgram(shadowVertexShaderSource, shadowFragmentShaderSource, shadow.programId))
+        return false;
+
+    UCreateDepthArray(size, shadow.nCascades, false, shadow.staticDepth);
+    UCreateDepthArray(size, shadow.nCascades, true, shadow.depth);
+
+    shadow.fbo.Create(UGPU_SHADOWS, "shadow framebuffer");
+    glBindFramebuffer(GL_FRAMEBUFFER, shadow.fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow.staticDepth, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cout << "Shadow map framebuffer is incomplete: 0x" << hex << status << dec << endl;
+        UDestroyShadowMap(shadow);
+        return false;
+    }
+
+    return true;
+}
+
+void UDestroyShadowMap(UShadowMap& shadow)
+{
+    shadow.fbo.Reset();
+    shadow.staticDepth.Reset();
+    shadow.depth.Reset();
+    UDestroyShaderProgram(shadow.programId);
+    shadow.programId = 0;
+}
+
+// Brings the shadow map up to date. Static layers are only re-rendered when a static caster,
+// the light or the cascade fit changed; the sampled layers are only touched when something did.
+void UUpdateShadowMap(UShadowMap& shadow, const vector<USceneObject>& scene, const glm::vec3& lightPosition,
+    const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane)
+{
+    shadow.nStaticLayersRendered = 0;
+    shadow.nDynamicLayersRendered = 0;
+
+    // Did any static caster move (or get added/removed) since the cache was built?
+    bool staticMoved = false;
+    bool hasDynamicCasters = false;
+    size_t nStatic = 0;
+    for (const USceneObject& object : scene)
+    {
+        if (!object.castsShadow)
+            continue;
+        if (!object.isStatic)
+        {
+            hasDynamicCasters = true;
+            continue;
+        }
+
+        if (nStatic >= shadow.cachedStaticModels.size())
+        {
+            shadow.cachedStaticModels.push_back(object.model);
+            staticMoved = true;
+        }
+        else if (shadow.cachedStaticModels[nStatic] != object.model)
+        {
+            shadow.cachedStaticModels[nStatic] = object.model;
+            staticMoved = true;
+        }
+        ++nStatic;
+    }
+    if (nStatic != shadow.cachedStaticModels.size())
+    {
+        shadow.cachedStaticModels.resize(nStatic);
+        staticMoved = true;
+    }
+
+    if (staticMoved)
+        for (int i = 0; i < shadow.nCascades; ++i)
+            shadow.staticValid[i] = false;
+
+    // Light matrices; unchanged light and camera give bit identical matrices
+    if (shadow.nCascades == 1)
+    {
+        shadow.lightSpace[0] = USpotLightSpace(shadow, lightPosition);
+        shadow.cascadeSplits[0] = farPlane;
+    }
+    else
+        UCascadeLightSpaces(shadow, lightPosition, view, projection, nearPlane, farPlane);
+
+    bool stateSaved = false;
+    GLint viewport[4];
+    GLint previousFbo = 0;
+
+    for (int i = 0; i < shadow.nCascades; ++i)
+    {
+        bool rebuildStatic = !shadow.staticValid[i] || shadow.lightSpace[i] != shadow.cachedLightSpace[i];
+        bool rebuildSampled = rebuildStatic || hasDynamicCasters || shadow.hadDynamicCasters;
+        if (!rebuildSampled)
+            continue;
+
+        // Only pay for the state changes when there is real work
+        if (!stateSaved)
+        {
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, shadow.fbo);
+            glViewport(0, 0, shadow.size, shadow.size);
+            glUseProgram(shadow.programId);
+            glEnable(GL_DEPTH_TEST);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(2.0f, 4.0f);
+            stateSaved = true;
+        }
+
+        if (rebuildStatic)
+        {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow.staticDepth, 0, i);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            URenderCasters(shadow, scene, shadow.lightSpace[i], true);
+
+            shadow.staticValid[i] = true;
+            shadow.cachedLightSpace[i] = shadow.lightSpace[i];
+            ++shadow.nStaticLayersRendered;
+        }
+
+        // Sampled layer = cached static depth + this frame's dynamic casters
+        glCopyImageSubData(shadow.staticDepth, GL_TEXTURE_2D_ARRAY, 0, 0, 0, i,
+                           shadow.depth, GL_TEXTURE_2D_ARRAY, 0, 0, 0, i,
+                           shadow.size, shadow.size, 1);
+
+        if (hasDynamicCasters)
+        {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow.depth, 0, i);
+            URenderCasters(shadow, scene, shadow.lightSpace[i], false);
+            ++shadow.nDynamicLayersRendered;
+        }
+    }
+
+    shadow.hadDynamicCasters = hasDynamicCasters;
+
+    if (stateSaved)
+    {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+}
+
+// Binds the sampled shadow layers and the matching uniforms on the (already active) scene program
+void UBindShadowMap(const UShadowMap& shadow, GLuint programId, GLuint textureUnit)
+{
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadow.depth);
+
+    glUniform1i(glGetUniformLocation(programId, "uShadowMap"), textureUnit);
+    glUniform1i(glGetUniformLocation(programId, "uCascadeCount"), shadow.nCascades);
+    glUniformMatrix4fv(glGetUniformLocation(programId, "uLightSpace"), shadow.nCascades, GL_FALSE, glm::value_ptr(shadow.lightSpace[0]));
+    glUniform1fv(glGetUniformLocation(programId, "uCascadeSplits"), shadow.nCascades, shadow.cascadeSplits);
+
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "GpuResources.h"
+
+const int MAX_SHADOW_CASCADES = 4;
+
+/* Shadow map for the scene light.
+ * Static casters are rendered into their own depth layers once and cached; the layers the
+ * scene shader samples are only rebuilt (static copy + dynamic casters) when something moved.
+ * With one cascade the light is a perspective spot aimed at the countertop, with more the
+ * light is treated as directional and the cascades split the camera frustum over the countertop.
+ */
+struct UShadowMap
+{
+    GLsizei size;           // resolution of every layer
+    int nCascades;
+
+    UGpuTexture staticDepth; // texture array holding only the static casters
+    UGpuTexture depth;      // texture array sampled by the scene shader (static + dynamic casters)
+    UGpuFramebuffer fbo;
+    GLuint programId;       // depth only shader
+
+    // Area the shadows have to cover (the countertop)
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    glm::mat4 lightSpace[MAX_SHADOW_CASCADES];
+    float cascadeSplits[MAX_SHADOW_CASCADES]; // far distance (view space) of each cascade
+
+    // Cache state
+    bool staticValid[MAX_SHADOW_CASCADES];
+    glm::mat4 cachedLightSpace[MAX_SHADOW_CASCADES];
+    std::vector<glm::mat4> cachedStaticModels;
+    bool hadDynamicCasters;
+
+    // Stats: how many layers were actually re-rendered in the last update
+    int nStaticLayersRendered;
+    int nDynamicLayersRendered;
+};
+
+bool UCreateShadowMap(UShadowMap& shadow, GLsizei size, int nCascades, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+void UDestroyShadowMap(UShadowMap& shadow);
+void UUpdateShadowMap(UShadowMap& shadow, const std::vector<USceneObject>& scene, const glm::vec3& lightPosition,
+    const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+void UBindShadowMap(const UShadowMap& shadow, GLuint programId, GLuint textureUnit);
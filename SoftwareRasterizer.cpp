@@ -0,0 +1,647 @@
+#include <algorithm>    // upper_bound
+#include <chrono>       // timing
+#include <cmath>        // floor, ceil, pow
+#include <iostream>     // cout, cerr
+#include <memory>       // unique_ptr
+#include "SoftwareRasterizer.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>  // SSE2
+#define USOFT_SSE 1
+#endif
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    enum USoftPhase { PHASE_VERTICES, PHASE_SETUP, PHASE_TILES };
+
+    // Same constants as lightFragmentShaderSource
+    const float AMBIENT_STRENGTH = 0.1f;
+    const float SPECULAR_INTENSITY = 0.8f;
+    // highlightSize is 16, UShade computes the power by squaring
+
+    const float SUBPIXEL_STEPS = 16.0f;     // vertices snap to 1/16 pixel like GPU rasterizers
+
+    double UMillisecondsSince(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    // Work range of one worker out of total items
+    void UWorkerRange(size_t total, unsigned worker, unsigned nWorkers, size_t& begin, size_t& end)
+    {
+        begin = total * worker / nWorkers;
+        end = total * (worker + 1) / nWorkers;
+    }
+
+    // Object that owns item index, given the per object offsets (last entry is the total)
+    size_t UOwner(const vector<size_t>& offsets, size_t index)
+    {
+        return (size_t)(upper_bound(offsets.begin(), offsets.end(), index) - offsets.begin()) - 1;
+    }
+
+    USoftVertex ULerp(const USoftVertex& a, const USoftVertex& b, float t)
+    {
+        USoftVertex v;
+        v.clip = a.clip + (b.clip - a.clip) * t;
+        v.world = a.world + (b.world - a.world) * t;
+        v.normal = a.normal + (b.normal - a.normal) * t;
+        v.uv = a.uv + (b.uv - a.uv) * t;
+        return v;
+    }
+
+    void UTransformVertices(USoftRasterizer& rasterizer, unsigned worker)
+    {
+        size_t begin, end;
+        UWorkerRange(rasterizer.vertices.size(), worker, rasterizer.nWorkers, begin, end);
+        if (begin >= end)
+            return;
+
+        size_t objectIndex = UOwner(rasterizer.vertexOffsets, begin);
+        for (size_t i = begin; i < end; ++i)
+        {
+            while (i >= rasterizer.vertexOffsets[objectIndex + 1])
+                ++objectIndex;
+            const USoftObject& object = rasterizer.scene->objects[objectIndex];
+            const UMeshData& mesh = *object.mesh;
+            size_t local = i - rasterizer.vertexOffsets[objectIndex];
+
+            glm::vec4 position(mesh.positions[local], 1.0f);
+            USoftVertex& vertex = rasterizer.vertices[i];
+            vertex.clip = rasterizer.objectClip[objectIndex] * position;
+            vertex.world = glm::vec3(object.model * position);
+            vertex.normal = mesh.normals.empty() ? glm::vec3(0.0f) : rasterizer.objectNormal[objectIndex] * mesh.normals[local];
+            vertex.uv = mesh.uvs.empty() ? glm::vec2(0.0f) : mesh.uvs[local] * object.uvScale;
+        }
+    }
+
+    // Screen space setup of one clipped triangle; appends it to the worker's list and bins it
+    void USetupTriangle(USoftRasterizer& rasterizer, unsigned worker, const USoftVertex* v[3], const USoftTexture* texture)
+    {
+        const USoftFrame& frame = *rasterizer.frame;
+        USoftTriangle t;
+        float x[3], y[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            float invW = 1.0f / v[i]->clip.w;
+            x[i] = floor(((v[i]->clip.x * invW) * 0.5f + 0.5f) * frame.width * SUBPIXEL_STEPS + 0.5f) / SUBPIXEL_STEPS;
+            y[i] = floor(((v[i]->clip.y * invW) * 0.5f + 0.5f) * frame.height * SUBPIXEL_STEPS + 0.5f) / SUBPIXEL_STEPS;
+            t.z[i] = (v[i]->clip.z * invW) * 0.5f + 0.5f;
+            t.invW[i] = invW;
+            t.world[i] = v[i]->world;
+            t.normal[i] = v[i]->normal;
+            t.uv[i] = v[i]->uv;
+        }
+
+        // Nothing is culled (the GL pass does not cull faces either); clockwise triangles are flipped
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0.0f)
+            return;
+        if (area < 0.0f)
+        {
+            swap(x[1], x[2]);
+            swap(y[1], y[2]);
+            swap(t.z[1], t.z[2]);
+            swap(t.invW[1], t.invW[2]);
+            swap(t.world[1], t.world[2]);
+            swap(t.normal[1], t.normal[2]);
+            swap(t.uv[1], t.uv[2]);
+            area = -area;
+        }
+        t.invArea = 1.0f / area;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            int j = (i + 1) % 3, k = (i + 2) % 3;
+            t.edgeA[i] = y[j] - y[k];
+            t.edgeB[i] = x[k] - x[j];
+            t.edgeX[i] = x[j];
+            t.edgeY[i] = y[j];
+            // Left edges and horizontal edges with the triangle above them own their pixels
+            t.inclusive[i] = t.edgeA[i] > 0.0f || (t.edgeA[i] == 0.0f && t.edgeB[i] < 0.0f);
+        }
+
+        // Meshes without normals are lit with the face normal, turned towards the camera
+        if (t.normal[0] == glm::vec3(0.0f) && t.normal[1] == glm::vec3(0.0f) && t.normal[2] == glm::vec3(0.0f))
+        {
+            glm::vec3 faceNormal = glm::cross(t.world[1] - t.world[0], t.world[2] - t.world[0]);
+            if (glm::dot(faceNormal, rasterizer.scene->viewPosition - t.world[0]) < 0.0f)
+                faceNormal = -faceNormal;
+            t.normal[0] = t.normal[1] = t.normal[2] = faceNormal;
+        }
+
+        // Pixel centers inside the bounding box
+        float minX = x[0] < x[1] ? (x[0] < x[2] ? x[0] : x[2]) : (x[1] < x[2] ? x[1] : x[2]);
+        float maxX = x[0] > x[1] ? (x[0] > x[2] ? x[0] : x[2]) : (x[1] > x[2] ? x[1] : x[2]);
+        float minY = y[0] < y[1] ? (y[0] < y[2] ? y[0] : y[2]) : (y[1] < y[2] ? y[1] : y[2]);
+        float maxY = y[0] > y[1] ? (y[0] > y[2] ? y[0] : y[2]) : (y[1] > y[2] ? y[1] : y[2]);
+        t.minX = (int)ceil(minX - 0.5f);
+        t.minY = (int)ceil(minY - 0.5f);
+        t.maxX = (int)floor(maxX - 0.5f);
+        t.maxY = (int)floor(maxY - 0.5f);
+        t.minX = t.minX > 0 ? t.minX : 0;
+        t.minY = t.minY > 0 ? t.minY : 0;
+        t.maxX = t.maxX < frame.width - 1 ? t.maxX : frame.width - 1;
+        t.maxY = t.maxY < frame.height - 1 ? t.maxY : frame.height - 1;
+        if (t.minX > t.maxX || t.minY > t.maxY)
+            return;
+        t.texture = texture;
+
+        vector<USoftTriangle>& triangles = rasterizer.triangles[worker];
+        uint32_t index = (uint32_t)triangles.size();
+        triangles.push_back(t);
+
+        size_t nTiles = (size_t)rasterizer.nTilesX * rasterizer.nTilesY;
+        for (int tileY = t.minY / USOFT_TILE_SIZE; tileY <= t.maxY / USOFT_TILE_SIZE; ++tileY)
+        {
+            for (int tileX = t.minX / USOFT_TILE_SIZE; tileX <= t.maxX / USOFT_TILE_SIZE; ++tileX)
+                rasterizer.bins[worker * nTiles + (size_t)tileY * rasterizer.nTilesX + tileX].push_back(index);
+        }
+    }
+
+    // Clips against the near plane (z >= -w), rejects triangles fully outside a side plane, then sets up
+    void USetupTriangles(USoftRasterizer& rasterizer, unsigned worker)
+    {
+        size_t nTiles = (size_t)rasterizer.nTilesX * rasterizer.nTilesY;
+        rasterizer.triangles[worker].clear();
+        for (size_t tile = 0; tile < nTiles; ++tile)
+            rasterizer.bins[worker * nTiles + tile].clear();
+
+        size_t begin, end;
+        UWorkerRange(rasterizer.triangleOffsets.back(), worker, rasterizer.nWorkers, begin, end);
+        if (begin >= end)
+            return;
+
+        size_t objectIndex = UOwner(rasterizer.triangleOffsets, begin);
+        for (size_t i = begin; i < end; ++i)
+        {
+            while (i >= rasterizer.triangleOffsets[objectIndex + 1])
+                ++objectIndex;
+            const USoftObject& object = rasterizer.scene->objects[objectIndex];
+            const UMeshData& mesh = *object.mesh;
+            size_t local = i - rasterizer.triangleOffsets[objectIndex];
+            const USoftVertex* base = &rasterizer.vertices[rasterizer.vertexOffsets[objectIndex]];
+
+            const USoftVertex* corners[3];
+            for (int c = 0; c < 3; ++c)
+                corners[c] = &base[mesh.indices.empty() ? local * 3 + c : mesh.indices[local * 3 + c]];
+
+            // Trivial reject against the side and far planes
+            bool outside = false;
+            for (int axis = 0; axis < 3 && !outside; ++axis)
+            {
+                bool allAbove = true, allBelow = true;
+                for (int c = 0; c < 3; ++c)
+                {
+                    allAbove = allAbove && corners[c]->clip[axis] > corners[c]->clip.w;
+                    allBelow = allBelow && axis < 2 && corners[c]->clip[axis] < -corners[c]->clip.w;
+                }
+                outside = allAbove || allBelow;
+            }
+            if (outside)
+                continue;
+
+            float distance[3];
+            int nInside = 0;
+            for (int c = 0; c < 3; ++c)
+            {
+                distance[c] = corners[c]->clip.z + corners[c]->clip.w;
+                nInside += distance[c] >= 0.0f;
+            }
+            if (nInside == 0)
+                continue;
+            if (nInside == 3)
+            {
+                USetupTriangle(rasterizer, worker, corners, object.texture);
+                continue;
+            }
+
+            // Sutherland-Hodgman against one plane: at most a quad, drawn as a fan
+            USoftVertex clipped[4];
+            int nClipped = 0;
+            for (int c = 0; c < 3; ++c)
+            {
+                int next = (c + 1) % 3;
+                if (distance[c] >= 0.0f)
+                    clipped[nClipped++] = *corners[c];
+                if ((distance[c] >= 0.0f) != (distance[next] >= 0.0f))
+                    clipped[nClipped++] = ULerp(*corners[c], *corners[next], distance[c] / (distance[c] - distance[next]));
+            }
+            for (int c = 1; c + 1 < nClipped; ++c)
+            {
+                const USoftVertex* fan[3] = { &clipped[0], &clipped[c], &clipped[c + 1] };
+                USetupTriangle(rasterizer, worker, fan, object.texture);
+            }
+        }
+    }
+
+    unsigned char UToByte(float value)
+    {
+        value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        return (unsigned char)(value * 255.0f + 0.5f);
+    }
+
+    // lightFragmentShaderSource on the CPU; w are the perspective correct barycentrics
+    void UShade(const USoftScene& scene, const USoftTriangle& t, float w0, float w1, float w2, unsigned char* pixel)
+    {
+        glm::vec3 world = t.world[0] * w0 + t.world[1] * w1 + t.world[2] * w2;
+        glm::vec3 normal = t.normal[0] * w0 + t.normal[1] * w1 + t.normal[2] * w2;
+        glm::vec2 uv = t.uv[0] * w0 + t.uv[1] * w1 + t.uv[2] * w2;
+
+        glm::vec3 ambient = AMBIENT_STRENGTH * scene.lightColor;
+
+        glm::vec3 norm = glm::normalize(normal);
+        glm::vec3 lightDirection = glm::normalize(scene.lightPosition - world);
+        float impact = glm::dot(norm, lightDirection);
+        impact = impact > 0.0f ? impact : 0.0f;
+        glm::vec3 diffuse = impact * scene.lightColor;
+
+        glm::vec3 viewDir = glm::normalize(scene.viewPosition - world);
+        glm::vec3 reflectDir = glm::reflect(-lightDirection, norm);
+        float specularDot = glm::dot(viewDir, reflectDir);
+        specularDot = specularDot > 0.0f ? specularDot : 0.0f;
+        // pow(x, 16) as four squarings
+        float specularComponent = specularDot * specularDot;
+        specularComponent *= specularComponent;
+        specularComponent *= specularComponent;
+        specularComponent *= specularComponent;
+        glm::vec3 specular = SPECULAR_INTENSITY * specularComponent * scene.lightColor;
+
+        glm::vec4 textureColor = t.texture ? USampleSoftTexture(*t.texture, uv) : glm::vec4(1.0f);
+        glm::vec3 phong = (ambient + diffuse + specular) * glm::vec3(textureColor);
+
+        pixel[0] = UToByte(phong.x);
+        pixel[1] = UToByte(phong.y);
+        pixel[2] = UToByte(phong.z);
+        pixel[3] = 255;
+    }
+
+    // Per tile visibility buffer: depth plus the nearest triangle and its perspective correct weights.
+    // Shading runs once per pixel after every triangle of the tile is in, so overdraw costs no shading.
+    struct UTileBuffer
+    {
+        float depth[USOFT_TILE_SIZE * USOFT_TILE_SIZE];
+        float weight1[USOFT_TILE_SIZE * USOFT_TILE_SIZE];
+        float weight2[USOFT_TILE_SIZE * USOFT_TILE_SIZE];
+        const USoftTriangle* triangle[USOFT_TILE_SIZE * USOFT_TILE_SIZE];
+    };
+
+    // Rasterizes one triangle into a tile's visibility buffer; (tileX, tileY) is the tile's first pixel
+    void URasterizeTriangle(const USoftTriangle& t, int tileX, int tileY, int tileWidth, int tileHeight, UTileBuffer& tile)
+    {
+        int x0 = t.minX > tileX ? t.minX : tileX;
+        int y0 = t.minY > tileY ? t.minY : tileY;
+        int x1 = t.maxX < tileX + tileWidth - 1 ? t.maxX : tileX + tileWidth - 1;
+        int y1 = t.maxY < tileY + tileHeight - 1 ? t.maxY : tileY + tileHeight - 1;
+        if (x0 > x1 || y0 > y1)
+            return;
+
+        // Groups of four pixels start on a multiple of 4 inside the tile
+        int groupX0 = tileX + ((x0 - tileX) & ~3);
+
+        for (int y = y0; y <= y1; ++y)
+        {
+            int row = (y - tileY) * USOFT_TILE_SIZE;
+
+            // Edge values at the first pixel center of the row, in double so big triangles stay accurate
+            float rowEdge[3];
+            for (int i = 0; i < 3; ++i)
+                rowEdge[i] = (float)((double)t.edgeA[i] * (groupX0 + 0.5 - t.edgeX[i]) + (double)t.edgeB[i] * (y + 0.5 - t.edgeY[i]));
+
+#ifdef USOFT_SSE
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 laneOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+            __m128 edge[3], edgeStep[3], inclusive[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                edge[i] = _mm_add_ps(_mm_set1_ps(rowEdge[i]), _mm_mul_ps(_mm_set1_ps(t.edgeA[i]), laneOffsets));
+                edgeStep[i] = _mm_set1_ps(t.edgeA[i] * 4.0f);
+                inclusive[i] = _mm_castsi128_ps(_mm_set1_epi32(t.inclusive[i] ? -1 : 0));
+            }
+            const __m128 invArea = _mm_set1_ps(t.invArea);
+
+            for (int x = groupX0; x <= x1; x += 4)
+            {
+                __m128 covered = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3)), _mm_set1_epi32(x1 + 1)));
+                covered = _mm_and_ps(covered, _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3)), _mm_set1_epi32(x0 - 1))));
+                for (int i = 0; i < 3; ++i)
+                {
+                    __m128 inside = _mm_or_ps(_mm_cmpgt_ps(edge[i], zero), _mm_and_ps(_mm_cmpeq_ps(edge[i], zero), inclusive[i]));
+                    covered = _mm_and_ps(covered, inside);
+                }
+
+                if (_mm_movemask_ps(covered))
+                {
+                    __m128 b0 = _mm_mul_ps(edge[0], invArea);
+                    __m128 b1 = _mm_mul_ps(edge[1], invArea);
+                    __m128 b2 = _mm_mul_ps(edge[2], invArea);
+
+                    // Depth test (GL_LESS) inside [0, 1]
+                    int pixel = row + (x - tileX);
+                    float* depthRow = tile.depth + pixel;
+                    __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, _mm_set1_ps(t.z[0])), _mm_mul_ps(b1, _mm_set1_ps(t.z[1]))), _mm_mul_ps(b2, _mm_set1_ps(t.z[2])));
+                    __m128 oldDepth = _mm_loadu_ps(depthRow);
+                    covered = _mm_and_ps(covered, _mm_cmplt_ps(z, oldDepth));
+                    covered = _mm_and_ps(covered, _mm_cmpge_ps(z, zero));
+                    int mask = _mm_movemask_ps(covered);
+                    if (mask)
+                    {
+                        _mm_storeu_ps(depthRow, _mm_or_ps(_mm_and_ps(covered, z), _mm_andnot_ps(covered, oldDepth)));
+
+                        // Perspective correct weights
+                        __m128 w0 = _mm_mul_ps(b0, _mm_set1_ps(t.invW[0]));
+                        __m128 w1 = _mm_mul_ps(b1, _mm_set1_ps(t.invW[1]));
+                        __m128 w2 = _mm_mul_ps(b2, _mm_set1_ps(t.invW[2]));
+                        __m128 inverseSum = _mm_div_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_add_ps(w0, w1), w2));
+                        w1 = _mm_mul_ps(w1, inverseSum);
+                        w2 = _mm_mul_ps(w2, inverseSum);
+                        _mm_storeu_ps(tile.weight1 + pixel, _mm_or_ps(_mm_and_ps(covered, w1), _mm_andnot_ps(covered, _mm_loadu_ps(tile.weight1 + pixel))));
+                        _mm_storeu_ps(tile.weight2 + pixel, _mm_or_ps(_mm_and_ps(covered, w2), _mm_andnot_ps(covered, _mm_loadu_ps(tile.weight2 + pixel))));
+                        for (int lane = 0; lane < 4; ++lane)
+                        {
+                            if (mask & (1 << lane))
+                                tile.triangle[pixel + lane] = &t;
+                        }
+                    }
+                }
+
+                for (int i = 0; i < 3; ++i)
+                    edge[i] = _mm_add_ps(edge[i], edgeStep[i]);
+            }
+#else
+            for (int x = groupX0; x <= x1; ++x)
+            {
+                float offset = (float)(x - groupX0);
+                float edge[3];
+                bool inside = x >= x0;
+                for (int i = 0; i < 3; ++i)
+                {
+                    edge[i] = rowEdge[i] + t.edgeA[i] * offset;
+                    inside = inside && (edge[i] > 0.0f || (edge[i] == 0.0f && t.inclusive[i]));
+                }
+                if (!inside)
+                    continue;
+
+                float b0 = edge[0] * t.invArea, b1 = edge[1] * t.invArea, b2 = edge[2] * t.invArea;
+                float z = b0 * t.z[0] + b1 * t.z[1] + b2 * t.z[2];
+                int pixel = row + x - tileX;
+                if (!(z < tile.depth[pixel]) || z < 0.0f)
+                    continue;
+                tile.depth[pixel] = z;
+
+                float w0 = b0 * t.invW[0], w1 = b1 * t.invW[1], w2 = b2 * t.invW[2];
+                float inverseSum = 1.0f / (w0 + w1 + w2);
+                tile.weight1[pixel] = w1 * inverseSum;
+                tile.weight2[pixel] = w2 * inverseSum;
+                tile.triangle[pixel] = &t;
+            }
+#endif
+        }
+    }
+
+    // Tiles are handed out one at a time, so busy tiles do not hold up a whole worker's share
+    void URasterizeTiles(USoftRasterizer& rasterizer, unsigned worker)
+    {
+        (void)worker;
+        USoftFrame& frame = *rasterizer.frame;
+        size_t nTiles = (size_t)rasterizer.nTilesX * rasterizer.nTilesY;
+        unique_ptr<UTileBuffer> buffer(new UTileBuffer);
+        UTileBuffer& tileBuffer = *buffer;
+
+        for (;;)
+        {
+            size_t tile = rasterizer.nextTile.fetch_add(1);
+            if (tile >= nTiles)
+                break;
+            int tileX = (int)(tile % rasterizer.nTilesX) * USOFT_TILE_SIZE;
+            int tileY = (int)(tile / rasterizer.nTilesX) * USOFT_TILE_SIZE;
+            int tileWidth = frame.width - tileX < USOFT_TILE_SIZE ? frame.width - tileX : USOFT_TILE_SIZE;
+            int tileHeight = frame.height - tileY < USOFT_TILE_SIZE ? frame.height - tileY : USOFT_TILE_SIZE;
+
+            fill(tileBuffer.depth, tileBuffer.depth + USOFT_TILE_SIZE * USOFT_TILE_SIZE, 1.0f);
+            fill(tileBuffer.triangle, tileBuffer.triangle + USOFT_TILE_SIZE * USOFT_TILE_SIZE, nullptr);
+
+            // Workers binned contiguous ranges, so walking them in order keeps submission order
+            for (unsigned binWorker = 0; binWorker < rasterizer.nWorkers; ++binWorker)
+            {
+                const vector<USoftTriangle>& triangles = rasterizer.triangles[binWorker];
+                for (uint32_t index : rasterizer.bins[binWorker * nTiles + tile])
+                    URasterizeTriangle(triangles[index], tileX, tileY, tileWidth, tileHeight, tileBuffer);
+            }
+
+            // Shade the visible surface straight into the frame; empty pixels are cleared to opaque black
+            for (int y = 0; y < tileHeight; ++y)
+            {
+                size_t frameOffset = (size_t)(tileY + y) * frame.width + tileX;
+                copy(tileBuffer.depth + y * USOFT_TILE_SIZE, tileBuffer.depth + y * USOFT_TILE_SIZE + tileWidth, frame.depth.begin() + frameOffset);
+                for (int x = 0; x < tileWidth; ++x)
+                {
+                    int pixel = y * USOFT_TILE_SIZE + x;
+                    unsigned char* color = &frame.color[(frameOffset + x) * 4];
+                    const USoftTriangle* triangle = tileBuffer.triangle[pixel];
+                    if (triangle)
+                    {
+                        float w1 = tileBuffer.weight1[pixel], w2 = tileBuffer.weight2[pixel];
+                        UShade(*rasterizer.scene, *triangle, 1.0f - w1 - w2, w1, w2, color);
+                    }
+                    else
+                    {
+                        color[0] = color[1] = color[2] = 0;
+                        color[3] = 255;
+                    }
+                }
+            }
+        }
+    }
+
+    void URunPhaseOnWorker(USoftRasterizer& rasterizer, int phase, unsigned worker)
+    {
+        if (phase == PHASE_VERTICES)
+            UTransformVertices(rasterizer, worker);
+        else if (phase == PHASE_SETUP)
+            USetupTriangles(rasterizer, worker);
+        else
+            URasterizeTiles(rasterizer, worker);
+    }
+
+    void UWorkerMain(USoftRasterizer* rasterizer, unsigned worker)
+    {
+        unsigned seen = 0;
+        for (;;)
+        {
+            int phase;
+            {
+                unique_lock<mutex> lock(rasterizer->mutex);
+                rasterizer->wake.wait(lock, [&]() { return rasterizer->quit || rasterizer->generation != seen; });
+                if (rasterizer->quit)
+                    return;
+                seen = rasterizer->generation;
+                phase = rasterizer->phase;
+            }
+
+            URunPhaseOnWorker(*rasterizer, phase, worker);
+
+            lock_guard<mutex> lock(rasterizer->mutex);
+            if (--rasterizer->nBusy == 0)
+                rasterizer->done.notify_one();
+        }
+    }
+
+    // The calling thread works as worker 0 and returns once every worker has finished the phase
+    void URunPhase(USoftRasterizer& rasterizer, int phase)
+    {
+        {
+            lock_guard<mutex> lock(rasterizer.mutex);
+            rasterizer.phase = phase;
+            rasterizer.nBusy = (unsigned)rasterizer.threads.size();
+            ++rasterizer.generation;
+        }
+        rasterizer.wake.notify_all();
+
+        URunPhaseOnWorker(rasterizer, phase, 0);
+
+        unique_lock<mutex> lock(rasterizer.mutex);
+        rasterizer.done.wait(lock, [&]() { return rasterizer.nBusy == 0; });
+    }
+}
+
+bool UCreateSoftRasterizer(USoftRasterizer& rasterizer, unsigned nThreads)
+{
+    if (nThreads == 0)
+        nThreads = thread::hardware_concurrency();
+    rasterizer.nWorkers = nThreads > 0 ? nThreads : 1;
+    rasterizer.generation = 0;
+    rasterizer.phase = PHASE_VERTICES;
+    rasterizer.nBusy = 0;
+    rasterizer.quit = false;
+    rasterizer.scene = nullptr;
+    rasterizer.frame = nullptr;
+    rasterizer.nTilesX = rasterizer.nTilesY = 0;
+    rasterizer.triangles.assign(rasterizer.nWorkers, vector<USoftTriangle>());
+
+    for (unsigned worker = 1; worker < rasterizer.nWorkers; ++worker)
+        rasterizer.threads.push_back(thread(UWorkerMain, &rasterizer, worker));
+    return true;
+}
+
+void UDestroySoftRasterizer(USoftRasterizer& rasterizer)
+{
+    {
+        lock_guard<mutex> lock(rasterizer.mutex);
+        rasterizer.quit = true;
+    }
+    rasterizer.wake.notify_all();
+    for (thread& worker : rasterizer.threads)
+        worker.join();
+    rasterizer.threads.clear();
+    rasterizer.vertices.clear();
+    rasterizer.triangles.clear();
+    rasterizer.bins.clear();
+}
+
+void UResizeSoftFrame(USoftFrame& frame, int width, int height)
+{
+    frame.width = width;
+    frame.height = height;
+    frame.color.assign((size_t)width * height * 4, 0);
+    frame.depth.assign((size_t)width * height, 1.0f);
+    frame.nTriangles = 0;
+    frame.vertexMs = frame.setupMs = frame.rasterMs = 0.0;
+}
+
+void URasterize(USoftRasterizer& rasterizer, const USoftScene& scene, USoftFrame& frame)
+{
+    rasterizer.scene = &scene;
+    rasterizer.frame = &frame;
+
+    // Per object transforms and where each object's vertices/triangles start
+    glm::mat4 viewProjection = scene.projection * scene.view;
+    rasterizer.vertexOffsets.assign(1, 0);
+    rasterizer.triangleOffsets.assign(1, 0);
+    rasterizer.objectClip.clear();
+    rasterizer.objectNormal.clear();
+    for (const USoftObject& object : scene.objects)
+    {
+        const UMeshData& mesh = *object.mesh;
+        size_t nTriangles = (mesh.indices.empty() ? mesh.positions.size() : mesh.indices.size()) / 3;
+        rasterizer.vertexOffsets.push_back(rasterizer.vertexOffsets.back() + mesh.positions.size());
+        rasterizer.triangleOffsets.push_back(rasterizer.triangleOffsets.back() + nTriangles);
+        rasterizer.objectClip.push_back(viewProjection * object.model);
+        rasterizer.objectNormal.push_back(glm::transpose(glm::inverse(glm::mat3(object.model))));
+    }
+    rasterizer.vertices.resize(rasterizer.vertexOffsets.back());
+
+    rasterizer.nTilesX = (frame.width + USOFT_TILE_SIZE - 1) / USOFT_TILE_SIZE;
+    rasterizer.nTilesY = (frame.height + USOFT_TILE_SIZE - 1) / USOFT_TILE_SIZE;
+    rasterizer.bins.resize((size_t)rasterizer.nWorkers * rasterizer.nTilesX * rasterizer.nTilesY);
+
+    auto start = chrono::steady_clock::now();
+    URunPhase(rasterizer, PHASE_VERTICES);
+    frame.vertexMs = UMillisecondsSince(start);
+
+    start = chrono::steady_clock::now();
+    URunPhase(rasterizer, PHASE_SETUP);
+    frame.setupMs = UMillisecondsSince(start);
+    frame.nTriangles = 0;
+    for (const vector<USoftTriangle>& triangles : rasterizer.triangles)
+        frame.nTriangles += triangles.size();
+
+    start = chrono::steady_clock::now();
+    rasterizer.nextTile = 0;
+    URunPhase(rasterizer, PHASE_TILES);
+    frame.rasterMs = UMillisecondsSince(start);
+}
+
+bool UCreateSoftTexture(const unsigned char* image, int width, int height, int channels, bool flipVertically, USoftTexture& texture)
+{
+    if (channels < 1 || channels > 4 || width <= 0 || height <= 0)
+        return false;
+
+    texture.width = width;
+    texture.height = height;
+    texture.pixels.resize((size_t)width * height * 4);
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char* source = image + (size_t)(flipVertically ? height - 1 - y : y) * width * channels;
+        unsigned char* destination = &texture.pixels[(size_t)y * width * 4];
+        for (int x = 0; x < width; ++x, source += channels, destination += 4)
+        {
+            // Gray expands to RGB, missing alpha is opaque
+            destination[0] = source[0];
+            destination[1] = channels >= 3 ? source[1] : source[0];
+            destination[2] = channels >= 3 ? source[2] : source[0];
+            destination[3] = channels == 4 ? source[3] : (channels == 2 ? source[1] : 255);
+        }
+    }
+    return true;
+}
+
+glm::vec4 USampleSoftTexture(const USoftTexture& texture, const glm::vec2& uv)
+{
+    // Repeat wrapping
+    float u = (uv.x - floor(uv.x)) * texture.width - 0.5f;
+    float v = (uv.y - floor(uv.y)) * texture.height - 0.5f;
+    float fu = floor(u), fv = floor(v);
+    float tu = u - fu, tv = v - fv;
+
+    int x0 = (int)fu, y0 = (int)fv;
+    x0 = x0 < 0 ? texture.width - 1 : (x0 < texture.width ? x0 : texture.width - 1);
+    y0 = y0 < 0 ? texture.height - 1 : (y0 < texture.height ? y0 : texture.height - 1);
+    int x1 = x0 + 1 < texture.width ? x0 + 1 : 0;
+    int y1 = y0 + 1 < texture.height ? y0 + 1 : 0;
+
+    const unsigned char* p00 = &texture.pixels[((size_t)y0 * texture.width + x0) * 4];
+    const unsigned char* p10 = &texture.pixels[((size_t)y0 * texture.width + x1) * 4];
+    const unsigned char* p01 = &texture.pixels[((size_t)y1 * texture.width + x0) * 4];
+    const unsigned char* p11 = &texture.pixels[((size_t)y1 * texture.width + x1) * 4];
+
+    glm::vec4 color;
+    for (int c = 0; c < 4; ++c)
+    {
+        float top = p00[c] + (p10[c] - p00[c]) * tu;
+        float bottom = p01[c] + (p11[c] - p01[c]) * tu;
+        color[c] = (top + (bottom - top) * tv) / 255.0f;
+    }
+    return color;
+}
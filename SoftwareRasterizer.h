@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>       // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <cstdint>      // uint32_t
+#include <mutex>        // std::mutex
+#include <thread>       // std::thread
+#include <vector>       // std::vector
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "VertexFormat.h"
+
+const int USOFT_TILE_SIZE = 64;
+
+// RGBA8 texture on the CPU, first row at the bottom like the GL textures
+struct USoftTexture
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+// Same placement data a USceneObject carries, pointing at CPU meshes and textures
+struct USoftObject
+{
+    const UMeshData* mesh;
+    const USoftTexture* texture;
+    glm::vec2 uvScale;
+    glm::mat4 model;
+    bool castsShadow;       // as in USceneObject; only the path tracer uses it
+};
+
+struct USoftScene
+{
+    std::vector<USoftObject> objects;
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 viewPosition;
+    glm::vec3 lightPosition;
+    glm::vec3 lightColor;
+};
+
+// Color and depth of a rendered frame, rows bottom up like glReadPixels
+struct USoftFrame
+{
+    int width;
+    int height;
+    std::vector<unsigned char> color;   // RGBA8
+    std::vector<float> depth;           // window depth, 1 = far
+
+    // Stats of the last URasterize
+    size_t nTriangles;                  // after near plane clipping and culling of empty ones
+    double vertexMs;
+    double setupMs;
+    double rasterMs;
+};
+
+// Vertex after the vertex stage: what the GL vertex shader hands to the fragment shader
+struct USoftVertex
+{
+    glm::vec4 clip;
+    glm::vec3 world;
+    glm::vec3 normal;       // zero when the mesh has none; setup uses the face normal then
+    glm::vec2 uv;           // already multiplied by the object's uvScale
+};
+
+// Screen space triangle ready for the tiles. Edge i is opposite vertex i; its edge function is
+// positive inside and equals twice the triangle area at vertex i.
+struct USoftTriangle
+{
+    float edgeA[3];
+    float edgeB[3];
+    float edgeX[3];         // a vertex on each edge, edge functions are evaluated relative to it
+    float edgeY[3];
+    int inclusive[3];       // fill convention: pixels exactly on the edge belong to this triangle
+    float invArea;
+    float z[3];
+    float invW[3];
+    glm::vec3 world[3];
+    glm::vec3 normal[3];
+    glm::vec2 uv[3];
+    int minX, minY, maxX, maxY; // covered pixels, clamped to the frame
+    const USoftTexture* texture;
+};
+
+// Tile based CPU rasterizer. A frame runs in three parallel phases on a persistent pool:
+// vertices, triangle setup + binning into 64x64 tiles (each worker bins its own contiguous range,
+// so submission order is kept per tile) and tiles rasterized and shaded independently.
+struct USoftRasterizer
+{
+    unsigned nWorkers;      // including the calling thread
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned generation;
+    int phase;
+    unsigned nBusy;
+    bool quit;
+    std::atomic<unsigned> nextTile;
+
+    // Current frame
+    const USoftScene* scene;
+    USoftFrame* frame;
+    int nTilesX;
+    int nTilesY;
+    std::vector<size_t> vertexOffsets;      // first vertex / triangle of every object, plus the total
+    std::vector<size_t> triangleOffsets;
+    std::vector<glm::mat4> objectClip;      // projection * view * model
+    std::vector<glm::mat3> objectNormal;
+    std::vector<USoftVertex> vertices;
+    std::vector<std::vector<USoftTriangle>> triangles;  // per worker
+    std::vector<std::vector<uint32_t>> bins;            // per worker and tile
+};
+
+bool UCreateSoftRasterizer(USoftRasterizer& rasterizer, unsigned nThreads = 0); // 0 = every core
+void UDestroySoftRasterizer(USoftRasterizer& rasterizer);
+
+void UResizeSoftFrame(USoftFrame& frame, int width, int height);
+// Clears to black and renders the scene with the Phong model of lightFragmentShaderSource
+void URasterize(USoftRasterizer& rasterizer, const USoftScene& scene, USoftFrame& frame);
+
+// image rows top down (as decoded), flipped to GL order unless flipVertically is false
+bool UCreateSoftTexture(const unsigned char* image, int width, int height, int channels, bool flipVertically, USoftTexture& texture);
+// Bilinear, repeat wrapping, like the GL samplers (without mipmaps)
+glm::vec4 USampleSoftTexture(const USoftTexture& texture, const glm::vec2& uv);
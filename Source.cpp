@@ -1,6 +1,12 @@
 #pragma once
 #include <iostream>     // cout, cerr
 #include <cstdlib>      // EXIT_FAILURE
+#include <cstdio>       // snprintf
+#include <cstring>      // strcmp, strncmp
+#include <vector>       // std::vector
+#include <algorithm>    // remove_if
+#include <chrono>       // steady_clock
+#include <thread>       // this_thread::yield
 #include <GL/glew.h>    // GLEW library
 #include <GLFW/glfw3.h> // GLFW library
 #include <camera.h>     //camera library
@@ -13,86 +19,70 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-using namespace std; // Standard namespace
+#include "Scene.h"
+#include "ShadowMap.h"
+#include "MeshFile.h"
+#include "MeshConverter.h"
+#include "GltfImporter.h"
+#include "AssetPack.h"
+#include "UploadRing.h"
+#include "OcclusionCulling.h"
+#include "Picking.h"
+#include "SoftwareRasterizer.h"
+#include "PngWriter.h"
+#include "PathTracer.h"
+#include "Lightmap.h"
+#include "Overlay.h"
+#include "CircleSim.h"
+#include "GpuResources.h"
+#include "DynamicResolution.h"
+#include "InputJournal.h"
+#include "BatchRenderer.h"
+#include "FrameCapture.h"
+#include "SceneFile.h"
+#include "PrimitiveMeshes.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+#include "Benchmark.h"
+#include "MappedFile.h"
+#include "JpegDecoder.h"
+#include "ProgressiveLoader.h"
 
-/*Shader program Macro*/
-#ifndef GLSL
-#define GLSL(Version, Source) "#version " #Version " core \n" #Source
-#endif
+using namespace std; // Standard namespace
 
 // Unnamed namespace
 namespace
 {
-    const float DEG2RAD = 3.14159 / 180;
-
     const char* const WINDOW_TITLE = "Module Five Milestone"; // Macro for window title
 
     // Variables for window width and height
     const int WINDOW_WIDTH = 800;
     const int WINDOW_HEIGHT = 600;
 
-    // Stores the GL data relative to a given mesh
+    // Stores the GL data relative to a given mesh. Objects built from the same primitive share it.
     struct GLMesh
     {
-        // Handle for plane
-        GLuint planeVao;
-        GLuint planeVbo;
-        GLuint nPlaneVertices;
-
-        // Handle for bottle
-        GLuint bottleVao;
-        GLuint bottleVbos;
-        GLuint nBottleVertices;
-
-        // Handle for bottleneck
-        GLuint bottleNeckVao;
-        GLuint bottleNeckVbo;
-        GLuint nBottleNeckVertices;
-        GLuint nBottleNeckIndices;
-
-        // Spatula handle
-        GLuint spatulaHandleVao;
-        GLuint spatulaHandleVbo;
-        GLuint nSpatulaHandleVertices;
-
-        // Spatula flat top
-        GLuint spatulaTopVao;
-        GLuint spatulaTopVbo;
-        GLuint nSpatulaTopVertices;
-
-        // Pot holder
-        GLuint potHolderVao;
-        GLuint potHolderVbo;
-        GLuint nPotHolderVertices;
-
-        // Salt Shaker
-        GLuint saltShakerVao;
-        GLuint saltShakerVbo;
-        GLuint nSaltShakerVertices;
-
-        // Pepper shaker 
-        GLuint pepperShakerVao;
-        GLuint pepperShakerVbo;
-        GLuint nPepperShakerVertices;
-
-        // Watermelon
-        GLuint watermelonVao;
-        GLuint watermelonVbo;
-        GLuint nWatermelonVertices;
-
-        // Lamp
-        GLuint lampVao;
-        GLuint lampVbo;
-        GLuint nLampVertices;
+        // Countertop plane
+        UGpuMesh plane;
+
+        // Bottle, spatula handle/top and pot holder
+        UGpuMesh cube;
+
+        // Bottle neck, salt and pepper shakers
+        UGpuMesh cylinder;
+
+        // Lamp (the only mesh with normals)
+        UGpuMesh lamp;
     };
 
     // Main GLFW window
     GLFWwindow* gWindow = nullptr;
     // Triangle mesh data
     GLMesh gMesh;
+    // CPU copies of the built in meshes; lightmap UVs are generated from them
+    UMeshData gPlaneData, gCubeData, gCylinderData, gLampData;
     // Shader program
     GLuint gProgramId;
-    GLuint gLampProgramId;
 
     // Texture Ids
     GLuint gPlaneTexture;
@@ -104,6 +94,20 @@ namespace
     GLuint gPepperShakerTexture;
     GLuint gWatermelonTexture;
 
+    // Startup textures. maxSize: the props never cover more than a fraction of the window, so their
+    // photos are decoded at reduced size; the countertop fills the view and keeps more detail. 0 = full size
+    struct UTextureSlot { GLuint* id; const char* filename; int maxSize; };
+    const UTextureSlot TEXTURE_SLOTS[] = {
+        { &gPlaneTexture, "../images/countertop.jpg", 2048 },
+        { &gBottleTexture, "../images/bottle.jpg", 1024 },
+        { &gBottleNeckTexture, "../images/bottleTop.jpg", 1024 },
+        { &gSpatulaTexture, "../images/spatula.jpg", 1024 },
+        { &gSaltShakerTexture, "../images/saltShaker.jpg", 1024 },
+        { &gPepperShakerTexture, "../images/pepperShaker.jpg", 1024 },
+        { &gPotHolderTexture, "../images/potHolder.jpg", 1024 },
+        { &gWatermelonTexture, "../images/watermelon.jpg", 1024 },
+    };
+
     glm::vec2 gUVScale(5.0f, 5.0f);
     GLint gTexWrapMode = GL_REPEAT;
 
@@ -133,6 +137,119 @@ namespace
     glm::vec3 gLightPosition(2.0f, 2.0f, -5.0f);
     glm::vec3 gLightScale(0.3f);
 
+    // Everything URender draws; built once the meshes and textures exist
+    vector<USceneObject> gScene;
+
+    // Shadow map for the scene light
+    UShadowMap gShadowMap;
+    const GLsizei SHADOW_MAP_SIZE = 2048;
+    const GLuint SHADOW_TEXTURE_UNIT = 8;
+    int gShadowCascades = 1; // 1 = spot shadow from gLightPosition, 2-4 = cascades over the countertop (--shadow-cascades N)
+
+    // Vertex layout every mesh is uploaded with (--vertex-format float|compressed)
+    UVertexFormat gVertexFormat = UVERTEX_COMPRESSED;
+
+    // glTF scene that replaces the built in props (--gltf file)
+    const char* gGltfFile = nullptr;
+    UGltfScene gGltfScene;
+
+    // Textures, meshes and shader overrides in one mapped file; loose files are the fallback
+    const char* const ASSET_PACK_FILE = "../assets.upak";
+    UAssetPack gAssetPack;
+
+    // Staging ring for textures/buffers streamed in after startup
+    UUploadRing gUploadRing;
+    const size_t UPLOAD_RING_SIZE = 16 * 1024 * 1024;
+    const size_t UPLOAD_FRAME_BUDGET = 2 * 1024 * 1024; // bytes uploaded per frame at most
+
+    // Hi-Z occlusion culling against last frame's depth (--no-occlusion turns it off)
+    UHiZ gHiZ;
+    bool gOcclusionCulling = true;
+    vector<char> gVisible;
+    int gLastCulled = -1;
+
+    // Left click selects the object under the crosshair
+    UPicker gPicker;
+    bool gPicking = false;
+    const int PICK_REGION_RADIUS = 4; // pixels around the crosshair that count as a hit
+    int gSelectedObject = -1;
+
+    // Baked lighting for the static props (--bake-lightmap writes it, --no-lightmap ignores it)
+    const char* const LIGHTMAP_FILE = "../lightmap.ulm";
+    const int LIGHTMAP_SIZE = 1024;
+    const GLuint LIGHTMAP_TEXTURE_UNIT = 9;
+    ULightmap gLightmap;
+    GLuint gLightmapProgramId;
+    bool gUseLightmap = true;
+    bool gLightmapped = false; // a bake matching the current scene is loaded
+
+    // 2D overlay over the scene: crosshair, frame stats and the selection (--no-hud turns it off)
+    UOverlay gOverlay;
+    bool gHud = true;
+    const size_t OVERLAY_REGION_VERTICES = 65536; // per frame before a second draw call is needed
+    float gFrameMs = 0.0f; // smoothed, so the numbers are readable
+
+    // Heap allocations the render thread made last frame; steady state should be zero
+    unsigned long long gFrameHeapAllocations = 0;
+    size_t gSteadyFrames = 0;
+    size_t gSteadyFramesAllocating = 0;
+    const size_t WARMUP_FRAMES = 120; // caches, pools and driver state settle first
+
+    // Bouncing circles drawn with the overlay (--circles N); they live in [-aspect, aspect] x [-1, 1]
+    UCircleSim gCircleSim;
+    int gCircleCount = 0;
+
+    // Scene drawn offscreen at a resolution that follows the GPU frame time and stretched to the window
+    // (--target-ms N, --resolution-scale MIN MAX, --sharpness S, --no-dynamic-resolution)
+    UDynamicResolution gResolution;
+    bool gDynamicResolution = true;
+
+    // Input journal: --record file saves the session, --replay file [--fixed-step MS] plays it back
+    // through the same handlers and reports the frame times
+    UInputJournal gJournal;
+    const char* gRecordFile = nullptr;
+    const char* gReplayFile = nullptr;
+    float gFixedStepMs = 0.0f;
+    // Keys UProcessInput reacts to; their order is the bit order in the journal
+    const int JOURNAL_KEYS[] = { GLFW_KEY_ESCAPE, GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_E, GLFW_KEY_Q, GLFW_KEY_O, GLFW_KEY_P, GLFW_KEY_SPACE };
+    const uint32_t N_JOURNAL_KEYS = sizeof(JOURNAL_KEYS) / sizeof(JOURNAL_KEYS[0]);
+
+    // Camera poses rendered offscreen to PNGs instead of the interactive loop
+    // (--batch-render poses.txt [--batch-output DIR] [--batch-size W H] [--batch-threads N] [--batch-encoders N])
+    const char* gBatchFile = nullptr;
+    const char* gBatchOutput = ".";
+    int gBatchWidth = WINDOW_WIDTH;
+    int gBatchHeight = WINDOW_HEIGHT;
+    int gBatchThreads = 2;
+    int gBatchEncoders = 0; // 0 = one per hardware thread
+
+    // Every presented frame written as Y4M video, to a file or an encoder's stdin
+    // (--capture walk.y4m or --capture-pipe "ffmpeg -i - walk.mp4", [--capture-fps N])
+    UFrameCapture gCapture;
+    const char* gCaptureFile = nullptr;
+    const char* gCapturePipe = nullptr;
+    int gCaptureFps = 60;
+
+    // Layout from a scene file instead of UCreateScene, applied again whenever the file is saved
+    // (--scene file [--camera preset])
+    USceneFile gSceneFile;
+    const char* gSceneFileName = nullptr;
+    const char* gCameraPreset = nullptr;
+
+    // --profile: Chrome trace of startup and every frame, written at exit
+    const char* gProfileFile = nullptr;
+
+    // --max-texture-size N: cap on the side of every startup texture, on top of the per texture limits
+    int gMaxTextureSize = 0;
+
+    // --progressive-startup: the first frame shows placeholder colors and the textures are swapped in
+    // as background threads decode them, the ones covering most of the view first
+    bool gProgressiveStartup = false;
+    UProgressiveLoader gTextureLoader;
+    const char* const PLACEHOLDER_COLORS_FILE = "../placeholders.txt";
+    const int TEXTURE_LOADER_THREADS = 4;   // at most, one core is left for the render thread
+    chrono::steady_clock::time_point gStartTime;
+
 }
 
 /* User-defined Function prototypes to:
@@ -147,18 +264,33 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void UCreateTexturedMesh(GLMesh& mesh);
+void UCreateMeshData(UMeshData& plane, UMeshData& cube, UMeshData& cylinder, UMeshData& lamp);
+int USoftwareRenderMain(int argc, char* argv[]);
+int UPathTraceMain(int argc, char* argv[]);
+int ULightmapBakeMain(int argc, char* argv[]);
+int UBenchmarkMain(int argc, char* argv[]);
+void UGetLightmapInputs(const UMeshData& plane, const UMeshData& cube, const UMeshData& cylinder, vector<ULightmapInput>& inputs);
+void UCreateScene();
+void UApplyScene(bool reload);
+void UApplyCameraPreset(const char* name);
 void UDestroyMesh(GLMesh& mesh);
-bool UCreateTexture(const char* filename, GLuint& textureId);
-void UDestroyTexture(GLuint textureId);
+const char* UAssetPackName(const char* filename);
+bool UCreateTextureFromPixels(unsigned char* image, int width, int height, int channels, GLuint& textureId, bool flipVertically, const char* label);
+unsigned char* UDecodeImage(const char* filename, int& width, int& height, int& channels, bool flipVertically);
+bool UDecodeScaledJpeg(const unsigned char* data, size_t size, int maxSize, bool flipVertically, const char* label, UJpegImage& image);
+void USetTexturePriorities(UProgressiveLoader& loader);
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
+bool UKeyDown(uint32_t keys, int key);
+void UReplayJournalEvents(GLFWwindow* window);
+void UDrawHud(int width, int height);
+void UCreateCircles(int nCircles);
+bool URenderBatch(const char* vertexShader, const char* fragmentShader);
 
 
 /* Vertex Shader Source Code*/
 const GLchar* vertexShaderSource = GLSL(440,
-    layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
-layout(location = 1) in vec3 normal; // VAP position 1 for normals
+    layout(location = 0) in vec4 position; // VAP position 0 for vertex position data (w = tangent handedness on compressed meshes)
+layout(location = 1) in vec3 normal; // VAP position 1 for normals (octahedral xy on compressed meshes)
 layout(location = 2) in vec2 textureCoordinate;
 
 out vec3 vertexNormal; // For outgoing normals to fragment shader
@@ -166,17 +298,32 @@ out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec2 vertexTextureCoordinate;
 
 //Uniform / Global variables for the  transform matrices
-uniform mat4 model;
+uniform mat4 model; // already includes the mesh dequantization for compressed meshes
 uniform mat4 view;
 uniform mat4 projection;
+uniform mat3 normalMatrix; // computed on the CPU from the object's model matrix
+uniform int uVertexFormat; // 0 = float, 1 = compressed
+
+// Octahedral normal decode
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    vec4 localPosition = vec4(position.xyz, 1.0f);
+
+    gl_Position = projection * view * model * localPosition; // Transforms vertices into clip coordinates
 
-    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+    vertexFragmentPos = vec3(model * localPosition); // Gets fragment / pixel position in world space only (exclude view and projection)
 
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
+    vec3 meshNormal = uVertexFormat == 1 ? OctDecode(normal.xy) : normal;
+    vertexNormal = normalMatrix * meshNormal; // get normal vectors in world space only and exclude normal translation properties
     vertexTextureCoordinate = textureCoordinate;
 }
 );
@@ -184,15 +331,52 @@ void main()
 
 /* Fragment Shader Source Code*/
 const GLchar* fragmentShaderSource = GLSL(440,
+    in vec3 vertexFragmentPos; // Fragment position in world space
     in vec2 vertexTextureCoordinate; // Variable to hold incoming color data from vertex shader
 
     out vec4 fragmentColor;
 
     uniform sampler2D uTexture;
+    uniform mat4 view;
+
+    // Shadow map layers and the matrices they were rendered with
+    uniform sampler2DArrayShadow uShadowMap;
+    uniform mat4 uLightSpace[4];
+    uniform float uCascadeSplits[4];
+    uniform int uCascadeCount;
+
+    // 1.0 = fully lit, 0.0 = fully in shadow
+    float ShadowFactor()
+    {
+        // Pick the cascade by view space depth
+        float viewDepth = -(view * vec4(vertexFragmentPos, 1.0f)).z;
+        int cascade = 0;
+        for (int i = 0; i < uCascadeCount - 1; ++i)
+        {
+            if (viewDepth > uCascadeSplits[i])
+                cascade = i + 1;
+        }
+
+        vec4 lightClip = uLightSpace[cascade] * vec4(vertexFragmentPos, 1.0f);
+        vec3 coords = lightClip.xyz / lightClip.w * 0.5f + 0.5f;
+        if (coords.z > 1.0f)
+            return 1.0f;
+
+        // 3x3 PCF on top of the hardware 2x2 filter
+        vec2 texelSize = 1.0f / vec2(textureSize(uShadowMap, 0).xy);
+        float lit = 0.0f;
+        for (int x = -1; x <= 1; ++x)
+        {
+            for (int y = -1; y <= 1; ++y)
+                lit += texture(uShadowMap, vec4(coords.xy + vec2(x, y) * texelSize, cascade, coords.z - 0.0005f));
+        }
+        return lit / 9.0f;
+    }
 
     void main()
     {
-        fragmentColor = texture(uTexture, vertexTextureCoordinate);
+        vec4 textureColor = texture(uTexture, vertexTextureCoordinate);
+        fragmentColor = vec4(textureColor.rgb * mix(0.35f, 1.0f, ShadowFactor()), textureColor.a);
     }
 );
 
@@ -246,6 +430,46 @@ const GLchar* lightFragmentShaderSource = GLSL(440,
 );
 
 
+/* Vertex Shader Source Code for lightmapped static objects*/
+const GLchar* lightmapVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec4 position; // compressed positions are dequantized by the model matrix
+layout(location = 2) in vec2 textureCoordinate;
+layout(location = 4) in vec2 lightmapCoordinate;
+
+out vec2 vertexTextureCoordinate;
+out vec2 vertexLightmapCoordinate;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(position.xyz, 1.0f);
+    vertexTextureCoordinate = textureCoordinate;
+    vertexLightmapCoordinate = lightmapCoordinate;
+}
+);
+
+
+/* Fragment Shader Source Code for lightmapped static objects: lighting is one texture fetch*/
+const GLchar* lightmapFragmentShaderSource = GLSL(440,
+    in vec2 vertexTextureCoordinate;
+    in vec2 vertexLightmapCoordinate;
+
+    out vec4 fragmentColor;
+
+    uniform sampler2D uTexture;
+    uniform sampler2D uLightmap; // direct + bounced light, shadows included
+
+    void main()
+    {
+        vec4 textureColor = texture(uTexture, vertexTextureCoordinate);
+        fragmentColor = vec4(textureColor.rgb * texture(uLightmap, vertexLightmapCoordinate).rgb, textureColor.a);
+    }
+);
+
+
 /* Lamp Shader Source Code*/
 const GLchar* lampVertexShaderSource = GLSL(440,
 
@@ -317,71 +541,251 @@ public:
         radius = rad;
         direction = dir;
     }
-    void DrawCircle()
+    // Queued on the overlay, which draws everything of a frame with one call
+    void DrawCircle(UOverlay& overlay)
     {
-        glColor3f(red, green, blue);
-        glBegin(GL_POLYGON);
-        for (int i = 0; i < 360; i++) {
-            float degInRad = i * DEG2RAD;
-            glVertex2f((cos(degInRad) * radius) + x, (sin(degInRad) * radius) + y);
-        }
-        glEnd();
+        // x, y and radius are in normalized device coordinates, the overlay works in pixels
+        glm::vec2 center((x * 0.5f + 0.5f) * overlay.width, (0.5f - y * 0.5f) * overlay.height);
+        UOverlayCircle(overlay, center, radius * 0.5f * overlay.height, glm::vec4(red, green, blue, 1.0f));
+    }
+
+    // Hands the circle to the batch simulation; speed here is per frame at 60 Hz, there per second
+    void AddTo(UCircleSim& simulation) const
+    {
+        UAddCircle(simulation, glm::vec2(x, y), radius, direction, speed * 60.0f, glm::vec4(red, green, blue, 1.0f));
     }
 };
 
 int main(int argc, char* argv[])
 {
+    // Offline tools run without a window
+    if (argc > 1 && strcmp(argv[1], "--convert-mesh") == 0)
+        return UMeshConverterMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--build-pack") == 0)
+        return UAssetPackBuilderMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--software-render") == 0)
+        return USoftwareRenderMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--path-trace") == 0)
+        return UPathTraceMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--bake-lightmap") == 0)
+        return ULightmapBakeMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--circle-bench") == 0)
+        return UCircleBenchmarkMain(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return UBenchmarkMain(argc, argv);
+
+    // Command line options
+    gResolution.targetMs = 16.0f;
+    gResolution.minScale = 0.5f;
+    gResolution.maxScale = 1.0f;
+    gResolution.sharpness = 0.5f;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--shadow-cascades") == 0 && i + 1 < argc)
+            gShadowCascades = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc)
+            gVertexFormat = strcmp(argv[++i], "float") == 0 ? UVERTEX_FLOAT : UVERTEX_COMPRESSED;
+        else if (strcmp(argv[i], "--gltf") == 0 && i + 1 < argc)
+            gGltfFile = argv[++i];
+        else if (strcmp(argv[i], "--no-occlusion") == 0)
+            gOcclusionCulling = false;
+        else if (strcmp(argv[i], "--no-lightmap") == 0)
+            gUseLightmap = false;
+        else if (strcmp(argv[i], "--no-hud") == 0)
+            gHud = false;
+        else if (strcmp(argv[i], "--circles") == 0 && i + 1 < argc)
+            gCircleCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--target-ms") == 0 && i + 1 < argc)
+            gResolution.targetMs = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--resolution-scale") == 0 && i + 2 < argc)
+        {
+            gResolution.minScale = (float)atof(argv[++i]);
+            gResolution.maxScale = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sharpness") == 0 && i + 1 < argc)
+            gResolution.sharpness = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--no-dynamic-resolution") == 0)
+            gDynamicResolution = false;
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            gRecordFile = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            gReplayFile = argv[++i];
+        else if (strcmp(argv[i], "--fixed-step") == 0 && i + 1 < argc)
+            gFixedStepMs = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--batch-render") == 0 && i + 1 < argc)
+            gBatchFile = argv[++i];
+        else if (strcmp(argv[i], "--batch-output") == 0 && i + 1 < argc)
+            gBatchOutput = argv[++i];
+        else if (strcmp(argv[i], "--batch-size") == 0 && i + 2 < argc)
+        {
+            gBatchWidth = atoi(argv[++i]);
+            gBatchHeight = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--batch-threads") == 0 && i + 1 < argc)
+            gBatchThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--batch-encoders") == 0 && i + 1 < argc)
+            gBatchEncoders = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+            gCaptureFile = argv[++i];
+        else if (strcmp(argv[i], "--capture-pipe") == 0 && i + 1 < argc)
+            gCapturePipe = argv[++i];
+        else if (strcmp(argv[i], "--capture-fps") == 0 && i + 1 < argc)
+            gCaptureFps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+            gSceneFileName = argv[++i];
+        else if (strcmp(argv[i], "--camera") == 0 && i + 1 < argc)
+            gCameraPreset = argv[++i];
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            gProfileFile = argv[++i];
+        else if (strcmp(argv[i], "--max-texture-size") == 0 && i + 1 < argc)
+            gMaxTextureSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--progressive-startup") == 0)
+            gProgressiveStartup = true;
+    }
+
+    // Recording starts before the window, so startup is on the timeline too
+    if (gProfileFile)
+    {
+        UStartProfiler();
+        UNameProfileThread("Main");
+    }
+    uint64_t startupTicks = UProfileTicks();
+    gStartTime = chrono::steady_clock::now();
+
+    // Cascades are fitted to one camera; every pose of a batch shares the spot shadow instead
+    if (gBatchFile && gShadowCascades > 1)
+    {
+        cout << "Batch rendering uses the spot light shadow instead of " << gShadowCascades << " cascades" << endl;
+        gShadowCascades = 1;
+    }
+    // Every pose of a batch needs the real textures
+    if (gBatchFile && gProgressiveStartup)
+    {
+        cout << "Batch rendering loads every texture before the first pose" << endl;
+        gProgressiveStartup = false;
+    }
+
     if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
+    // One open for every startup asset when the pack exists
+    UOpenAssetPack(ASSET_PACK_FILE, gAssetPack);
+
     // Create the mesh
     UCreateTexturedMesh(gMesh); // Calls the function to create the Vertex Buffer Object
 
     // Create the shader program
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
+    const char* packVertexShader = UFindShaderInPack(gAssetPack, "shaders/scene.vert");
+    const char* packFragmentShader = UFindShaderInPack(gAssetPack, "shaders/scene.frag");
+    if (!UCreateShaderProgram(packVertexShader ? packVertexShader : vertexShaderSource, packFragmentShader ? packFragmentShader : fragmentShaderSource, gProgramId))
         return EXIT_FAILURE;
+    // Batch render threads compile their own copies, after the pack is closed
+    string sceneVertexShader = packVertexShader ? packVertexShader : vertexShaderSource;
+    string sceneFragmentShader = packFragmentShader ? packFragmentShader : fragmentShaderSource;
 
 
     //Load textures
-    const char* texFileName = "../images/countertop.jpg";
-    if (!UCreateTexture(texFileName, gPlaneTexture)) {
-        cout << "Failed to load texture " << texFileName << endl;
-        return EXIT_FAILURE;
-    }
-    texFileName = "../images/bottle.jpg";
-    if (!UCreateTexture(texFileName, gBottleTexture)) {
-        cout << "Failed to load texture " << texFileName << endl;
-        return EXIT_FAILURE;
+    if (gProgressiveStartup)
+        ULoadPlaceholderColors(PLACEHOLDER_COLORS_FILE, gTextureLoader);
+    for (const UTextureSlot& slot : TEXTURE_SLOTS)
+    {
+        int maxSize = slot.maxSize;
+        if (gMaxTextureSize > 0 && (maxSize == 0 || gMaxTextureSize < maxSize))
+            maxSize = gMaxTextureSize;
+        // Pack textures are already decoded, so only loose files are worth deferring
+        size_t packedSize;
+        bool packed = UFindAsset(gAssetPack, UAssetPackName(slot.filename), UASSET_TEXTURE, packedSize) != nullptr;
+        bool loaded = gProgressiveStartup && !packed
+            ? UAddProgressiveTexture(gTextureLoader, slot.filename, maxSize, *slot.id)
+            : ULoadTexture(slot.filename, *slot.id, maxSize);
+        if (!loaded) {
+            cout << "Failed to load texture " << slot.filename << endl;
+            return EXIT_FAILURE;
+        }
+        // A scene file naming the same image uses this copy
+        UAddSceneTexture(gSceneFile, slot.filename, *slot.id);
     }
-    texFileName = "../images/bottleTop.jpg";
-    if (!UCreateTexture(texFileName, gBottleNeckTexture)) {
-        cout << "Failed to load texture " << texFileName << endl;
-        return EXIT_FAILURE;
+
+    // Everything from the pack is on the GPU now
+    UCloseAssetPack(gAssetPack);
+
+    // Background uploads; everything still works synchronously if the ring can't be created
+    bool uploadRing = UCreateUploadRing(gUploadRing, UPLOAD_RING_SIZE, UPLOAD_FRAME_BUDGET);
+
+    // Imported assets; the built in props stay if the import fails
+    if (gGltfFile && !UImportGltf(gGltfFile, glm::mat4(1.0f), gGltfScene, uploadRing ? &gUploadRing : nullptr))
+        cout << "Failed to import " << gGltfFile << ", using the built in props" << endl;
+
+    // Build the scene object list now that every mesh and texture exists
+    UCreateScene();
+    if (gSceneFileName)
+    {
+        UAddSceneMesh(gSceneFile, "plane", &gMesh.plane);
+        UAddSceneMesh(gSceneFile, "cube", &gMesh.cube);
+        UAddSceneMesh(gSceneFile, "cylinder", &gMesh.cylinder);
+        UAddSceneMesh(gSceneFile, "lamp", &gMesh.lamp);
+        if (!UOpenSceneFile(gSceneFile, gSceneFileName))
+        {
+            UDestroyUploadRing(gUploadRing);
+            return EXIT_FAILURE;
+        }
+        UApplyScene(false);
     }
-    texFileName = "../images/spatula.jpg";
-    if (!UCreateTexture(texFileName, gSpatulaTexture)) {
-        cout << "Failed to load texture " << texFileName << endl;
+
+    // Shadow map covering the countertop and everything standing on it
+    if (!UCreateShadowMap(gShadowMap, SHADOW_MAP_SIZE, gShadowCascades, glm::vec3(-5.0f, -1.0f, -5.0f), glm::vec3(5.0f, 3.0f, 5.0f)))
+    {
+        UDestroyUploadRing(gUploadRing);
         return EXIT_FAILURE;
     }
-    texFileName = "../images/saltShaker.jpg";
-    if (!UCreateTexture(texFileName, gSaltShakerTexture)) {
-        cout << "Failed to load texture " << texFileName << endl;
-        return EXIT_FAILURE;
+
+    // Culling is an optimization; draw everything if the compute shader is unavailable
+    if (gOcclusionCulling && !UCreateHiZ(gHiZ))
+    {
+        cout << "Hi-Z occlusion culling unavailable, drawing every object" << endl;
+        gOcclusionCulling = false;
     }
-    texFileName = "../images/pepperShaker.jpg";
-    if (!UCreateTexture(texFileName, gPepperShakerTexture)) {
-        cout << "Failed to load texture " << texFileName << endl;
-        return EXIT_FAILURE;
+
+    // Without the offscreen target the scene goes straight to the window at full resolution
+    if (gDynamicResolution && !UCreateDynamicResolution(gResolution))
+    {
+        cout << "Dynamic resolution unavailable, rendering at window resolution" << endl;
+        gDynamicResolution = false;
     }
-    texFileName = "../images/potHolder.jpg";
-    if (!UCreateTexture(texFileName, gPotHolderTexture)) {
-        cout << "Failed to load texture " << texFileName << endl;
-        return EXIT_FAILURE;
+
+    // Picking only costs anything when a click is pending
+    gPicking = UCreatePicker(gPicker, PICK_REGION_RADIUS);
+    if (!gPicking)
+        cout << "Object picking unavailable" << endl;
+
+    if (gHud && !UCreateOverlay(gOverlay, OVERLAY_REGION_VERTICES))
+    {
+        cout << "Overlay unavailable, running without the HUD" << endl;
+        gHud = false;
     }
-    texFileName = "../images/watermelon.jpg";
-    if (!UCreateTexture(texFileName, gWatermelonTexture)) {
-        cout << "Failed to load texture " << texFileName << endl;
-        return EXIT_FAILURE;
+    if (gHud && gCircleCount > 0)
+        UCreateCircles(gCircleCount);
+
+    // Static props sample their baked lighting when a bake for this exact layout exists
+    if (gUseLightmap)
+    {
+        vector<ULightmapInput> inputs;
+        UGetLightmapInputs(gPlaneData, gCubeData, gCylinderData, inputs);
+        ULightmapAtlas atlas;
+        UBuildLightmapAtlas(inputs, { gLightPosition, gLightColor }, LIGHTMAP_SIZE, atlas);
+        if (ULoadLightmap(LIGHTMAP_FILE, atlas, gScene.size(), gVertexFormat, gLightmap))
+        {
+            gLightmapped = UCreateShaderProgram(lightmapVertexShaderSource, lightmapFragmentShaderSource, gLightmapProgramId);
+            if (gLightmapped)
+            {
+                glUseProgram(gLightmapProgramId);
+                glUniform1i(glGetUniformLocation(gLightmapProgramId, "uTexture"), 0);
+                glUniform1i(glGetUniformLocation(gLightmapProgramId, "uLightmap"), LIGHTMAP_TEXTURE_UNIT);
+                cout << "INFO: Lightmap " << LIGHTMAP_FILE << " lights " << inputs.size() << " static objects" << endl;
+            }
+            else
+                UDestroyLightmap(gLightmap);
+        }
     }
 
     glUseProgram(gProgramId);
@@ -399,23 +803,116 @@ int main(int argc, char* argv[])
     // Sets the background color of the window to black (it will be implicitely used by glClear)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
+    // Started last, so a replay doesn't count loading as frame time
+    if (gReplayFile && !UStartReplay(gJournal, gReplayFile, N_JOURNAL_KEYS, gFixedStepMs / 1000.0f))
+        return EXIT_FAILURE;
+    if (!gReplayFile && gRecordFile && !UStartRecording(gJournal, gRecordFile, N_JOURNAL_KEYS))
+        return EXIT_FAILURE;
+
+    // Replaying with --fixed-step and capturing gives a video whose timing doesn't depend on the machine
+    if (!gBatchFile && (gCaptureFile || gCapturePipe))
+    {
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+        if (!UStartCapture(gCapture, framebufferWidth, framebufferHeight, gCaptureFps, gCaptureFile, gCapturePipe))
+            return EXIT_FAILURE;
+    }
+
+    // Decoding starts once nothing can fail any more, in order of how much of the first view each texture covers
+    if (gProgressiveStartup)
+    {
+        USetTexturePriorities(gTextureLoader);
+        unsigned int cores = thread::hardware_concurrency();
+        int nThreads = cores > 1 ? (int)cores - 1 : 1;
+        UStartProgressiveLoader(gTextureLoader, nThreads < TEXTURE_LOADER_THREADS ? nThreads : TEXTURE_LOADER_THREADS);
+    }
+
+    if (gProfilerEnabled)
+        URecordProfileZone("Startup", nullptr, startupTicks, UProfileTicks());
+
+    // A batch replaces the interactive loop
+    bool batchFailed = gBatchFile && !URenderBatch(sceneVertexShader.c_str(), sceneFragmentShader.c_str());
+
     // render loop
-    while (!glfwWindowShouldClose(gWindow))
+    gLastFrame = glfwGetTime();
+    while (!gBatchFile && !glfwWindowShouldClose(gWindow))
     {
+        UPROFILE_ZONE("Frame");
+
         // per-frame timing
         float currentFrame = glfwGetTime();
         gDeltaTime = currentFrame - gLastFrame;
         gLastFrame = currentFrame;
 
+        // A replay swaps in the recorded timestep and ends the run when it runs out
+        if (!UBeginJournalFrame(gJournal, gDeltaTime))
+            break;
+
+        // Last frame's scratch memory is recycled; everything this frame allocates from the heap is counted
+        UBeginFrameArenas();
+        unsigned long long heapAllocations = UThreadHeapAllocations();
+
+        // Saved scene edits show up within a few frames
+        if (UPollSceneFile(gSceneFile, glfwGetTime()))
+            UApplyScene(true);
+
+        // One decoded texture a frame replaces its placeholder, so no single frame uploads them all
+        if (!UProgressiveLoaderDone(gTextureLoader) && UPumpProgressiveLoader(gTextureLoader) > 0 && UProgressiveLoaderDone(gTextureLoader))
+        {
+            double fullQualityMs = chrono::duration<double, milli>(chrono::steady_clock::now() - gStartTime).count();
+            cout << "INFO: Time to full quality " << fullQualityMs << " ms (" << gTextureLoader.textures.size() << " textures swapped in)" << endl;
+        }
+
         // input
         UProcessInput(gWindow);
 
         // Render this frame
         URender();
 
-        glfwPollEvents();
+        if (gSteadyFrames == 0)
+        {
+            double firstFrameMs = chrono::duration<double, milli>(chrono::steady_clock::now() - gStartTime).count();
+            cout << "INFO: Time to first frame " << firstFrameMs << " ms";
+            if (gProgressiveStartup)
+                cout << " (" << gTextureLoader.textures.size() - gTextureLoader.nSwapped << " placeholder textures)";
+            cout << endl;
+        }
+
+        {
+            UPROFILE_ZONE("Poll events");
+            glfwPollEvents();
+        }
+
+        // The frame's mouse events: written out when recording, fed to the handlers when replaying
+        UReplayJournalEvents(gWindow);
+        UEndJournalFrame(gJournal);
+
+        gFrameHeapAllocations = UThreadHeapAllocations() - heapAllocations;
+        if (++gSteadyFrames > WARMUP_FRAMES && gFrameHeapAllocations > 0)
+            ++gSteadyFramesAllocating;
+    }
+    if (gSteadyFrames > WARMUP_FRAMES)
+    {
+        UFrameArenaStats arenaStats;
+        UGetFrameArenaStats(arenaStats);
+        cout << "INFO: " << gSteadyFramesAllocating << " of " << gSteadyFrames - WARMUP_FRAMES << " frames after warm-up allocated from the heap; "
+            << "frame arena peak " << arenaStats.peakBytes << " of " << arenaStats.capacity << " bytes, " << arenaStats.nOverflows << " overflows" << endl;
+    }
+    UStopJournal(gJournal);
+    UStopCapture(gCapture);
+    // Texture loaders still decoding are dropped; the rest keep their colors for the next run's placeholders
+    UStopProgressiveLoader(gTextureLoader, PLACEHOLDER_COLORS_FILE);
+
+    // Every other thread has finished by now
+    if (gProfileFile)
+    {
+        UStopProfiler();
+        UWriteProfile(gProfileFile);
     }
 
+    // Release what the scene file loaded, then the built in meshes and textures it shared
+    UCloseSceneFile(gSceneFile);
+
     // Release mesh data
     UDestroyMesh(gMesh);
 
@@ -429,813 +926,1299 @@ int main(int argc, char* argv[])
     UDestroyTexture(gPotHolderTexture);
     UDestroyTexture(gWatermelonTexture);
 
+    // Stop background uploads before anything they write to goes away
+    UDestroyUploadRing(gUploadRing);
+
+    // Release imported glTF
+    UDestroyGltfScene(gGltfScene);
+
+    // Release shadow map
+    UDestroyShadowMap(gShadowMap);
+
+    // Release occlusion culling
+    if (gOcclusionCulling)
+        UDestroyHiZ(gHiZ);
+
+    // Release the offscreen scene target
+    if (gDynamicResolution)
+        UDestroyDynamicResolution(gResolution);
+
+    // Release picking
+    if (gPicking)
+        UDestroyPicker(gPicker);
+
+    // Release the overlay
+    if (gHud)
+        UDestroyOverlay(gOverlay);
+
+    // Release baked lighting
+    if (gLightmapped)
+    {
+        UDestroyLightmap(gLightmap);
+        UDestroyShaderProgram(gLightmapProgramId);
+    }
+
     // Release shader program
     UDestroyShaderProgram(gProgramId);
 
-    exit(EXIT_SUCCESS); // Terminates the program successfully
+    // Anything still registered now was never released
+    UReportGpuLeaks();
+
+    exit(batchFailed ? EXIT_FAILURE : EXIT_SUCCESS); // Terminates the program successfully
 }
 
 // Function called to render a frame
 void URender()
 {
+    UPROFILE_ZONE("Render");
 
-    // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
 
-    // Clear the frame and z buffers
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Times the whole frame and picks the scene resolution from the frames before it
+    bool offscreen = gDynamicResolution && UBeginDynamicResolutionFrame(gResolution, framebufferWidth, framebufferHeight);
+
+    // Streamed uploads get their slice of the frame first
+    {
+        UPROFILE_ZONE("Pump uploads");
+        UPumpUploads(gUploadRing);
+    }
 
-    // Scale, rotate, and translate object
-    glm::mat4 scale = glm::scale(glm::vec3(1.0f, 1.0f, 1.0f));
-    glm::mat4 rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-    glm::mat4 translation = glm::translate(glm::vec3(0.0f, 4.0f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 model = translation * rotation * scale;
+    // Enable z-depth
+    glEnable(GL_DEPTH_TEST);
 
     // camera/view transformation
     glm::mat4 view = gCamera.GetViewMatrix();
 
-    // Creates a perspective projection
-    glm::mat4 projection = glm::ortho(-10.0f, 10.0f, -10.0f, 100.0f, -100.0f, 100.0f);
-    if (!ortho) {
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
-    }
+    // Creates a perspective projection with the window's current aspect ratio
+    float aspect = framebufferHeight > 0 ? (GLfloat)framebufferWidth / (GLfloat)framebufferHeight : (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT;
+    float nearPlane = 0.1f;
+    float farPlane = 100.0f;
+    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), aspect, nearPlane, farPlane);
     if (ortho) {
-        projection = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -10.0f, 10.0f);
-    };
+        nearPlane = -10.0f;
+        farPlane = 10.0f;
+        projection = glm::ortho(-aspect, aspect, -1.0f, 1.0f, nearPlane, farPlane);
+    }
+
+    // Bring the shadow map up to date; this does nothing unless a caster or the light moved
+    {
+        UPROFILE_ZONE("Shadow update");
+        UUpdateShadowMap(gShadowMap, gScene, gLightPosition, view, projection, nearPlane, farPlane);
+    }
 
-    glm::mat4 transformation(1.0f);
+    // The scene goes into the offscreen target at this frame's resolution
+    if (offscreen)
+        UBindSceneTarget(gResolution);
+
+    // Clear the frame and z buffers
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Set the shader to be used
     glUseProgram(gProgramId);
 
     GLuint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-    //// Sends transform information to the Vertex shader
-    GLuint transformLocation = glGetUniformLocation(gProgramId, "shaderTransform");
-    glUniformMatrix4fv(transformLocation, 1, GL_FALSE, glm::value_ptr(transformation));
 
     // Retrieves and passes transform matrices to the Shader program
     GLint modelLoc = glGetUniformLocation(gProgramId, "model");
     GLint viewLoc = glGetUniformLocation(gProgramId, "view");
     GLint projLoc = glGetUniformLocation(gProgramId, "projection");
+    GLint normalMatrixLoc = glGetUniformLocation(gProgramId, "normalMatrix");
+    GLint vertexFormatLoc = glGetUniformLocation(gProgramId, "uVertexFormat");
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
     glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
     glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
+    // Shadow map layers on their own texture unit
+    UBindShadowMap(gShadowMap, gProgramId, SHADOW_TEXTURE_UNIT);
 
-    // Plane
-    glBindVertexArray(gMesh.planeVao);
-    model = glm::mat4(1.0f);
+    // Objects hidden behind last frame's depth are skipped; shadows above still use the whole scene
+    {
+        UPROFILE_ZONE("Occlusion cull");
+        if (gOcclusionCulling)
+        {
+            UCullScene(gHiZ, gScene, gVisible);
+            if (gHiZ.nCulled != gLastCulled)
+            {
+                cout << "INFO: Hi-Z culled " << gHiZ.nCulled << " of " << gHiZ.nTested << " objects" << endl;
+                gLastCulled = gHiZ.nCulled;
+            }
+        }
+        else
+            gVisible.assign(gScene.size(), 1);
+    }
 
-    // Bind textures 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gPlaneTexture);
+    {
+        UPROFILE_ZONE("Scene pass");
+        // Every visible object in the scene, lightmapped ones follow in their own pass. The draw list
+        // lives in the frame arena and is sorted by mesh and texture, so consecutive draws share state.
+        UFrameVector<const USceneObject*> drawList;
+        drawList.reserve(gScene.size());
+        for (size_t i = 0; i < gScene.size(); ++i)
+        {
+            if (gVisible[i] && !(gLightmapped && gLightmap.meshes[i].vao))
+                drawList.push_back(&gScene[i]);
+        }
+        sort(drawList.begin(), drawList.end(), [](const USceneObject* a, const USceneObject* b)
+            {
+                return a->mesh != b->mesh ? less<const UGpuMesh*>()(a->mesh, b->mesh) : a->texture < b->texture;
+            });
+
+        glActiveTexture(GL_TEXTURE0);
+        const UGpuMesh* boundMesh = nullptr;
+        GLuint boundTexture = 0;
+        for (const USceneObject* object : drawList)
+        {
+            // Dequantization is folded into the model matrix; normals use the plain model matrix
+            glm::mat4 model = object->model * object->mesh->dequantize;
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(object->model)));
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+            glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+            glUniform2fv(UVScaleLoc, 1, glm::value_ptr(object->uvScale));
+            if (object->mesh != boundMesh)
+                glUniform1i(vertexFormatLoc, object->mesh->format);
+
+            // Bind textures
+            if (object->texture != boundTexture || !boundMesh)
+                glBindTexture(GL_TEXTURE_2D, object->texture);
+            boundMesh = object->mesh;
+            boundTexture = object->texture;
+
+            // Draws the triangles
+            UDrawGpuMesh(*object->mesh);
+        }
+    }
 
-    // Draw Plane
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nPlaneVertices);
+    // Static objects: albedo times the baked light, nothing evaluated per light
+    if (gLightmapped)
+    {
+        UPROFILE_ZONE("Lightmap pass");
+        glUseProgram(gLightmapProgramId);
+        GLint lightmapModelLoc = glGetUniformLocation(gLightmapProgramId, "model");
+        glUniformMatrix4fv(glGetUniformLocation(gLightmapProgramId, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(gLightmapProgramId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        glActiveTexture(GL_TEXTURE0 + LIGHTMAP_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, gLightmap.texture);
+
+        for (size_t i = 0; i < gScene.size(); ++i)
+        {
+            const UGpuMesh& mesh = gLightmap.meshes[i];
+            if (!gVisible[i] || !mesh.vao)
+                continue;
+            glm::mat4 model = gScene[i].model * mesh.dequantize;
+            glUniformMatrix4fv(lightmapModelLoc, 1, GL_FALSE, glm::value_ptr(model));
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, gScene[i].texture);
+            UDrawGpuMesh(mesh);
+        }
+    }
 
-    //////////////////////////////////
+    // Deactivate the Vertex Array Object
+    glBindVertexArray(0);
 
-    // Bottle
-    // Scale, rotate, and translate bottle
-    glm::mat4 bottleScale = glm::scale(glm::vec3(1.0f, 2.0f, 1.0f));
-    glm::mat4 bottleRotation = glm::rotate(-25.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    glm::mat4 bottleTranslation = glm::translate(glm::vec3(-2.0f, 0.0f, -1.5f));
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 bottleModel = bottleTranslation * bottleRotation * bottleScale;
+    // This frame's depth becomes the occluder pyramid for the next ones; the pyramid stays at window
+    // size whatever the scene resolution
+    if (gOcclusionCulling)
+    {
+        UPROFILE_ZONE("Hi-Z capture");
+        if (offscreen)
+            UCaptureHiZ(gHiZ, projection * view, framebufferWidth, framebufferHeight, gResolution.fbo, gResolution.width, gResolution.height);
+        else
+            UCaptureHiZ(gHiZ, projection * view, framebufferWidth, framebufferHeight);
+    }
 
-    // Retrieves and passes transform matrices to the Shader program
-    GLint bottleModelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint bottleViewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint bottleProjLoc = glGetUniformLocation(gProgramId, "projection");
+    // Scene up to window size; picking and the HUD work at window resolution from here on
+    if (offscreen)
+    {
+        UPROFILE_ZONE("Present scene");
+        UPresentSceneTarget(gResolution);
+    }
 
-    glUniformMatrix4fv(bottleModelLoc, 1, GL_FALSE, glm::value_ptr(bottleModel));
-    glUniformMatrix4fv(bottleViewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(bottleProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // Clicks are rendered into the ID buffer here and answered a frame or two later
+    {
+        UPROFILE_ZONE("Picking");
+        UPickResult pick;
+        if (gPicking && UUpdatePicker(gPicker, gScene, &gVisible, projection * view, framebufferWidth, framebufferHeight, pick))
+        {
+            gSelectedObject = pick.objectIndex;
+            if (pick.hit)
+                cout << "Selected " << pick.name << " at (" << pick.worldPosition.x << ", " << pick.worldPosition.y << ", " << pick.worldPosition.z << ")" << endl;
+            else
+                cout << "Nothing selected" << endl;
+        }
+    }
 
-    // Draws bottle
-    glBindVertexArray(gMesh.bottleVao);
-    model = glm::mat4(1.0f);
+    // 2D on top, after the depth capture so it never occludes anything
+    if (gHud)
+    {
+        UPROFILE_ZONE("HUD");
+        // The walls follow the framebuffer's shape, so circles stay round and on screen after a resize
+        float aspect = framebufferHeight > 0 ? (float)framebufferWidth / framebufferHeight : gCircleSim.boundsMax.x;
+        if (aspect != gCircleSim.boundsMax.x)
+            USetCircleSimBounds(gCircleSim, glm::vec2(-aspect, -1.0f), glm::vec2(aspect, 1.0f));
+        UStepCircleSim(gCircleSim, gDeltaTime);
+        UDrawHud(framebufferWidth, framebufferHeight);
+    }
 
-    // Bind textures
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gBottleTexture);
+    if (gDynamicResolution)
+        UEndDynamicResolutionFrame(gResolution, gDeltaTime * 1000.0f);
 
-    // Draw bottle
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nBottleVertices);
-    /////////////////
+    // The finished frame, HUD included, starts its readback before the swap
+    {
+        UPROFILE_ZONE("Frame capture");
+        UCaptureFrame(gCapture, framebufferWidth, framebufferHeight);
+    }
 
-    //// Bottle Neck
-    // Scale, rotate, and translate bottle neck
-    glm::mat4 bottleNeckScale = glm::scale(glm::vec3(0.06f, 0.1f, 0.06f));
-    glm::mat4 bottleNeckRotation = glm::rotate(-25.0f, glm::vec3(0.0, 1.0f, 0.0f));
-    glm::mat4 bottleNeckTranslation = glm::translate(glm::vec3(-2.05f, 1.0f, -1.5f));
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 bottleNeckModel = bottleNeckTranslation * bottleNeckRotation * bottleNeckScale;
+    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    {
+        UPROFILE_ZONE("Swap buffers");
+        glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    }
+}
 
-    // Retrieves and passes transform matrices to the Shader program
-    GLint bottleNeckModelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint bottleNeckViewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint bottleNeckProjLoc = glGetUniformLocation(gProgramId, "projection");
+// Crosshair, frame stats and the selected object, batched into one overlay draw
+void UDrawHud(int width, int height)
+{
+    gFrameMs += (gDeltaTime * 1000.0f - gFrameMs) * 0.05f;
 
-    glUniformMatrix4fv(bottleNeckModelLoc, 1, GL_FALSE, glm::value_ptr(bottleNeckModel));
-    glUniformMatrix4fv(bottleNeckViewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(bottleNeckProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    UBeginOverlay(gOverlay, width, height);
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.bottleNeckVao);
-    model = glm::mat4(1.0f);
+    // Circles first, so everything else stays readable on top
+    float aspect = height > 0 ? (float)width / height : 1.0f;
+    for (size_t i = 0; i < gCircleSim.x.size(); ++i)
+    {
+        uint32_t packed = gCircleSim.color[i];
+        glm::vec4 color((packed & 0xFF) / 255.0f, (packed >> 8 & 0xFF) / 255.0f, (packed >> 16 & 0xFF) / 255.0f, (packed >> 24) / 255.0f);
+        glm::vec2 position((gCircleSim.x[i] / aspect * 0.5f + 0.5f) * width, (0.5f - gCircleSim.y[i] * 0.5f) * height);
+        UOverlayCircle(gOverlay, position, gCircleSim.radius[i] * 0.5f * height, color);
+    }
 
-    // Bind textures
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gBottleNeckTexture);
+    glm::vec2 center(width * 0.5f, height * 0.5f);
+    const glm::vec4 crosshairColor(1.0f, 1.0f, 1.0f, 0.8f);
+    UOverlayLine(gOverlay, glm::vec2(center.x - 8.0f, center.y), glm::vec2(center.x + 8.0f, center.y), 2.0f, crosshairColor);
+    UOverlayLine(gOverlay, glm::vec2(center.x, center.y - 8.0f), glm::vec2(center.x, center.y + 8.0f), 2.0f, crosshairColor);
+    UOverlayCircle(gOverlay, center, 2.0f, glm::vec4(1.0f, 0.4f, 0.2f, 1.0f));
+
+    // Counts from the previous flush; this frame's aren't known until it is drawn
+    char text[256];
+    size_t nVisible = 0;
+    for (char visible : gVisible)
+        nVisible += visible ? 1 : 0;
+    // GPU memory should stay flat across scene reloads; a climbing number is a leak
+    UGpuMemoryStats memory;
+    UGetGpuMemoryStats(memory);
+    int length = snprintf(text, sizeof(text), "%.1f MS  %.0f FPS\nOBJECTS %u/%u\nOVERLAY %u TRIS, %u DRAW\nGPU %.1f MB, %u OBJECTS",
+        gFrameMs, gFrameMs > 0.0f ? 1000.0f / gFrameMs : 0.0f, (unsigned)nVisible, (unsigned)gScene.size(),
+        (unsigned)(gOverlay.nVertices / 3), gOverlay.nDrawCalls, memory.bytes / (1024.0 * 1024.0), (unsigned)memory.nObjects);
+    int nLines = 4;
+    if (!gCircleSim.x.empty() && length > 0 && length < (int)sizeof(text))
+    {
+        snprintf(text + length, sizeof(text) - length, "\nCIRCLES %u, %.2f MS", (unsigned)gCircleSim.x.size(),
+            gCircleSim.integrateMs + gCircleSim.sortMs + gCircleSim.collideMs);
+        ++nLines;
+    }
+    length = (int)strlen(text);
+    if (gDynamicResolution)
+    {
+        snprintf(text + length, sizeof(text) - length, "\nRES %dX%d %.0f%%, %.1f MS", gResolution.width, gResolution.height,
+            gResolution.scale * 100.0f, gResolution.frameMs);
+        ++nLines;
+    }
+    UFrameArenaStats arenaStats;
+    UGetFrameArenaStats(arenaStats);
+    length = (int)strlen(text);
+    snprintf(text + length, sizeof(text) - length, "\nHEAP %u ARENA %.1f/%.1fKB", (unsigned)gFrameHeapAllocations,
+        arenaStats.bytesUsed / 1024.0, arenaStats.peakBytes / 1024.0);
+    ++nLines;
+    UOverlayQuad(gOverlay, glm::vec2(8.0f, 8.0f), glm::vec2(8.0f + 27 * 12.0f + 8.0f, 8.0f + nLines * 16.0f + 8.0f), glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
+    UOverlayText(gOverlay, glm::vec2(16.0f, 16.0f), 2.0f, text, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+
+    if (gSelectedObject >= 0 && gSelectedObject < (int)gScene.size())
+        UOverlayText(gOverlay, glm::vec2(center.x + 16.0f, center.y + 16.0f), 2.0f, gScene[gSelectedObject].name.c_str(), glm::vec4(1.0f, 0.85f, 0.3f, 1.0f));
+
+    UFlushOverlay(gOverlay);
+}
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nBottleNeckVertices);
-    /////////////////////////////////
+// Renders the poses in gBatchFile with the scene as loaded; the main window stays hidden meanwhile
+bool URenderBatch(const char* vertexShader, const char* fragmentShader)
+{
+    vector<UBatchPose> poses;
+    if (!ULoadBatchPoses(gBatchFile, poses))
+        return false;
+    glfwHideWindow(gWindow);
 
-    ////Spatula Handle
-    //// ----------------------------------------------------
-    // Scale, rotate, and translate
-    glm::mat4 spatulaHandleScale = glm::scale(glm::vec3(0.35f, 3.0f, 0.35f));
-    glm::mat4 spatulaHandleRotation = glm::rotate(glm::radians(90.0f), glm::vec3(2.0, 0.0f, 0.0f));
-    glm::mat4 spatulaHandleRotation1 = glm::rotate(glm::radians(45.0f), glm::vec3(0.0, 0.0f, 2.0f));
-    glm::mat4 spatulaHandleTranslation = glm::translate(glm::vec3(-0.5f, -0.8f, 3.0f));
-    glm::mat4 spatulaHandleModel = spatulaHandleTranslation * spatulaHandleRotation * spatulaHandleRotation1 * spatulaHandleScale;
+    // Streamed textures and buffers must all be in place before other contexts read them
+    while (!UUploadsIdle(gUploadRing))
+    {
+        UPumpUploads(gUploadRing);
+        this_thread::yield();
+    }
 
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+    // The spot shadow doesn't depend on the camera, so one update serves every pose
+    glm::mat4 view = gCamera.GetViewMatrix();
+    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)gBatchWidth / (GLfloat)gBatchHeight, 0.1f, 100.0f);
+    UUpdateShadowMap(gShadowMap, gScene, gLightPosition, view, projection, 0.1f, 100.0f);
+
+    UBatchSettings settings;
+    settings.width = gBatchWidth;
+    settings.height = gBatchHeight;
+    settings.nRenderThreads = gBatchThreads;
+    settings.nEncodeThreads = gBatchEncoders > 0 ? gBatchEncoders : (int)thread::hardware_concurrency();
+    settings.outputDirectory = gBatchOutput;
+    settings.scene = &gScene;
+    settings.vertexShaderSource = vertexShader;
+    settings.fragmentShaderSource = fragmentShader;
+    settings.shadow = &gShadowMap;
+    settings.shadowTextureUnit = SHADOW_TEXTURE_UNIT;
+    settings.lightmap = gLightmapped ? &gLightmap : nullptr;
+    settings.lightmapVertexShaderSource = lightmapVertexShaderSource;
+    settings.lightmapFragmentShaderSource = lightmapFragmentShaderSource;
+    settings.lightmapTextureUnit = LIGHTMAP_TEXTURE_UNIT;
+    return UBatchRender(gWindow, poses, settings);
+}
 
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc1 = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc1 = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc1 = glGetUniformLocation(gProgramId, "projection");
+// Random bouncing circles, made with the Circle class and handed over to the simulation
+void UCreateCircles(int nCircles)
+{
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+    float aspect = framebufferHeight > 0 ? (float)framebufferWidth / framebufferHeight : (float)WINDOW_WIDTH / WINDOW_HEIGHT;
+    UCreateCircleSim(gCircleSim, glm::vec2(-aspect, -1.0f), glm::vec2(aspect, 1.0f));
+    srand(1);
+    for (int i = 0; i < nCircles; ++i)
+    {
+        float radius = 0.005f + 0.015f * rand() / RAND_MAX;
+        float x = -aspect + 2.0f * aspect * rand() / RAND_MAX;
+        float y = -1.0f + 2.0f * rand() / RAND_MAX;
+        Circle circle(x, y, radius, 1 + rand() % 8, radius, (float)rand() / RAND_MAX, (float)rand() / RAND_MAX, (float)rand() / RAND_MAX);
+        circle.AddTo(gCircleSim);
+    }
+    cout << "INFO: " << nCircles << " circles, " << (gCircleSim.useAvx2 ? "AVX2" : "scalar") << " update" << endl;
+}
 
-    glUniformMatrix4fv(modelLoc1, 1, GL_FALSE, glm::value_ptr(spatulaHandleModel));
-    glUniformMatrix4fv(viewLoc1, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc1, 1, GL_FALSE, glm::value_ptr(projection));
+// Places every object in the scene. Model matrix: transformations are applied right-to-left order
+void UCreateScene()
+{
+    UPROFILE_ZONE("Create scene");
+    gScene.clear();
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.spatulaHandleVao);
+    // Plane
+    glm::mat4 planeModel = glm::translate(glm::vec3(0.0f, 4.0f, 0.0f));
+    gScene.push_back({ "countertop", &gMesh.plane, gPlaneTexture, gUVScale, planeModel, true, false });
 
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gSpatulaTexture);
+    // Bottle
+    glm::mat4 bottleScale = glm::scale(glm::vec3(1.0f, 2.0f, 1.0f));
+    glm::mat4 bottleRotation = glm::rotate(-25.0f, glm::vec3(0.0, 1.0f, 0.0f));
+    glm::mat4 bottleTranslation = glm::translate(glm::vec3(-2.0f, 0.0f, -1.5f));
+    glm::mat4 bottleModel = bottleTranslation * bottleRotation * bottleScale;
+    gScene.push_back({ "bottle", &gMesh.cube, gBottleTexture, gUVScale, bottleModel, true, true });
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nSpatulaHandleVertices);
-    /////////////////////////
+    // Bottle Neck
+    glm::mat4 bottleNeckScale = glm::scale(glm::vec3(0.06f, 0.1f, 0.06f));
+    glm::mat4 bottleNeckRotation = glm::rotate(-25.0f, glm::vec3(0.0, 1.0f, 0.0f));
+    glm::mat4 bottleNeckTranslation = glm::translate(glm::vec3(-2.05f, 1.0f, -1.5f));
+    glm::mat4 bottleNeckModel = bottleNeckTranslation * bottleNeckRotation * bottleNeckScale;
+    gScene.push_back({ "bottleNeck", &gMesh.cylinder, gBottleNeckTexture, gUVScale, bottleNeckModel, true, true });
 
-    // Spatula Top
-    //----------------------------------------------------
-    // Scale, rotate, and translate
-    glm::mat4 spatulaTopScale = glm::scale(glm::vec3(1.0f, 1.5f, 0.2f));
-    glm::mat4 SpatulaTopRotation = glm::rotate(glm::radians(90.0f), glm::vec3(2.0, 0.0f, 0.0f));
-    glm::mat4 SpatulaTopRotation1 = glm::rotate(glm::radians(45.0f), glm::vec3(0.0, 0.0f, 2.0f));
-    glm::mat4 spatulaTopTranslation = glm::translate(glm::vec3(1.0f, -0.8f, 1.5f));
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 spatulaTopModel = spatulaTopTranslation * SpatulaTopRotation * SpatulaTopRotation1 * spatulaTopScale;
-
-    // Set the shader to be used
-    glUseProgram(gProgramId);
-
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc2 = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc2 = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc2 = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc2, 1, GL_FALSE, glm::value_ptr(spatulaTopModel));
-    glUniformMatrix4fv(viewLoc2, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc2, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.spatulaTopVao);
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gSpatulaTexture);
+    // Spatula Handle
+    glm::mat4 spatulaHandleScale = glm::scale(glm::vec3(0.35f, 3.0f, 0.35f));
+    glm::mat4 spatulaHandleRotation = glm::rotate(glm::radians(90.0f), glm::vec3(2.0, 0.0f, 0.0f));
+    glm::mat4 spatulaHandleRotation1 = glm::rotate(glm::radians(45.0f), glm::vec3(0.0, 0.0f, 2.0f));
+    glm::mat4 spatulaHandleTranslation = glm::translate(glm::vec3(-0.5f, -0.8f, 3.0f));
+    glm::mat4 spatulaHandleModel = spatulaHandleTranslation * spatulaHandleRotation * spatulaHandleRotation1 * spatulaHandleScale;
+    gScene.push_back({ "spatulaHandle", &gMesh.cube, gSpatulaTexture, gUVScale, spatulaHandleModel, true, true });
 
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nSpatulaTopVertices);
-    /////////////////////////
+    // Spatula Top
+    glm::mat4 spatulaTopScale = glm::scale(glm::vec3(1.0f, 1.5f, 0.2f));
+    glm::mat4 SpatulaTopRotation = glm::rotate(glm::radians(90.0f), glm::vec3(2.0, 0.0f, 0.0f));
+    glm::mat4 SpatulaTopRotation1 = glm::rotate(glm::radians(45.0f), glm::vec3(0.0, 0.0f, 2.0f));
+    glm::mat4 spatulaTopTranslation = glm::translate(glm::vec3(1.0f, -0.8f, 1.5f));
+    glm::mat4 spatulaTopModel = spatulaTopTranslation * SpatulaTopRotation * SpatulaTopRotation1 * spatulaTopScale;
+    gScene.push_back({ "spatulaTop", &gMesh.cube, gSpatulaTexture, gUVScale, spatulaTopModel, true, true });
 
     // Salt Shaker
-    //----------------------------------------------------
-    // Scale, rotate, and translate bottle neck
     glm::mat4 saltShakerScale = glm::scale(glm::vec3(0.1f, 0.1f, 0.1f));
     glm::mat4 saltShakerRotation = glm::rotate(-25.0f, glm::vec3(0.0, 1.0f, 0.0f));
     glm::mat4 saltShakerTranslation = glm::translate(glm::vec3(3.0f, -1.0f, -1.5f));
-    // Model matrix: transformations are applied right-to-left order
     glm::mat4 saltShakerModel = saltShakerTranslation * saltShakerRotation * saltShakerScale;
-
-    // Retrieves and passes transform matrices to the Shader program
-    GLint saltShakerModelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint saltShakerViewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint saltShakerProjLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(saltShakerModelLoc, 1, GL_FALSE, glm::value_ptr(saltShakerModel));
-    glUniformMatrix4fv(saltShakerViewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(saltShakerProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.saltShakerVao);
-    model = glm::mat4(1.0f);
-
-    // Bind textures
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gSaltShakerTexture);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nSaltShakerVertices);
-    /////////////////////////
+    gScene.push_back({ "saltShaker", &gMesh.cylinder, gSaltShakerTexture, gUVScale, saltShakerModel, true, true });
 
     // Pepper Shaker
-    //----------------------------------------------------
-    // Scale, rotate, and translate bottle neck
     glm::mat4 pepperShakerScale = glm::scale(glm::vec3(0.1f, 0.1f, 0.1f));
     glm::mat4 pepperShakerRotation = glm::rotate(-25.0f, glm::vec3(0.0, 1.0f, 0.0f));
     glm::mat4 pepperShakerTranslation = glm::translate(glm::vec3(2.5f, -1.0f, -3.0));
-    // Model matrix: transformations are applied right-to-left order
     glm::mat4 pepperShakerModel = pepperShakerTranslation * pepperShakerRotation * pepperShakerScale;
-
-    // Retrieves and passes transform matrices to the Shader program
-    GLint pepperShakerModelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint pepperShakerViewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint pepperShakerProjLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(pepperShakerModelLoc, 1, GL_FALSE, glm::value_ptr(pepperShakerModel));
-    glUniformMatrix4fv(pepperShakerViewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(pepperShakerProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.pepperShakerVao);
-    model = glm::mat4(1.0f);
-
-    // Bind textures
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gPepperShakerTexture);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nPepperShakerVertices);
-    /////////////////////////
+    gScene.push_back({ "pepperShaker", &gMesh.cylinder, gPepperShakerTexture, gUVScale, pepperShakerModel, true, true });
 
     // Pot Holder
-    //----------------------------------------------------
-    // Scale, rotate, and translate bottle neck
     glm::mat4 potHolderScale = glm::scale(glm::vec3(4.25f, 0.1f, 5.5f));
     glm::mat4 potHolderRotation = glm::rotate(45.0f, glm::vec3(0.0f, 1.0f, 0.0f));
     glm::mat4 potHolderTranslation = glm::translate(glm::vec3(0.5f, -1.0f, -1.0f));
     glm::mat4 potHolderModel = potHolderTranslation * potHolderRotation * potHolderScale;
+    gScene.push_back({ "potHolder", &gMesh.cube, gPotHolderTexture, gUVScale, potHolderModel, true, true });
 
-    // Retrieves and passes transform matrices to the Shader program
-    GLint potHoldermodelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint potHolderviewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint potHolderprojLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(potHoldermodelLoc, 1, GL_FALSE, glm::value_ptr(potHolderModel));
-    glUniformMatrix4fv(potHolderviewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(potHolderprojLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.potHolderVao);
-    model = glm::mat4(1.0f);
-    //bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gPotHolderTexture);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nPotHolderVertices);
-    ////////////////////////////
     // Lamp
-    /*glUseProgram(gLampProgramId);*/
-
     glm::mat4 lampModel = glm::translate(gLightPosition) * glm::scale(gLightScale);
+    gScene.push_back({ "lamp", &gMesh.lamp, gSaltShakerTexture, gUVScale, lampModel, true, false });
+
+    // Imported glTF assets take the place of the props; the countertop and lamp stay
+    if (!gGltfScene.objects.empty())
+    {
+        gScene.erase(remove_if(gScene.begin(), gScene.end(), [](const USceneObject& object)
+            {
+                return object.name != "countertop" && object.name != "lamp";
+            }), gScene.end());
+        gScene.insert(gScene.end(), gGltfScene.objects.begin(), gGltfScene.objects.end());
+    }
+}
 
-    // Reference matrix uniforms from the Lamp Shader program
-    GLint lampModelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint lampViewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint lampProjLoc = glGetUniformLocation(gProgramId, "projection");
+// Rebuilds gScene from gSceneFile (imported glTF assets are added on top) and invalidates only what
+// the changes touch: the lightmap is baked for one layout, the shadow cache compares transforms only
+void UApplyScene(bool reload)
+{
+    UPROFILE_ZONE("Apply scene file");
+    auto start = chrono::steady_clock::now();
+    USceneChanges changes;
+    UApplySceneFile(gSceneFile, gScene, changes);
+    gScene.insert(gScene.end(), gGltfScene.objects.begin(), gGltfScene.objects.end());
+
+    const USceneLight& light = gSceneFile.desc.light;
+    gLightPosition = light.position;
+    gLightColor = light.color;
+    gLightScale = light.scale;
+
+    if (changes.staticLayoutChanged)
+        gShadowMap.cachedStaticModels.clear();
+    if (gSelectedObject >= (int)gScene.size())
+        gSelectedObject = -1;
+    if (!reload || changes.camerasChanged)
+        UApplyCameraPreset(gCameraPreset);
+    if (!reload)
+        return;
+
+    // The lightmap meshes are indexed by scene position, so a dynamic object coming or going breaks them too
+    if (gLightmapped && (changes.staticLayoutChanged || changes.orderChanged || changes.lightChanged))
+    {
+        gLightmapped = false;
+        cout << "Baked lighting no longer matches the scene, lighting every object dynamically" << endl;
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "INFO: Reloaded " << gSceneFile.filename << " in " << ms << " ms: " << changes.nMoved << " changed, "
+        << changes.nAdded << " added, " << changes.nRemoved << " removed, " << changes.nTexturesLoaded << " textures and "
+        << changes.nMeshesLoaded << " meshes loaded" << endl;
+}
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(lampModelLoc, 1, GL_FALSE, glm::value_ptr(lampModel));
-    glUniformMatrix4fv(lampViewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(lampProjLoc, 1, GL_FALSE, glm::value_ptr(projection));
+// Puts the camera at a preset of the scene file; the first one when name is null
+void UApplyCameraPreset(const char* name)
+{
+    for (const USceneCamera& camera : gSceneFile.desc.cameras)
+    {
+        if (name && camera.name != name)
+            continue;
+        gCamera.Position = camera.position;
+        gCamera.Yaw = camera.yaw;
+        gCamera.Pitch = camera.pitch;
+        gCamera.Zoom = camera.zoom;
+        gCamera.ProcessMouseMovement(0.0f, 0.0f); // recomputes the camera vectors from yaw and pitch
+        ortho = camera.ortho;
+        return;
+    }
+    if (name)
+        cout << "No camera preset " << name << " in " << gSceneFile.filename << endl;
+}
 
-    glActiveTexture(GL_TEXTURE);
-    glBindTexture(GL_TEXTURE_2D, gSaltShakerTexture);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nLampVertices);
 
+// Builds the CPU side meshes of the built in props; the GL and software renderers both start from these
+void UCreateMeshData(UMeshData& plane, UMeshData& cube, UMeshData& cylinder, UMeshData& lamp)
+{
+    // Generated at compile time: already indexed, with normals and tangents for whoever wants them
+    static constexpr auto planeMesh = UMakePlane(10.0f, 10.0f, -5.0f, UUV_UNIT);
+    static constexpr auto cubeMesh = UMakeBox(1.0f, 1.0f, 1.0f, UUV_UNIT);
+    static constexpr auto cylinderMesh = UMakeCylinder<24, true>(4.0f, 10.0f, UUV_UNIT);
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    plane = UMeshDataFromStatic(planeMesh, false);
+    cube = UMeshDataFromStatic(cubeMesh, false);
+    cylinder = UMeshDataFromStatic(cylinderMesh, false);
 
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    // Lamp is the cube with normals (the only lit mesh), so it also gets tangents
+    lamp = UMeshDataFromStatic(cubeMesh, true);
 }
 
 // Implements the UCreateMesh function
 void UCreateTexturedMesh(GLMesh& mesh)
 {
+    UPROFILE_ZONE("Create meshes");
+    UCreateMeshData(gPlaneData, gCubeData, gCylinderData, gLampData);
+
+    // Converted assets (pack or ../meshes) win over the built in arrays, which are uploaded in the selected vertex format
+    if (!ULoadMesh("../meshes/plane.umesh", mesh.plane))
+        UCreateGpuMesh(gPlaneData, gVertexFormat, mesh.plane);
+    if (!ULoadMesh("../meshes/cube.umesh", mesh.cube))
+        UCreateGpuMesh(gCubeData, gVertexFormat, mesh.cube);
+    if (!ULoadMesh("../meshes/cylinder.umesh", mesh.cylinder))
+        UCreateGpuMesh(gCylinderData, gVertexFormat, mesh.cylinder);
+    if (!ULoadMesh("../meshes/lamp.umesh", mesh.lamp))
+        UCreateGpuMesh(gLampData, gVertexFormat, mesh.lamp);
+
+    GLsizeiptr vertexBytes = mesh.plane.vertexBytes + mesh.cube.vertexBytes + mesh.cylinder.vertexBytes + mesh.lamp.vertexBytes;
+    GLsizeiptr indexBytes = mesh.plane.indexBytes + mesh.cube.indexBytes + mesh.cylinder.indexBytes + mesh.lamp.indexBytes;
+    cout << "INFO: Mesh memory (" << (gVertexFormat == UVERTEX_COMPRESSED ? "compressed" : "float") << "): "
+         << vertexBytes << " vertex bytes, " << indexBytes << " index bytes" << endl;
+}
 
-    GLfloat planeVerts[] = {
-        // Vertex Positions    // Texture coordinates
-        -5.0f, -5.0f, -5.0f,   0.0f, 0.0f,
-         5.0f, -5.0f, -5.0f,   1.0f, 0.0f,
-         5.0f, -5.0f,  5.0f,   1.0f, 1.0f,
-         5.0f, -5.0f,  5.0f,   1.0f, 1.0f,
-        -5.0f, -5.0f,  5.0f,   0.0f, 1.0f,
-        -5.0f, -5.0f, -5.0f,   0.0f, 0.0f
-
-    };
-
-    GLfloat cubeVerts[] = {
-        // Vertex Positions    // Texture coordinates
-       -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-       -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-       -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-       -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-       -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-       -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-       -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-       -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-       -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-       -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-       -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-       -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-       -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-       -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-       -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-       -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-       -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-       -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-
-    };
-
-
-    GLfloat cylinderVerts[] = {
-        -3.0f, 0.0f,  3.0f,     0.0f, 0.0f,
-         0.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-         0.0f, 0.0f,  4.0f,     1.0f, 1.0f,
-         0.0f, 0.0f,  4.0f,     1.0f, 1.0f,
-         0.0f, 0.0f,  0.0f,     0.0f, 1.0f,
-         3.0f, 0.0f,  3.0f,     0.0f, 0.0f,
-         3.0f, 0.0f,  3.0f,     1.0f, 0.0f,
-         0.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-         4.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-         4.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-         0.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-         3.0f, 0.0f, -3.0f,     1.0f, 0.0f,
-         3.0f, 0.0f, -3.0f,     1.0f, 0.0f,
-         0.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-         0.0f, 0.0f, -4.0f,     1.0f, 0.0f,
-         0.0f, 0.0f, -4.0f,     1.0f, 0.0f,
-         0.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-        -3.0f, 0.0f, -3.0f,     1.0f, 0.0f,
-        -3.0f, 0.0f, -3.0f,     1.0f, 0.0f,
-         0.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-        -4.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-        -4.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-         0.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-        -3.0f, 0.0f,  3.0f,     1.0f, 0.0f,
-
-
-
-        -3.0f, 10.0f, 3.0f,     0.0f, 0.0f,
-        -3.0f, 0.0f,  3.0f,     1.0f, 0.0f,
-         0.0f, 0.0f,  4.0f,     1.0f, 1.0f,
-         0.0f, 0.0f,  4.0f,     1.0f, 1.0f,
-         0.0f, 10.0f, 4.0f,     0.0f, 1.0f,
-        -3.0f, 10.0f, 3.0f,     0.0f, 0.0f,
-
-         0.0f, 10.0f, 4.0f,     0.0f, 0.0f,
-         0.0f, 0.0f,  4.0f,     1.0f, 0.0f,
-         3.0f, 0.0f,  3.0f,     1.0f, 1.0f,
-         3.0f, 0.0f,  3.0f,     1.0f, 1.0f,
-         3.0f, 10.0f, 3.0f,     0.0f, 1.0f,
-         0.0f, 10.0f, 4.0f,     0.0f, 0.0f,
-
-         3.0f, 10.0f, 3.0f,     0.0f, 0.0f,
-         3.0f, 0.0f,  3.0f,     1.0f, 0.0f,
-         4.0f, 0.0f,  0.0f,     1.0f, 1.0f,
-         4.0f, 0.0f,  0.0f,     1.0f, 1.0f,
-         4.0f, 10.0f, 0.0f,     0.0f, 1.0f,
-         3.0f, 10.0f, 3.0f,     0.0f, 0.0f,
-
-         4.0f, 10.0f, 0.0f,     0.0f, 0.0f,
-         4.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-         3.0f, 0.0f,  -3.0f,    1.0f, 1.0f,
-         3.0f, 0.0f,  -3.0f,    1.0f, 1.0f,
-         3.0f, 10.0f, -3.0f,    0.0f, 1.0f,
-         4.0f, 10.0f,  0.0f,    0.0f, 0.0f,
-
-         3.0f, 10.0f, -3.0f,    0.0f, 0.0f,
-         3.0f, 0.0f,  -3.0f,    1.0f, 0.0f,
-         0.0f, 0.0f,  -4.0f,    1.0f, 1.0f,
-         0.0f, 0.0f,  -4.0f,    1.0f, 1.0f,
-         0.0f, 10.0f, -4.0f,    0.0f, 1.0f,
-         3.0f, 10.0f, -3.0f,    0.0f, 0.0f,
-
-         0.0f, 10.0f, -4.0f,    0.0f, 0.0f,
-         0.0f, 0.0f,  -4.0f,    1.0f, 0.0f,
-        -3.0f, 0.0f,  -3.0f,    1.0f, 1.0f,
-        -3.0f, 0.0f,  -3.0f,    1.0f, 1.0f,
-        -3.0f, 10.0f, -3.0f,    0.0f, 1.0f,
-         0.0f, 10.0f, -4.0f,    0.0f, 0.0f,
-
-        -3.0f, 10.0f, -3.0f,    0.0f, 0.0f,
-        -3.0f, 0.0f,  -3.0f,    1.0f, 0.0f,
-        -4.0f, 0.0f,  0.0f,     1.0f, 1.0f,
-        -4.0f, 0.0f,  0.0f,     1.0f, 1.0f,
-        -4.0f, 10.0f, 0.0f,     0.0f, 1.0f,
-        -3.0f, 10.0f, -3.0f,    0.0f, 0.0f,
-
-        -4.0f, 10.0f, 0.0f,     0.0f, 0.0f,
-        -4.0f, 0.0f,  0.0f,     1.0f, 0.0f,
-        -3.0f, 0.0f,  3.0f,     1.0f, 1.0f,
-        -3.0f, 0.0f,  3.0f,     1.0f, 1.0f,
-        -3.0f, 10.0f, 3.0f,     0.0f, 1.0f,
-        -4.0f, 10.0f, 0.0f,     0.0f, 0.0f,
-
-
-
-        -3.0f, 10.0f,  3.0f,     0.0f, 0.0f,
-         0.0f, 10.0f,  0.0f,     1.0f, 0.0f,
-         0.0f, 10.0f,  4.0f,     1.0f, 1.0f,
-         0.0f, 10.0f,  4.0f,     1.0f, 1.0f,
-         0.0f, 10.0f,  0.0f,     0.0f, 1.0f,
-         3.0f, 10.0f,  3.0f,     0.0f, 0.0f,
-         3.0f, 10.0f,  3.0f,     0.0f, 0.0f,
-         0.0f, 10.0f,  0.0f,     1.0f, 0.0f,
-         4.0f, 10.0f,  0.0f,     1.0f, 1.0f,
-         4.0f, 10.0f,  0.0f,     1.0f, 1.0f,
-         0.0f, 10.0f,  0.0f,     0.0f, 1.0f,
-         3.0f, 10.0f, -3.0f,     0.0f, 0.0f,
-         3.0f, 10.0f, -3.0f,     0.0f, 0.0f,
-         0.0f, 10.0f,  0.0f,     1.0f, 0.0f,
-         0.0f, 10.0f, -4.0f,     1.0f, 1.0f,
-         0.0f, 10.0f, -4.0f,     1.0f, 1.0f,
-         0.0f, 10.0f,  0.0f,     0.0f, 1.0f,
-        -3.0f, 10.0f, -3.0f,     0.0f, 0.0f,
-        -3.0f, 10.0f, -3.0f,     0.0f, 0.0f,
-         0.0f, 10.0f,  0.0f,     1.0f, 0.0f,
-        -4.0f, 10.0f,  0.0f,     1.0f, 1.0f,
-        -4.0f, 10.0f,  0.0f,     1.0f, 1.0f,
-         0.0f, 10.0f,  0.0f,     0.0f, 1.0f,
-        -3.0f, 10.0f,  3.0f,     0.0f, 0.0f,
-    };
-
-    // Position and Color data
-    GLfloat verts[] = {
-        //Positions          //Normals
-        // ------------------------------------------------------
-        //Back Face          //Negative Z Normal  Texture Coords.
-       -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
-        0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
-       -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 1.0f,
-       -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
-
-       //Front Face         //Positive Z Normal
-      -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f, 0.0f,
-       0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f, 0.0f,
-       0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f, 1.0f,
-       0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f, 1.0f,
-      -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f, 1.0f,
-      -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f, 0.0f,
-
-      //Left Face          //Negative X Normal
-     -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-     -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
-     -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-     -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-     -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
-     -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-
-     //Right Face         //Positive X Normal
-     0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-     0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
-     0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-     0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-     0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
-     0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-
-     //Bottom Face        //Negative Y Normal
-    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
-     0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f,
-     0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
-     0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
-
-    //Top Face           //Positive Y Normal
-   -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f,
-    0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f,
-    0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
-    0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
-   -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f,
-   -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f
-    };
-
-
-
-
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
-
-    // Strides between vertex coordinates 
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerUV);
-
-    // Plane
-    // --------------------------
-    mesh.nPlaneVertices = sizeof(planeVerts) / (sizeof(planeVerts[0]) * (floatsPerVertex + floatsPerUV));
-    glGenVertexArrays(1, &mesh.planeVao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.planeVao);
-
-    // Create VBO
-    glGenBuffers(1, &mesh.planeVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.planeVbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(planeVerts), planeVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
-    ////////////////////////////////
-
-    // Bottle
-    // --------------------------
-    mesh.nBottleVertices = sizeof(cubeVerts) / (sizeof(cubeVerts[0]) * (floatsPerVertex + floatsPerUV));
 
-    glGenVertexArrays(1, &mesh.bottleVao);
-    glBindVertexArray(mesh.bottleVao);
 
-    //Create VBO
-    glGenBuffers(1, &mesh.bottleVbos);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.bottleVbos);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVerts), cubeVerts, GL_STATIC_DRAW);
+// Paths are relative to the working directory; inside the pack the same asset is keyed without the leading "../"
+const char* UAssetPackName(const char* filename)
+{
+    return strncmp(filename, "../", 3) == 0 ? filename + 3 : filename;
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
+bool ULoadMesh(const char* filename, UGpuMesh& mesh)
+{
+    UPROFILE_ZONE_DETAIL("Load mesh", filename);
+    if (UCreateMeshFromPack(gAssetPack, UAssetPackName(filename), mesh))
+        return true;
+    return ULoadMeshFile(filename, mesh);
+}
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
-    /////////////////
+bool ULoadTexture(const char* filename, GLuint& textureId, int maxSize)
+{
+    UPROFILE_ZONE_DETAIL("Load texture", filename);
+    // Packed textures are already decoded, so they go up at the size they were packed at
+    if (UCreateTextureFromPack(gAssetPack, UAssetPackName(filename), textureId))
+        return true;
+    return UCreateTexture(filename, textureId, true, maxSize);
+}
 
-    // Bottleneck
-    // --------------------------
-    mesh.nBottleNeckVertices = sizeof(cylinderVerts) / (sizeof(cylinderVerts[0]) * (floatsPerVertex + floatsPerUV));
+// Share of the view an object's bounding box covers, 1 when it reaches behind the camera
+float UScreenCoverage(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& modelViewProjection)
+{
+    glm::vec2 ndcMin(1e30f), ndcMax(-1e30f);
+    int nBehind = 0;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        glm::vec4 p((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z, 1.0f);
+        glm::vec4 clip = modelViewProjection * p;
+        if (clip.w <= 1e-5f)
+        {
+            ++nBehind;
+            continue;
+        }
+        glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+    if (nBehind > 0)
+        return nBehind == 8 ? 0.0f : 1.0f;
+
+    ndcMin = glm::max(ndcMin, glm::vec2(-1.0f));
+    ndcMax = glm::min(ndcMax, glm::vec2(1.0f));
+    if (ndcMax.x <= ndcMin.x || ndcMax.y <= ndcMin.y)
+        return 0.0f;
+    return (ndcMax.x - ndcMin.x) * (ndcMax.y - ndcMin.y) * 0.25f;
+}
 
-    glGenVertexArrays(1, &mesh.bottleNeckVao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.bottleNeckVao);
+// Progressive textures load in order of how much of the starting view they cover; off screen ones go last
+void USetTexturePriorities(UProgressiveLoader& loader)
+{
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+    float aspect = framebufferHeight > 0 ? (GLfloat)framebufferWidth / (GLfloat)framebufferHeight : (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT;
+    glm::mat4 viewProjection = glm::perspective(glm::radians(gCamera.Zoom), aspect, 0.1f, 100.0f) * gCamera.GetViewMatrix();
 
+    for (UProgressiveTexture& texture : loader.textures)
+    {
+        texture.priority = 0.0f;
+        for (const USceneObject& object : gScene)
+        {
+            if (object.texture == texture.textureId && object.mesh)
+                texture.priority += UScreenCoverage(object.mesh->boundsMin, object.mesh->boundsMax, viewProjection * object.model);
+        }
+    }
+}
 
-    // Create VBO
-    glGenBuffers(1, &mesh.bottleNeckVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.bottleNeckVbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cylinderVerts), cylinderVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
+void UDestroyMesh(GLMesh& mesh)
+{
+    UDestroyGpuMesh(mesh.plane);
+    UDestroyGpuMesh(mesh.cube);
+    UDestroyGpuMesh(mesh.cylinder);
+    UDestroyGpuMesh(mesh.lamp);
+}
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
-    ////////////////////
 
-    // Spatula Handle
-    // --------------------------
-    mesh.nSpatulaHandleVertices = sizeof(cubeVerts) / (sizeof(cubeVerts[0]) * (floatsPerVertex + floatsPerUV));
+// The kitchen with CPU meshes and textures, for the renderers that run without GL
+struct USoftKitchen
+{
+    UMeshData plane, cube, cylinder, lamp;
+    std::vector<USoftTexture> textures;
+    USoftScene scene;       // points into the members above, so a kitchen must not be copied
+};
 
-    glGenVertexArrays(1, &mesh.spatulaHandleVao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.spatulaHandleVao);
+void UCreateSoftKitchen(USoftKitchen& kitchen, int width, int height)
+{
+    // Same meshes as the GL path, kept on the CPU
+    UCreateMeshData(kitchen.plane, kitchen.cube, kitchen.cylinder, kitchen.lamp);
+
+    // No GL here, so texture "ids" are just indices into the window's slot table; UCreateScene only
+    // copies them. Full size: the software images are references, not bound by the startup limits
+    const size_t nSlots = sizeof(TEXTURE_SLOTS) / sizeof(TEXTURE_SLOTS[0]);
+    kitchen.textures.assign(nSlots, USoftTexture());
+    for (size_t i = 0; i < nSlots; ++i)
+    {
+        *TEXTURE_SLOTS[i].id = (GLuint)i + 1;
+        int imageWidth, imageHeight, channels;
+        unsigned char* image = UDecodeImage(TEXTURE_SLOTS[i].filename, imageWidth, imageHeight, channels, true);
+        if (!image || !UCreateSoftTexture(image, imageWidth, imageHeight, channels, false, kitchen.textures[i]))
+        {
+            // Keep going with a white texture so a missing image does not fail a whole CI run
+            cout << "Failed to load texture " << TEXTURE_SLOTS[i].filename << ", using white" << endl;
+            const unsigned char white[4] = { 255, 255, 255, 255 };
+            UCreateSoftTexture(white, 1, 1, 4, false, kitchen.textures[i]);
+        }
+        stbi_image_free(image);
+    }
 
-    // Create VBO
-    glGenBuffers(1, &mesh.spatulaHandleVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.spatulaHandleVbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVerts), cubeVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    // Same placement as the window; GL mesh addresses map back to the CPU meshes
+    UCreateScene();
+    USoftScene& scene = kitchen.scene;
+    scene.objects.clear();
+    for (const USceneObject& object : gScene)
+    {
+        USoftObject softObject;
+        softObject.mesh = object.mesh == &gMesh.plane ? &kitchen.plane : object.mesh == &gMesh.cube ? &kitchen.cube
+            : object.mesh == &gMesh.cylinder ? &kitchen.cylinder : &kitchen.lamp;
+        softObject.texture = object.texture >= 1 && object.texture <= nSlots ? &kitchen.textures[object.texture - 1] : nullptr;
+        softObject.uvScale = object.uvScale;
+        softObject.model = object.model;
+        softObject.castsShadow = object.castsShadow;
+        scene.objects.push_back(softObject);
+    }
+    scene.view = gCamera.GetViewMatrix();
+    scene.projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)width / (GLfloat)height, 0.1f, 100.0f);
+    scene.viewPosition = gCamera.Position;
+    scene.lightPosition = gLightPosition;
+    scene.lightColor = gLightColor;
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
+// --size WxH, false when malformed
+bool UParseSize(const char* text, int& width, int& height)
+{
+    char* end;
+    width = (int)strtol(text, &end, 10);
+    height = *end == 'x' ? (int)strtol(end + 1, nullptr, 10) : 0;
+    return width > 0 && height > 0;
+}
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
-    /////////////////
+// Renders the kitchen on the CPU without a window or GL context:
+// --software-render out.png [--size WxH] [--threads N] [--frames N]
+int USoftwareRenderMain(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        cout << "Usage: " << argv[0] << " --software-render out.png [--size WxH] [--threads N] [--frames N]" << endl;
+        return EXIT_FAILURE;
+    }
+    const char* outputFile = argv[2];
+    int width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+    unsigned nThreads = 0;
+    int nFrames = 1;
+    bool validSize = true;
+    for (int i = 3; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            validSize = UParseSize(argv[++i], width, height);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            nThreads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            nFrames = atoi(argv[++i]);
+    }
+    if (!validSize || nFrames <= 0)
+    {
+        cout << "Invalid --size or --frames" << endl;
+        return EXIT_FAILURE;
+    }
 
-    // Spatula top
-    mesh.nSpatulaTopVertices = sizeof(cubeVerts) / (sizeof(cubeVerts[0]) * (floatsPerVertex + floatsPerUV));
+    USoftKitchen kitchen;
+    UCreateSoftKitchen(kitchen, width, height);
 
-    glGenVertexArrays(1, &mesh.spatulaTopVao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.spatulaTopVao);
+    USoftRasterizer rasterizer;
+    UCreateSoftRasterizer(rasterizer, nThreads);
+    USoftFrame frame;
+    UResizeSoftFrame(frame, width, height);
 
-    // Create VBO
-    glGenBuffers(1, &mesh.spatulaTopVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.spatulaTopVbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVerts), cubeVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    // Extra frames only measure speed; every frame renders the same image
+    double totalMs = 0.0;
+    for (int i = 0; i < nFrames; ++i)
+    {
+        URasterize(rasterizer, kitchen.scene, frame);
+        totalMs += frame.vertexMs + frame.setupMs + frame.rasterMs;
+    }
+    cout << "INFO: Software render " << width << "x" << height << " on " << rasterizer.nWorkers << " threads, "
+         << frame.nTriangles << " triangles: " << totalMs / nFrames << " ms/frame (vertices " << frame.vertexMs
+         << ", setup " << frame.setupMs << ", tiles " << frame.rasterMs << ")" << endl;
+    UDestroySoftRasterizer(rasterizer);
 
+    if (!UWritePng(outputFile, frame.color.data(), width, height, 4, true))
+        return EXIT_FAILURE;
+    cout << "Wrote " << outputFile << endl;
+    return EXIT_SUCCESS;
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
+// Ground truth for the GL lighting: progressive path tracing of the kitchen on every core
+// --path-trace out.png [--size WxH] [--threads N] [--spp N] [--bounces N]
+int UPathTraceMain(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        cout << "Usage: " << argv[0] << " --path-trace out.png [--size WxH] [--threads N] [--spp N] [--bounces N]" << endl;
+        return EXIT_FAILURE;
+    }
+    const char* outputFile = argv[2];
+    int width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+    unsigned nThreads = 0;
+    int nSamples = 64;
+    int maxBounces = 4;
+    bool validSize = true;
+    for (int i = 3; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            validSize = UParseSize(argv[++i], width, height);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            nThreads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--spp") == 0 && i + 1 < argc)
+            nSamples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bounces") == 0 && i + 1 < argc)
+            maxBounces = atoi(argv[++i]);
+    }
+    if (!validSize || nSamples <= 0 || maxBounces < 0)
+    {
+        cout << "Invalid --size, --spp or --bounces" << endl;
+        return EXIT_FAILURE;
+    }
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
-    /////////////////
+    USoftKitchen kitchen;
+    UCreateSoftKitchen(kitchen, width, height);
 
-    // Salt Shaker
-    // --------------------------
-    mesh.nSaltShakerVertices = sizeof(cylinderVerts) / (sizeof(cylinderVerts[0]) * (floatsPerVertex + floatsPerUV));
+    UBvh bvh;
+    UBuildBvh(kitchen.scene, bvh);
+    cout << "INFO: BVH over " << bvh.triangles.size() << " triangles built in " << bvh.buildMs << " ms ("
+         << bvh.nBinaryNodes << " binary nodes, " << bvh.nodes.size() << " 4 wide nodes)" << endl;
 
-    glGenVertexArrays(1, &mesh.saltShakerVao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.saltShakerVao);
+    UPathTracer tracer;
+    UCreatePathTracer(tracer, width, height, maxBounces, nThreads);
+    USoftFrame frame;
+    double totalMs = 0.0;
+    uint64_t totalRays = 0;
+    for (int i = 0; i < nSamples; ++i)
+    {
+        UTracePass(tracer, bvh, kitchen.scene);
+        totalMs += tracer.passMs;
+        totalRays += tracer.passRays;
 
+        // Progress with the running average written out, so a long render can be looked at early
+        if ((tracer.nSamples & (tracer.nSamples - 1)) == 0 || i == nSamples - 1)
+        {
+            cout << "INFO: " << tracer.nSamples << " spp, " << (double)width * height / (tracer.passMs * 1000.0)
+                 << " Msamples/s, " << tracer.passRays / (tracer.passMs * 1000.0) << " Mrays/s" << endl;
+            UResolvePathTracer(tracer, frame);
+            if (!UWritePng(outputFile, frame.color.data(), width, height, 4, true))
+                return EXIT_FAILURE;
+        }
+    }
+    cout << "INFO: Path traced " << width << "x" << height << " at " << nSamples << " spp on " << tracer.nThreads
+         << " threads in " << totalMs / 1000.0 << " s (" << (double)width * height * nSamples / (totalMs * 1000.0)
+         << " Msamples/s, " << totalRays / (totalMs * 1000.0) << " Mrays/s)" << endl;
+    cout << "Wrote " << outputFile << endl;
+    return EXIT_SUCCESS;
+}
 
-    // Create VBO
-    glGenBuffers(1, &mesh.saltShakerVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.saltShakerVbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cylinderVerts), cylinderVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+// Static objects of gScene that get a lightmap, with the CPU mesh each one was built from. The bake and
+// the window both build their atlas from this list, so their UVs agree. The lamp holds the light and
+// imported assets have no CPU mesh, so both stay dynamically lit.
+void UGetLightmapInputs(const UMeshData& plane, const UMeshData& cube, const UMeshData& cylinder, vector<ULightmapInput>& inputs)
+{
+    inputs.clear();
+    for (size_t i = 0; i < gScene.size(); ++i)
+    {
+        const USceneObject& object = gScene[i];
+        const UMeshData* data = object.mesh == &gMesh.plane ? &plane : object.mesh == &gMesh.cube ? &cube
+            : object.mesh == &gMesh.cylinder ? &cylinder : nullptr;
+        if (object.isStatic && data)
+            inputs.push_back({ i, data, object.model });
+    }
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
+// x,y,z,r,g,b
+bool UParseLight(const char* text, ULightmapLight& light)
+{
+    float values[6];
+    for (int i = 0; i < 6; ++i)
+    {
+        char* end;
+        values[i] = strtof(text, &end);
+        if (end == text || (i < 5 && *end != ','))
+            return false;
+        text = end + 1;
+    }
+    light.position = glm::vec3(values[0], values[1], values[2]);
+    light.color = glm::vec3(values[3], values[4], values[5]);
+    return true;
+}
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
-    ////////////////////
+// Bakes direct and bounced light of the static props for the window to sample:
+// --bake-lightmap [out.ulm] [--samples N] [--bounces N] [--threads N] [--light x,y,z,r,g,b]... [--preview out.png]
+int ULightmapBakeMain(int argc, char* argv[])
+{
+    const char* outputFile = LIGHTMAP_FILE;
+    const char* previewFile = nullptr;
+    int first = 2;
+    if (argc > 2 && strncmp(argv[2], "--", 2) != 0)
+        outputFile = argv[first++];
+
+    ULightmapBakeSettings settings;
+    settings.lights.push_back({ gLightPosition, gLightColor });
+    settings.nSamples = 256;
+    settings.maxBounces = 3;
+    settings.nThreads = 0;
+    bool valid = true;
+    for (int i = first; i < argc; ++i)
+    {
+        ULightmapLight light;
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            settings.nSamples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bounces") == 0 && i + 1 < argc)
+            settings.maxBounces = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            settings.nThreads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--light") == 0 && i + 1 < argc)
+        {
+            valid = valid && UParseLight(argv[++i], light);
+            settings.lights.push_back(light);
+        }
+        else if (strcmp(argv[i], "--preview") == 0 && i + 1 < argc)
+            previewFile = argv[++i];
+    }
+    if (!valid || settings.nSamples < 0 || settings.maxBounces < 0)
+    {
+        cout << "Usage: " << argv[0] << " --bake-lightmap [out.ulm] [--samples N] [--bounces N] [--threads N] [--light x,y,z,r,g,b]... [--preview out.png]" << endl;
+        return EXIT_FAILURE;
+    }
 
-    // Pepper Shaker
-    // --------------------------
-    mesh.nPepperShakerVertices = sizeof(cylinderVerts) / (sizeof(cylinderVerts[0]) * (floatsPerVertex + floatsPerUV));
+    // Same scene and meshes as the window
+    USoftKitchen kitchen;
+    UCreateSoftKitchen(kitchen, WINDOW_WIDTH, WINDOW_HEIGHT);
+    vector<ULightmapInput> inputs;
+    UGetLightmapInputs(kitchen.plane, kitchen.cube, kitchen.cylinder, inputs);
+
+    auto start = chrono::steady_clock::now();
+    ULightmapAtlas atlas;
+    UBuildLightmapAtlas(inputs, settings.lights.front(), LIGHTMAP_SIZE, atlas);
+    double atlasMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "INFO: Lightmap atlas " << LIGHTMAP_SIZE << "x" << LIGHTMAP_SIZE << ": " << inputs.size() << " objects, "
+         << atlas.nCharts << " charts, " << atlas.texelsPerUnit << " texels per unit in " << atlasMs << " ms" << endl;
+
+    // Every object occludes and bounces light, lightmapped or not
+    UBvh bvh;
+    UBuildBvh(kitchen.scene, bvh);
+
+    ULightmapBake bake;
+    UBakeLightmap(atlas, bvh, settings, bake);
+    cout << "INFO: Baked " << bake.nCoveredTexels << " texels with " << settings.lights.size() << " lights, " << settings.nSamples
+         << " samples and " << settings.maxBounces << " bounces (rasterize " << bake.rasterizeMs << " ms, lighting "
+         << bake.lightingMs << " ms, denoise and dilate " << bake.filterMs << " ms)" << endl;
+
+    if (!UWriteLightmapFile(outputFile, atlas, bake))
+        return EXIT_FAILURE;
+    cout << "Wrote " << outputFile << endl;
 
-    glGenVertexArrays(1, &mesh.pepperShakerVao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.pepperShakerVao);
+    // Clamped 8 bit copy for looking at the atlas
+    if (previewFile)
+    {
+        vector<unsigned char> pixels(bake.texels.size() * 3);
+        for (size_t i = 0; i < bake.texels.size(); ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+                pixels[i * 3 + c] = (unsigned char)(glm::clamp(bake.texels[i][c], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+        if (!UWritePng(previewFile, pixels.data(), bake.size, bake.size, 3, true))
+            return EXIT_FAILURE;
+        cout << "Wrote " << previewFile << endl;
+    }
+    return EXIT_SUCCESS;
+}
 
+// Microbenchmarks of the CPU work behind startup and the render loop; none of them needs a window
 
-    // Create VBO
-    glGenBuffers(1, &mesh.pepperShakerVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.pepperShakerVbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cylinderVerts), cylinderVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+// Row swap every texture goes through after decoding, on a square RGB image of the given side
+void UBenchFlipImage(UBenchmarkState& state)
+{
+    int side = (int)state.arg;
+    vector<unsigned char> image((size_t)side * side * 3);
+    for (size_t i = 0; i < image.size(); ++i)
+        image[i] = (unsigned char)i;
+    while (UKeepRunning(state))
+    {
+        flipImageVertically(image.data(), side, side, 3);
+        UDoNotOptimize(image[0]);
+    }
+    state.bytesPerIteration = image.size();
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
+// The startup decode of each of the kitchen's textures at its slot's maxSize, through the same path as
+// the loaders; the file stays mapped so after the first pass disk reads don't count
+void UBenchDecodeTexture(UBenchmarkState& state)
+{
+    const UTextureSlot& slot = TEXTURE_SLOTS[state.arg % (sizeof(TEXTURE_SLOTS) / sizeof(TEXTURE_SLOTS[0]))];
+    UMappedFile file;
+    if (!UMapFile(slot.filename, file))
+    {
+        state.skipped = true;
+        state.label = string("missing ") + slot.filename;
+        return;
+    }
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
-    ////////////////////
+    vector<unsigned char> pixels;
+    int width = 0, height = 0, channels = 0, scale = 1;
+    while (UKeepRunning(state))
+    {
+        if (!UDecodeTexturePixelsFromMemory(file.data, file.size, slot.filename, slot.maxSize, true, pixels, width, height, channels, scale))
+        {
+            state.skipped = true;
+            state.label = string("can't decode ") + slot.filename;
+            UUnmapFile(file);
+            return;
+        }
+        UDoNotOptimize(pixels[0]);
+    }
+    state.itemsPerIteration = (size_t)width * height;
+    state.label = string(slot.filename) + " " + to_string(width) + "x" + to_string(height) + (scale > 1 ? " at 1/" + to_string(scale) : "");
+    UUnmapFile(file);
+}
 
-    // PotHolder
-    mesh.nPotHolderVertices = sizeof(cubeVerts) / (sizeof(cubeVerts[0]) * (floatsPerVertex + floatsPerUV));
+// The reduced size decode of UCreateTexture on the largest prop photo, at 1/arg size
+void UBenchDecodeTextureScaled(UBenchmarkState& state)
+{
+    const char* filename = "../images/potHolder.jpg";
+    UMappedFile file;
+    if (!UMapFile(filename, file))
+    {
+        state.skipped = true;
+        state.label = string("missing ") + filename;
+        return;
+    }
 
-    glGenVertexArrays(1, &mesh.potHolderVao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.potHolderVao);
+    UJpegImage image;
+    while (UKeepRunning(state))
+    {
+        if (!UDecodeJpeg(file.data, file.size, (int)state.arg, true, image))
+        {
+            state.skipped = true;
+            state.label = string("can't decode ") + filename;
+            UUnmapFile(file);
+            return;
+        }
+        UDoNotOptimize(image.pixels[0]);
+    }
+    state.itemsPerIteration = (size_t)image.width * image.height;
+    state.label = string(filename) + " " + to_string(image.width) + "x" + to_string(image.height);
+    UUnmapFile(file);
+}
 
+// Per object matrix work of URender's scene pass: dequantized model matrix and normal matrix
+void UBenchComposeTransforms(UBenchmarkState& state)
+{
+    size_t nObjects = (size_t)state.arg;
+    vector<glm::mat4> models(nObjects);
+    for (size_t i = 0; i < nObjects; ++i)
+    {
+        float t = (float)i;
+        models[i] = glm::translate(glm::vec3(sin(t), 0.1f * (i % 7), cos(t)))
+            * glm::rotate(t * 0.37f, glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f)))
+            * glm::scale(glm::vec3(1.0f + 0.01f * (i % 13)));
+    }
+    glm::mat4 dequantize = glm::translate(glm::vec3(-0.5f)) * glm::scale(glm::vec3(1.0f / 65535.0f));
+    vector<glm::mat4> finalModels(nObjects);
+    vector<glm::mat3> normalMatrices(nObjects);
+    while (UKeepRunning(state))
+    {
+        for (size_t i = 0; i < nObjects; ++i)
+        {
+            finalModels[i] = models[i] * dequantize;
+            normalMatrices[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+        }
+        UDoNotOptimize(finalModels[0]);
+        UDoNotOptimize(normalMatrices[0]);
+    }
+    state.itemsPerIteration = nObjects;
+}
 
-    // Create VBO
-    glGenBuffers(1, &mesh.potHolderVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.potHolderVbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVerts), cubeVerts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+// Built in meshes expanded to vertex arrays, as UCreateTexturedMesh starts with
+void UBenchCreateMeshData(UBenchmarkState& state)
+{
+    size_t nVertices = 0;
+    while (UKeepRunning(state))
+    {
+        UMeshData plane, cube, cylinder, lamp;
+        UCreateMeshData(plane, cube, cylinder, lamp);
+        nVertices = plane.positions.size() + cube.positions.size() + cylinder.positions.size() + lamp.positions.size();
+        UDoNotOptimize(nVertices);
+    }
+    state.itemsPerIteration = nVertices;
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
+// Those arrays packed into the bytes UCreateGpuMesh uploads; arg is the UVertexFormat
+void UBenchPackMeshes(UBenchmarkState& state)
+{
+    UVertexFormat format = state.arg == UVERTEX_FLOAT ? UVERTEX_FLOAT : UVERTEX_COMPRESSED;
+    UMeshData meshes[4];
+    UCreateMeshData(meshes[0], meshes[1], meshes[2], meshes[3]);
+    size_t nVertices = 0, nBytes = 0;
+    for (const UMeshData& mesh : meshes)
+        nVertices += mesh.positions.size();
+
+    UPackedMesh packed;
+    while (UKeepRunning(state))
+    {
+        nBytes = 0;
+        for (const UMeshData& mesh : meshes)
+        {
+            UPackMesh(mesh, format, packed);
+            nBytes += packed.vertices.size() + packed.indices.size();
+        }
+        UDoNotOptimize(nBytes);
+    }
+    state.itemsPerIteration = nVertices;
+    state.label = format == UVERTEX_FLOAT ? "float" : "compressed";
+}
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(2);
+// Circle::DrawCircle turning circles into overlay triangles, at HUD sized radii
+void UBenchDrawCircles(UBenchmarkState& state)
+{
+    vector<Circle> circles;
+    for (int64_t i = 0; i < state.arg; ++i)
+    {
+        float t = (float)i;
+        float radius = 0.01f + 0.01f * (i % 5);
+        circles.push_back(Circle(sin(t * 1.3f), cos(t * 0.7f), radius, 1 + (int)(i % 8), radius, 1.0f, 0.5f, 0.25f));
+    }
+    UOverlay overlay = UOverlay();
+    UCreateOverlayTables(overlay);
+    while (UKeepRunning(state))
+    {
+        UBeginOverlay(overlay, WINDOW_WIDTH, WINDOW_HEIGHT);
+        for (Circle& circle : circles)
+            circle.DrawCircle(overlay);
+        UDoNotOptimize(overlay.vertices.back());
+    }
+    state.itemsPerIteration = circles.size();
+}
 
-    // Lamp 1
-    
-    mesh.nLampVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+int UBenchmarkMain(int argc, char* argv[])
+{
+    const vector<UBenchmark> benchmarks = {
+        { "FlipImageVertically", UBenchFlipImage, { 256, 1024, 2048, 4096 } },
+        { "DecodeTexture", UBenchDecodeTexture, { 0, 1, 2, 3, 4, 5, 6, 7 } },
+        { "DecodeTextureScaled", UBenchDecodeTextureScaled, { 1, 2, 4, 8 } },
+        { "ComposeTransforms", UBenchComposeTransforms, { 1000, 10000, 100000, 1000000 } },
+        { "CreateMeshData", UBenchCreateMeshData, {} },
+        { "PackMeshes", UBenchPackMeshes, { UVERTEX_FLOAT, UVERTEX_COMPRESSED } },
+        { "DrawCircles", UBenchDrawCircles, { 1000, 10000, 100000 } },
+    };
+    return URunBenchmarks(benchmarks, argc, argv);
+}
 
-    glGenVertexArrays(1, &mesh.lampVao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.lampVao);
+/*Generate and load the texture*/
+bool UCreateTexture(const char* filename, GLuint& textureId, bool flipVertically, int maxSize)
+{
+    // A large JPEG is decoded at reduced size straight from the file's pages, anything else by stb
+    if (maxSize > 0)
+    {
+        UMappedFile file;
+        if (UMapFile(filename, file))
+        {
+            UJpegImage scaled;
+            bool decoded = UDecodeScaledJpeg(file.data, file.size, maxSize, flipVertically, filename, scaled);
+            UUnmapFile(file);
+            if (decoded)
+            {
+                cout << "INFO: Decoded " << filename << " at 1/" << scaled.scale << " (" << scaled.width << "x" << scaled.height << ")" << endl;
+                return UCreateTextureFromPixels(scaled.pixels.data(), scaled.width, scaled.height, scaled.channels, textureId, false, filename);
+            }
+        }
+    }
 
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.lampVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.lampVbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    int width, height, channels;
+    unsigned char* image = UDecodeImage(filename, width, height, channels, flipVertically);
+    if (image)
+    {
+        bool created = UCreateTextureFromPixels(image, width, height, channels, textureId, false, filename);
+        stbi_image_free(image);
+        return created;
+    }
 
-    GLint stride1 = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
+    // Error loading the image
+    return false;
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride1, 0);
-    glEnableVertexAttribArray(0);
+/*Decode an image file to pixels in GL row order, free with stbi_image_free*/
+unsigned char* UDecodeImage(const char* filename, int& width, int& height, int& channels, bool flipVertically)
+{
+    UPROFILE_ZONE_DETAIL("Decode image", filename);
+    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
+    if (image && flipVertically)
+        flipImageVertically(image, width, height, channels);
+    return image;
+}
 
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride1, (void*)(sizeof(float)* floatsPerVertex));
-    glEnableVertexAttribArray(1);
+/*Decode a JPEG larger than maxSize at the smallest of 1/2, 1/4 and 1/8 size that fits, using only the
+ *low frequency DCT coefficients of each block; false when it fits already or isn't a JPEG we handle.
+ *Runs on the texture loader threads too, so the callers report image.scale*/
+bool UDecodeScaledJpeg(const unsigned char* data, size_t size, int maxSize, bool flipVertically, const char* label, UJpegImage& image)
+{
+    int width, height;
+    if (maxSize <= 0 || !UReadJpegSize(data, size, width, height) || (width <= maxSize && height <= maxSize))
+        return false;
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride1, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+    UPROFILE_ZONE_DETAIL("Decode scaled JPEG", label);
+    int scale = UChooseJpegScale(width, height, maxSize);
+    return UDecodeJpeg(data, size, scale, flipVertically, image);
 }
 
+/*Decode an image file for any thread: reduced size when it is a JPEG larger than maxSize, else through stb*/
+bool UDecodeTexturePixels(const char* filename, int maxSize, bool flipVertically, vector<unsigned char>& pixels, int& width, int& height, int& channels, int& scale)
+{
+    UMappedFile file;
+    if (!UMapFile(filename, file))
+        return false;
 
+    bool decoded = UDecodeTexturePixelsFromMemory(file.data, file.size, filename, maxSize, flipVertically, pixels, width, height, channels, scale);
+    UUnmapFile(file);
+    return decoded;
+}
 
-void UDestroyMesh(GLMesh& mesh)
+bool UDecodeTexturePixelsFromMemory(const unsigned char* data, size_t size, const char* label, int maxSize, bool flipVertically,
+    vector<unsigned char>& pixels, int& width, int& height, int& channels, int& scale)
 {
-    glDeleteVertexArrays(1, &mesh.planeVao);
-    glDeleteBuffers(1, &mesh.planeVbo);
+    UJpegImage scaled;
+    bool decoded = UDecodeScaledJpeg(data, size, maxSize, flipVertically, label, scaled);
+    scale = decoded ? scaled.scale : 1;
+    if (decoded)
+    {
+        pixels.swap(scaled.pixels);
+        width = scaled.width;
+        height = scaled.height;
+        channels = scaled.channels;
+    }
+    else
+    {
+        UPROFILE_ZONE_DETAIL("Decode image", label);
+        unsigned char* image = stbi_load_from_memory(data, (int)size, &width, &height, &channels, 0);
+        if (image)
+        {
+            if (flipVertically)
+                flipImageVertically(image, width, height, channels);
+            pixels.assign(image, image + (size_t)width * height * channels);
+            stbi_image_free(image);
+            decoded = true;
+        }
+    }
+    return decoded;
+}
 
-    glDeleteVertexArrays(1, &mesh.bottleVao);
-    glDeleteBuffers(2, &mesh.bottleVbos);
+/*Generate a texture from an encoded image (jpg, png...) already in memory*/
+bool UCreateTextureFromMemory(const unsigned char* data, size_t size, GLuint& textureId, bool flipVertically, int maxSize)
+{
+    UJpegImage scaled;
+    if (UDecodeScaledJpeg(data, size, maxSize, flipVertically, "embedded image", scaled))
+    {
+        cout << "INFO: Decoded embedded image at 1/" << scaled.scale << " (" << scaled.width << "x" << scaled.height << ")" << endl;
+        return UCreateTextureFromPixels(scaled.pixels.data(), scaled.width, scaled.height, scaled.channels, textureId, false, "embedded image");
+    }
 
-    glDeleteVertexArrays(1, &mesh.bottleNeckVao);
-    glDeleteBuffers(1, &mesh.bottleNeckVbo);
+    int width, height, channels;
+    unsigned char* image;
+    {
+        UPROFILE_ZONE("Decode image");
+        image = stbi_load_from_memory(data, (int)size, &width, &height, &channels, 0);
+    }
+    if (image)
+    {
+        bool created = UCreateTextureFromPixels(image, width, height, channels, textureId, flipVertically, "embedded image");
+        stbi_image_free(image);
+        return created;
+    }
 
-    glDeleteVertexArrays(1, &mesh.spatulaHandleVao);
-    glDeleteBuffers(1, &mesh.spatulaHandleVbo);
+    // Error decoding the image
+    return false;
+}
 
-    glDeleteVertexArrays(1, &mesh.lampVao);
-    glDeleteBuffers(1, &mesh.lampVbo);
+/*1x1 texture of a single color, for materials without an image*/
+bool UCreateSolidTexture(const glm::vec4& color, GLuint& textureId)
+{
+    unsigned char pixel[4];
+    for (int i = 0; i < 4; ++i)
+        pixel[i] = (unsigned char)(glm::clamp(color[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+    return UCreateTextureFromPixels(pixel, 1, 1, 4, textureId, false, "solid color");
 }
 
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
+bool UCreateTextureFromPixels(unsigned char* image, int width, int height, int channels, GLuint& textureId, bool flipVertically, const char* label)
 {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
+    UPROFILE_ZONE_DETAIL("Upload texture", label);
+    if (channels != 3 && channels != 4)
     {
-        flipImageVertically(image, width, height, channels);
+        cout << "Not implemented to handle image with " << channels << " channels" << endl;
+        return false;
+    }
 
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
+    if (flipVertically)
+        flipImageVertically(image, width, height, channels);
 
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    textureId = UGenGpuObject(UGPU_TEXTURE, UGPU_MATERIALS, label);
+    glBindTexture(GL_TEXTURE_2D, textureId);
 
+    // set the texture wrapping parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // set texture filtering parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
-        {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
-        }
 
-        glGenerateMipmap(GL_TEXTURE_2D);
+    // Rows are tightly packed, and RGB widths (bottleTop's, most reduced decodes) aren't multiples of 4
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (channels == 3)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+    glGenerateMipmap(GL_TEXTURE_2D);
 
-        return true;
-    }
+    glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+    // RGB8 is stored as 4 bytes a texel by most drivers
+    USetGpuObjectBytes(UGPU_TEXTURE, textureId, UEstimateTextureBytes(width, height, 1, 4, true));
 
-    // Error loading the image
-    return false;
+    return true;
 }
 
 void UDestroyTexture(GLuint textureId)
 {
-    glGenTextures(1, &textureId);
+    UDeleteGpuObject(UGPU_TEXTURE, textureId);
 }
 
 // Implements the UCreateShaders function
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
 {
+    UPROFILE_ZONE("Compile shader program");
     // Compilation and linkage error reporting
     int success = 0;
     char infoLog[512];
 
     // Create a Shader program object.
-    programId = glCreateProgram();
+    programId = UGenGpuObject(UGPU_PROGRAM, UGPU_SHADERS, "shader program");
 
     // Create the vertex and fragment shader objects
     GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
@@ -1254,6 +2237,9 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
         glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
         std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
 
+        glDeleteShader(vertexShaderId);
+        glDeleteShader(fragmentShaderId);
+        UDestroyShaderProgram(programId);
         return false;
     }
 
@@ -1265,6 +2251,9 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
         glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
         std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
 
+        glDeleteShader(vertexShaderId);
+        glDeleteShader(fragmentShaderId);
+        UDestroyShaderProgram(programId);
         return false;
     }
 
@@ -1273,6 +2262,9 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
     glAttachShader(programId, fragmentShaderId);
 
     glLinkProgram(programId);   // links the shader program
+    // The program keeps the shaders alive as long as it needs them
+    glDeleteShader(vertexShaderId);
+    glDeleteShader(fragmentShaderId);
     // check for linking errors
     glGetProgramiv(programId, GL_LINK_STATUS, &success);
     if (!success)
@@ -1280,6 +2272,7 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
         glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
         std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
 
+        UDestroyShaderProgram(programId);
         return false;
     }
 
@@ -1288,15 +2281,56 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
     return true;
 }
 
+// Same for a single compute shader
+bool UCreateComputeProgram(const char* computeShaderSource, GLuint& programId)
+{
+    UPROFILE_ZONE("Compile compute program");
+    int success = 0;
+    char infoLog[512];
+
+    programId = UGenGpuObject(UGPU_PROGRAM, UGPU_SHADERS, "compute program");
+    GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeShaderId, 1, &computeShaderSource, NULL);
+
+    glCompileShader(computeShaderId);
+    glGetShaderiv(computeShaderId, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(computeShaderId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+
+        glDeleteShader(computeShaderId);
+        UDestroyShaderProgram(programId);
+        return false;
+    }
+
+    glAttachShader(programId, computeShaderId);
+    glLinkProgram(programId);
+    glDeleteShader(computeShaderId); // the program keeps it alive
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+
+        UDestroyShaderProgram(programId);
+        return false;
+    }
+
+    return true;
+}
+
 
 void UDestroyShaderProgram(GLuint programId)
 {
-    glDeleteProgram(programId);
+    UDeleteGpuObject(UGPU_PROGRAM, programId);
 }
 
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
+    UPROFILE_ZONE("Create window");
+
     // GLFW: initialize and configure
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -1346,40 +2380,51 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 // Process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 void UProcessInput(GLFWwindow* window)
 {
+    UPROFILE_ZONE("Input");
     static const float cameraSpeed = 2.5f;
 
-    // Terminates program if escape pressed 
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    // One snapshot of the keys per frame, which the input journal records or replaces
+    uint32_t keys = 0;
+    for (uint32_t i = 0; i < N_JOURNAL_KEYS; ++i)
+    {
+        if (glfwGetKey(window, JOURNAL_KEYS[i]) == GLFW_PRESS)
+            keys |= 1u << i;
+    }
+    bool liveEscape = (keys & 1u) != 0;
+    keys = UJournalKeys(gJournal, keys);
+
+    // Terminates program if escape pressed (a live escape also stops a replay)
+    if (UKeyDown(keys, GLFW_KEY_ESCAPE) || liveEscape)
         glfwSetWindowShouldClose(window, true);
 
     // Moves left, right, forward, and backward
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    if (UKeyDown(keys, GLFW_KEY_W))
         gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    if (UKeyDown(keys, GLFW_KEY_S))
         gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    if (UKeyDown(keys, GLFW_KEY_A))
         gCamera.ProcessKeyboard(LEFT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    if (UKeyDown(keys, GLFW_KEY_D))
         gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
 
     // Moves camera up and down
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
+    if (UKeyDown(keys, GLFW_KEY_E)) {
         gCamera.ProcessKeyboard(UP, gDeltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {
+    if (UKeyDown(keys, GLFW_KEY_Q)) {
         gCamera.ProcessKeyboard(DOWN, gDeltaTime);
     }
 
     // Changes orthographic/perspective camera view
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
+    if (UKeyDown(keys, GLFW_KEY_O)) {
         ortho = true;
     }
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
+    if (UKeyDown(keys, GLFW_KEY_P)) {
         ortho = false;
     }
 
     //reset camera to default speed and setting
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
+    if (UKeyDown(keys, GLFW_KEY_SPACE)) {
         gCamera = glm::vec3(0.0f, 0.0f, 3.0f);
         //cameraSpeed = 2.5f;
     }
@@ -1388,6 +2433,38 @@ void UProcessInput(GLFWwindow* window)
 }
 
 
+// Whether a tracked key is held in a key snapshot
+bool UKeyDown(uint32_t keys, int key)
+{
+    for (uint32_t i = 0; i < N_JOURNAL_KEYS; ++i)
+    {
+        if (JOURNAL_KEYS[i] == key)
+            return (keys & 1u << i) != 0;
+    }
+    return false;
+}
+
+
+// Feeds a replayed frame's mouse events through the GLFW handlers, in the order they were recorded
+void UReplayJournalEvents(GLFWwindow* window)
+{
+    if (gJournal.mode != UJOURNAL_REPLAY)
+        return;
+
+    gJournal.dispatching = true;
+    for (const UInputEvent& event : gJournal.frame.events)
+    {
+        if (event.type == UINPUT_CURSOR)
+            UMousePositionCallback(window, event.x, event.y);
+        else if (event.type == UINPUT_SCROLL)
+            UMouseScrollCallback(window, event.x, event.y);
+        else if (event.type == UINPUT_BUTTON)
+            UMouseButtonCallback(window, event.button, event.action, 0);
+    }
+    gJournal.dispatching = false;
+}
+
+
 // GLFW: Whenever the window size changed (by OS or user resize) this callback function executes
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
@@ -1398,6 +2475,9 @@ void UResizeWindow(GLFWwindow* window, int width, int height)
 // GLFW: whenever the mouse moves, this callback is called
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 {
+    if (!UJournalCursor(gJournal, xpos, ypos))
+        return;
+
     if (gFirstMouse)
     {
         gLastX = xpos;
@@ -1418,19 +2498,33 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 // GLFW: whenever the mouse scroll wheel scrolls, this callback is called
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
+    if (!UJournalScroll(gJournal, xoffset, yoffset))
+        return;
+
     gCamera.ProcessMouseScroll(yoffset);
 }
 
 // GLFW: handle mouse button events
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
+    if (!UJournalButton(gJournal, button, action))
+        return;
+
     switch (button)
     {
         // Left mouse button clicked 
     case GLFW_MOUSE_BUTTON_LEFT:
     {
         if (action == GLFW_PRESS)
+        {
             cout << "Left mouse button pressed" << endl;
+
+            // The cursor is captured by the camera, so picks go through the middle of the window
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            if (gPicking)
+                URequestPick(gPicker, width / 2, height / 2);
+        }
         else
             cout << "Left mouse button released" << endl;
     }
@@ -0,0 +1,437 @@
+#include <iostream>     // cout, cerr
+#include <cstring>      // memcpy
+#include <utility>      // move
+#include "UploadRing.h"
+#include "Profiler.h"
+#include "stb_image.h"  // Image loading utility functions
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    // glTexSubImage2D/glCopyBufferSubData offsets stay aligned for every format we upload
+    const size_t RING_ALIGNMENT = 16;
+
+    size_t UAlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Reserves bytes of contiguous ring space, waiting for the render thread to recycle space
+    // when the ring is full. Returns false when the ring is shutting down. Called with the lock held.
+    bool UAllocateRing(UUploadRing& ring, unique_lock<mutex>& lock, size_t bytes, size_t& offset, size_t& ringBytes)
+    {
+        bytes = UAlignUp(bytes, RING_ALIGNMENT);
+        while (!ring.quit)
+        {
+            if (ring.used == 0)
+                ring.head = ring.tail = 0;
+
+            // head == tail with used > 0 is a full ring; neither branch applies and we wait
+            if (ring.head > ring.tail || ring.used == 0)
+            {
+                // Free space is [head, size) and [0, tail)
+                if (ring.size - ring.head >= bytes)
+                {
+                    offset = ring.head;
+                    ringBytes = bytes;
+                    break;
+                }
+                if (ring.tail >= bytes)
+                {
+                    // Wrap; the unused end is released together with this allocation
+                    offset = 0;
+                    ringBytes = ring.size - ring.head + bytes;
+                    break;
+                }
+            }
+            else if (ring.head < ring.tail && ring.tail - ring.head >= bytes)
+            {
+                offset = ring.head;
+                ringBytes = bytes;
+                break;
+            }
+            ring.spaceFreed.wait(lock);
+        }
+        if (ring.quit)
+            return false;
+
+        ring.head = offset + bytes;
+        ring.used += ringBytes;
+        return true;
+    }
+
+    void UPushCommand(UUploadRing& ring, UUploadCommand command)
+    {
+        lock_guard<mutex> lock(ring.mutex);
+        ring.commands.push_back(move(command));
+    }
+
+    void URunTextureJob(UUploadRing& ring, const UUploadJob& job)
+    {
+        UPROFILE_ZONE_DETAIL("Stream texture", job.filename.c_str());
+        UUploadCommand command = UUploadCommand();
+        command.target = job.target;
+        command.name = job.filename;
+
+        int width, height, channels;
+        unsigned char* image = stbi_load(job.filename.c_str(), &width, &height, &channels, 0);
+        if (!image || (channels != 3 && channels != 4))
+        {
+            if (image)
+                stbi_image_free(image);
+            command.type = UUploadCommand::FAILED;
+            UPushCommand(ring, command);
+            return;
+        }
+
+        command.type = UUploadCommand::CREATE_TEXTURE;
+        command.width = width;
+        command.height = height;
+        command.channels = channels;
+        UPushCommand(ring, command);
+
+        // A single row wider than a piece may be would wait for ring space forever; such images
+        // skip the ring and go up straight from memory
+        size_t rowBytes = (size_t)width * channels;
+        if (rowBytes > ring.chunkBytes)
+        {
+            command.type = UUploadCommand::TEXTURE_DIRECT;
+            command.firstRow = 0;
+            command.nRows = height;
+            command.bytes = (size_t)height * rowBytes;
+            command.last = true;
+            command.pixels.resize(command.bytes);
+            for (int row = 0; row < height; ++row)
+            {
+                int sourceRow = job.flipVertically ? height - 1 - row : row;
+                memcpy(command.pixels.data() + row * rowBytes, image + (size_t)sourceRow * rowBytes, rowBytes);
+            }
+            stbi_image_free(image);
+            UPushCommand(ring, move(command));
+            return;
+        }
+
+        // Whole rows per piece, each piece no bigger than the chunk size
+        int rowsPerPiece = (int)(ring.chunkBytes / rowBytes);
+
+        for (int firstRow = 0; firstRow < height; firstRow += rowsPerPiece)
+        {
+            int nRows = height - firstRow < rowsPerPiece ? height - firstRow : rowsPerPiece;
+            size_t offset, ringBytes;
+            {
+                unique_lock<mutex> lock(ring.mutex);
+                if (!UAllocateRing(ring, lock, nRows * rowBytes, offset, ringBytes))
+                    break;
+            }
+
+            // Copy (and flip) outside the lock; the render thread won't touch this range until the command is queued
+            for (int row = 0; row < nRows; ++row)
+            {
+                int glRow = firstRow + row;
+                int sourceRow = job.flipVertically ? height - 1 - glRow : glRow;
+                memcpy(ring.mapped + offset + row * rowBytes, image + (size_t)sourceRow * rowBytes, rowBytes);
+            }
+
+            command.type = UUploadCommand::TEXTURE_ROWS;
+            command.firstRow = firstRow;
+            command.nRows = nRows;
+            command.ringOffset = offset;
+            command.bytes = nRows * rowBytes;
+            command.ringBytes = ringBytes;
+            command.last = firstRow + nRows >= height;
+            UPushCommand(ring, command);
+        }
+        stbi_image_free(image);
+    }
+
+    void URunBufferJob(UUploadRing& ring, const UUploadJob& job)
+    {
+        UUploadCommand command = UUploadCommand();
+        command.type = UUploadCommand::BUFFER_COPY;
+        command.target = job.target;
+
+        for (size_t copied = 0; copied < job.bytes.size(); copied += ring.chunkBytes)
+        {
+            size_t n = job.bytes.size() - copied < ring.chunkBytes ? job.bytes.size() - copied : ring.chunkBytes;
+            size_t offset, ringBytes;
+            {
+                unique_lock<mutex> lock(ring.mutex);
+                if (!UAllocateRing(ring, lock, n, offset, ringBytes))
+                    return;
+            }
+            memcpy(ring.mapped + offset, job.bytes.data() + copied, n);
+
+            command.targetOffset = job.targetOffset + (GLintptr)copied;
+            command.ringOffset = offset;
+            command.bytes = n;
+            command.ringBytes = ringBytes;
+            command.last = copied + n >= job.bytes.size();
+            UPushCommand(ring, command);
+        }
+    }
+
+    void UUploadWorker(UUploadRing* ring)
+    {
+        UNameProfileThread("Upload worker");
+        while (true)
+        {
+            UUploadJob job;
+            {
+                unique_lock<mutex> lock(ring->mutex);
+                while (ring->jobs.empty() && !ring->quit)
+                    ring->jobQueued.wait(lock);
+                if (ring->quit)
+                    return;
+                job = move(ring->jobs.front());
+                ring->jobs.pop_front();
+            }
+
+            if (job.isBuffer)
+                URunBufferJob(*ring, job);
+            else
+                URunTextureJob(*ring, job);
+        }
+    }
+
+    // Render thread: turns one command into GL calls
+    void UIssueCommand(UUploadRing& ring, const UUploadCommand& command)
+    {
+        switch (command.type)
+        {
+        case UUploadCommand::FAILED:
+        {
+            // Leave something sampleable behind
+            cout << "Failed to load texture " << command.name << endl;
+            const unsigned char white[4] = { 255, 255, 255, 255 };
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glBindTexture(GL_TEXTURE_2D, command.target);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffer);
+            ring.pendingJobs--;
+        }
+        break;
+        case UUploadCommand::CREATE_TEXTURE:
+        {
+            GLsizei levels = 1;
+            for (GLsizei extent = command.width > command.height ? command.width : command.height; extent > 1; extent /= 2)
+                ++levels;
+            glBindTexture(GL_TEXTURE_2D, command.target);
+            glTexStorage2D(GL_TEXTURE_2D, levels, command.channels == 3 ? GL_RGB8 : GL_RGBA8, command.width, command.height);
+            USetGpuObjectBytes(UGPU_TEXTURE, command.target, UEstimateTextureBytes(command.width, command.height, 1, 4, true));
+        }
+        break;
+        case UUploadCommand::TEXTURE_ROWS:
+            glBindTexture(GL_TEXTURE_2D, command.target);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, command.firstRow, command.width, command.nRows,
+                command.channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, (void*)command.ringOffset);
+            if (command.last)
+            {
+                glGenerateMipmap(GL_TEXTURE_2D);
+                ring.pendingJobs--;
+            }
+            break;
+        case UUploadCommand::TEXTURE_DIRECT:
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glBindTexture(GL_TEXTURE_2D, command.target);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, command.firstRow, command.width, command.nRows,
+                command.channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, command.pixels.data());
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffer);
+            ring.pendingJobs--;
+            break;
+        case UUploadCommand::BUFFER_COPY:
+            glBindBuffer(GL_COPY_WRITE_BUFFER, command.target);
+            glCopyBufferSubData(GL_PIXEL_UNPACK_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)command.ringOffset, command.targetOffset, (GLsizeiptr)command.bytes);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            if (command.last)
+                ring.pendingJobs--;
+            break;
+        }
+    }
+}
+
+bool UCreateUploadRing(UUploadRing& ring, size_t size, size_t frameBudget)
+{
+    ring.size = UAlignUp(size, RING_ALIGNMENT);
+    ring.frameBudget = frameBudget;
+    // A piece never exceeds the budget or half the ring, so every piece fits eventually
+    ring.chunkBytes = frameBudget < ring.size / 2 ? frameBudget : ring.size / 2;
+    ring.head = ring.tail = ring.used = 0;
+    ring.quit = false;
+    ring.bytesThisFrame = ring.totalBytes = ring.pendingJobs = 0;
+
+    // Persistent + coherent, so the worker's memcpy is visible to GL without explicit flushes
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    ring.buffer.Create(UGPU_STREAMING, "upload ring");
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)ring.size, nullptr, flags);
+    ring.buffer.SetBytes(ring.size);
+    ring.mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)ring.size, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!ring.mapped)
+    {
+        cout << "Failed to map the upload ring" << endl;
+        ring.buffer.Reset();
+        return false;
+    }
+
+    ring.worker = thread(UUploadWorker, &ring);
+    return true;
+}
+
+void UDestroyUploadRing(UUploadRing& ring)
+{
+    if (!ring.buffer)
+        return;
+
+    {
+        lock_guard<mutex> lock(ring.mutex);
+        ring.quit = true;
+        ring.jobs.clear();
+    }
+    ring.jobQueued.notify_all();
+    ring.spaceFreed.notify_all();
+    if (ring.worker.joinable())
+        ring.worker.join();
+
+    // Commands still queued are dropped; wait for the ones in flight before unmapping
+    for (UUploadFence& fence : ring.fences)
+    {
+        glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence.sync);
+    }
+    ring.fences.clear();
+    ring.commands.clear();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    ring.buffer.Reset();
+    ring.mapped = nullptr;
+}
+
+GLuint UQueueTextureFile(UUploadRing& ring, const char* filename, bool flipVertically)
+{
+    // Owned by the caller like any other texture; the size is known once the worker has the header
+    GLuint textureId = UGenGpuObject(UGPU_TEXTURE, UGPU_MATERIALS, filename);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+
+    // set the texture wrapping parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // set texture filtering parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    UUploadJob job;
+    job.target = textureId;
+    job.filename = filename;
+    job.flipVertically = flipVertically;
+    job.targetOffset = 0;
+    job.isBuffer = false;
+    {
+        lock_guard<mutex> lock(ring.mutex);
+        ring.jobs.push_back(move(job));
+    }
+    ring.pendingJobs++;
+    ring.jobQueued.notify_one();
+    return textureId;
+}
+
+void UQueueBufferUpload(UUploadRing& ring, GLuint buffer, GLintptr offset, const void* data, size_t size)
+{
+    if (size == 0)
+        return;
+
+    UUploadJob job;
+    job.target = buffer;
+    job.flipVertically = false;
+    job.bytes.assign((const unsigned char*)data, (const unsigned char*)data + size);
+    job.targetOffset = offset;
+    job.isBuffer = true;
+    {
+        lock_guard<mutex> lock(ring.mutex);
+        ring.jobs.push_back(move(job));
+    }
+    ring.pendingJobs++;
+    ring.jobQueued.notify_one();
+}
+
+void UPumpUploads(UUploadRing& ring)
+{
+    if (!ring.buffer)
+        return;
+
+    // Recycle ranges whose GL commands finished
+    size_t released = 0, tail = 0;
+    while (!ring.fences.empty())
+    {
+        GLenum status = glClientWaitSync(ring.fences.front().sync, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(ring.fences.front().sync);
+        released += ring.fences.front().bytes;
+        tail = ring.fences.front().tail;
+        ring.fences.pop_front();
+    }
+    if (released)
+    {
+        {
+            lock_guard<mutex> lock(ring.mutex);
+            ring.used -= released;
+            ring.tail = tail;
+        }
+        ring.spaceFreed.notify_all();
+    }
+
+    // Issue ready commands until this frame's budget is spent; at least one so big pieces still progress
+    ring.bytesThisFrame = 0;
+    size_t ringBytes = 0, lastTail = 0;
+    bool bound = false;
+    while (true)
+    {
+        UUploadCommand command;
+        {
+            lock_guard<mutex> lock(ring.mutex);
+            if (ring.commands.empty())
+                break;
+            const UUploadCommand& next = ring.commands.front();
+            if (ring.bytesThisFrame > 0 && ring.bytesThisFrame + next.bytes > ring.frameBudget)
+                break;
+            command = move(ring.commands.front());
+            ring.commands.pop_front();
+        }
+
+        if (!bound)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffer);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            bound = true;
+        }
+        UIssueCommand(ring, command);
+
+        ring.bytesThisFrame += command.bytes;
+        ringBytes += command.ringBytes;
+        if (command.ringBytes)
+            lastTail = command.ringOffset + UAlignUp(command.bytes, RING_ALIGNMENT);
+    }
+
+    if (bound)
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    if (ringBytes)
+        ring.fences.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), lastTail, ringBytes });
+    ring.totalBytes += ring.bytesThisFrame;
+}
+
+bool UUploadsIdle(UUploadRing& ring)
+{
+    return ring.pendingJobs == 0 && ring.fences.empty();
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <condition_variable> // std::condition_variable
+#include <deque>        // std::deque
+#include <mutex>        // std::mutex
+#include <string>       // std::string
+#include <thread>       // std::thread
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+#include "GpuResources.h"
+
+// One step the render thread performs for the worker, in submission order
+struct UUploadCommand
+{
+    enum Type { CREATE_TEXTURE, TEXTURE_ROWS, TEXTURE_DIRECT, BUFFER_COPY, FAILED };
+
+    Type type;
+    GLuint target;          // texture or buffer id
+    GLsizei width;
+    GLsizei height;
+    GLint channels;
+    GLint firstRow;         // TEXTURE_ROWS
+    GLsizei nRows;
+    GLintptr targetOffset;  // BUFFER_COPY
+    size_t ringOffset;
+    size_t bytes;           // bytes this command reads from the ring
+    size_t ringBytes;       // ring space it releases once complete (includes wrap padding)
+    bool last;              // last piece of its texture, mipmaps are built after it
+    std::string name;       // for messages
+    std::vector<unsigned char> pixels; // TEXTURE_DIRECT: the whole image in GL row order, for rows too wide for the ring
+};
+
+// Work handed to the worker thread
+struct UUploadJob
+{
+    GLuint target;
+    std::string filename;               // texture jobs decode this file
+    bool flipVertically;
+    std::vector<unsigned char> bytes;   // buffer jobs copy these
+    GLintptr targetOffset;
+    bool isBuffer;
+};
+
+// Ring range a fence protects
+struct UUploadFence
+{
+    GLsync sync;
+    size_t tail;            // ring tail once it signals
+    size_t bytes;           // ring bytes it releases
+};
+
+// Persistently mapped GL_PIXEL_UNPACK_BUFFER staging ring. A worker thread decodes images and
+// copies pixels/bytes into the ring; the render thread issues glTexSubImage2D/glCopyBufferSubData
+// from ring offsets, at most frameBudget bytes per frame, and recycles space behind fences.
+struct UUploadRing
+{
+    UGpuBuffer buffer;
+    unsigned char* mapped;
+    size_t size;
+    size_t frameBudget;
+    size_t chunkBytes;      // largest single command, <= frameBudget
+
+    // Ring state, shared with the worker
+    std::mutex mutex;
+    std::condition_variable spaceFreed;
+    std::condition_variable jobQueued;
+    size_t head;
+    size_t tail;
+    size_t used;
+    std::deque<UUploadJob> jobs;
+    std::deque<UUploadCommand> commands;
+    bool quit;
+    std::thread worker;
+
+    // Render thread only
+    std::deque<UUploadFence> fences;
+    size_t bytesThisFrame;
+    size_t totalBytes;
+    size_t pendingJobs;
+};
+
+bool UCreateUploadRing(UUploadRing& ring, size_t size, size_t frameBudget);
+void UDestroyUploadRing(UUploadRing& ring);
+
+// Returns the texture id right away; it is blank until the worker and UPumpUploads have filled it
+GLuint UQueueTextureFile(UUploadRing& ring, const char* filename, bool flipVertically = true);
+// Copies data now; the buffer must have storage for offset + size
+void UQueueBufferUpload(UUploadRing& ring, GLuint buffer, GLintptr offset, const void* data, size_t size);
+
+// Once per frame on the render thread: recycles finished ranges and issues up to frameBudget bytes
+void UPumpUploads(UUploadRing& ring);
+bool UUploadsIdle(UUploadRing& ring);
@@ -0,0 +1,582 @@
+#include <iostream>     // cout, cerr
+#include <cmath>        // fabs, floor, lround
+#include <cstring>      // memcpy
+#include <unordered_map>
+#include "VertexFormat.h"
+
+// GLM Math Header inclusions
+#include <glm/gtx/transform.hpp>
+
+using namespace std; // Standard namespace
+
+namespace
+{
+    float USignNotZero(float value)
+    {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    int16_t UToSnorm16(float value)
+    {
+        value = glm::clamp(value, -1.0f, 1.0f);
+        return (int16_t)lround(value * 32767.0f);
+    }
+
+    float UFromSnorm16(int16_t value)
+    {
+        return glm::max(value / 32767.0f, -1.0f);
+    }
+}
+
+UVertexLayout UGetVertexLayout(const UMeshData& data, UVertexFormat format)
+{
+    bool hasNormals = !data.normals.empty();
+    bool hasUvs = !data.uvs.empty();
+    bool hasTangents = !data.tangents.empty();
+    bool hasLightmapUvs = !data.lightmapUvs.empty();
+
+    UVertexLayout layout;
+    if (format == UVERTEX_COMPRESSED)
+    {
+        // 4 x unorm16 position (w = tangent handedness), 2 x half uv, 2 x snorm16 normal, 2 x snorm16 tangent,
+        // 2 x unorm16 lightmap uv
+        layout.stride = 8;
+        layout.uvOffset = hasUvs ? layout.stride : -1;          layout.stride += hasUvs ? 4 : 0;
+        layout.normalOffset = hasNormals ? layout.stride : -1;  layout.stride += hasNormals ? 4 : 0;
+        layout.tangentOffset = hasTangents ? layout.stride : -1; layout.stride += hasTangents ? 4 : 0;
+        layout.lightmapUvOffset = hasLightmapUvs ? layout.stride : -1; layout.stride += hasLightmapUvs ? 4 : 0;
+    }
+    else
+    {
+        layout.stride = 12;
+        layout.normalOffset = hasNormals ? layout.stride : -1;  layout.stride += hasNormals ? 12 : 0;
+        layout.uvOffset = hasUvs ? layout.stride : -1;          layout.stride += hasUvs ? 8 : 0;
+        layout.tangentOffset = hasTangents ? layout.stride : -1; layout.stride += hasTangents ? 16 : 0;
+        layout.lightmapUvOffset = hasLightmapUvs ? layout.stride : -1; layout.stride += hasLightmapUvs ? 8 : 0;
+    }
+    return layout;
+}
+
+UMeshData UMeshDataFromInterleaved(const GLfloat* verts, size_t nFloats, bool hasNormals)
+{
+    const size_t floatsPerVertex = hasNormals ? 8 : 5;
+    const size_t nVertices = nFloats / floatsPerVertex;
+
+    UMeshData data;
+    data.positions.reserve(nVertices);
+    data.uvs.reserve(nVertices);
+    if (hasNormals)
+        data.normals.reserve(nVertices);
+
+    for (size_t i = 0; i < nVertices; ++i)
+    {
+        const GLfloat* v = verts + i * floatsPerVertex;
+        data.positions.push_back(glm::vec3(v[0], v[1], v[2]));
+        if (hasNormals)
+        {
+            data.normals.push_back(glm::vec3(v[3], v[4], v[5]));
+            data.uvs.push_back(glm::vec2(v[6], v[7]));
+        }
+        else
+            data.uvs.push_back(glm::vec2(v[3], v[4]));
+    }
+    return data;
+}
+
+void UWeldVertices(UMeshData& data)
+{
+    if (!data.indices.empty())
+        return;
+
+    // Key = raw bytes of every attribute of a vertex
+    const size_t nVertices = data.positions.size();
+    auto key = [&](size_t i)
+    {
+        string bytes((const char*)&data.positions[i], sizeof(glm::vec3));
+        if (!data.normals.empty())
+            bytes.append((const char*)&data.normals[i], sizeof(glm::vec3));
+        if (!data.uvs.empty())
+            bytes.append((const char*)&data.uvs[i], sizeof(glm::vec2));
+        if (!data.tangents.empty())
+            bytes.append((const char*)&data.tangents[i], sizeof(glm::vec4));
+        if (!data.lightmapUvs.empty())
+            bytes.append((const char*)&data.lightmapUvs[i], sizeof(glm::vec2));
+        return bytes;
+    };
+
+    UMeshData welded;
+    unordered_map<string, uint32_t> unique;
+    welded.indices.reserve(nVertices);
+
+    for (size_t i = 0; i < nVertices; ++i)
+    {
+        auto inserted = unique.insert(make_pair(key(i), (uint32_t)welded.positions.size()));
+        if (inserted.second)
+        {
+            welded.positions.push_back(data.positions[i]);
+            if (!data.normals.empty())
+                welded.normals.push_back(data.normals[i]);
+            if (!data.uvs.empty())
+                welded.uvs.push_back(data.uvs[i]);
+            if (!data.tangents.empty())
+                welded.tangents.push_back(data.tangents[i]);
+            if (!data.lightmapUvs.empty())
+                welded.lightmapUvs.push_back(data.lightmapUvs[i]);
+        }
+        welded.indices.push_back(inserted.first->second);
+    }
+
+    data = welded;
+}
+
+void UComputeTangents(UMeshData& data)
+{
+    if (data.normals.empty() || data.uvs.empty())
+        return;
+
+    const size_t nVertices = data.positions.size();
+    vector<glm::vec3> tan(nVertices, glm::vec3(0.0f));
+    vector<glm::vec3> bitan(nVertices, glm::vec3(0.0f));
+
+    size_t nCorners = data.indices.empty() ? nVertices : data.indices.size();
+    for (size_t c = 0; c + 2 < nCorners; c += 3)
+    {
+        uint32_t i0 = data.indices.empty() ? (uint32_t)c : data.indices[c];
+        uint32_t i1 = data.indices.empty() ? (uint32_t)c + 1 : data.indices[c + 1];
+        uint32_t i2 = data.indices.empty() ? (uint32_t)c + 2 : data.indices[c + 2];
+
+        glm::vec3 e1 = data.positions[i1] - data.positions[i0];
+        glm::vec3 e2 = data.positions[i2] - data.positions[i0];
+        glm::vec2 d1 = data.uvs[i1] - data.uvs[i0];
+        glm::vec2 d2 = data.uvs[i2] - data.uvs[i0];
+
+        float det = d1.x * d2.y - d2.x * d1.y;
+        if (fabs(det) < 1e-12f)
+            continue;
+        float r = 1.0f / det;
+        glm::vec3 t = (e1 * d2.y - e2 * d1.y) * r;
+        glm::vec3 b = (e2 * d1.x - e1 * d2.x) * r;
+
+        tan[i0] += t; tan[i1] += t; tan[i2] += t;
+        bitan[i0] += b; bitan[i1] += b; bitan[i2] += b;
+    }
+
+    data.tangents.resize(nVertices);
+    for (size_t i = 0; i < nVertices; ++i)
+    {
+        // Gram-Schmidt orthogonalize against the normal
+        glm::vec3 n = data.normals[i];
+        glm::vec3 t = tan[i] - n * glm::dot(n, tan[i]);
+        if (glm::length(t) < 1e-6f)
+            t = fabs(n.x) < 0.9f ? glm::cross(n, glm::vec3(1.0f, 0.0f, 0.0f)) : glm::cross(n, glm::vec3(0.0f, 1.0f, 0.0f));
+        t = glm::normalize(t);
+        float handedness = glm::dot(glm::cross(n, t), bitan[i]) < 0.0f ? -1.0f : 1.0f;
+        data.tangents[i] = glm::vec4(t, handedness);
+    }
+}
+
+void UPackMesh(const UMeshData& data, UVertexFormat format, UPackedMesh& packed)
+{
+    const size_t nVertices = data.positions.size();
+
+    packed.format = format;
+    packed.layout = UGetVertexLayout(data, format);
+    packed.nVertices = (GLuint)nVertices;
+    packed.nIndices = (GLuint)data.indices.size();
+    packed.lods = data.lods;
+
+    // Bounds
+    packed.boundsMin = packed.boundsMax = nVertices ? data.positions[0] : glm::vec3(0.0f);
+    for (const glm::vec3& p : data.positions)
+    {
+        packed.boundsMin = glm::min(packed.boundsMin, p);
+        packed.boundsMax = glm::max(packed.boundsMax, p);
+    }
+
+    // Flat axes (the plane) get a unit extent so nothing divides by zero
+    glm::vec3 extent = packed.boundsMax - packed.boundsMin;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (extent[axis] <= 0.0f)
+            extent[axis] = 1.0f;
+    }
+
+    const UVertexLayout& layout = packed.layout;
+    packed.vertices.assign(nVertices * layout.stride, 0);
+
+    for (size_t i = 0; i < nVertices; ++i)
+    {
+        unsigned char* v = &packed.vertices[i * layout.stride];
+
+        if (format == UVERTEX_COMPRESSED)
+        {
+            glm::vec3 q = (data.positions[i] - packed.boundsMin) / extent;
+            uint16_t position[4];
+            for (int axis = 0; axis < 3; ++axis)
+                position[axis] = (uint16_t)floor(glm::clamp(q[axis], 0.0f, 1.0f) * 65535.0f + 0.5f);
+            // Tangent handedness rides along in the unused w
+            position[3] = (!data.tangents.empty() && data.tangents[i].w < 0.0f) ? 0 : 65535;
+            memcpy(v, position, sizeof(position));
+
+            if (layout.uvOffset >= 0)
+            {
+                uint16_t uv[2] = { UFloatToHalf(data.uvs[i].x), UFloatToHalf(data.uvs[i].y) };
+                memcpy(v + layout.uvOffset, uv, sizeof(uv));
+            }
+            if (layout.normalOffset >= 0)
+            {
+                uint32_t normal = UOctEncode(data.normals[i]);
+                memcpy(v + layout.normalOffset, &normal, sizeof(normal));
+            }
+            if (layout.tangentOffset >= 0)
+            {
+                uint32_t tangent = UOctEncode(glm::vec3(data.tangents[i]));
+                memcpy(v + layout.tangentOffset, &tangent, sizeof(tangent));
+            }
+            if (layout.lightmapUvOffset >= 0)
+            {
+                uint16_t uv[2];
+                for (int axis = 0; axis < 2; ++axis)
+                    uv[axis] = (uint16_t)floor(glm::clamp(data.lightmapUvs[i][axis], 0.0f, 1.0f) * 65535.0f + 0.5f);
+                memcpy(v + layout.lightmapUvOffset, uv, sizeof(uv));
+            }
+        }
+        else
+        {
+            memcpy(v, &data.positions[i], sizeof(glm::vec3));
+            if (layout.normalOffset >= 0)
+                memcpy(v + layout.normalOffset, &data.normals[i], sizeof(glm::vec3));
+            if (layout.uvOffset >= 0)
+                memcpy(v + layout.uvOffset, &data.uvs[i], sizeof(glm::vec2));
+            if (layout.tangentOffset >= 0)
+                memcpy(v + layout.tangentOffset, &data.tangents[i], sizeof(glm::vec4));
+            if (layout.lightmapUvOffset >= 0)
+                memcpy(v + layout.lightmapUvOffset, &data.lightmapUvs[i], sizeof(glm::vec2));
+        }
+    }
+
+    // Positions are stored in [0,1] over the AABB; this matrix takes them back to mesh space
+    packed.dequantize = format == UVERTEX_COMPRESSED ? glm::translate(packed.boundsMin) * glm::scale(extent) : glm::mat4(1.0f);
+
+    // Indices, 16 bit whenever the vertex count allows it
+    if (nVertices <= 65536)
+    {
+        packed.indexType = GL_UNSIGNED_SHORT;
+        packed.indices.resize(data.indices.size() * sizeof(uint16_t));
+        for (size_t i = 0; i < data.indices.size(); ++i)
+        {
+            uint16_t index = (uint16_t)data.indices[i];
+            memcpy(&packed.indices[i * sizeof(uint16_t)], &index, sizeof(index));
+        }
+    }
+    else
+    {
+        packed.indexType = GL_UNSIGNED_INT;
+        packed.indices.resize(data.indices.size() * sizeof(uint32_t));
+        if (!data.indices.empty())
+            memcpy(packed.indices.data(), data.indices.data(), packed.indices.size());
+    }
+}
+
+UMeshView UGetMeshView(const UPackedMesh& packed)
+{
+    UMeshView view;
+    view.format = packed.format;
+    view.layout = packed.layout;
+    view.vertices = packed.vertices.data();
+    view.vertexBytes = (GLsizeiptr)packed.vertices.size();
+    view.nVertices = packed.nVertices;
+    view.indices = packed.indices.empty() ? nullptr : packed.indices.data();
+    view.indexBytes = (GLsizeiptr)packed.indices.size();
+    view.indexType = packed.indexType;
+    view.nIndices = packed.nIndices;
+    view.boundsMin = packed.boundsMin;
+    view.boundsMax = packed.boundsMax;
+    view.dequantize = packed.dequantize;
+    view.lods = packed.lods.empty() ? nullptr : packed.lods.data();
+    view.nLods = (GLuint)packed.lods.size();
+    return view;
+}
+
+bool UCreateGpuMesh(const UMeshData& data, UVertexFormat format, UGpuMesh& mesh)
+{
+    UPackedMesh packed;
+    UPackMesh(data, format, packed);
+    return UCreateGpuMesh(UGetMeshView(packed), mesh);
+}
+
+// Uploads already packed data as is; the pointers may come straight from a memory mapped file
+bool UCreateGpuMesh(const UMeshView& view, UGpuMesh& mesh)
+{
+    if (view.nVertices == 0)
+    {
+        cout << "Cannot create a mesh without vertices" << endl;
+        return false;
+    }
+
+    mesh.format = view.format;
+    mesh.nVertices = view.nVertices;
+    mesh.nIndices = view.nIndices;
+    mesh.indexType = view.indexType;
+    mesh.boundsMin = view.boundsMin;
+    mesh.boundsMax = view.boundsMax;
+    mesh.dequantize = view.dequantize;
+
+    // Level of detail table; a mesh without one has a single level covering every index
+    mesh.nLods = view.nLods < (GLuint)UMAX_LODS ? view.nLods : (GLuint)UMAX_LODS;
+    for (GLuint lod = 0; lod < mesh.nLods; ++lod)
+        mesh.lods[lod] = view.lods[lod];
+    if (mesh.nLods == 0)
+    {
+        mesh.nLods = 1;
+        mesh.lods[0].firstIndex = 0;
+        mesh.lods[0].nIndices = view.nIndices;
+        mesh.lods[0].error = 0.0f;
+    }
+
+    const UVertexLayout& layout = view.layout;
+
+    mesh.vao.Create(UGPU_GEOMETRY, "mesh");
+    glBindVertexArray(mesh.vao);
+
+    // Create VBO; immutable storage filled directly from the caller's memory
+    mesh.vertexBytes = view.vertexBytes;
+    mesh.vbo.Create(UGPU_GEOMETRY, "mesh vertices");
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glBufferStorage(GL_ARRAY_BUFFER, mesh.vertexBytes, view.vertices, 0);
+    mesh.vbo.SetBytes((size_t)mesh.vertexBytes);
+
+    // Create Vertex Attribute Pointers
+    if (view.format == UVERTEX_COMPRESSED)
+    {
+        glVertexAttribPointer(UATTRIB_POSITION, 4, GL_UNSIGNED_SHORT, GL_TRUE, layout.stride, 0);
+        if (layout.normalOffset >= 0)
+            glVertexAttribPointer(UATTRIB_NORMAL, 2, GL_SHORT, GL_TRUE, layout.stride, (void*)(size_t)layout.normalOffset);
+        if (layout.uvOffset >= 0)
+            glVertexAttribPointer(UATTRIB_UV, 2, GL_HALF_FLOAT, GL_FALSE, layout.stride, (void*)(size_t)layout.uvOffset);
+        if (layout.tangentOffset >= 0)
+            glVertexAttribPointer(UATTRIB_TANGENT, 2, GL_SHORT, GL_TRUE, layout.stride, (void*)(size_t)layout.tangentOffset);
+        if (layout.lightmapUvOffset >= 0)
+            glVertexAttribPointer(UATTRIB_LIGHTMAP_UV, 2, GL_UNSIGNED_SHORT, GL_TRUE, layout.stride, (void*)(size_t)layout.lightmapUvOffset);
+    }
+    else
+    {
+        glVertexAttribPointer(UATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, layout.stride, 0);
+        if (layout.normalOffset >= 0)
+            glVertexAttribPointer(UATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, layout.stride, (void*)(size_t)layout.normalOffset);
+        if (layout.uvOffset >= 0)
+            glVertexAttribPointer(UATTRIB_UV, 2, GL_FLOAT, GL_FALSE, layout.stride, (void*)(size_t)layout.uvOffset);
+        if (layout.tangentOffset >= 0)
+            glVertexAttribPointer(UATTRIB_TANGENT, 4, GL_FLOAT, GL_FALSE, layout.stride, (void*)(size_t)layout.tangentOffset);
+        if (layout.lightmapUvOffset >= 0)
+            glVertexAttribPointer(UATTRIB_LIGHTMAP_UV, 2, GL_FLOAT, GL_FALSE, layout.stride, (void*)(size_t)layout.lightmapUvOffset);
+    }
+    glEnableVertexAttribArray(UATTRIB_POSITION);
+    if (layout.normalOffset >= 0)
+        glEnableVertexAttribArray(UATTRIB_NORMAL);
+    if (layout.uvOffset >= 0)
+        glEnableVertexAttribArray(UATTRIB_UV);
+    if (layout.tangentOffset >= 0)
+        glEnableVertexAttribArray(UATTRIB_TANGENT);
+    if (layout.lightmapUvOffset >= 0)
+        glEnableVertexAttribArray(UATTRIB_LIGHTMAP_UV);
+
+    // Index buffer
+    mesh.ibo.Reset();
+    mesh.indexBytes = 0;
+    if (view.nIndices > 0)
+    {
+        mesh.indexBytes = view.indexBytes;
+        mesh.ibo.Create(UGPU_GEOMETRY, "mesh indices");
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+        glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBytes, view.indices, 0);
+        mesh.ibo.SetBytes((size_t)mesh.indexBytes);
+    }
+
+    glBindVertexArray(0);
+    return true;
+}
+
+void UDestroyGpuMesh(UGpuMesh& mesh)
+{
+    mesh.vao.Reset();
+    mesh.vbo.Reset();
+    mesh.ibo.Reset();
+}
+
+void UDrawGpuMesh(const UGpuMesh& mesh, GLuint lod)
+{
+    UDrawGpuMesh(mesh, lod, mesh.vao);
+}
+
+void UDrawGpuMesh(const UGpuMesh& mesh, GLuint lod, GLuint vertexArray)
+{
+    glBindVertexArray(vertexArray);
+    if (mesh.nIndices > 0)
+    {
+        const ULodRange& range = mesh.lods[lod < mesh.nLods ? lod : mesh.nLods - 1];
+        size_t indexSize = mesh.indexType == GL_UNSIGNED_BYTE ? 1 : mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        glDrawElements(GL_TRIANGLES, range.nIndices, mesh.indexType, (void*)(range.firstIndex * indexSize));
+    }
+    else
+        glDrawArrays(GL_TRIANGLES, 0, mesh.nVertices);
+}
+
+void UGetVertexArrayState(GLuint vertexArray, UVertexArrayState& state)
+{
+    GLint previous = 0;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous);
+    glBindVertexArray(vertexArray);
+
+    for (GLuint i = 0; i < UMAX_VERTEX_ARRAY_ATTRIBS; ++i)
+    {
+        UVertexAttributeState& attribute = state.attributes[i];
+        GLint value = 0;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &value);
+        attribute.enabled = value != 0;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &value);
+        attribute.normalized = value != 0;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_INTEGER, &value);
+        attribute.integer = value != 0;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_SIZE, &attribute.size);
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_TYPE, &value);
+        attribute.type = (GLenum)value;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &value);
+        attribute.stride = value;
+        glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &value);
+        attribute.buffer = (GLuint)value;
+        void* pointer = nullptr;
+        glGetVertexAttribPointerv(i, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+        attribute.offset = (size_t)pointer;
+    }
+
+    GLint elementBuffer = 0;
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementBuffer);
+    state.elementBuffer = (GLuint)elementBuffer;
+
+    glBindVertexArray((GLuint)previous);
+}
+
+void UCreateVertexArray(const UVertexArrayState& state, UGpuCategory category, UGpuVertexArray& vertexArray)
+{
+    vertexArray.Create(category, "shared mesh");
+    glBindVertexArray(vertexArray);
+    for (GLuint i = 0; i < UMAX_VERTEX_ARRAY_ATTRIBS; ++i)
+    {
+        const UVertexAttributeState& attribute = state.attributes[i];
+        if (!attribute.enabled || !attribute.buffer)
+            continue;
+        glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer);
+        if (attribute.integer)
+            glVertexAttribIPointer(i, attribute.size, attribute.type, attribute.stride, (void*)attribute.offset);
+        else
+            glVertexAttribPointer(i, attribute.size, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE, attribute.stride, (void*)attribute.offset);
+        glEnableVertexAttribArray(i);
+    }
+    if (state.elementBuffer)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, state.elementBuffer);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// IEEE 754 binary16 with round to nearest even
+uint16_t UFloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffffu;
+
+    if (((bits >> 23) & 0xffu) == 0xffu)                 // inf / nan
+        return (uint16_t)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+    if (exponent >= 31)                                  // overflow -> inf
+        return (uint16_t)(sign | 0x7c00u);
+    if (exponent <= 0)                                   // subnormal or zero
+    {
+        if (exponent < -10)
+            return (uint16_t)sign;
+        mantissa |= 0x800000u;
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+            ++half;
+        return (uint16_t)(sign | half);
+    }
+
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        ++half; // may carry into the exponent, which is still correct
+    return (uint16_t)half;
+}
+
+float UHalfToFloat(uint16_t value)
+{
+    uint32_t sign = (uint32_t)(value & 0x8000u) << 16;
+    uint32_t exponent = (value >> 10) & 0x1fu;
+    uint32_t mantissa = value & 0x3ffu;
+
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+            bits = sign;
+        else
+        {
+            // Renormalize the subnormal
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400u) == 0)
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+        }
+    }
+    else if (exponent == 31)
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    else
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// Octahedral encoding: project onto the octahedron, fold the lower half over the upper one
+uint32_t UOctEncode(const glm::vec3& normal)
+{
+    float l1 = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+    if (l1 <= 0.0f)
+        return 0;
+
+    float x = normal.x / l1;
+    float y = normal.y / l1;
+    if (normal.z < 0.0f)
+    {
+        float foldedX = (1.0f - fabs(y)) * USignNotZero(x);
+        float foldedY = (1.0f - fabs(x)) * USignNotZero(y);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    uint16_t ex = (uint16_t)UToSnorm16(x);
+    uint16_t ey = (uint16_t)UToSnorm16(y);
+    return (uint32_t)ex | ((uint32_t)ey << 16);
+}
+
+glm::vec3 UOctDecode(uint32_t packed)
+{
+    float x = UFromSnorm16((int16_t)(packed & 0xffffu));
+    float y = UFromSnorm16((int16_t)(packed >> 16));
+
+    glm::vec3 n(x, y, 1.0f - fabs(x) - fabs(y));
+    float t = glm::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <cstdint>      // uint16_t, uint32_t
+#include <vector>       // std::vector
+#include <GL/glew.h>    // GLEW library
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+
+#include "GpuResources.h"
+
+// Layouts a mesh can be uploaded with
+enum UVertexFormat
+{
+    UVERTEX_FLOAT = 0,      // 32 bit floats everywhere
+    UVERTEX_COMPRESSED = 1  // 16 bit unorm positions (relative to the AABB), half UVs, octahedral normals/tangents
+};
+
+// Vertex attribute locations shared by every shader
+const GLuint UATTRIB_POSITION = 0;
+const GLuint UATTRIB_NORMAL = 1;
+const GLuint UATTRIB_UV = 2;
+const GLuint UATTRIB_TANGENT = 3;
+const GLuint UATTRIB_LIGHTMAP_UV = 4;
+
+const int UMAX_LODS = 8;
+
+// Index range of one level of detail; every level shares the vertex buffer
+struct ULodRange
+{
+    uint32_t firstIndex;
+    uint32_t nIndices;
+    float error;            // mesh space distance the simplification may have moved vertices by
+};
+
+// Full precision mesh on the CPU; every vertex format is built from this
+struct UMeshData
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;     // optional
+    std::vector<glm::vec2> uvs;         // optional
+    std::vector<glm::vec4> tangents;    // optional, w = handedness (+1/-1)
+    std::vector<glm::vec2> lightmapUvs; // optional second UV channel in [0,1], unique over the lightmap atlas
+    std::vector<uint32_t> indices;      // optional, non-indexed when empty
+    std::vector<ULodRange> lods;        // optional, one level covering every index when empty
+};
+
+// Byte offset of each stream inside one vertex; -1 means the stream is not stored
+struct UVertexLayout
+{
+    GLsizei stride;
+    GLsizei normalOffset;
+    GLsizei uvOffset;
+    GLsizei tangentOffset;
+    GLsizei lightmapUvOffset;
+};
+
+// Mesh converted to the exact bytes the GPU reads
+struct UPackedMesh
+{
+    UVertexFormat format;
+    UVertexLayout layout;
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned char> indices;
+    GLenum indexType;
+    GLuint nVertices;
+    GLuint nIndices;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::mat4 dequantize;
+    std::vector<ULodRange> lods;
+};
+
+// Non-owning view of packed mesh bytes, either from a UPackedMesh or a memory mapped mesh file
+struct UMeshView
+{
+    UVertexFormat format;
+    UVertexLayout layout;
+    const void* vertices;
+    GLsizeiptr vertexBytes;
+    GLuint nVertices;
+    const void* indices;
+    GLsizeiptr indexBytes;
+    GLenum indexType;
+    GLuint nIndices;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::mat4 dequantize;
+    const ULodRange* lods;
+    GLuint nLods;
+};
+
+// A mesh living on the GPU
+struct UGpuMesh
+{
+    UGpuVertexArray vao;
+    UGpuBuffer vbo;         // empty when the VAO reads buffers owned elsewhere (imported glTF)
+    UGpuBuffer ibo;
+    GLuint nVertices;
+    GLuint nIndices;
+    GLenum indexType;       // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT (GL_UNSIGNED_BYTE for imported glTF)
+    UVertexFormat format;
+
+    // Maps the stored positions back to mesh space. Identity for UVERTEX_FLOAT; for
+    // UVERTEX_COMPRESSED it is folded into the model matrix, so shaders never dequantize.
+    glm::mat4 dequantize;
+
+    glm::vec3 boundsMin;    // mesh space AABB
+    glm::vec3 boundsMax;
+
+    GLsizeiptr vertexBytes;
+    GLsizeiptr indexBytes;
+
+    GLuint nLods;
+    ULodRange lods[UMAX_LODS];
+};
+
+// Builds mesh data from the interleaved position/(normal)/uv float arrays used in UCreateTexturedMesh
+UMeshData UMeshDataFromInterleaved(const GLfloat* verts, size_t nFloats, bool hasNormals);
+// Merges identical vertices and builds an index buffer
+void UWeldVertices(UMeshData& data);
+// Fills data.tangents from positions, normals and uvs
+void UComputeTangents(UMeshData& data);
+
+UVertexLayout UGetVertexLayout(const UMeshData& data, UVertexFormat format);
+void UPackMesh(const UMeshData& data, UVertexFormat format, UPackedMesh& packed);
+UMeshView UGetMeshView(const UPackedMesh& packed);
+
+bool UCreateGpuMesh(const UMeshData& data, UVertexFormat format, UGpuMesh& mesh);
+bool UCreateGpuMesh(const UMeshView& view, UGpuMesh& mesh);
+void UDestroyGpuMesh(UGpuMesh& mesh);
+void UDrawGpuMesh(const UGpuMesh& mesh, GLuint lod = 0);
+// Same draw through another VAO reading the mesh's buffers, for contexts the mesh's own VAO doesn't exist in
+void UDrawGpuMesh(const UGpuMesh& mesh, GLuint lod, GLuint vertexArray);
+
+// Attribute setup of a VAO. Buffers are shared between contexts, VAOs never are: a context that
+// wants to draw the same mesh rebuilds the VAO from this state.
+const GLuint UMAX_VERTEX_ARRAY_ATTRIBS = 8;
+
+struct UVertexAttributeState
+{
+    bool enabled;
+    bool normalized;
+    bool integer;
+    GLint size;
+    GLenum type;
+    GLsizei stride;
+    GLuint buffer;
+    size_t offset;
+};
+
+struct UVertexArrayState
+{
+    UVertexAttributeState attributes[UMAX_VERTEX_ARRAY_ATTRIBS];
+    GLuint elementBuffer;
+};
+
+// Reads the state back in the context the VAO was made in
+void UGetVertexArrayState(GLuint vertexArray, UVertexArrayState& state);
+// Rebuilds it in the current context
+void UCreateVertexArray(const UVertexArrayState& state, UGpuCategory category, UGpuVertexArray& vertexArray);
+
+// Packing helpers
+uint16_t UFloatToHalf(float value);
+float UHalfToFloat(uint16_t value);
+uint32_t UOctEncode(const glm::vec3& normal);  // two snorm16 values
+glm::vec3 UOctDecode(uint32_t packed);